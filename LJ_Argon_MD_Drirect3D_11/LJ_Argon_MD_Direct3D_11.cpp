@@ -15,6 +15,7 @@
 #include "DXUTgui.h"
 #include "DXUTsettingsdlg.h"
 #include "moleculardynamics/Ar_moleculardynamics.h"
+#include "moleculardynamics/simulationthread.h"
 #include "SDKmesh.h"
 #include "SDKmisc.h"
 #include <array>					// for std::array
@@ -95,6 +96,12 @@ static auto constexpr NUMINDEXBUFFER = 24U;
 */
 static auto constexpr NUMVERTEXBUFFER = 8U;
 
+//! A global variable (constant).
+/*!
+	1t[MD̃XebviF1L[ŁAł邾vZ郂[hƐ؂ւj
+*/
+static auto constexpr STEPSPERFRAME = 1;
+
 //! A global variable (constant).
 /*!
 	ʃTCYij
@@ -113,6 +120,12 @@ static auto constexpr WINDOWWIDTH = 1280;
 */
 moleculardynamics::Ar_moleculardynamics armd;
 
+//! A global variable.
+/*!
+	`悵̈ӂ̒iВPʁj
+*/
+double boxlen = 0.0;
+
 //! A global variable.
 /*!
 	A model viewing camera
@@ -149,18 +162,6 @@ CDXUTDialog hud;
 */
 CDXUTSDKMesh mesh;
 
-//! A global variable.
-/*!
-	iq萔ύXꂽƂʒmtO
-*/
-bool modLatconst = false;
-
-//! A global variable.
-/*!
-	X[p[ZύXꂽƂʒmtO
-*/
-bool modNc = false;
-
 //! A global variable.
 /*!
 */
@@ -229,6 +230,12 @@ Microsoft::WRL::ComPtr<ID3D11VertexShader> pVertexShaderSphere;
 */
 CD3DSettingsDlg settingsDlg;
 
+//! A global variable.
+/*!
+	MD`Ƃ͕ʂ̃XbhŎsIuWFNgiarmdɂ́ÃIuWFNgʂĂGj
+*/
+moleculardynamics::SimulationThread simthread(armd, STEPSPERFRAME);
+
 //! A global variable.
 /*!
 	dialog for specific controls
@@ -261,14 +268,15 @@ void CALLBACK OnGUIEvent(UINT nEvent, int nControlID, CDXUTControl* pControl, vo
 //--------------------------------------------------------------------------------------
 // Forward declarations 
 //--------------------------------------------------------------------------------------
-void RenderText();
+void RenderText(moleculardynamics::Snapshot const & snapshot);
 
 //! A function.
 /*!
 	`悷
 	\param pd3dDevice Direct3D̃foCX
+	\param periodiclen ̈ӂ̒iВPʁj
 */
-HRESULT RenderBox(ID3D11Device* pd3dDevice);
+HRESULT RenderBox(ID3D11Device* pd3dDevice, double periodiclen);
 
 //! A function.
 /*!
@@ -445,7 +453,7 @@ HRESULT CALLBACK OnD3D11CreateDevice( ID3D11Device* pd3dDevice, const DXGI_SURFA
 	// Load the mesh
 	V_RETURN(mesh.Create(pd3dDevice, L"sphere.sdkmesh"));
 
-	hr = RenderBox(pd3dDevice);
+	hr = RenderBox(pd3dDevice, simthread.acquire().periodiclen);
 	if (FAILED(hr)) {
 		return hr;
 	}
@@ -535,18 +543,15 @@ void CALLBACK OnD3D11FrameRender(ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 		return;
 	}
 
-	if (modLatconst) {
-		RenderBox(pd3dDevice);
-		modLatconst = false;
-	}
+	// MD̃Xbh1t[̃Xebvi߂A`ɂ͍ŐṼXibvVbgp
+	simthread.frame();
+	auto const & snapshot = simthread.acquire();
 
-	if (modNc) {
-		RenderBox(pd3dDevice);
-		modNc = false;
+	// iq萔X[p[ŽςA蒼
+	if (snapshot.periodiclen != boxlen) {
+		RenderBox(pd3dDevice, snapshot.periodiclen);
 	}
 
-	armd.runCalc();
-
 	//
 	// Clear the back buffer
 	//
@@ -594,24 +599,24 @@ void CALLBACK OnD3D11FrameRender(ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 	pd3dImmediateContext->PSSetConstantBuffers(0, 1, pCBChangesEveryFrame_Box.GetAddressOf());
 	pd3dImmediateContext->DrawIndexed(NUMINDEXBUFFER, 0, 0);
 
-	auto const pos = boost::numeric_cast<float>(armd.periodiclen()) * 0.5f;
-	auto const size = armd.Atoms().size();
+	auto const pos = boost::numeric_cast<float>(snapshot.periodiclen) * 0.5f;
+	auto const size = snapshot.x.size();
 
 	for (auto i = 0U; i < size; i++) {
-		auto const rcolor = COLORRATIO * armd.getForce(i);
+		auto const rcolor = COLORRATIO * snapshot.force[i];
 		XMFLOAT4 const color = { rcolor > 1.0f ? 1.0f : rcolor, 0.0f, 1.0f, 1.0f };
 
 		RenderSphere(
 			pd3dImmediateContext,
-			boost::numeric_cast<float>(armd.Atoms()[i].r[0]) - pos,
-			boost::numeric_cast<float>(armd.Atoms()[i].r[1]) - pos,
-			boost::numeric_cast<float>(armd.Atoms()[i].r[2]) - pos,
+			snapshot.x[i] - pos,
+			snapshot.y[i] - pos,
+			snapshot.z[i] - pos,
 			color);
 	}
 
 	hud.OnRender(fElapsedTime);
 	ui.OnRender(fElapsedTime);
-	RenderText();
+	RenderText(snapshot);
 }
 
 
@@ -674,6 +679,8 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
 //--------------------------------------------------------------------------------------
 void CALLBACK OnGUIEvent(UINT nEvent, int nControlID, CDXUTControl* pControl, void* pUserContext)
 {
+	using namespace moleculardynamics;
+
 	switch (nControlID)
 	{
 	case IDC_TOGGLEFULLSCREEN:
@@ -684,41 +691,39 @@ void CALLBACK OnGUIEvent(UINT nEvent, int nControlID, CDXUTControl* pControl, vo
 		settingsDlg.SetActive(!settingsDlg.IsActive());
 		break;
 	case IDC_RECALC:
-		armd.recalc();
+		simthread.post({ CommandType::RECALC, 0.0 });
 		break;
 
 	case IDC_SLIDER:
-		armd.setTgiven(static_cast<double>((reinterpret_cast<CDXUTSlider *>(pControl))->GetValue()));
+		simthread.post({ CommandType::SET_TGIVEN, static_cast<double>((reinterpret_cast<CDXUTSlider *>(pControl))->GetValue()) });
 		break;
 
 	case IDC_SLIDER2:
-		armd.setScale(static_cast<double>((reinterpret_cast<CDXUTSlider *>(pControl))->GetValue()) / LATTICERATIO);
-		modLatconst = true;
+		simthread.post({ CommandType::SET_SCALE, static_cast<double>((reinterpret_cast<CDXUTSlider *>(pControl))->GetValue()) / LATTICERATIO });
 		break;
 
 	case IDC_SLIDER3:
-		armd.setNc(reinterpret_cast<CDXUTSlider *>(pControl)->GetValue());
-		modNc = true;
+		simthread.post({ CommandType::SET_NC, static_cast<double>(reinterpret_cast<CDXUTSlider *>(pControl)->GetValue()) });
 		break;
 
 	case IDC_RADIOA:
-		armd.setEnsemble(moleculardynamics::EnsembleType::NVT);
+		simthread.post({ CommandType::SET_ENSEMBLE, static_cast<double>(EnsembleType::NVT) });
 		break;
 
 	case IDC_RADIOB:
-		armd.setEnsemble(moleculardynamics::EnsembleType::NVE);
+		simthread.post({ CommandType::SET_ENSEMBLE, static_cast<double>(EnsembleType::NVE) });
 		break;
 
 	case IDC_RADIOC:
-		armd.setTempContMethod(moleculardynamics::TempControlMethod::LANGEVIN);
+		simthread.post({ CommandType::SET_TEMPCONTMETHOD, static_cast<double>(TempControlMethod::LANGEVIN) });
 		break;
 
 	case IDC_RADIOD:
-		armd.setTempContMethod(moleculardynamics::TempControlMethod::NOSE_HOOVER);
+		simthread.post({ CommandType::SET_TEMPCONTMETHOD, static_cast<double>(TempControlMethod::NOSE_HOOVER) });
 		break;
 
 	case IDC_RADIOE:
-		armd.setTempContMethod(moleculardynamics::TempControlMethod::VELOCITY);
+		simthread.post({ CommandType::SET_TEMPCONTMETHOD, static_cast<double>(TempControlMethod::VELOCITY) });
 		break;
 
 	default:
@@ -737,7 +742,8 @@ void CALLBACK OnKeyboard( UINT nChar, bool bKeyDown, bool bAltDown, void* pUserC
     {
         switch( nChar )
         {
-            case VK_F1: // Change as needed                
+            case VK_F1: // 1t[̃Xebv߂邩Ał邾vZ邩؂ւ
+                simthread.setStepsPerFrame(simthread.getStepsPerFrame() ? 0 : STEPSPERFRAME);
                 break;
 
             default:
@@ -747,11 +753,12 @@ void CALLBACK OnKeyboard( UINT nChar, bool bKeyDown, bool bAltDown, void* pUserC
 }
 
 
-HRESULT RenderBox(ID3D11Device* pd3dDevice)
+HRESULT RenderBox(ID3D11Device* pd3dDevice, double periodiclen)
 {
 	auto hr = S_OK;
 
-	auto const pos = boost::numeric_cast<float>(armd.periodiclen()) * 0.5f;
+	boxlen = periodiclen;
+	auto const pos = boost::numeric_cast<float>(periodiclen) * 0.5f;
 
 	// Create vertex buffer
 	std::array<SimpleVertex, NUMVERTEXBUFFER> vertices =
@@ -873,25 +880,46 @@ HRESULT RenderSphere(ID3D11DeviceContext* pd3dImmediateContext, float x, float y
 //--------------------------------------------------------------------------------------
 // Render the help and statistics text.
 //--------------------------------------------------------------------------------------
-void RenderText()
+void RenderText(moleculardynamics::Snapshot const & snapshot)
 {
 	pTxtHelper->Begin();
 	pTxtHelper->SetInsertionPos(5, 5);
 	pTxtHelper->SetForegroundColor(Colors::White);
 	pTxtHelper->DrawTextLine(DXUTGetFrameStats(DXUTIsVsyncEnabled()));
 	pTxtHelper->DrawTextLine(DXUTGetDeviceStats());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Number of atoms: %d") % armd.NumAtom).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Number of supercell: %d") % armd.Nc).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Number of MD step: %d") % armd.MD_iter).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Elapsed time: %.3f (ps)") % armd.getDeltat()).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Lattice constant: %.3f (nm)") % armd.getLatticeconst()).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Periodic length: %.3f (nm)") % armd.getPeriodiclen()).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Preset temperture: %.3f (K)") % armd.getTgiven()).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Calculation temperture: %.3f (K)") % armd.getTcalc()).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Kinetic energy: %.3f (Hartree)") % armd.Uk).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Potential energy: %.3f (Hartree)") % armd.Up).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Total energy: %.3f (Hartree)") % armd.Utot).str().c_str());
-	pTxtHelper->DrawTextLine((boost::wformat(L"Pressure: %.3f (atm)") % armd.getPressure()).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Number of atoms: %d") % snapshot.numatom).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Number of supercell: %d") % snapshot.nc).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Number of MD step: %d") % snapshot.mditer).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Elapsed time: %.3f (ps)") % snapshot.deltat).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Lattice constant: %.3f (nm)") % snapshot.latticeconst).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Periodic length: %.3f (nm)") % snapshot.periodiclennm).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Preset temperture: %.3f (K)") % snapshot.tgiven).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Calculation temperture: %.3f (K)") % snapshot.tcalc).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Kinetic energy: %.3f (Hartree)") % snapshot.uk).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Potential energy: %.3f (Hartree)") % snapshot.up).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Total energy: %.3f (Hartree)") % snapshot.utot).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Pressure: %.3f (atm)") % snapshot.pressure).str().c_str());
+
+	auto const & counters = snapshot.counters;
+	pTxtHelper->DrawTextLine((boost::wformat(L"Pairs in pair list: %d") % counters.pairs).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Pair list rebuilds: %d (interval: %d steps)") % counters.rebuilds % counters.rebuildinterval).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Pair list skin: %.3f") % counters.skin).str().c_str());
+	pTxtHelper->DrawTextLine((boost::wformat(L"Atoms per cell: %.3f") % counters.atomspercell).str().c_str());
+
+	auto const stepsperframe = simthread.getStepsPerFrame();
+	if (stepsperframe) {
+		pTxtHelper->DrawTextLine((boost::wformat(L"MD steps per second: %.1f (%d steps per frame, F1: free running)") % snapshot.stepspersecond % stepsperframe).str().c_str());
+	}
+	else {
+		pTxtHelper->DrawTextLine((boost::wformat(L"MD steps per second: %.1f (free running, F1: %d steps per frame)") % snapshot.stepspersecond % STEPSPERFRAME).str().c_str());
+	}
+
+	// runCalc()̒iKƂ̌oߎԁiwړρj
+	for (auto i = 0; i < static_cast<std::int32_t>(moleculardynamics::Phase::COUNT); i++) {
+		auto const phase = static_cast<moleculardynamics::Phase>(i);
+		pTxtHelper->DrawTextLine((boost::wformat(L"%s: %.1f (us)") % moleculardynamics::Profiler::name(phase) % (snapshot.phasens[i] * 1.0E-3)).str().c_str());
+	}
+
 	pTxtHelper->End();
 }
 
@@ -1007,8 +1035,19 @@ int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     // Only require 10-level hardware or later
     DXUTCreateDevice( D3D_FEATURE_LEVEL_11_0, true, WINDOWWIDTH, WINDOWHEIGHT);
 
+	// yAXg̍蒼Ńt[Ȃ悤ɁA蒼͂̌vZƏd˂
+	armd.setAsyncRebuild(true);
+
+	// `悷ł͍Č葬D悵AyAXg̃}[WoߎԂŎ
+	armd.setSkinAutoTune(true);
+
+	// MD̃XbhJniȌAarmdɂsimthreadʂĂGj
+	simthread.start();
+
 	// Enter into the DXUT render loop
     DXUTMainLoop();
 
+	simthread.stop();
+
     return DXUTGetExitCode();
 }
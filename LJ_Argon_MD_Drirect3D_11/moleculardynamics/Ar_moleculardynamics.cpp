@@ -6,12 +6,20 @@ This software is released under the BSD 2-Clause License.
 */
 
 #include "Ar_moleculardynamics.h"
-#include "myrandom/myrand.h"
+#include "myrandom/philox.h"
+#include <algorithm>                // for std::copy_n, std::fill, std::min
+#include <array>                    // for std::array
+#include <chrono>                   // for std::chrono::steady_clock
 #include <cmath>                    // for std::sqrt, std::pow
-#include <random>                   // for std::uniform_real_distribution
-#include <dvec.h>
+#include <functional>               // for std::cref, std::plus
+#include <future>                   // for std::async, std::future_status
+#include <numeric>                  // for std::accumulate, std::partial_sum
+#include <random>                   // for std::random_device
+#include <vector>                   // for std::vector
+#include <boost/assert.hpp>         // for BOOST_ASSERT
 #include <tbb/combinable.h>         // for tbb::combinable
 #include <tbb/parallel_for.h>       // for tbb::parallel_for
+#include <tbb/parallel_reduce.h>    // for tbb::parallel_deterministic_reduce
 
 namespace moleculardynamics {
     // #region static private 定数
@@ -34,22 +42,49 @@ namespace moleculardynamics {
         Up([this] { return DimensionlessToHartree(Up_); }, nullptr),
         Utot([this] { return DimensionlessToHartree(Utot_); }, nullptr),
         atoms_(Nc_ * Nc_ * Nc_ * 4),
-        rc2_(SystemParam::RCUTOFF * SystemParam::RCUTOFF),
-        rcm6_(std::pow(SystemParam::RCUTOFF, -6.0)),
-        rcm12_(std::pow(SystemParam::RCUTOFF, -12.0)),
-        Tg_(Ar_moleculardynamics::FIRSTTEMP * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON),
-        Vrc_(4.0 * (rcm6_ - rcm12_))
+        potential_(potential::lennardjones(SystemParam::RCUTOFF)),
+        Tg_(Ar_moleculardynamics::FIRSTTEMP * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON)
     {
         // initalize parameters
         lat_ = std::pow(2.0, 2.0 / 3.0) * scale_;
 
+        // シードが与えられなければ、実行ごとに異なる乱数列を用いる
+        std::random_device rnd;
+        seed_ = (static_cast<std::uint64_t>(rnd()) << 32) | static_cast<std::uint64_t>(rnd());
+
         recalc();
     }
 
+    Ar_moleculardynamics::~Ar_moleculardynamics()
+    {
+        cancelRebuild();
+    }
+
     // #endregion コンストラクタ
 
     // #region publicメンバ関数
 
+    void Ar_moleculardynamics::exchangeTgiven(double Tgiven)
+    {
+        auto const Tg = Tgiven * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON;
+
+        // 運動量をsqrt(Tnew / Told)倍すると、交換後の配置はそのまま新しい温度での平衡分布に従う
+        auto const s = std::sqrt(Tg / Tg_);
+        auto const sr = static_cast<real>(s);
+        for (auto n = 0; n < NumAtom_; n++) {
+            atoms_.px[n] *= sr;
+            atoms_.py[n] *= sr;
+            atoms_.pz[n] *= sr;
+        }
+
+        kinetic_ *= s * s;
+        zeta_ *= s;
+
+        // setTgiven()と異なり、マージンの探索はやり直さない
+        // （隣り合う温度の間で頻繁に入れ替わるので、やり直すと探索が終わらない）
+        Tg_ = Tg;
+    }
+
     double Ar_moleculardynamics::getDeltat() const
     {
         return Ar_moleculardynamics::TAU * t_ * 1.0E+12;
@@ -60,6 +95,11 @@ namespace moleculardynamics {
         return static_cast<float>(atoms_[n].f.norm());
     }
 
+    ForceMethod Ar_moleculardynamics::getForceMethod() const
+    {
+        return cellPair() ? ForceMethod::CELLPAIR : ForceMethod::PAIRLIST;
+    }
+
     double Ar_moleculardynamics::getLatticeconst() const
     {
         return Ar_moleculardynamics::SIGMA * lat_ * 1.0E+9;
@@ -70,51 +110,62 @@ namespace moleculardynamics {
         return Ar_moleculardynamics::SIGMA * periodiclen_ * 1.0E+9;
     }
 
-    double Ar_moleculardynamics::getPressure()
+    PotentialTable const * Ar_moleculardynamics::getPotentialTable() const
+    {
+        return potentialtable_.get();
+    }
+
+    double Ar_moleculardynamics::getPressure() const
     {
         auto const N = static_cast<double>(NumAtom_);
         auto const V = std::pow(periodiclen_, 3);
 
-        auto const pp = static_cast<std::int32_t>(pairs_.size());
+        // ビリアルは、力の計算と同時に求めたもの（最後にエネルギーを計算したステップの値）を用いる
+        auto const phi = virial_ / (3.0 * V);
 
-        tbb::combinable<double> phitmp;
-        tbb::combinable<double> Up;
-
-        tbb::parallel_for(
-            tbb::blocked_range<std::int32_t>(0, pp),
-            [this, &phitmp, &Up](tbb::blocked_range<std::int32_t> const & range) {
-                for (auto && n = range.begin(); n != range.end(); ++n) {
-                    auto const i = pairs_[n].first;
-                    auto const j = pairs_[n].second;
-                    Eigen::Vector4d d = atoms_[j].r - atoms_[i].r;
+        auto const density = N / V;
+        
+        return (density * Tc_ + phi) / std::pow(Ar_moleculardynamics::SIGMA, 3) * Ar_moleculardynamics::YPSILON * Ar_moleculardynamics::ATM;
+    }
 
-                    SystemParam::adjust_periodic(d, periodiclen_);
+    double Ar_moleculardynamics::getTcalc() const
+    {
+        return Ar_moleculardynamics::YPSILON / Ar_moleculardynamics::KB * Tc_;
+    }
 
-                    auto const r2 = d.squaredNorm();
+    std::int32_t Ar_moleculardynamics::getRebuilds() const
+    {
+        return rebuilds_;
+    }
 
-                    if (r2 > rc2_) {
-                        continue;
-                    }
+    PerfCounters Ar_moleculardynamics::getCounters() const
+    {
+        PerfCounters counters;
 
-                    auto const r6 = r2 * r2 * r2;
-                    auto const r12 = r6 * r6;
-                    phitmp.local() += 48.0 / r12 - 24.0 / r6;
-                    Up.local() += 4.0 * (1.0 / r12 - 1.0 / r6) - Vrc_;
-                }
-        });
+        counters.asyncfallbacks = asyncfallbacks_;
+        counters.atomspercell = pmesh_ ? static_cast<double>(NumAtom_) / static_cast<double>(pmesh_->number_of_mesh()) : 0.0;
+        counters.pairlistbytes = static_cast<std::int64_t>(pairs_.bytes());
+        counters.pairs = static_cast<std::int64_t>(pairs_.size());
+        counters.rebuildinterval = rebuildinterval_;
+        counters.rebuilds = rebuilds_;
+        counters.skin = skin_;
 
-        auto const phi = phitmp.combine(std::plus<>()) / (3.0 * V);
+        return counters;
+    }
 
-        Up_ = Up.combine(std::plus<>());
+    Profiler const & Ar_moleculardynamics::getProfiler() const
+    {
+        return profiler_;
+    }
 
-        auto const density = N / V;
-        
-        return (density * Tc_ + phi) / std::pow(Ar_moleculardynamics::SIGMA, 3) * Ar_moleculardynamics::YPSILON * Ar_moleculardynamics::ATM;
+    SimdType Ar_moleculardynamics::getSimd() const
+    {
+        return simd_;
     }
 
-    double Ar_moleculardynamics::getTcalc() const
+    double Ar_moleculardynamics::getSkin() const
     {
-        return Ar_moleculardynamics::YPSILON / Ar_moleculardynamics::KB * Tc_;
+        return skin_;
     }
 
     double Ar_moleculardynamics::getTgiven() const
@@ -124,8 +175,18 @@ namespace moleculardynamics {
 
     void Ar_moleculardynamics::recalc()
     {
+        cancelRebuild();
+
         t_ = 0.0;
         MD_iter_ = 1;
+        margin_length_ = skin_;
+        Up_ = 0.0;
+        virial_ = 0.0;
+        rebuilds_ = 0;
+        rebuildinterval_ = 0;
+        lastrebuild_ = 0;
+        asyncfallbacks_ = 0;
+        dispmax_ = 0.0;
 
         MD_initPos();
 
@@ -133,39 +194,92 @@ namespace moleculardynamics {
 
         periodiclen_ = lat_ * static_cast<double>(Nc_);
 
-        m_ = static_cast<std::int32_t>(periodiclen_ / (SystemParam::RCUTOFF + SystemParam::MARGIN)) - 1;
+        // 密度や原子数が変わると最適なマージンも変わるので、探索をやり直す
+        skintuner_.reset(skin_);
 
-        if (m_ > 2) {
-            pmesh_.reset(new MeshList(periodiclen_));
-            pmesh_->set_number_of_atoms(atoms_.size());
-            pmesh_->make_pair(atoms_, pairs_);
-        }
-        else {
-            makePair();
-        }
+        resetMesh();
+
+        rebuildPairlist();
 
         zeta_ = 0.0;
     }
 
+    void Ar_moleculardynamics::resetProfiler()
+    {
+        profiler_.reset();
+    }
+
     void Ar_moleculardynamics::runCalc()
     {
-        moveAtoms();
-        checkPairlist();
-        calcForcePair();
-        moveAtoms();
-        periodic();
+        auto const begin = std::chrono::steady_clock::now();
+
+        {
+            MD_PROFILE_SCOPE(profiler_, Phase::MOVE_FIRST);
+            moveAtoms(false);
+        }
+
+        {
+            MD_PROFILE_SCOPE(profiler_, Phase::CHECK_PAIRLIST);
+            checkPairlist();
+        }
+
+        {
+            MD_PROFILE_SCOPE(profiler_, Phase::FORCE);
+            calcForcePair();
+        }
+
+        {
+            MD_PROFILE_SCOPE(profiler_, Phase::MOVE_SECOND);
+            moveAtoms(true);
+        }
+
+        if (autoskin_) {
+            skintuner_.record(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        }
 
         // 繰り返し回数と時間を増加
         t_ = static_cast<double>(MD_iter_)* Ar_moleculardynamics::DT;
         MD_iter_++;
     }
 
+    void Ar_moleculardynamics::setAsyncRebuild(bool asyncrebuild)
+    {
+        if (!asyncrebuild) {
+            cancelRebuild();
+        }
+
+        asyncrebuild_ = asyncrebuild;
+    }
+
+    void Ar_moleculardynamics::setEnergyInterval(std::int32_t interval)
+    {
+        BOOST_ASSERT(interval > 0);
+
+        energyinterval_ = interval;
+    }
+
     void Ar_moleculardynamics::setEnsemble(EnsembleType ensemble)
     {
         ensemble_ = ensemble;
         recalc();
     }
 
+    void Ar_moleculardynamics::setForceEngine(ForceEngine forceengine)
+    {
+        forceengine_ = forceengine;
+    }
+
+    void Ar_moleculardynamics::setForceMethod(ForceMethod forcemethod)
+    {
+        cancelRebuild();
+
+        forcemethod_ = forcemethod;
+
+        // 番地の大きさは、ペアリストならカットオフ半径とマージンの和、番地の組ならカットオフ半径で決まる
+        resetMesh();
+        rebuildPairlist();
+    }
+
     void Ar_moleculardynamics::setNc(std::int32_t Nc)
     {
         Nc_ = Nc;
@@ -174,12 +288,92 @@ namespace moleculardynamics {
         ModLattice();
     }
 
+    void Ar_moleculardynamics::setPairListFormat(PairListFormat format)
+    {
+        cancelRebuild();
+
+        pairlistformat_ = format;
+        rebuildPairlist();
+    }
+
+    void Ar_moleculardynamics::setPotential(PotentialParam const & potential)
+    {
+        // 作りかけのペアリストはカットオフ半径を読むので、書き換える前に止める
+        cancelRebuild();
+
+        potential_ = potential;
+
+        // 表を用いているなら、新しいポテンシャルから作り直す
+        if (potentialtable_) {
+            setPotentialTable(potentialtable_->param().type, potentialtable_->param().tablesize);
+        }
+
+        // カットオフ半径が変わると番地の大きさも変わるので、メッシュリストとペアリストも作り直す
+        recalc();
+    }
+
+    void Ar_moleculardynamics::setPotentialTable(PotentialType interpolation, std::int32_t size)
+    {
+        if (interpolation == PotentialType::LINEARTABLE || interpolation == PotentialType::CUBICTABLE) {
+            potentialtable_.reset(new PotentialTable(potential_, interpolation, size));
+        }
+        else {
+            potentialtable_.reset();
+        }
+    }
+
+    void Ar_moleculardynamics::setRebuildCriterion(RebuildCriterion rebuildcriterion)
+    {
+        rebuildcriterion_ = rebuildcriterion;
+        margin_length_ = skin_;
+    }
+
+    void Ar_moleculardynamics::setReorder(ReorderType reorder)
+    {
+        // 作り直しの途中で並べ替えの方法が変わらないようにする
+        cancelRebuild();
+
+        reorder_ = reorder;
+    }
+
     void Ar_moleculardynamics::setScale(double scale)
     {
         scale_ = scale;
         ModLattice();
     }
 
+    void Ar_moleculardynamics::setSeed(std::uint64_t seed)
+    {
+        seed_ = seed;
+        recalc();
+    }
+
+    void Ar_moleculardynamics::setSimd(SimdType simd)
+    {
+        // CPUが対応していない命令セットが指定されたときは、使用できるもっとも幅の広いものにする
+        simd_ = std::min(simd, forcekernel::best_simd());
+    }
+
+    void Ar_moleculardynamics::setSkin(double skin)
+    {
+        BOOST_ASSERT(skin > 0.0);
+
+        cancelRebuild();
+
+        autoskin_ = false;
+
+        skin_ = skin;
+        margin_length_ = skin_;
+        resetMesh();
+        rebuildPairlist();
+    }
+
+    void Ar_moleculardynamics::setSkinAutoTune(bool autotune)
+    {
+        autoskin_ = autotune;
+        skintuner_.reset(skin_);
+    }
+
     void Ar_moleculardynamics::setTempContMethod(TempControlMethod tempcontmethod)
     {
         tempcontmethod_ = tempcontmethod;
@@ -189,132 +383,415 @@ namespace moleculardynamics {
     void Ar_moleculardynamics::setTgiven(double Tgiven)
     {
         Tg_ = Tgiven * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON;
+
+        // 温度が変わると原子の速さが変わり、最適なマージンも変わる
+        skintuner_.reset(skin_);
+    }
+
+    void Ar_moleculardynamics::setTracing(bool tracing)
+    {
+        profiler_.set_tracing(tracing);
     }
 
     // #endregion publicメンバ関数
 
     // #region privateメンバ関数
 
+    void Ar_moleculardynamics::calcForceCells(std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const
+    {
+        pmesh_->calc_force(first, last, forcekernel::get_cell(simd_), potentialtable_ ? potentialtable_->param() : potential_, fx, fy, fz, energy);
+    }
+
     void Ar_moleculardynamics::calcForcePair()
     {
-        // 各原子に働く力の初期化
-        for (auto && a : atoms_) {
-            a.f = Eigen::Vector4d::Zero();
-        }
+        // ポテンシャルエネルギーとビリアルは、energyinterval_ステップごとに力と同時に求める
+        ForceKernelEnergy energy;
+        auto const penergy = MD_iter_ % energyinterval_ == 0 ? &energy : nullptr;
 
-        auto const number_of_pairs = pairs_.size();
-        std::int32_t i_a = 0, j_a = 0;
-        Eigen::Vector4d d_a, d_b;
+        switch (forceengine_) {
+        case ForceEngine::SERIAL:
+            calcForcePairSerial(penergy);
+            break;
 
-        if (number_of_pairs) {
-            i_a = pairs_[0].first;
-            j_a = pairs_[0].second;
-            d_b = atoms_[j_a].r - atoms_[i_a].r;
-            SystemParam::adjust_periodic(d_b, periodiclen_);
+        case ForceEngine::PARALLEL:
+            calcForcePairParallel(penergy);
+            break;
+
+        default:
+            BOOST_ASSERT(!"何かがおかしい！");
+            break;
         }
 
-        for (auto k = 1U; k < number_of_pairs; ++k) {
-            d_a = d_b;
+        if (penergy) {
+            Up_ = static_cast<double>(energy.up);
+            virial_ = static_cast<double>(energy.virial);
+        }
+    }
 
-            auto const i_b = pairs_[k].first;
-            auto const j_b = pairs_[k].second;
-            d_b = atoms_[j_b].r - atoms_[i_b].r;
+    void Ar_moleculardynamics::calcForcePairParallel(ForceKernelEnergy * energy)
+    {
+        // 番地の組から計算するときは、番地のループを分割し、バッファには番地の順に並べた原子の力を足し込む
+        auto const cell = cellPair();
+        auto const rows = cell ? pmesh_->number_of_mesh() : NumAtom_;
+        auto const grain = cell ? SystemParam::CELLGRAINSIZE : SystemParam::ROWGRAINSIZE;
 
-            SystemParam::adjust_periodic(d_b, periodiclen_);
-            auto const r2 = d_a.squaredNorm();
+        // 行（番地）の区間は行数だけで決め、スレッド数やワークスティーリングの具合によらず
+        // 同じ区間を同じバッファに足し込む（力とエネルギーの和を取る順序が毎回同じになる）
+        auto const chunks = std::max(std::min(SystemParam::FORCECHUNKS, (rows + grain - 1) / grain), 1);
+        resizeForceBuffers(chunks);
 
-            auto const r6 = r2 * r2 * r2;
-            auto const dFdr = (24.0 * r6 - 48.0) / (r6 * r6 * r2);
-            auto df = dFdr * DT;
+        // 各区間は自分のバッファにだけ書き込むので、作用・反作用の更新が競合しない
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, chunks, 1),
+            [this, energy, cell, rows, chunks](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto c = range.begin(); c != range.end(); ++c) {
+                    auto & buf = forcebuffers_[c];
+                    auto const first = static_cast<std::int32_t>(static_cast<std::int64_t>(rows) * c / chunks);
+                    auto const last = static_cast<std::int32_t>(static_cast<std::int64_t>(rows) * (c + 1) / chunks);
+
+                    buf.energy = ForceKernelEnergy();
 
-            if (r2 > rc2_) {
-                df = 0.0;
+                    if (cell) {
+                        calcForceCells(first, last, buf.fx.data(), buf.fy.data(), buf.fz.data(), energy ? &buf.energy : nullptr);
+                    }
+                    else {
+                        calcForceRows(first, last, buf.fx.data(), buf.fy.data(), buf.fz.data(), energy ? &buf.energy : nullptr);
+                    }
+                }
+            },
+            tbb::simple_partitioner());
+
+        // エネルギーとビリアルは、区間の順に足し合わせる
+        if (energy) {
+            for (auto const & buf : forcebuffers_) {
+                energy->up += buf.energy.up;
+                energy->virial += buf.energy.virial;
             }
+        }
 
-            atoms_[i_a].f += dFdr * d_a;
-            atoms_[j_a].f -= dFdr * d_a;
+        // 力の集計と運動量の更新を同じループで行い、更新後の運動エネルギーも求める
+        // （読んだバッファの要素はその場で0に戻し、次のステップのための初期化を省く）
+        auto const p2 = tbb::parallel_deterministic_reduce(
+            tbb::blocked_range<std::int32_t>(0, NumAtom_, SystemParam::ATOMGRAINSIZE),
+            static_cast<accum>(0),
+            [this, cell](tbb::blocked_range<std::int32_t> const & range, accum sum) {
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    auto const k = cell ? pmesh_->sorted_position(n) : n;
+                    auto sx = 0.0, sy = 0.0, sz = 0.0;
+
+                    for (auto & buf : forcebuffers_) {
+                        sx += buf.fx[k];
+                        sy += buf.fy[k];
+                        sz += buf.fz[k];
+                        buf.fx[k] = buf.fy[k] = buf.fz[k] = 0.0;
+                    }
 
-            atoms_[i_a].p += df * d_a;
-            atoms_[j_a].p -= df * d_a;
+                    atoms_.fx[n] = static_cast<real>(sx);
+                    atoms_.fy[n] = static_cast<real>(sy);
+                    atoms_.fz[n] = static_cast<real>(sz);
+                }
 
-            i_a = i_b;
-            j_a = j_b;
-        }
+                return sum + kick(range.begin(), range.end());
+            },
+            std::plus<>());
 
-        if (number_of_pairs) {
-            d_a = d_b;
+        kinetic_ = 0.5 * static_cast<double>(p2);
+    }
 
-            auto const r2 = d_a.squaredNorm();
+    void Ar_moleculardynamics::calcForcePairSerial(ForceKernelEnergy * energy)
+    {
+        if (cellPair()) {
+            // 番地の順に並べた原子の力をバッファに足し込んでから、原子の順に戻す
+            resizeForceBuffers(1);
+            auto & buf = forcebuffers_.front();
+
+            calcForceCells(0, pmesh_->number_of_mesh(), buf.fx.data(), buf.fy.data(), buf.fz.data(), energy);
+
+            for (auto n = 0; n < NumAtom_; n++) {
+                auto const k = pmesh_->sorted_position(n);
+                atoms_.fx[n] = buf.fx[k];
+                atoms_.fy[n] = buf.fy[k];
+                atoms_.fz[n] = buf.fz[k];
+                buf.fx[k] = buf.fy[k] = buf.fz[k] = 0.0;
+            }
 
-            auto const r6 = r2 * r2 * r2;
-            auto const dFdr = (24.0 * r6 - 48.0) / (r6 * r6 * r2);
-            auto df = dFdr * DT;
+            kinetic_ = 0.5 * static_cast<double>(kick(0, NumAtom_));
+            return;
+        }
 
-            if (r2 > rc2_) {
-                df = 0.0;
-            }
+        // 各原子に働く力の初期化
+        std::fill(atoms_.fx.begin(), atoms_.fx.end(), 0.0);
+        std::fill(atoms_.fy.begin(), atoms_.fy.end(), 0.0);
+        std::fill(atoms_.fz.begin(), atoms_.fz.end(), 0.0);
 
-            atoms_[i_a].f += dFdr * d_a;
-            atoms_[j_a].f -= dFdr * d_a;
+        calcForceRows(0, NumAtom_, atoms_.fx.data(), atoms_.fy.data(), atoms_.fz.data(), energy);
+
+        kinetic_ = 0.5 * static_cast<double>(kick(0, NumAtom_));
+    }
+
+    void Ar_moleculardynamics::calcForceRows(std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const
+    {
+        ForceKernelParam const param = {
+            atoms_.rx.data(), atoms_.ry.data(), atoms_.rz.data(),
+            pairs_.offsets.data(), pairs_.neighbors.data(),
+            pairs_.format == PairListFormat::DELTA16 ? pairs_.deltas.data() : nullptr,
+            pairs_.faroffsets.data(), pairs_.farneighbors.data(),
+            periodiclen_, potentialtable_ ? potentialtable_->param() : potential_ };
+
+        forcekernel::get(simd_)(param, first, last, fx, fy, fz, energy);
+    }
 
-            atoms_[i_a].p += df * d_a;
-            atoms_[j_a].p -= df * d_a;
+    void Ar_moleculardynamics::cancelRebuild()
+    {
+        if (pending_.valid()) {
+            pending_.get();
         }
     }
 
+    bool Ar_moleculardynamics::cellPair() const
+    {
+        return forcemethod_ == ForceMethod::CELLPAIR && pmesh_;
+    }
+
     void Ar_moleculardynamics::checkPairlist()
     {
-        auto vmax2 = 0.0;
+        // 番地の組から計算するときは、毎ステップ原子を番地に振り分けるだけでよい
+        if (cellPair()) {
+            MD_PROFILE_SCOPE(profiler_, Phase::REBUILD);
+            pmesh_->bin(atoms_);
+            return;
+        }
+
+        auto rebuild = false;
+
+        switch (rebuildcriterion_) {
+        case RebuildCriterion::VELOCITY:
+            {
+                // 速さの最大値は、直前のmoveAtoms()で求めてある
+                auto const vmax = std::sqrt(vmax2_);
+                margin_length_ -= vmax * 2.0 * DT;
 
-        for (auto && a : atoms_) {
-            auto const v2 = a.p.squaredNorm();
-            if (vmax2 < v2) {
-                vmax2 = v2;
+                rebuild = margin_length_ < 0.0;
             }
+            break;
+
+        case RebuildCriterion::DISPLACEMENT:
+            // 2つの原子の距離は、両者の変位の和より大きくは縮まないので、
+            // 変位の大きい方から2つの和がマージンを超えない限り、ペアリストに漏れはない
+            rebuild = dispmax_ > listskin_;
+            break;
+
+        default:
+            BOOST_ASSERT(!"何かがおかしい！");
+            break;
         }
 
-        auto const vmax = std::sqrt(vmax2);
-        margin_length_ -= vmax * 2.0 * DT;
+        // 今のペアリストのマージンを消費した量
+        auto const used = rebuildcriterion_ == RebuildCriterion::VELOCITY ? listskin_ - margin_length_ : dispmax_;
+
+        // マージンを自動調整しているときは、計測の区間が長くなりすぎたら作り直しを待たずに区間を締める
+        auto const windowfull = autoskin_ && skintuner_.window_full();
+
+        if (asyncrebuild_) {
+            if (pending_.valid()) {
+                // 新しいペアリストができていれば入れ替え、今のペアリストがもう使えなければ、できるまで待つ
+                if (rebuild || pending_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    auto const begin = std::chrono::steady_clock::now();
+                    auto swapped = false;
+
+                    {
+                        MD_PROFILE_SCOPE(profiler_, Phase::REBUILD);
+                        swapped = finishRebuild();
+                    }
+
+                    if (swapped) {
+                        rebuilds_++;
+                        rebuildinterval_ = MD_iter_ - lastrebuild_;
+                        lastrebuild_ = MD_iter_;
 
-        if (margin_length_ < 0.0) {
-            margin_length_ = SystemParam::MARGIN;
-            if (m_ > 2) {
-                pmesh_->make_pair(atoms_, pairs_);
+                        if (autoskin_) {
+                            skintuner_.record_rebuild(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+                        }
+
+                        return;
+                    }
+
+                    // 作り直しに用いた座標から動きすぎていたので、同期的に作り直す
+                    rebuild = true;
+                }
             }
-            else {
-                makePair();
+            else if (!rebuild && (used >= Ar_moleculardynamics::ASYNCTRIGGER * listskin_ || windowfull)) {
+                // マージンを変えるのは、作り直しを始めるときだけにする（今のペアリストは、元のマージンのまま使い続ける）
+                if (autoskin_) {
+                    // 作り直しを始める時点を、作り直しの周期の終わりとみなして見積もらせる
+                    auto const skin = skintuner_.next(used / (Ar_moleculardynamics::ASYNCTRIGGER * listskin_));
+                    if (skin != skin_) {
+                        skin_ = skin;
+                        resetMesh();
+                    }
+                }
+
+                startRebuild();
+
+                return;
             }
         }
+        else if (windowfull) {
+            rebuild = true;
+        }
+
+        if (rebuild) {
+            // マージンを変えるのは、ペアリストを作り直すときだけにする（余計な作り直しをしない）
+            // （非同期に作り直しているときは、作り直しを始めたときに決めてある）
+            if (autoskin_ && !asyncrebuild_) {
+                // 区間の終わりまでに消費したマージンの割合から、作り直しの周期を見積もらせる
+                auto const skin = skintuner_.next(used / skin_);
+                if (skin != skin_) {
+                    skin_ = skin;
+                    resetMesh();
+                }
+            }
+
+            if (asyncrebuild_) {
+                asyncfallbacks_++;
+            }
+
+            auto const begin = std::chrono::steady_clock::now();
+
+            margin_length_ = skin_;
+
+            {
+                MD_PROFILE_SCOPE(profiler_, Phase::REBUILD);
+                rebuildPairlist();
+            }
+
+            rebuilds_++;
+            rebuildinterval_ = MD_iter_ - lastrebuild_;
+            lastrebuild_ = MD_iter_;
+
+            if (autoskin_) {
+                skintuner_.record_rebuild(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+            }
+        }
+    }
+
+    double Ar_moleculardynamics::displacement(AtomArray::myvector const & rx0, AtomArray::myvector const & ry0, AtomArray::myvector const & rz0) const
+    {
+        auto const d2max = tbb::parallel_reduce(
+            tbb::blocked_range<std::int32_t>(0, NumAtom_, SystemParam::ATOMGRAINSIZE),
+            static_cast<real>(0),
+            [this, &rx0, &ry0, &rz0](tbb::blocked_range<std::int32_t> const & range, real d2max) {
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    auto dx = atoms_.rx[n] - rx0[n];
+                    auto dy = atoms_.ry[n] - ry0[n];
+                    auto dz = atoms_.rz[n] - rz0[n];
+                    SystemParam::adjust_periodic(dx, periodiclen_);
+                    SystemParam::adjust_periodic(dy, periodiclen_);
+                    SystemParam::adjust_periodic(dz, periodiclen_);
+
+                    auto const d2 = dx * dx + dy * dy + dz * dz;
+                    d2max = d2 > d2max ? d2 : d2max;
+                }
+
+                return d2max;
+            },
+            [](real lhs, real rhs) { return lhs > rhs ? lhs : rhs; });
+
+        return std::sqrt(static_cast<double>(d2max));
+    }
+
+    bool Ar_moleculardynamics::finishRebuild()
+    {
+        pending_.get();
+
+        // 新しいペアリストは並べ替えた後の順序で作ってあるので、原子も同じ順序に並べ替える
+        // （安全の確認に失敗しても、並べ替え自体は害がない）
+        if (!order_.empty()) {
+            atoms_.permute(order_);
+        }
+
+        // 2つの原子の変位の和は、変位の最大値の2倍を超えない
+        auto const disp = 2.0 * displacement(pendingatoms_.rx, pendingatoms_.ry, pendingatoms_.rz);
+        if (disp > skin_) {
+            return false;
+        }
+
+        pairs_.swap(pendingpairs_);
+
+        // 変位の基準を、作り直しに用いた座標に切り替える
+        rx0_.swap(pendingatoms_.rx);
+        ry0_.swap(pendingatoms_.ry);
+        rz0_.swap(pendingatoms_.rz);
+        dispmax_ = disp;
+
+        listskin_ = skin_;
+        margin_length_ = skin_ - disp;
+
+        return true;
     }
         
-    void Ar_moleculardynamics::Langevin()
+    accum Ar_moleculardynamics::kick(std::int32_t first, std::int32_t last)
     {
-        auto const D = std::sqrt(2.0 * Ar_moleculardynamics::GAMMA * Tg_ / DT);
+        auto const fx = atoms_.fx.data(), fy = atoms_.fy.data(), fz = atoms_.fz.data();
+        auto const px = atoms_.px.data(), py = atoms_.py.data(), pz = atoms_.pz.data();
+        auto const dt = static_cast<real>(DT);
 
-        std::normal_distribution<double> nd(0.0, D);
-        myrandom::MyRand<std::normal_distribution<double> > mr(nd);
-        for (auto && atom : atoms_) {
-            atom.p[0] += (-Ar_moleculardynamics::GAMMA * atom.p[0] + mr.myrand()) * DT;
-            atom.p[1] += (-Ar_moleculardynamics::GAMMA * atom.p[1] + mr.myrand()) * DT;
-            atom.p[2] += (-Ar_moleculardynamics::GAMMA * atom.p[2] + mr.myrand()) * DT;
+        accum p2 = 0;
+        for (auto n = first; n < last; n++) {
+            px[n] += fx[n] * dt;
+            py[n] += fy[n] * dt;
+            pz[n] += fz[n] * dt;
+
+            p2 += static_cast<accum>(px[n] * px[n] + py[n] * py[n] + pz[n] * pz[n]);
         }
+
+        return p2;
     }
 
-    void Ar_moleculardynamics::makePair()
+    double Ar_moleculardynamics::Langevin()
     {
-        pairs_.clear();
+        // 揺動力の標準偏差（揺動力そのものは、sweep()の中で原子ごとに生成する）
+        sigma_ = std::sqrt(2.0 * Ar_moleculardynamics::GAMMA * Tg_ / DT);
 
-        for (auto i = 0; i < NumAtom_ - 1; i++) {
-            for (auto j = i + 1; j < NumAtom_; j++) {
-                Eigen::Vector4d d = atoms_[j].r - atoms_[i].r;
+        return 1.0 - Ar_moleculardynamics::GAMMA * DT;
+    }
 
-                SystemParam::adjust_periodic(d, periodiclen_);
+    void Ar_moleculardynamics::makePair(SystemParam::myatomvector const & atoms, PairList & pairs)
+    {
+        rowbegin_.resize(NumAtom_);
+        rowbuffer_.resize(NumAtom_);
+        rowcount_.resize(NumAtom_);
+
+        // MeshList::make_pair()と同じく、原子ごとの行をスレッドごとのバッファへ並列に詰める
+        // （行の中は従来どおりjの昇順になるので、結果はスレッド数によらない）
+        for (auto && buf : pairbuffers_) {
+            buf.clear();
+        }
 
-                if (d.squaredNorm() <= rc2_) {
-                    pairs_.push_back(std::make_pair(i, j));
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, NumAtom_, Ar_moleculardynamics::PAIRGRAINSIZE),
+            [this, &atoms](tbb::blocked_range<std::int32_t> const & range) {
+                auto & buf = pairbuffers_.local();
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    rowbegin_[i] = static_cast<std::int32_t>(buf.size());
+                    rowbuffer_[i] = &buf;
+                    pairRow(atoms, i, buf);
+                    rowcount_[i] = static_cast<std::int32_t>(buf.size()) - rowbegin_[i];
                 }
-            }
-        }
+        });
+
+        // 原子のインデックスの順に並べて、CSR形式にする
+        pairs.clear(NumAtom_);
+        std::partial_sum(rowcount_.begin(), rowcount_.end(), pairs.offsets.begin() + 1);
+        pairs.neighbors.resize(pairs.offsets[NumAtom_]);
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, NumAtom_),
+            [this, &pairs](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    std::copy_n(rowbuffer_[i]->begin() + rowbegin_[i], rowcount_[i], pairs.neighbors.begin() + pairs.offsets[i]);
+                }
+        });
     }
 
     void Ar_moleculardynamics::MD_initPos()
@@ -322,6 +799,13 @@ namespace moleculardynamics {
         double sx, sy, sz;
         auto n = 0;
 
+        auto const setpos = [this, &n](double x, double y, double z) {
+            atoms_.rx[n] = x;
+            atoms_.ry[n] = y;
+            atoms_.rz[n] = z;
+            n++;
+        };
+
         for (auto i = 0; i < Nc_; i++) {
             for (auto j = 0; j < Nc_; j++) {
                 for (auto k = 0; k < Nc_; k++) {
@@ -331,64 +815,68 @@ namespace moleculardynamics {
                     sz = static_cast<double>(k)* lat_;
 
                     // 基本セル内には4つの原子がある
-                    atoms_[n].r = Eigen::Vector4d(sx, sy, sz, 0.0);
-                    n++;
-
-                    atoms_[n].r = Eigen::Vector4d(0.5 * lat_ + sx, 0.5 * lat_ + sy, sz, 0.0);
-                    n++;
-
-                    atoms_[n].r = Eigen::Vector4d(sx, 0.5 * lat_ + sy, 0.5 * lat_ + sz, 0.0);
-                    n++;
-
-                    atoms_[n].r = Eigen::Vector4d(0.5 * lat_ + sx, sy, 0.5 * lat_ + sz, 0.0);
-                    n++;
+                    setpos(sx, sy, sz);
+                    setpos(0.5 * lat_ + sx, 0.5 * lat_ + sy, sz);
+                    setpos(sx, 0.5 * lat_ + sy, 0.5 * lat_ + sz);
+                    setpos(0.5 * lat_ + sx, sy, 0.5 * lat_ + sz);
                 }
             }
         }
 
         NumAtom_ = n;
 
+        // 初期配置では、原子のIDは配列のインデックスと一致する
+        atoms_.reset_ids();
+
         // move the center of mass to the origin
         // 系の重心を座標系の原点とする
-        Eigen::Vector4d s(0.0, 0.0, 0.0, 0.0);
-
-        for (auto && atom : atoms_) {
-            s += atom.r;
-        }
-
-        s /= static_cast<double>(NumAtom_);
+        auto const sumx = std::accumulate(atoms_.rx.begin(), atoms_.rx.end(), 0.0) / static_cast<double>(NumAtom_);
+        auto const sumy = std::accumulate(atoms_.ry.begin(), atoms_.ry.end(), 0.0) / static_cast<double>(NumAtom_);
+        auto const sumz = std::accumulate(atoms_.rz.begin(), atoms_.rz.end(), 0.0) / static_cast<double>(NumAtom_);
 
         for (auto n = 0; n < NumAtom_; n++) {
-            atoms_[n].r -= s;
+            atoms_.rx[n] -= sumx;
+            atoms_.ry[n] -= sumy;
+            atoms_.rz[n] -= sumz;
         }
     }
 
     void Ar_moleculardynamics::MD_initVel()
     {
         auto const v = std::sqrt(3.0 * Tg_);
+        auto const key = myrandom::Philox::make_key(seed_);
 
-        std::uniform_real_distribution<double> dist(-1.0, 1.0);
-        myrandom::MyRand<std::uniform_real_distribution<double> > mr(dist);
+        for (auto n = 0; n < NumAtom_; n++) {
+            // 原子のIDをカウンタとするので、乱数列は原子の並び順によらない
+            auto const bits = myrandom::Philox::generate(
+                { static_cast<std::uint32_t>(atoms_.id[n]), 0U, 0U, Ar_moleculardynamics::STREAM_INITVEL }, key);
 
-        for (auto && a : atoms_) {
-            Eigen::Vector4d rnd(mr.myrand(), mr.myrand(), mr.myrand(), 0.0);
+            auto const rndx = 2.0 * myrandom::Philox::to_uniform(bits[0]) - 1.0;
+            auto const rndy = 2.0 * myrandom::Philox::to_uniform(bits[1]) - 1.0;
+            auto const rndz = 2.0 * myrandom::Philox::to_uniform(bits[2]) - 1.0;
+            auto const norm = std::sqrt(rndx * rndx + rndy * rndy + rndz * rndz);
 
             // 方向はランダムに与える
-            a.p = v * rnd / rnd.norm();
-        }
-
-        Eigen::Vector4d s(0.0, 0.0, 0.0, 0.0);
-
-        for (auto && a : atoms_) {
-            s += a.p;
+            atoms_.px[n] = v * rndx / norm;
+            atoms_.py[n] = v * rndy / norm;
+            atoms_.pz[n] = v * rndz / norm;
         }
 
-        s /= static_cast<double>(NumAtom_);
+        auto const sumx = std::accumulate(atoms_.px.begin(), atoms_.px.end(), 0.0) / static_cast<double>(NumAtom_);
+        auto const sumy = std::accumulate(atoms_.py.begin(), atoms_.py.end(), 0.0) / static_cast<double>(NumAtom_);
+        auto const sumz = std::accumulate(atoms_.pz.begin(), atoms_.pz.end(), 0.0) / static_cast<double>(NumAtom_);
 
         // 重心の並進運動を避けるために、速度の和がゼロになるように補正
-        for (auto && a : atoms_) {
-            a.p -= s;
+        accum p2 = 0;
+        for (auto n = 0; n < NumAtom_; n++) {
+            atoms_.px[n] -= sumx;
+            atoms_.py[n] -= sumy;
+            atoms_.pz[n] -= sumz;
+
+            p2 += static_cast<accum>(atoms_.px[n] * atoms_.px[n] + atoms_.py[n] * atoms_.py[n] + atoms_.pz[n] * atoms_.pz[n]);
         }
+
+        kinetic_ = 0.5 * static_cast<double>(p2);
     }
 
     void Ar_moleculardynamics::ModLattice()
@@ -397,18 +885,10 @@ namespace moleculardynamics {
         recalc();
     }
 
-    void Ar_moleculardynamics::moveAtoms()
+    void Ar_moleculardynamics::moveAtoms(bool second)
     {
-        // 運動エネルギーの初期化
-        Uk_ = 0.0;
-
-        // calculate temperture
-        for (auto && a : atoms_) {
-            Uk_ += a.p.squaredNorm();
-        }
-
-        // 運動エネルギーの計算
-        Uk_ *= 0.5;
+        // 運動エネルギーは、直前に運動量を更新したループで求めてある
+        Uk_ = kinetic_;
 
         // 全エネルギー（運動エネルギー+ポテンシャルエネルギー）の計算
         Utot_ = Uk_ + Up_;
@@ -416,6 +896,9 @@ namespace moleculardynamics {
         // 温度の計算
         Tc_ = Uk_ / (1.5 * static_cast<double>(NumAtom_));
 
+        auto s = 1.0;
+        auto noise = false;
+
         switch (ensemble_) {
         case EnsembleType::NVE:
             break;
@@ -423,15 +906,16 @@ namespace moleculardynamics {
         case EnsembleType::NVT:
             switch (tempcontmethod_) {
             case TempControlMethod::LANGEVIN:
-                Langevin();
+                s = Langevin();
+                noise = true;
                 break;
 
             case TempControlMethod::NOSE_HOOVER:
-                NoseHoover();
+                s = NoseHoover();
                 break;
 
             case TempControlMethod::VELOCITY:
-                Woodcock_velocity_scaling();
+                s = Woodcock_velocity_scaling();
                 break;
 
             default:
@@ -445,56 +929,290 @@ namespace moleculardynamics {
             break;
         }
 
-        for (auto && atom : atoms_) {
-            atom.r += atom.p * DT * 0.5;
+        // 揺動力の乱数のカウンタ（ステップの前半と後半で異なる値にする）
+        auto const counter = static_cast<std::uint64_t>(MD_iter_) * 2 + (second ? 1 : 0);
+
+        // 温度制御、座標の移動、周期境界条件の補正を、1回のループでまとめて行う
+        auto const res = noise ?
+            (second ? sweep<true, true>(s, counter) : sweep<true, false>(s, counter)) :
+            (second ? sweep<false, true>(s, counter) : sweep<false, false>(s, counter));
+
+        kinetic_ = 0.5 * static_cast<double>(res.p2);
+        vmax2_ = static_cast<double>(res.p2max);
+
+        if (!second) {
+            dispmax_ = std::sqrt(static_cast<double>(res.d2max1)) + std::sqrt(static_cast<double>(res.d2max2));
         }
     }
 
-    void Ar_moleculardynamics::NoseHoover()
+    double Ar_moleculardynamics::NoseHoover()
     {
         zeta_ += (Tc_ - Tg_) / (Ar_moleculardynamics::TAU_NOSE_HOOVER * Ar_moleculardynamics::TAU_NOSE_HOOVER) * DT;
 
-        for (auto && atom : atoms_) {
-            atom.p -= atom.p * zeta_ * DT;
-        }
+        return 1.0 - zeta_ * DT;
     }
 
-    void Ar_moleculardynamics::periodic()
+    void Ar_moleculardynamics::pairRow(SystemParam::myatomvector const & atoms, std::int32_t i, PairList::myindexvector & buffer) const
     {
-        // consider the periodic boundary condination
-        // セルの外側に出たら座標をセル内に戻す
-        for (auto && atom : atoms_) {
-            if (atom.r[0] > periodiclen_) {
-                atom.r[0] -= periodiclen_;
-            }
-            else if (atom.r[0] < 0.0) {
-                atom.r[0] += periodiclen_;
-            }
+        auto const rx = atoms.rx.data(), ry = atoms.ry.data(), rz = atoms.rz.data();
+        auto const L = static_cast<real>(periodiclen_);
+        auto const LH = static_cast<real>(periodiclen_ * 0.5);
+        auto const ml2 = (potential_.rc + skin_) * (potential_.rc + skin_);
+        auto const xi = rx[i], yi = ry[i], zi = rz[i];
 
-            if (atom.r[1] > periodiclen_) {
-                atom.r[1] -= periodiclen_;
-            }
-            else if (atom.r[1] < 0.0) {
-                atom.r[1] += periodiclen_;
+        std::array<std::uint8_t, Ar_moleculardynamics::PAIRBLOCKSIZE> inside;
+
+        for (auto first = i + 1; first < NumAtom_; first += Ar_moleculardynamics::PAIRBLOCKSIZE) {
+            auto const n = std::min(Ar_moleculardynamics::PAIRBLOCKSIZE, NumAtom_ - first);
+
+            // 周期境界条件の補正（SystemParam::adjust_periodic()と同じ結果になる）を分岐なしで書いて、ベクトル化させる
+            for (auto k = 0; k < n; k++) {
+                auto dx = rx[first + k] - xi;
+                auto dy = ry[first + k] - yi;
+                auto dz = rz[first + k] - zi;
+
+                dx += (dx < -LH ? L : real(0)) - (dx > LH ? L : real(0));
+                dy += (dy < -LH ? L : real(0)) - (dy > LH ? L : real(0));
+                dz += (dz < -LH ? L : real(0)) - (dz > LH ? L : real(0));
+
+                // ペアリストにはマージンの分まで含めておかないと、寿命の間にカットオフに入ってきたペアを取りこぼす
+                inside[k] = dx * dx + dy * dy + dz * dz <= ml2;
             }
 
-            if (atom.r[2] > periodiclen_) {
-                atom.r[2] -= periodiclen_;
+            // 判定の結果で書き込み位置を進めるだけにして、分岐をなくす
+            auto const size = buffer.size();
+            buffer.resize(size + n);
+
+            auto const row = buffer.data() + size;
+            auto count = 0;
+            for (auto k = 0; k < n; k++) {
+                row[count] = first + k;
+                count += inside[k];
             }
-            else if (atom.r[2] < 0.0) {
-                atom.r[2] += periodiclen_;
+
+            buffer.resize(size + count);
+        }
+    }
+
+    void Ar_moleculardynamics::rebuildPairlist()
+    {
+        if (cellPair()) {
+            // 番地の組から計算するときはペアリストを使わないので、メモリを解放して原子の振り分けだけを行う
+            PairList().swap(pairs_);
+            PairList().swap(pendingpairs_);
+            pmesh_->bin(atoms_);
+        }
+        else if (pmesh_) {
+            // 空間的に近い原子がメモリ上でも近くに並ぶようにして、力の計算のキャッシュミスを減らす
+            if (reorder_ != ReorderType::NONE) {
+                pmesh_->sort_atoms(atoms_, order_, reorder_ == ReorderType::MORTON);
+                atoms_.permute(order_);
             }
+
+            pmesh_->make_pair(atoms_, pairs_);
+        }
+        else {
+            makePair(atoms_, pairs_);
+        }
+
+        if (pairlistformat_ == PairListFormat::DELTA16 && !cellPair()) {
+            pairs_.compress();
         }
+
+        // 変位の基準となる座標を記録する（並べ替えの後なので、配列のインデックスがそのまま対応する）
+        rx0_ = atoms_.rx;
+        ry0_ = atoms_.ry;
+        rz0_ = atoms_.rz;
+        dispmax_ = 0.0;
+        listskin_ = skin_;
     }
 
-    void Ar_moleculardynamics::Woodcock_velocity_scaling()
+    void Ar_moleculardynamics::resetMesh()
     {
-        auto const s = std::sqrt((Tg_ + Ar_moleculardynamics::ALPHA * (Tc_ - Tg_)) / Tc_);
+        // 小さな箱では番地を細かくしてメッシュリストを作り、それでも作れなければすべての組を調べる
+        // （番地の組から直接計算するときは、マージンは要らない）
+        auto const margin = forcemethod_ == ForceMethod::CELLPAIR ? 0.0 : skin_;
+        if (MeshList::divisions(periodiclen_, potential_.rc, margin)) {
+            pmesh_.reset(new MeshList(periodiclen_, potential_.rc, margin, forcemethod_ == ForceMethod::CELLPAIR));
+            pmesh_->set_number_of_atoms(atoms_.size());
+        }
+        else {
+            pmesh_.reset();
+        }
+    }
 
-        for (auto && atom : atoms_) {
-            atom.p *= s;
+    void Ar_moleculardynamics::resizeForceBuffers(std::int32_t chunks)
+    {
+        auto const N = static_cast<std::size_t>(NumAtom_);
+
+        forcebuffers_.resize(static_cast<std::size_t>(chunks));
+        for (auto & buf : forcebuffers_) {
+            if (buf.fx.size() != N) {
+                buf.fx.assign(N, 0.0);
+                buf.fy.assign(N, 0.0);
+                buf.fz.assign(N, 0.0);
+            }
         }
     }
 
+    template <bool Noise, bool Wrap>
+    Ar_moleculardynamics::SweepResult Ar_moleculardynamics::sweep(double s, std::uint64_t counter)
+    {
+        // 2つの部分的な結果をまとめる（変位は、両者の大きい方から2つを残す）
+        auto const merge = [](SweepResult lhs, SweepResult const & rhs) {
+            lhs.p2 += rhs.p2;
+            lhs.p2max = rhs.p2max > lhs.p2max ? rhs.p2max : lhs.p2max;
+
+            auto const lo = rhs.d2max1 > lhs.d2max1 ? lhs.d2max1 : rhs.d2max1;
+            auto const second = rhs.d2max2 > lhs.d2max2 ? rhs.d2max2 : lhs.d2max2;
+            lhs.d2max1 = rhs.d2max1 > lhs.d2max1 ? rhs.d2max1 : lhs.d2max1;
+            lhs.d2max2 = second > lo ? second : lo;
+
+            return lhs;
+        };
+
+        return tbb::parallel_deterministic_reduce(
+            tbb::blocked_range<std::int32_t>(0, NumAtom_, SystemParam::ATOMGRAINSIZE),
+            SweepResult(),
+            [this, s, counter, &merge](tbb::blocked_range<std::int32_t> const & range, SweepResult res) {
+                auto const px = atoms_.px.data(), py = atoms_.py.data(), pz = atoms_.pz.data();
+                auto const rx = atoms_.rx.data(), ry = atoms_.ry.data(), rz = atoms_.rz.data();
+                auto const id = atoms_.id.data();
+                auto const rx0 = rx0_.data(), ry0 = ry0_.data(), rz0 = rz0_.data();
+
+                auto const key = myrandom::Philox::make_key(seed_);
+                auto const c1 = static_cast<std::uint32_t>(counter);
+                auto const c2 = static_cast<std::uint32_t>(counter >> 32);
+                auto const sdt = sigma_ * DT;
+
+                // 揺動力の標準正規乱数は、NORMALBLOCKSIZE個の原子ごとにまとめてSIMD命令で作る
+                auto constexpr B = Ar_moleculardynamics::NORMALBLOCKSIZE;
+                auto const normal = forcekernel::get_normal(simd_);
+                alignas(64) std::uint32_t bits[4 * B];
+                alignas(64) double g[4 * B];
+
+                auto const sr = static_cast<real>(s);
+                auto const hdt = static_cast<real>(DT * 0.5);
+                auto const L = static_cast<real>(periodiclen_);
+
+                accum p2 = 0;
+                real p2max = 0;
+                real d2max1 = 0, d2max2 = 0;
+
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    auto x = px[n] * sr;
+                    auto y = py[n] * sr;
+                    auto z = pz[n] * sr;
+
+                    if (Noise) {
+                        auto const m = (n - range.begin()) % B;
+                        if (!m) {
+                            // 揺動力は（シード, ステップ, 原子のID）だけで決まるので、スレッド数や原子の並び順によらない
+                            // （ブロックの端数の組も同じ関数で作るので、原子がブロックのどこにあっても同じ値になる）
+                            for (auto k = 0; k < B; k++) {
+                                bits[k] = n + k < range.end() ? static_cast<std::uint32_t>(id[n + k]) : 0U;
+                                bits[B + k] = c1;
+                                bits[2 * B + k] = c2;
+                                bits[3 * B + k] = Ar_moleculardynamics::STREAM_LANGEVIN;
+                            }
+
+                            myrandom::Philox::generate<B>(bits, key);
+                            normal(bits, B, g);
+                        }
+
+                        x += static_cast<real>(g[m] * sdt);
+                        y += static_cast<real>(g[B + m] * sdt);
+                        z += static_cast<real>(g[2 * B + m] * sdt);
+                    }
+
+                    px[n] = x;
+                    py[n] = y;
+                    pz[n] = z;
+
+                    auto const v2 = x * x + y * y + z * z;
+                    p2 += static_cast<accum>(v2);
+                    p2max = v2 > p2max ? v2 : p2max;
+
+                    auto xn = rx[n] + x * hdt;
+                    auto yn = ry[n] + y * hdt;
+                    auto zn = rz[n] + z * hdt;
+
+                    // consider the periodic boundary condination
+                    // セルの外側に出たら座標をセル内に戻す
+                    if (Wrap) {
+                        xn = xn > L ? xn - L : (xn < 0 ? xn + L : xn);
+                        yn = yn > L ? yn - L : (yn < 0 ? yn + L : yn);
+                        zn = zn > L ? zn - L : (zn < 0 ? zn + L : zn);
+                    }
+                    else {
+                        // ペアリストを作ったときからの変位（周期境界条件を考慮する）
+                        auto dx = xn - rx0[n];
+                        auto dy = yn - ry0[n];
+                        auto dz = zn - rz0[n];
+                        SystemParam::adjust_periodic(dx, periodiclen_);
+                        SystemParam::adjust_periodic(dy, periodiclen_);
+                        SystemParam::adjust_periodic(dz, periodiclen_);
+
+                        auto const d2 = dx * dx + dy * dy + dz * dz;
+                        if (d2 > d2max2) {
+                            d2max2 = d2 > d2max1 ? d2max1 : d2;
+                            d2max1 = d2 > d2max1 ? d2 : d2max1;
+                        }
+                    }
+
+                    rx[n] = xn;
+                    ry[n] = yn;
+                    rz[n] = zn;
+                }
+
+                return merge(res, SweepResult{ p2, p2max, d2max1, d2max2 });
+            },
+            merge);
+    }
+
+    void Ar_moleculardynamics::startRebuild()
+    {
+        BOOST_ASSERT(!pending_.valid());
+
+        // 別のスレッドは座標の写しだけを読むので、その間もこのスレッドは原子を動かし続けられる
+        pendingatoms_.rx = atoms_.rx;
+        pendingatoms_.ry = atoms_.ry;
+        pendingatoms_.rz = atoms_.rz;
+
+        pending_ = std::async(std::launch::async, [this] {
+            order_.clear();
+
+            if (pmesh_) {
+                // 並べ替えは写しにだけ行い、原子はペアリストを入れ替えるときに同じ順序に並べ替える
+                if (reorder_ != ReorderType::NONE) {
+                    pmesh_->sort_atoms(pendingatoms_, order_, reorder_ == ReorderType::MORTON);
+
+                    for (auto v : { &pendingatoms_.rx, &pendingatoms_.ry, &pendingatoms_.rz }) {
+                        AtomArray::myvector sorted(v->size());
+                        for (auto k = 0U; k < sorted.size(); k++) {
+                            sorted[k] = (*v)[order_[k]];
+                        }
+
+                        v->swap(sorted);
+                    }
+                }
+
+                pmesh_->make_pair(pendingatoms_, pendingpairs_);
+            }
+            else {
+                makePair(pendingatoms_, pendingpairs_);
+            }
+
+            if (pairlistformat_ == PairListFormat::DELTA16) {
+                pendingpairs_.compress();
+            }
+        });
+    }
+
+    double Ar_moleculardynamics::Woodcock_velocity_scaling()
+    {
+        return std::sqrt((Tg_ + Ar_moleculardynamics::ALPHA * (Tc_ - Tg_)) / Tc_);
+    }
+
     // #endregion privateメンバ関数
 }
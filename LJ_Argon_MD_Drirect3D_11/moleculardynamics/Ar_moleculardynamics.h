@@ -11,10 +11,18 @@
 #pragma once
 
 #include "utility/property.h"
+#include "forcekernel.h"
 #include "meshlist.h"
+#include "pairlist.h"
+#include "potential.h"
+#include "profiler.h"
+#include "skintuner.h"
 #include "systemparam.h"
-#include <cstdint>                  // for std::int32_t
+#include <cstdint>                  // for std::int32_t, std::uint64_t
+#include <future>                   // for std::future
 #include <memory>                   // for std::unique_ptr
+#include <vector>                   // for std::vector
+#include <tbb/enumerable_thread_specific.h>     // for tbb::enumerable_thread_specific
 
 namespace moleculardynamics {
     using namespace utility;
@@ -31,6 +39,57 @@ namespace moleculardynamics {
         NVT = 1
     };
 
+    //! A enum.
+    /*!
+        原子に働く力を計算するエンジンの列挙型
+    */
+    enum class ForceEngine : std::int32_t {
+        // 逐次計算
+        SERIAL = 0,
+
+        // 行（番地）の区間ごとの力の配列に並列に足し込み、最後に区間の順に集計する（結果はスレッド数によらない）
+        PARALLEL = 1
+    };
+
+    //! A enum.
+    /*!
+        原子に働く力を計算するときの、相手の原子の探し方の列挙型
+    */
+    enum class ForceMethod : std::int32_t {
+        // ペアリストを作り、マージンを使い切るまで使い回す
+        PAIRLIST = 0,
+
+        // 毎ステップ原子を番地に振り分け、隣接する番地の組から直接力を計算する（ペアリストを作らない）
+        CELLPAIR = 1
+    };
+
+    //! A enum.
+    /*!
+        ペアリストを作り直すかどうかの判定方法の列挙型
+    */
+    enum class RebuildCriterion : std::int32_t {
+        // 最も速い原子の速さから、毎ステップ最悪の場合の移動距離をマージンから差し引く
+        VELOCITY = 0,
+
+        // ペアリストを作ったときからの変位が最も大きい2つの原子について、変位の和がマージンを超えたら作り直す
+        DISPLACEMENT = 1
+    };
+
+    //! A enum.
+    /*!
+        ペアリストを作り直すときの原子の並べ替えの方法の列挙型
+    */
+    enum class ReorderType : std::int32_t {
+        // 並べ替えない
+        NONE = 0,
+
+        // 番地番号の順に並べ替える
+        CELL = 1,
+
+        // 番地をMorton順（Z曲線の順）にたどって並べ替える
+        MORTON = 2
+    };
+
     //! A enum.
     /*!
         温度制御の方法の列挙型
@@ -62,14 +121,22 @@ namespace moleculardynamics {
 
         //! A destructor.
         /*!
-            デフォルトデストラクタ
+            デストラクタ（非同期のペアリストの作り直しが終わるのを待つ）
         */
-        ~Ar_moleculardynamics() = default;
+        ~Ar_moleculardynamics();
 
         // #endregion コンストラクタ・デストラクタ
 
         // #region publicメンバ関数
 
+        //! A public member function.
+        /*!
+            レプリカ交換で、温度を入れ替える
+            recalc()を行わずに、運動量（とNose-Hoover法の変数）を新しい温度に合わせてスケールする
+            \param Tgiven 新しい温度（絶対温度）
+        */
+        void exchangeTgiven(double Tgiven);
+
         //! A public member function (constant).
         /*!
             シミュレーションを開始してからの経過時間を求める
@@ -82,6 +149,13 @@ namespace moleculardynamics {
         */
         float getForce(std::int32_t n) const;
 
+        //! A public member function (constant).
+        /*!
+            実際に用いている、原子に働く力を計算するときの相手の原子の探し方を求める
+            （番地の組を指定しても、番地を作れない小さな箱ではペアリストになる）
+        */
+        ForceMethod getForceMethod() const;
+
         //! A public member function (constant).
         /*!
             格子定数を求める
@@ -96,9 +170,46 @@ namespace moleculardynamics {
 
         //! A public member function (constant).
         /*!
-            計算された圧力を求める
+            力の計算に用いているポテンシャルの表を求める（解析的な式で計算しているときはnullptr）
         */
-        double getPressure();
+        PotentialTable const * getPotentialTable() const;
+
+        //! A public member function (constant).
+        /*!
+            計算された圧力を求める（最後にエネルギーを計算したステップのビリアルを用いる）
+        */
+        double getPressure() const;
+
+        //! A public member function (constant).
+        /*!
+            初期状態を作ってからペアリストを作り直した回数を求める
+        */
+        std::int32_t getRebuilds() const;
+
+        //! A public member function (constant).
+        /*!
+            ペアリストやメッシュリストに関するカウンタを求める
+        */
+        PerfCounters getCounters() const;
+
+        //! A public member function (constant).
+        /*!
+            runCalc()の段階ごとの経過時間の計測結果を求める
+            MOLECULARDYNAMICS_DISABLE_PROFILEを定義してビルドしたときは、何も計測されない
+        */
+        Profiler const & getProfiler() const;
+
+        //! A public member function (constant).
+        /*!
+            力の計算に用いているSIMD命令セットを求める
+        */
+        SimdType getSimd() const;
+
+        //! A public member function (constant).
+        /*!
+            ペアリストのマージン（Verletのスキン）を求める
+        */
+        double getSkin() const;
 
         //! A public member function (constant).
         /*!
@@ -118,12 +229,34 @@ namespace moleculardynamics {
         */
         void recalc();
 
+        //! A public member function.
+        /*!
+            runCalc()の段階ごとの経過時間の計測結果とタイムラインを消去する
+        */
+        void resetProfiler();
+
         //! A oublic member function.
         /*!
             MDを1ステップ計算する
         */
         void runCalc();
 
+        //! A public member function.
+        /*!
+            ペアリストの作り直しを、力の計算と重ねて非同期に行うかどうかを設定する
+            非同期に作り直すときは、マージンを半分消費した時点の座標の写しから、新しいペアリストを
+            別のスレッドで作り始め、できあがるまでは今のペアリストで計算を続ける
+            \param asyncrebuild 非同期に作り直すならtrue
+        */
+        void setAsyncRebuild(bool asyncrebuild);
+
+        //! A public member function.
+        /*!
+            ポテンシャルエネルギーとビリアルを、何ステップごとに力と同時に計算するかを設定する
+            \param interval 計算の間隔（ステップ数）
+        */
+        void setEnergyInterval(std::int32_t interval);
+
         //! A public member function.
         /*!
             アンサンブルを設定する
@@ -131,6 +264,21 @@ namespace moleculardynamics {
         */
         void setEnsemble(EnsembleType ensemble);
 
+        //! A public member function.
+        /*!
+            原子に働く力を計算するエンジンを設定する
+            \param forceengine 原子に働く力を計算するエンジン
+        */
+        void setForceEngine(ForceEngine forceengine);
+
+        //! A public member function.
+        /*!
+            原子に働く力を計算するときの、相手の原子の探し方を設定する
+            （CELLPAIRでも、箱が小さすぎて番地を作れなければペアリストを用いる）
+            \param forcemethod 相手の原子の探し方
+        */
+        void setForceMethod(ForceMethod forcemethod);
+
         //! A public member function.
         /*!
             スーパーセルの大きさを設定する
@@ -138,6 +286,43 @@ namespace moleculardynamics {
         */
         void setNc(std::int32_t Nc);
 
+        //! A public member function.
+        /*!
+            ペアリストの格納形式を設定する（ペアリストはすぐに作り直す）
+            \param format ペアリストの格納形式
+        */
+        void setPairListFormat(PairListFormat format);
+
+        //! A public member function.
+        /*!
+            原子の組の間に働くポテンシャルを設定する（初期状態から計算し直す）
+            \param potential ポテンシャルの種類と係数
+        */
+        void setPotential(PotentialParam const & potential);
+
+        //! A public member function.
+        /*!
+            原子の組の間に働くポテンシャルを、距離の2乗で引く表から補間するように設定する
+            （setPotential()で設定したポテンシャルから表を作り、カットオフ半径はそのまま用いる）
+            \param interpolation 補間の方法（PotentialType::LINEARTABLEかPotentialType::CUBICTABLE、それ以外なら表を用いない）
+            \param size 表の区間の数
+        */
+        void setPotentialTable(PotentialType interpolation, std::int32_t size);
+
+        //! A public member function.
+        /*!
+            ペアリストを作り直すかどうかの判定方法を設定する
+            \param rebuildcriterion ペアリストを作り直すかどうかの判定方法
+        */
+        void setRebuildCriterion(RebuildCriterion rebuildcriterion);
+
+        //! A public member function.
+        /*!
+            ペアリストを作り直すときの原子の並べ替えの方法を設定する
+            \param reorder 原子の並べ替えの方法
+        */
+        void setReorder(ReorderType reorder);
+
         //! A public member function.
         /*!
             格子定数のスケールを設定する
@@ -145,6 +330,35 @@ namespace moleculardynamics {
         */
         void setScale(double scale);
 
+        //! A public member function.
+        /*!
+            乱数（初期速度とLangevin法の揺動力）のシードを設定し、初期状態を作り直す
+            同じシードを与えれば、スレッド数によらず同じ乱数列が得られる
+            \param seed 乱数のシード
+        */
+        void setSeed(std::uint64_t seed);
+
+        //! A public member function.
+        /*!
+            力の計算に用いるSIMD命令セットを設定する（CPUが対応していなければ、使用できるものに切り下げる）
+            \param simd SIMD命令セット
+        */
+        void setSimd(SimdType simd);
+
+        //! A public member function.
+        /*!
+            ペアリストのマージン（Verletのスキン）を固定し、自動調整を止める
+            \param skin マージン（無次元単位）
+        */
+        void setSkin(double skin);
+
+        //! A public member function.
+        /*!
+            ペアリストのマージンを、1ステップあたりの経過時間が最小になるように自動調整するかどうかを設定する
+            \param autotune 自動調整するならtrue
+        */
+        void setSkinAutoTune(bool autotune);
+
         //! A public member function.
         /*!
             温度制御の方法を設定する
@@ -159,11 +373,74 @@ namespace moleculardynamics {
         */
         void setTgiven(double Tgiven);
 
+        //! A public member function.
+        /*!
+            runCalc()の段階ごとのタイムラインを記録するかどうかを設定する
+            \param tracing タイムラインを記録するならtrue
+        */
+        void setTracing(bool tracing);
+
         // #endregion publicメンバ関数
 
-        // #region privateメンバ関数
+        // #region フレンドクラス
+
+        //! A friend class.
+        /*!
+            領域分割で複数のプロセスに分けて計算するクラス（物理定数と温度制御の定数を共有する）
+        */
+        friend class Ar_moleculardynamics_mpi;
+
+        //! A friend class.
+        /*!
+            privateメンバ関数の経過時間を個別に計測するベンチマーク（moleculardynamics_bench）
+        */
+        friend class Benchmark;
+
+        //! A friend class.
+        /*!
+            レプリカ交換を行うクラス（交換の判定に、無次元単位の温度とポテンシャルエネルギーを用いる）
+        */
+        friend class ReplicaExchange;
+
+        // #endregion フレンドクラス
+
+        // #region 内部クラス
 
     private:
+        //! A struct.
+        /*!
+            sweep()で求める、運動量の2乗の和と最大値、および変位の2乗の大きい方から2つ
+        */
+        struct SweepResult {
+            //! A public member variable.
+            /*!
+                運動量の2乗の和
+            */
+            accum p2 = 0;
+
+            //! A public member variable.
+            /*!
+                運動量の2乗の最大値
+            */
+            real p2max = 0;
+
+            //! A public member variable.
+            /*!
+                ペアリストを作ったときからの変位の2乗の最大値
+            */
+            real d2max1 = 0;
+
+            //! A public member variable.
+            /*!
+                ペアリストを作ったときからの変位の2乗の、2番目に大きい値
+            */
+            real d2max2 = 0;
+        };
+
+        // #endregion 内部クラス
+
+        // #region privateメンバ関数
+
         //! A private member function.
         /*!
             エネルギーの単位を無次元単位からHartreeに変換する
@@ -175,29 +452,111 @@ namespace moleculardynamics {
             return e * Ar_moleculardynamics::YPSILON / Ar_moleculardynamics::HARTREE;
         }
         
+        //! A private member function (constant).
+        /*!
+            番地の[first, last)にいる原子について、番地の組から直接、原子に働く力を足し込む
+            \param first 最初の番地
+            \param last 最後の番地の次
+            \param fx 番地の順に並べた原子に働く力のx成分の足し込み先
+            \param fy 番地の順に並べた原子に働く力のy成分の足し込み先
+            \param fz 番地の順に並べた原子に働く力のz成分の足し込み先
+            \param energy ポテンシャルエネルギーとビリアルの足し込み先（nullptrなら計算しない）
+        */
+        void calcForceCells(std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const;
+
         //! A private member function.
         /*!
             原子に働く力を計算する
         */
         void calcForcePair();
 
+        //! A private member function.
+        /*!
+            原子に働く力を並列に計算する
+            \param energy ポテンシャルエネルギーとビリアルの足し込み先（nullptrなら計算しない）
+        */
+        void calcForcePairParallel(ForceKernelEnergy * energy);
+
+        //! A private member function.
+        /*!
+            原子に働く力を逐次計算する
+            \param energy ポテンシャルエネルギーとビリアルの足し込み先（nullptrなら計算しない）
+        */
+        void calcForcePairSerial(ForceKernelEnergy * energy);
+
+        //! A private member function (constant).
+        /*!
+            ペアリストの[first, last)の行について、原子に働く力を足し込む
+            \param first 最初の行（原子）のインデックス
+            \param last 最後の行（原子）の次のインデックス
+            \param fx 原子に働く力のx成分の足し込み先
+            \param fy 原子に働く力のy成分の足し込み先
+            \param fz 原子に働く力のz成分の足し込み先
+            \param energy ポテンシャルエネルギーとビリアルの足し込み先（nullptrなら計算しない）
+        */
+        void calcForceRows(std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const;
+
+        //! A private member function.
+        /*!
+            非同期のペアリストの作り直しが進行中なら、終わるのを待って結果を捨てる
+        */
+        void cancelRebuild();
+
+        //! A private member function (constant).
+        /*!
+            ペアリストを作らずに、番地の組から直接力を計算しているかどうかを返す
+            \return 番地の組から直接力を計算していればtrue
+        */
+        bool cellPair() const;
+
         //! A private member function.
         /*!
             ペアリストの寿命をチェックする
         */
         void checkPairlist();
+
+        //! A private member function (constant).
+        /*!
+            座標の写しを取ったときからの変位の最大値を求める
+            \param rx0 座標の写しのx成分
+            \param ry0 座標の写しのy成分
+            \param rz0 座標の写しのz成分
+            \return 変位の最大値
+        */
+        double displacement(AtomArray::myvector const & rx0, AtomArray::myvector const & ry0, AtomArray::myvector const & rz0) const;
+
+        //! A private member function.
+        /*!
+            非同期に作り直したペアリストを受け取り、今のペアリストと入れ替える
+            作り直しに用いた座標からの変位がマージンを超えていたら、新しいペアリストには漏れがあるかもしれないので入れ替えない
+            \return 入れ替えたらtrue
+        */
+        bool finishRebuild();
                 
         //! A private member function.
         /*!
-            Langevin法
+            原子に働く力で運動量を更新する
+            \param first 更新する最初の原子のインデックス
+            \param last 更新する最後の原子の次のインデックス
+            \return 更新後の運動量の2乗の和
+        */
+        accum kick(std::int32_t first, std::int32_t last);
+
+        //! A private member function.
+        /*!
+            Langevin法（揺動力の標準偏差をsigma_に設定する）
+            \return 運動量に掛ける減衰の係数
         */
-        void Langevin();
+        double Langevin();
 
         //! A private member function.
         /*!
-            ペアリストを構築する
+            メッシュリストを作れない小さな箱で、すべての組を調べてペアリストを構築する
+            （行ごとに並列化し、ブロックごとに距離の判定をベクトル化する）
+            \param atoms 原子の座標が格納された可変長配列
+            \param pairs 構築したペアリスト
         */
-        void makePair();
+        void makePair(SystemParam::myatomvector const & atoms, PairList & pairs);
 
         //! A private member function.
         /*!
@@ -219,27 +578,71 @@ namespace moleculardynamics {
 
         //! A privte member function.
         /*!
-            原子を移動させる
+            温度制御を行い、原子を半ステップ分移動させる
+            \param second ステップの後半かどうか（後半なら、移動後に周期境界条件を用いて原子の位置を補正する）
         */
-        void moveAtoms();
+        void moveAtoms(bool second);
 
         //! A privte member function.
         /*!
             Nose-Hoover法
+            \return 運動量に掛けるスケーリングの係数
         */
-        void NoseHoover();
+        double NoseHoover();
+
+        //! A private member function (constant).
+        /*!
+            すべての組を調べて、原子iのペアリストの行を求める
+            \param atoms 原子の座標が格納された可変長配列
+            \param i 原子のインデックス
+            \param buffer 相手の原子を末尾に追加するバッファ
+        */
+        void pairRow(SystemParam::myatomvector const & atoms, std::int32_t i, PairList::myindexvector & buffer) const;
+
+        //! A private member function.
+        /*!
+            必要なら原子を空間的に近い順に並べ替えてから、ペアリストを作り直す
+        */
+        void rebuildPairlist();
 
         //! A private member function.
         /*!
-            周期境界条件を用いて、原子の位置を補正する
+            現在のマージンに合わせて、メッシュリストを作り直す
         */
-        void periodic();
+        void resetMesh();
+
+        //! A private member function.
+        /*!
+            力を足し込むバッファの個数を合わせ、要素数が原子数と異なるバッファは0で初期化する
+            （バッファは力の集計で読んだときに0に戻すので、それ以外のときは初期化しない）
+            \param chunks バッファの個数
+        */
+        void resizeForceBuffers(std::int32_t chunks);
+
+        //! A private member function (template function).
+        /*!
+            運動量のスケーリング、揺動力の加算、座標の移動、周期境界条件の補正を1回のループで行う
+            \tparam Noise 揺動力を加えるかどうか
+            \tparam Wrap 周期境界条件の補正を行うかどうか（行わないステップの前半では、代わりにペアリストを作ったときからの変位を調べる）
+            \param s 運動量に掛けるスケーリングの係数
+            \param counter 揺動力の乱数のカウンタ
+            \return 更新後の運動量の2乗の和と最大値、および変位の2乗の大きい方から2つ
+        */
+        template <bool Noise, bool Wrap>
+        SweepResult sweep(double s, std::uint64_t counter);
         
+        //! A private member function.
+        /*!
+            現在の座標の写しを取り、別のスレッドでペアリストの作り直しを始める
+        */
+        void startRebuild();
+
         //! A private member function.
         /*!
             Woodcockの速度スケーリング法
+            \return 運動量に掛けるスケーリングの係数
         */
-        void Woodcock_velocity_scaling();
+        double Woodcock_velocity_scaling();
 
         // #endregion privateメンバ関数
 
@@ -334,6 +737,36 @@ namespace moleculardynamics {
         // #region privateメンバ変数
 
     private:
+        //! A struct.
+        /*!
+            行（番地）の区間ごとに原子に働く力を足し込むためのバッファ
+        */
+        struct ForceBuffer {
+            //! A public member variable.
+            /*!
+                原子に働く力のx成分
+            */
+            AtomArray::myvector fx;
+
+            //! A public member variable.
+            /*!
+                原子に働く力のy成分
+            */
+            AtomArray::myvector fy;
+
+            //! A public member variable.
+            /*!
+                原子に働く力のz成分
+            */
+            AtomArray::myvector fz;
+
+            //! A public member variable.
+            /*!
+                ポテンシャルエネルギーとビリアルの和
+            */
+            ForceKernelEnergy energy;
+        };
+
         //! A private member variable (static constant).
         /*!
             Woodcockの温度スケーリングの係数
@@ -346,6 +779,12 @@ namespace moleculardynamics {
         */
         static auto constexpr ATM = 9.86923266716013E-6;
 
+        //! A private member variable (static constant).
+        /*!
+            ペアリストを非同期に作り直すときに、作り直しを始めるマージンの消費の割合
+        */
+        static auto constexpr ASYNCTRIGGER = 0.5;
+
         //! A private member variable (static constant).
         /*!
             アボガドロ定数
@@ -376,6 +815,42 @@ namespace moleculardynamics {
         */
         static auto constexpr KB = 1.3806488E-23;
 
+        //! A private member variable (static constant).
+        /*!
+            揺動力の標準正規乱数をまとめて作る原子の数（8の倍数）
+        */
+        static auto constexpr NORMALBLOCKSIZE = 64;
+
+        //! A private member variable (static constant).
+        /*!
+            すべての組を調べるときに、距離の判定をまとめて行う相手の原子の数
+        */
+        static auto constexpr PAIRBLOCKSIZE = 256;
+
+        //! A private member variable (static constant).
+        /*!
+            すべての組を調べるときに、原子のループを並列化する粒度
+        */
+        static auto constexpr PAIRGRAINSIZE = 16;
+
+        //! A private member variable (static constant).
+        /*!
+            初期速度の乱数のストリーム番号（Philoxのカウンタの4番目の要素）
+        */
+        static std::uint32_t constexpr STREAM_INITVEL = 1U;
+
+        //! A private member variable (static constant).
+        /*!
+            レプリカ交換の判定の乱数のストリーム番号（Philoxのカウンタの4番目の要素）
+        */
+        static std::uint32_t constexpr STREAM_EXCHANGE = 2U;
+
+        //! A private member variable (static constant).
+        /*!
+            Langevin法の揺動力の乱数のストリーム番号（Philoxのカウンタの4番目の要素）
+        */
+        static std::uint32_t constexpr STREAM_LANGEVIN = 0U;
+
 		//! A private member variable (static constant).
 		/*!
 			Nose-Hoover法の自由パラメータ
@@ -400,29 +875,83 @@ namespace moleculardynamics {
         */
         std::int32_t Nc_ = Ar_moleculardynamics::FIRSTNC;
 
+        //! A private member variable.
+        /*!
+            非同期のペアリストの作り直しが間に合わないか、安全の確認に失敗して、同期的に作り直した回数
+        */
+        std::int32_t asyncfallbacks_ = 0;
+
+        //! A private member variable.
+        /*!
+            ペアリストの作り直しを非同期に行うかどうか
+        */
+        bool asyncrebuild_ = false;
+
         //! A private member variable.
         /*!
             原子の可変長配列
         */
         SystemParam::myatomvector atoms_;
 
+        //! A private member variable.
+        /*!
+            ポテンシャルエネルギーとビリアルを計算する間隔（ステップ数）
+        */
+        std::int32_t energyinterval_ = 1;
+
         //! A private member variable.
         /*!
             アンサンブル
         */
         EnsembleType ensemble_ = EnsembleType::NVT;
 
+        //! A private member variable.
+        /*!
+            行（番地）の区間ごとに原子に働く力を足し込むためのバッファ
+        */
+        std::vector<ForceBuffer> forcebuffers_;
+
+        //! A private member variable.
+        /*!
+            原子に働く力を計算するエンジン
+        */
+        ForceEngine forceengine_ = ForceEngine::PARALLEL;
+
+        //! A private member variable.
+        /*!
+            原子に働く力を計算するときの、相手の原子の探し方
+        */
+        ForceMethod forcemethod_ = ForceMethod::PAIRLIST;
+
         //! A private member variable.
         /*!
             格子定数
         */
         double lat_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作り直したときのMDのステップ数
+        */
+        std::int32_t lastrebuild_ = 0;
+
+        //! A private member variable.
+        /*!
+            直前に運動量を更新したループで求めた運動エネルギー
+        */
+        double kinetic_ = 0.0;
         
         //! A private member variable.
         /*!
-            一辺のメッシュの数
+            ペアリストのマージンを自動調整するかどうか（経過時間で決まるので、既定では行わない）
         */
-        std::int32_t m_;
+        bool autoskin_ = false;
+
+        //! A private member variable.
+        /*!
+            今のペアリストを作ったときのマージン（非同期に作り直すときは、次のペアリストのマージンskin_と異なることがある）
+        */
+        double listskin_ = SystemParam::MARGIN;
 
         //! A private member variable.
         /*!
@@ -454,11 +983,47 @@ namespace moleculardynamics {
         */
         std::int32_t NumAtom_;
 
+        //! A private member variable.
+        /*!
+            原子の並べ替えの順序
+        */
+        AtomArray::myindexvector order_;
+
+        //! A private member variable.
+        /*!
+            すべての組を調べるときに、原子ごとに相手の原子を一時的に格納する、スレッドごとのバッファ
+        */
+        tbb::enumerable_thread_specific<PairList::myindexvector> pairbuffers_;
+
+        //! A private member variable.
+        /*!
+            ペアリストの格納形式
+        */
+        PairListFormat pairlistformat_ = PairListFormat::INDEX32;
+
         //! A private member variable.
         /*!
             ペアリスト
         */
-        SystemParam::mypairvector pairs_;
+        PairList pairs_;
+
+        //! A private member variable.
+        /*!
+            非同期のペアリストの作り直しの完了を待つためのfuture（作り直していなければ無効）
+        */
+        std::future<void> pending_;
+
+        //! A private member variable.
+        /*!
+            非同期にペアリストを作り直すときの座標の写し（座標の成分だけを持つ）
+        */
+        SystemParam::myatomvector pendingatoms_{ 0 };
+
+        //! A private member variable.
+        /*!
+            非同期に作り直しているペアリスト
+        */
+        PairList pendingpairs_;
         
         //! A private member variable.
         /*!
@@ -472,23 +1037,83 @@ namespace moleculardynamics {
         */
         double periodiclen_;
 
-        //! A private member variable (constant).
+        //! A private member variable.
         /*!
-            カットオフ半径の2乗
+            原子の組の間に働くポテンシャルの種類と係数
         */
-        double const rc2_;
+        PotentialParam potential_;
 
-        //! A private member variable (constant).
+        //! A private member variable.
         /*!
-            カットオフ半径の逆数の6乗
+            ポテンシャルの表（解析的な式で計算するときはnullptr）
         */
-        double const rcm6_;
+        std::unique_ptr<PotentialTable> potentialtable_;
 
-        //! A private member variable (constant).
+        //! A private member variable.
+        /*!
+            runCalc()の段階ごとの経過時間の計測
+        */
+        Profiler profiler_;
+
+        //! A private member variable.
+        /*!
+            ペアリストを作り直すかどうかの判定方法
+        */
+        RebuildCriterion rebuildcriterion_ = RebuildCriterion::DISPLACEMENT;
+
+        //! A private member variable.
+        /*!
+            初期状態を作ってからペアリストを作り直した回数
+        */
+        std::int32_t rebuilds_ = 0;
+
+        //! A private member variable.
+        /*!
+            直前の2回のペアリストの作り直しの間隔（ステップ数）
+        */
+        std::int32_t rebuildinterval_ = 0;
+
+        //! A private member variable.
+        /*!
+            すべての組を調べるときに、各原子の相手の原子が、バッファのどこから始まるか
+        */
+        std::vector<std::int32_t> rowbegin_;
+
+        //! A private member variable.
+        /*!
+            すべての組を調べるときに、各原子の相手の原子が、どのスレッドのバッファに格納されているか
+        */
+        std::vector<PairList::myindexvector const *> rowbuffer_;
+
+        //! A private member variable.
+        /*!
+            すべての組を調べるときの、各原子の相手の原子の数
+        */
+        std::vector<std::int32_t> rowcount_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの原子の座標のx成分
+        */
+        AtomArray::myvector rx0_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの原子の座標のy成分
+        */
+        AtomArray::myvector ry0_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの原子の座標のz成分
+        */
+        AtomArray::myvector rz0_;
+
+        //! A private member variable.
         /*!
-            カットオフ半径の逆数の12乗
+            ペアリストを作り直すときの原子の並べ替えの方法
         */
-        double const rcm12_;
+        ReorderType reorder_ = ReorderType::NONE;
 
         //! A private member variable.
         /*!
@@ -496,6 +1121,36 @@ namespace moleculardynamics {
         */
         double scale_ = Ar_moleculardynamics::FIRSTSCALE;
 
+        //! A private member variable.
+        /*!
+            乱数のシード
+        */
+        std::uint64_t seed_;
+
+        //! A private member variable.
+        /*!
+            Langevin法の揺動力の標準偏差
+        */
+        double sigma_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            力の計算に用いるSIMD命令セット（既定では、実行中のCPUで使用できるもっとも幅の広いもの）
+        */
+        SimdType simd_ = forcekernel::best_simd();
+
+        //! A private member variable.
+        /*!
+            ペアリストのマージン（Verletのスキン）
+        */
+        double skin_ = SystemParam::MARGIN;
+
+        //! A private member variable.
+        /*!
+            ペアリストのマージンを自動調整するオブジェクト
+        */
+        SkinTuner skintuner_{ SystemParam::MARGIN };
+
         //! A private member variable.
         /*!
             時間
@@ -538,11 +1193,23 @@ namespace moleculardynamics {
         */
         double Utot_;
 
-        //! A private member variable (constant).
+        //! A private member variable.
+        /*!
+            ビリアル（ペアごとの r・F の和、無次元単位）
+        */
+        double virial_;
+
+        //! A private member variable.
+        /*!
+            直前のmoveAtoms()で求めた運動量の2乗の最大値
+        */
+        double vmax2_ = 0.0;
+
+        //! A private member variable.
         /*!
-            ポテンシャルエネルギーの打ち切り
+            直前のステップの前半のmoveAtoms()で求めた、ペアリストを作ったときからの変位の大きい方から2つの和
         */
-        double const Vrc_;
+        double dispmax_ = 0.0;
 
         // #endregion privateメンバ変数
 
@@ -0,0 +1,59 @@
+﻿/*! \file atomarray.cpp
+    \brief 原子の情報を構造体の配列（SoA）で格納するクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "atomarray.h"
+#include <utility>                  // for std::swap
+#include <boost/assert.hpp>         // for BOOST_ASSERT
+#include <tbb/parallel_for.h>       // for tbb::parallel_for
+
+namespace moleculardynamics {
+    void AtomArray::permute(myindexvector const & order)
+    {
+        auto const n = static_cast<std::int32_t>(size());
+
+        BOOST_ASSERT(order.size() == size());
+
+        work_.resize(n);
+        workid_.resize(n);
+
+        for (auto v : { &fx, &fy, &fz, &px, &py, &pz, &rx, &ry, &rz }) {
+            tbb::parallel_for(
+                tbb::blocked_range<std::int32_t>(0, n),
+                [this, v, &order](tbb::blocked_range<std::int32_t> const & range) {
+                    for (auto k = range.begin(); k != range.end(); ++k) {
+                        work_[k] = (*v)[order[k]];
+                    }
+            });
+
+            std::swap(*v, work_);
+        }
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, n),
+            [this, &order](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto k = range.begin(); k != range.end(); ++k) {
+                    workid_[k] = id[order[k]];
+                    index[workid_[k]] = k;
+                }
+        });
+
+        std::swap(id, workid_);
+    }
+
+    void AtomArray::reset_ids()
+    {
+        auto const n = size();
+
+        id.resize(n);
+        index.resize(n);
+
+        for (auto k = 0U; k < n; k++) {
+            id[k] = static_cast<std::int32_t>(k);
+            index[k] = static_cast<std::int32_t>(k);
+        }
+    }
+}
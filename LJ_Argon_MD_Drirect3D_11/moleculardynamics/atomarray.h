@@ -0,0 +1,318 @@
+﻿/*! \file atomarray.h
+    \brief 原子の情報を構造体の配列（SoA）で格納するクラスの宣言と実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _ATOMARRAY_H_
+#define _ATOMARRAY_H_
+
+#pragma once
+
+#include "precision.h"
+#include <cmath>                                // for std::sqrt
+#include <cstddef>                              // for std::size_t
+#include <cstdint>                              // for std::int32_t
+#include <vector>                               // for std::vector
+#include <boost/align/aligned_allocator.hpp>    // for boost::alignment::aligned_allocator
+
+namespace moleculardynamics {
+    //! A class.
+    /*!
+        原子の力、運動量、座標をx, y, z成分ごとの配列で格納するクラス
+    */
+    class AtomArray final {
+        // #region 型エイリアス
+
+    public:
+        //! A public member variable (static constant).
+        /*!
+            配列のアライメント（AVX-512のレジスタ幅）
+        */
+        static auto constexpr ALIGNMENT = 64U;
+
+        using myvector = std::vector<real, boost::alignment::aligned_allocator<real, AtomArray::ALIGNMENT> >;
+
+        using myindexvector = std::vector<std::int32_t>;
+
+        // #endregion 型エイリアス
+
+        // #region 内部クラス
+
+        //! A class.
+        /*!
+            ある原子のベクトル量（力、運動量、座標のいずれか）への読み取り専用のビュー
+        */
+        class Vector3View final {
+        public:
+            //! A constructor.
+            /*!
+                唯一のコンストラクタ
+                \param x x成分へのポインタ
+                \param y y成分へのポインタ
+                \param z z成分へのポインタ
+            */
+            Vector3View(real const * x, real const * y, real const * z) : x_(x), y_(y), z_(z) {}
+
+            //! A public member function (constant).
+            /*!
+                k番目の成分を返す
+                \param k 成分の番号（0: x, 1: y, 2: z）
+                \return k番目の成分
+            */
+            real operator[](std::int32_t k) const
+            {
+                return k == 0 ? *x_ : (k == 1 ? *y_ : *z_);
+            }
+
+            //! A public member function (constant).
+            /*!
+                ベクトルのノルムを返す
+                \return ベクトルのノルム
+            */
+            double norm() const
+            {
+                auto const x = static_cast<double>(*x_), y = static_cast<double>(*y_), z = static_cast<double>(*z_);
+
+                return std::sqrt(x * x + y * y + z * z);
+            }
+
+        private:
+            //! A private member variable (constant).
+            /*!
+                x成分へのポインタ
+            */
+            real const * const x_;
+
+            //! A private member variable (constant).
+            /*!
+                y成分へのポインタ
+            */
+            real const * const y_;
+
+            //! A private member variable (constant).
+            /*!
+                z成分へのポインタ
+            */
+            real const * const z_;
+        };
+
+        //! A struct.
+        /*!
+            ある原子への読み取り専用のビュー（従来のAtom構造体と同じ形でアクセスできる）
+        */
+        struct AtomView final {
+            //! A public member variable (constant).
+            /*!
+                原子に働く力
+            */
+            Vector3View const f;
+
+            //! A public member variable (constant).
+            /*!
+                原子の運動量
+            */
+            Vector3View const p;
+
+            //! A public member variable (constant).
+            /*!
+                原子の座標
+            */
+            Vector3View const r;
+        };
+
+        // #endregion 内部クラス
+
+        // #region コンストラクタ・デストラクタ
+
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+            \param n 原子数
+        */
+        explicit AtomArray(std::size_t n)
+        {
+            resize(n);
+        }
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~AtomArray() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (constant).
+        /*!
+            IDがnの原子へのビューを返す（配列が並べ替えられていても、同じIDは同じ原子を指す）
+            \param n 原子のID
+            \return IDがnの原子へのビュー
+        */
+        AtomView operator[](std::size_t n) const
+        {
+            n = static_cast<std::size_t>(index[n]);
+
+            return AtomView{
+                Vector3View(fx.data() + n, fy.data() + n, fz.data() + n),
+                Vector3View(px.data() + n, py.data() + n, pz.data() + n),
+                Vector3View(rx.data() + n, ry.data() + n, rz.data() + n) };
+        }
+
+        //! A public member function.
+        /*!
+            配列を並べ替える（k番目の原子には、並べ替え前のorder[k]番目の原子が入る）
+            \param order 並べ替えの順序
+        */
+        void permute(myindexvector const & order);
+
+        //! A public member function.
+        /*!
+            原子のIDを、配列のインデックスと同じになるように初期化する
+        */
+        void reset_ids();
+
+        //! A public member function.
+        /*!
+            原子数を変更する
+            \param n 新しい原子数
+        */
+        void resize(std::size_t n)
+        {
+            for (auto v : { &fx, &fy, &fz, &px, &py, &pz, &rx, &ry, &rz }) {
+                v->resize(n);
+            }
+
+            reset_ids();
+        }
+
+        //! A public member function (constant).
+        /*!
+            原子数を返す
+            \return 原子数
+        */
+        std::size_t size() const
+        {
+            return rx.size();
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region publicメンバ変数
+
+        //! A public member variable.
+        /*!
+            原子に働く力のx成分
+        */
+        myvector fx;
+
+        //! A public member variable.
+        /*!
+            原子に働く力のy成分
+        */
+        myvector fy;
+
+        //! A public member variable.
+        /*!
+            原子に働く力のz成分
+        */
+        myvector fz;
+
+        //! A public member variable.
+        /*!
+            配列のインデックスから原子のIDを引く表
+        */
+        myindexvector id;
+
+        //! A public member variable.
+        /*!
+            原子のIDから配列のインデックスを引く表
+        */
+        myindexvector index;
+
+        //! A public member variable.
+        /*!
+            原子の運動量のx成分
+        */
+        myvector px;
+
+        //! A public member variable.
+        /*!
+            原子の運動量のy成分
+        */
+        myvector py;
+
+        //! A public member variable.
+        /*!
+            原子の運動量のz成分
+        */
+        myvector pz;
+
+        //! A public member variable.
+        /*!
+            原子の座標のx成分
+        */
+        myvector rx;
+
+        //! A public member variable.
+        /*!
+            原子の座標のy成分
+        */
+        myvector ry;
+
+        //! A public member variable.
+        /*!
+            原子の座標のz成分
+        */
+        myvector rz;
+
+        // #endregion publicメンバ変数
+
+        // #region privateメンバ変数
+
+    private:
+        //! A private member variable.
+        /*!
+            並べ替えに用いる作業用の配列
+        */
+        myvector work_;
+
+        //! A private member variable.
+        /*!
+            並べ替えに用いる作業用の配列（ID用）
+        */
+        myindexvector workid_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        AtomArray() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        AtomArray(AtomArray const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        AtomArray & operator=(AtomArray const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _ATOMARRAY_H_
@@ -0,0 +1,286 @@
+﻿/*! \file forcekernel.cpp
+    \brief ペアリストの行ごとに、原子に働く力を計算するカーネルの実装（スカラー版と実行時の選択）
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "forcekernel.h"
+#include "systemparam.h"
+#include "myrandom/philox.h"
+#include <array>                    // for std::array
+#include <boost/assert.hpp>         // for BOOST_ASSERT
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>             // for __cpuid, __cpuidex, _xgetbv
+#endif
+
+namespace moleculardynamics {
+    namespace forcekernel {
+        namespace {
+            template <typename Potential, bool Energy, typename Partners>
+            //! A template function.
+            /*!
+                SIMD命令を用いずに、原子[first, last)のそれぞれについて、partnersが列挙する相手の原子との間に働く力を計算する
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Partners 原子iと、相手の原子jとの間に働く力を足し込む関数を受け取り、相手の原子を列挙する関数の型
+            */
+            void kernel(ForceKernelParam const & param, std::int32_t first, std::int32_t last, Partners const & partners, real * fx, real * fy, real * fz, ForceKernelEnergy & energy)
+            {
+                auto const rx = param.rx, ry = param.ry, rz = param.rz;
+                auto const rc2 = static_cast<real>(param.potential.rc2);
+
+                typename Potential::template Eval<potential::Scalar<real>, real> const potential(param.potential);
+
+                for (auto i = first; i < last; i++) {
+                    // 原子iの座標と力はループの間レジスタに置いておく
+                    auto const xi = rx[i], yi = ry[i], zi = rz[i];
+                    real fxi = 0, fyi = 0, fzi = 0;
+                    real up = 0, virial = 0;
+                    std::int32_t npair = 0;
+
+                    // 原子iと原子jの間に働く力を足し込む
+                    auto const pair = [&](std::int32_t j) {
+                        auto dx = rx[j] - xi;
+                        auto dy = ry[j] - yi;
+                        auto dz = rz[j] - zi;
+
+                        SystemParam::adjust_periodic(dx, param.periodiclen);
+                        SystemParam::adjust_periodic(dy, param.periodiclen);
+                        SystemParam::adjust_periodic(dz, param.periodiclen);
+
+                        auto const r2 = dx * dx + dy * dy + dz * dz;
+
+                        real u;
+                        auto const dFdr = potential(r2, r2 <= rc2, u);
+
+                        fxi += dFdr * dx;
+                        fyi += dFdr * dy;
+                        fzi += dFdr * dz;
+
+                        fx[j] -= dFdr * dx;
+                        fy[j] -= dFdr * dy;
+                        fz[j] -= dFdr * dz;
+
+                        if (Energy) {
+                            up += u;
+                            virial -= dFdr * r2;
+                            npair += r2 > rc2 ? 0 : 1;
+                        }
+                    };
+
+                    partners(i, pair);
+
+                    fx[i] += fxi;
+                    fy[i] += fyi;
+                    fz[i] += fzi;
+
+                    if (Energy) {
+                        energy.up += static_cast<accum>(up) - static_cast<accum>(param.potential.vrc) * static_cast<accum>(npair);
+                        energy.virial += static_cast<accum>(virial);
+                    }
+                }
+            }
+
+            template <typename Potential, bool Energy>
+            //! A template function.
+            /*!
+                SIMD命令を用いずに、番地の原子[first, last)について、番地の中の組と、隣接番地の原子の区間との間に働く力を計算する
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+            */
+            void cell(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy & energy)
+            {
+                kernel<Potential, Energy>(param, first, last, [last, ranges, nranges](std::int32_t i, auto const & pair) {
+                    for (auto j = i + 1; j < last; j++) {
+                        pair(j);
+                    }
+
+                    for (auto r = 0; r < nranges; r++) {
+                        for (auto j = ranges[r][0]; j < ranges[r][1]; j++) {
+                            pair(j);
+                        }
+                    }
+                }, fx, fy, fz, energy);
+            }
+
+            template <typename Potential, bool Energy, bool Compact>
+            //! A template function.
+            /*!
+                SIMD命令を用いずに、ペアリストの[first, last)の行について原子に働く力を計算する
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Compact ペアリストが16ビット整数の差の形式ならtrue
+            */
+            void rows(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy & energy)
+            {
+                auto const offsets = param.offsets;
+                auto const neighbors = param.neighbors;
+                auto const deltas = param.deltas;
+                auto const faroffsets = param.faroffsets;
+                auto const farneighbors = param.farneighbors;
+
+                kernel<Potential, Energy>(param, first, last, [&](std::int32_t i, auto const & pair) {
+                    if (Compact) {
+                        for (auto k = offsets[i]; k < offsets[i + 1]; k++) {
+                            pair(i + deltas[k]);
+                        }
+
+                        for (auto k = faroffsets[i]; k < faroffsets[i + 1]; k++) {
+                            pair(farneighbors[k]);
+                        }
+                    }
+                    else {
+                        for (auto k = offsets[i]; k < offsets[i + 1]; k++) {
+                            pair(neighbors[k]);
+                        }
+                    }
+                }, fx, fy, fz, energy);
+            }
+        }
+
+        SimdType best_simd()
+        {
+#if defined(_MSC_VER) && defined(_M_X64)
+            int info[4];
+
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return SimdType::SCALAR;
+            }
+
+            __cpuid(info, 1);
+            auto const fma = (info[2] & (1 << 12)) != 0;
+            auto const osxsave = (info[2] & (1 << 27)) != 0;
+            if (!osxsave) {
+                return SimdType::SCALAR;
+            }
+
+            // OSがYMM/ZMMレジスタの退避に対応しているかを確かめる
+            auto const xcr0 = _xgetbv(0);
+
+            __cpuidex(info, 7, 0);
+            if ((info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6) {
+                return SimdType::AVX512;
+            }
+            else if ((info[1] & (1 << 5)) != 0 && fma && (xcr0 & 0x6) == 0x6) {
+                return SimdType::AVX2;
+            }
+#elif defined(__x86_64__)
+            __builtin_cpu_init();
+
+            if (__builtin_cpu_supports("avx512f")) {
+                return SimdType::AVX512;
+            }
+            else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                return SimdType::AVX2;
+            }
+#endif
+            return SimdType::SCALAR;
+        }
+
+        void cell_scalar(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                if (energy) {
+                    cell<Potential, true>(param, first, last, ranges, nranges, fx, fy, fz, *energy);
+                }
+                else {
+                    ForceKernelEnergy dummy;
+                    cell<Potential, false>(param, first, last, ranges, nranges, fx, fy, fz, dummy);
+                }
+            });
+        }
+
+        rowsfunc get(SimdType simd)
+        {
+            switch (simd) {
+            case SimdType::SCALAR:
+                return rows_scalar;
+
+            case SimdType::AVX2:
+                return rows_avx2;
+
+            case SimdType::AVX512:
+                return rows_avx512;
+
+            default:
+                BOOST_ASSERT(!"何かがおかしい！");
+                return rows_scalar;
+            }
+        }
+
+        cellfunc get_cell(SimdType simd)
+        {
+            switch (simd) {
+            case SimdType::SCALAR:
+                return cell_scalar;
+
+            case SimdType::AVX2:
+                return cell_avx2;
+
+            case SimdType::AVX512:
+                return cell_avx512;
+
+            default:
+                BOOST_ASSERT(!"何かがおかしい！");
+                return cell_scalar;
+            }
+        }
+
+        normalfunc get_normal(SimdType simd)
+        {
+            switch (simd) {
+            case SimdType::SCALAR:
+                return normal_scalar;
+
+            case SimdType::AVX2:
+                return normal_avx2;
+
+            case SimdType::AVX512:
+                return normal_avx512;
+
+            default:
+                BOOST_ASSERT(!"何かがおかしい！");
+                return normal_scalar;
+            }
+        }
+
+        void normal_scalar(std::uint32_t const * bits, std::int32_t n, double * g)
+        {
+            for (auto m = 0; m < n; m++) {
+                auto const normal = myrandom::Philox::to_normal({ bits[m], bits[n + m], bits[2 * n + m], bits[3 * n + m] });
+
+                for (auto k = 0; k < 4; k++) {
+                    g[k * n + m] = normal[k];
+                }
+            }
+        }
+
+        void rows_scalar(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                ForceKernelEnergy dummy;
+
+                if (param.deltas) {
+                    if (energy) {
+                        rows<Potential, true, true>(param, first, last, fx, fy, fz, *energy);
+                    }
+                    else {
+                        rows<Potential, false, true>(param, first, last, fx, fy, fz, dummy);
+                    }
+                }
+                else if (energy) {
+                    rows<Potential, true, false>(param, first, last, fx, fy, fz, *energy);
+                }
+                else {
+                    rows<Potential, false, false>(param, first, last, fx, fy, fz, dummy);
+                }
+            });
+        }
+    }
+}
@@ -0,0 +1,229 @@
+﻿/*! \file forcekernel.h
+    \brief ペアリストの行ごとに、原子に働く力を計算するカーネルの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _FORCEKERNEL_H_
+#define _FORCEKERNEL_H_
+
+#pragma once
+
+#include "potential.h"
+#include "precision.h"
+#include <array>                    // for std::array
+#include <cstdint>                  // for std::int16_t, std::int32_t, std::uint32_t
+
+namespace moleculardynamics {
+    //! A enum.
+    /*!
+        力の計算に用いるSIMD命令セットの列挙型
+    */
+    enum class SimdType : std::int32_t {
+        // SIMD命令を用いない（スカラー版）
+        SCALAR = 0,
+
+        // AVX2 + FMA（4ペア、単精度なら8ペアずつ計算する）
+        AVX2 = 1,
+
+        // AVX-512F（8ペア、単精度なら16ペアずつ計算する）
+        AVX512 = 2
+    };
+
+    //! A struct.
+    /*!
+        力の計算のカーネルに渡す、原子の座標とペアリストへのポインタと定数
+    */
+    struct ForceKernelParam final {
+        //! A public member variable.
+        /*!
+            原子の座標のx成分
+        */
+        real const * rx;
+
+        //! A public member variable.
+        /*!
+            原子の座標のy成分
+        */
+        real const * ry;
+
+        //! A public member variable.
+        /*!
+            原子の座標のz成分
+        */
+        real const * rz;
+
+        //! A public member variable.
+        /*!
+            ペアリストの各行の先頭のインデックス（deltasがnullptrでなければ、deltasの行の先頭）
+        */
+        std::int32_t const * offsets;
+
+        //! A public member variable.
+        /*!
+            ペアリストの相手の原子のインデックス（deltasがnullptrのとき）
+        */
+        std::int32_t const * neighbors;
+
+        //! A public member variable.
+        /*!
+            ペアリストの相手の原子のインデックスの、原子iからの差（16ビット整数の差の形式でなければnullptr）
+        */
+        std::int16_t const * deltas;
+
+        //! A public member variable.
+        /*!
+            差が16ビット整数に収まらない相手の原子の、各行の先頭のインデックス（deltasがnullptrでないとき）
+        */
+        std::int32_t const * faroffsets;
+
+        //! A public member variable.
+        /*!
+            差が16ビット整数に収まらない相手の原子のインデックス（deltasがnullptrでないとき）
+        */
+        std::int32_t const * farneighbors;
+
+        //! A public member variable.
+        /*!
+            周期境界条件の長さ
+        */
+        double periodiclen;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルの種類と係数（カーネルは、種類ごとに特殊化したものが呼ばれる）
+        */
+        PotentialParam potential;
+    };
+
+    //! A struct.
+    /*!
+        力の計算と同時に足し込む、ポテンシャルエネルギーとビリアルの和
+    */
+    struct ForceKernelEnergy final {
+        //! A public member variable.
+        /*!
+            ポテンシャルエネルギーの和
+        */
+        accum up = 0;
+
+        //! A public member variable.
+        /*!
+            ペアごとの r・F の和（ビリアル）
+        */
+        accum virial = 0;
+    };
+
+    namespace forcekernel {
+        //! A typedef.
+        /*!
+            番地の原子[first, last)について、番地の中の組と、隣接番地の原子の区間[ranges[r][0], ranges[r][1])（r < nranges）との間に
+            働く力をfx, fy, fzに足し込む関数へのポインタ（原子は番地の順に並んでいて、param.rx, ry, rzとfx, fy, fzの添字は並べた後の順序）
+            （energyがnullptrでなければ、ポテンシャルエネルギーとビリアルも同じループで*energyに足し込む）
+        */
+        using cellfunc = void (*)(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A typedef.
+        /*!
+            n組の4個の32ビットの乱数bits（成分ごとに並べ、bits[k * n + m]がm組目のk番目の乱数）から、Box-Muller法で
+            揺動力に用いる標準正規乱数を作り、同じ並びでgに書き込む関数へのポインタ
+            （nは8の倍数で、gは64バイトの境界に揃えたもの）
+        */
+        using normalfunc = void (*)(std::uint32_t const * bits, std::int32_t n, double * g);
+
+        //! A typedef.
+        /*!
+            ペアリストの[first, last)の行について、原子に働く力をfx, fy, fzに足し込む関数へのポインタ
+            （energyがnullptrでなければ、ポテンシャルエネルギーとビリアルも同じループで*energyに足し込む）
+        */
+        using rowsfunc = void (*)(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            実行中のCPUとOSが対応している、もっとも幅の広いSIMD命令セットを返す
+            \return 使用できるSIMD命令セット
+        */
+        SimdType best_simd();
+
+        //! A function.
+        /*!
+            AVX2 + FMAを用いて、番地の原子について4ペア（単精度なら8ペア）ずつ原子に働く力を計算する
+        */
+        void cell_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            AVX-512Fを用いて、番地の原子について8ペア（単精度なら16ペア）ずつ原子に働く力を計算する
+        */
+        void cell_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            SIMD命令を用いずに、番地の原子について1ペアずつ原子に働く力を計算する
+        */
+        void cell_scalar(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            SIMD命令セットに対応するカーネルを返す
+            \param simd SIMD命令セット
+            \return カーネルへのポインタ
+        */
+        rowsfunc get(SimdType simd);
+
+        //! A function.
+        /*!
+            SIMD命令セットに対応する、番地ごとに力を計算するカーネルを返す
+            \param simd SIMD命令セット
+            \return カーネルへのポインタ
+        */
+        cellfunc get_cell(SimdType simd);
+
+        //! A function.
+        /*!
+            SIMD命令セットに対応する、標準正規乱数を作る関数を返す
+            \param simd SIMD命令セット
+            \return 関数へのポインタ
+        */
+        normalfunc get_normal(SimdType simd);
+
+        //! A function.
+        /*!
+            AVX2 + FMAを用いて、4組ずつ標準正規乱数を作る（logとsin, cosは多項式で求める）
+        */
+        void normal_avx2(std::uint32_t const * bits, std::int32_t n, double * g);
+
+        //! A function.
+        /*!
+            AVX-512Fを用いて、8組ずつ標準正規乱数を作る（logとsin, cosは多項式で求める）
+        */
+        void normal_avx512(std::uint32_t const * bits, std::int32_t n, double * g);
+
+        //! A function.
+        /*!
+            SIMD命令を用いずに、1組ずつ標準正規乱数を作る
+        */
+        void normal_scalar(std::uint32_t const * bits, std::int32_t n, double * g);
+
+        //! A function.
+        /*!
+            AVX2 + FMAを用いて、4ペア（単精度なら8ペア）ずつ原子に働く力を計算する
+        */
+        void rows_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            AVX-512Fを用いて、8ペア（単精度なら16ペア）ずつ原子に働く力を計算する
+        */
+        void rows_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+
+        //! A function.
+        /*!
+            SIMD命令を用いずに、1ペアずつ原子に働く力を計算する
+        */
+        void rows_scalar(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy);
+    }
+}
+
+#endif  // _FORCEKERNEL_H_
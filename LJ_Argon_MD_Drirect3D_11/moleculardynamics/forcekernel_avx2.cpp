@@ -0,0 +1,577 @@
+﻿/*! \file forcekernel_avx2.cpp
+    \brief AVX2 + FMAを用いて、原子に働く力を計算するカーネルの実装
+    （このファイルだけをAVX2 + FMAを有効にしてコンパイルし、実行時に対応するCPUでのみ呼び出す）
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "forcekernel.h"
+#include "myrandom/philox.h"
+#include <array>                    // for std::array
+#include <bitset>                   // for std::bitset
+#if defined(_M_X64) || defined(__x86_64__)
+    #include <immintrin.h>          // for _mm256_fmadd_pd, _mm256_fmadd_ps
+#endif
+
+namespace moleculardynamics {
+    namespace forcekernel {
+#if defined(_M_X64) || defined(__x86_64__)
+        namespace {
+            template <typename T>
+            //! A template struct.
+            /*!
+                AVX2の演算を、浮動小数点数の型によらない名前で呼び出すための構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Avx2;
+
+            template <>
+            //! A struct.
+            /*!
+                倍精度（4レーン）のAVX2の演算
+            */
+            struct Avx2<double> {
+                using vec = __m256d;
+
+                static auto constexpr WIDTH = 4;
+
+                static vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+
+                static vec and_(vec a, vec b) { return _mm256_and_pd(a, b); }
+
+                static std::int32_t count(vec m) { return static_cast<std::int32_t>(std::bitset<4>(_mm256_movemask_pd(m)).count()); }
+
+                //! A public static member function.
+                /*!
+                    4個の符号なし32ビット整数を読み込み、倍精度に変換する
+                    \param p 符号なし32ビット整数の配列（4要素）
+                    \return 変換した値
+                */
+                static vec cvtu32(std::uint32_t const * p)
+                {
+                    // 最上位ビットを反転して符号付き整数として変換し、2^31を足して戻す
+                    auto const x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p)), _mm_set1_epi32(INT32_MIN));
+
+                    return _mm256_add_pd(_mm256_cvtepi32_pd(x), _mm256_set1_pd(2147483648.0));
+                }
+
+                static vec div(vec a, vec b) { return _mm256_div_pd(a, b); }
+
+                static vec exp(vec a) { return potential::exp<Avx2<double>, double>(a); }
+
+                //! A public static member function.
+                /*!
+                    正の正規化数aの指数部（floor(log2(a))）を求める
+                    \param a 引数
+                    \return 指数部（整数値の浮動小数点数）
+                */
+                static vec exponent(vec a)
+                {
+                    // 指数部のビットを2^52の仮数部に詰めて、2^52 + 1023を引く
+                    auto const e = _mm256_or_si256(_mm256_srli_epi64(_mm256_castpd_si256(a), 52), _mm256_set1_epi64x(0x4330000000000000LL));
+
+                    return _mm256_sub_pd(_mm256_castsi256_pd(e), _mm256_set1_pd(4503599627371519.0));
+                }
+
+                static vec floor(vec a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+                static vec fmadd(vec a, vec b, vec c) { return _mm256_fmadd_pd(a, b, c); }
+
+                static vec fmsub(vec a, vec b, vec c) { return _mm256_fmsub_pd(a, b, c); }
+
+                static vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_pd(a, b, c); }
+
+                //! A public static member function.
+                /*!
+                    4つの原子の座標の成分を読み込む
+                    （多くのCPUでは、AVX2のgather命令よりも個別に読み込むほうが速い）
+                    \param r 座標の成分の配列
+                    \param j 読み込む原子のインデックスの配列（4要素）
+                    \return 4つの原子の座標の成分
+                */
+                static vec gather(double const * r, std::int32_t const * j)
+                {
+                    return _mm256_set_pd(r[j[3]], r[j[2]], r[j[1]], r[j[0]]);
+                }
+
+                static vec gt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+
+                //! A public static member function.
+                /*!
+                    a 2^kを求める（kは整数値で、2^kが正規化数に収まるものとする）
+                    \param a 仮数
+                    \param k 指数（整数値の浮動小数点数）
+                    \return a 2^k
+                */
+                static vec ldexp(vec a, vec k)
+                {
+                    // 2^kは、指数部にk + 1023を詰めて作る
+                    auto const e = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k)), _mm256_set1_epi64x(1023));
+
+                    return _mm256_mul_pd(a, _mm256_castsi256_pd(_mm256_slli_epi64(e, 52)));
+                }
+
+                static vec le(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+
+                static vec lt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+
+                //! A public static member function.
+                /*!
+                    表の要素を、レーンごとのインデックスで読み込む
+                    （インデックスはレジスタの中で計算したものなので、ここではgather命令を用いる）
+                    \param p 表の先頭
+                    \param k 読み込む要素のインデックス（整数値の浮動小数点数）
+                    \return 表の要素
+                */
+                static vec lookup(double const * p, vec k) { return _mm256_i32gather_pd(p, _mm256_cvttpd_epi32(k), 8); }
+
+                //! A public static member function.
+                /*!
+                    正の正規化数aの仮数（[1, 2)の範囲）を求める
+                    \param a 引数
+                    \return 仮数
+                */
+                static vec mantissa(vec a)
+                {
+                    auto const m = _mm256_and_si256(_mm256_castpd_si256(a), _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL));
+
+                    return _mm256_castsi256_pd(_mm256_or_si256(m, _mm256_set1_epi64x(0x3FF0000000000000LL)));
+                }
+
+                static vec maskload(double const * p, vec m) { return _mm256_maskload_pd(p, _mm256_castpd_si256(m)); }
+
+                static void maskstore(double * p, vec m, vec a) { _mm256_maskstore_pd(p, _mm256_castpd_si256(m), a); }
+
+                static vec max(vec a, vec b) { return _mm256_max_pd(a, b); }
+
+                static vec min(vec a, vec b) { return _mm256_min_pd(a, b); }
+
+                static vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+
+                static vec round(vec a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+                static vec select(vec m, vec a) { return _mm256_and_pd(m, a); }
+
+                static vec set1(double a) { return _mm256_set1_pd(a); }
+
+                static vec sqrt(vec a) { return _mm256_sqrt_pd(a); }
+
+                static void store(double * p, vec a) { _mm256_store_pd(p, a); }
+
+                static vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+
+                //! A public static member function.
+                /*!
+                    4成分の総和を求める
+                    \param a 4成分のベクトル
+                    \return 4成分の総和
+                */
+                static double sum(vec a)
+                {
+                    auto const s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+
+                    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+                }
+
+                //! A public static member function.
+                /*!
+                    先頭からn個のレーンだけが立ったマスクを作る
+                    \param n 有効なレーンの数
+                    \return マスク
+                */
+                static vec valid(std::int32_t n)
+                {
+                    return _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_set_epi64x(3, 2, 1, 0)));
+                }
+
+                static vec zero() { return _mm256_setzero_pd(); }
+            };
+
+            template <>
+            //! A struct.
+            /*!
+                単精度（8レーン）のAVX2の演算
+            */
+            struct Avx2<float> {
+                using vec = __m256;
+
+                static auto constexpr WIDTH = 8;
+
+                static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+
+                static vec and_(vec a, vec b) { return _mm256_and_ps(a, b); }
+
+                static std::int32_t count(vec m) { return static_cast<std::int32_t>(std::bitset<8>(_mm256_movemask_ps(m)).count()); }
+
+                static vec div(vec a, vec b) { return _mm256_div_ps(a, b); }
+
+                static vec exp(vec a) { return potential::exp<Avx2<float>, float>(a); }
+
+                static vec floor(vec a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+                static vec fmadd(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+
+                static vec fmsub(vec a, vec b, vec c) { return _mm256_fmsub_ps(a, b, c); }
+
+                static vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_ps(a, b, c); }
+
+                //! A public static member function.
+                /*!
+                    8つの原子の座標の成分を読み込む
+                    \param r 座標の成分の配列
+                    \param j 読み込む原子のインデックスの配列（8要素）
+                    \return 8つの原子の座標の成分
+                */
+                static vec gather(float const * r, std::int32_t const * j)
+                {
+                    return _mm256_set_ps(r[j[7]], r[j[6]], r[j[5]], r[j[4]], r[j[3]], r[j[2]], r[j[1]], r[j[0]]);
+                }
+
+                static vec gt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+
+                //! A public static member function.
+                /*!
+                    a 2^kを求める（kは整数値で、2^kが正規化数に収まるものとする）
+                    \param a 仮数
+                    \param k 指数（整数値の浮動小数点数）
+                    \return a 2^k
+                */
+                static vec ldexp(vec a, vec k)
+                {
+                    // 2^kは、指数部にk + 127を詰めて作る
+                    auto const e = _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127));
+
+                    return _mm256_mul_ps(a, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+                }
+
+                static vec le(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+
+                static vec lt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+
+                //! A public static member function.
+                /*!
+                    表の要素を、レーンごとのインデックスで読み込む
+                    （インデックスはレジスタの中で計算したものなので、ここではgather命令を用いる）
+                    \param p 表の先頭
+                    \param k 読み込む要素のインデックス（整数値の浮動小数点数）
+                    \return 表の要素
+                */
+                static vec lookup(float const * p, vec k) { return _mm256_i32gather_ps(p, _mm256_cvttps_epi32(k), 4); }
+
+                static vec maskload(float const * p, vec m) { return _mm256_maskload_ps(p, _mm256_castps_si256(m)); }
+
+                static void maskstore(float * p, vec m, vec a) { _mm256_maskstore_ps(p, _mm256_castps_si256(m), a); }
+
+                static vec max(vec a, vec b) { return _mm256_max_ps(a, b); }
+
+                static vec min(vec a, vec b) { return _mm256_min_ps(a, b); }
+
+                static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+
+                static vec round(vec a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+                static vec select(vec m, vec a) { return _mm256_and_ps(m, a); }
+
+                static vec set1(float a) { return _mm256_set1_ps(a); }
+
+                static vec sqrt(vec a) { return _mm256_sqrt_ps(a); }
+
+                static void store(float * p, vec a) { _mm256_store_ps(p, a); }
+
+                static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+
+                //! A public static member function.
+                /*!
+                    8成分の総和を求める
+                    \param a 8成分のベクトル
+                    \return 8成分の総和
+                */
+                static float sum(vec a)
+                {
+                    auto s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+                    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+
+                    return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+                }
+
+                //! A public static member function.
+                /*!
+                    先頭からn個のレーンだけが立ったマスクを作る
+                    \param n 有効なレーンの数
+                    \return マスク
+                */
+                static vec valid(std::int32_t n)
+                {
+                    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+                }
+
+                static vec zero() { return _mm256_setzero_ps(); }
+            };
+
+            template <typename T, typename Potential, bool Energy, typename Partners>
+            //! A template function.
+            /*!
+                AVX2 + FMAを用いて、原子[first, last)のそれぞれについて、partnersが列挙する相手の原子との間に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Partners 原子iと、インデックスで与える相手と連続した区間で与える相手を足し込む関数を受け取り、相手の原子を列挙する関数の型
+            */
+            void kernel(ForceKernelParam const & param, std::int32_t first, std::int32_t last, Partners const & partners, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                using S = Avx2<T>;
+                auto constexpr W = S::WIDTH;
+
+                auto const rx = param.rx, ry = param.ry, rz = param.rz;
+
+                auto const l = S::set1(static_cast<T>(param.periodiclen));
+                auto const lh = S::set1(static_cast<T>(param.periodiclen * 0.5));
+                auto const mlh = S::set1(static_cast<T>(-param.periodiclen * 0.5));
+                auto const rc2 = S::set1(static_cast<T>(param.potential.rc2));
+
+                typename Potential::template Eval<S, T> const potential(param.potential);
+
+                // 周期的境界条件の補正を、分岐なしでレーンごとに行う
+                auto const adjust_periodic = [l, lh, mlh](typename S::vec d) {
+                    return S::sub(S::add(d, S::and_(S::lt(d, mlh), l)), S::and_(S::gt(d, lh), l));
+                };
+
+                alignas(32) T dfx[W], dfy[W], dfz[W];
+
+                for (auto i = first; i < last; i++) {
+                    auto const xi = S::set1(rx[i]);
+                    auto const yi = S::set1(ry[i]);
+                    auto const zi = S::set1(rz[i]);
+
+                    // 原子iに働く力は、行の終わりまでレジスタの中で足し込む
+                    auto fxi = S::zero();
+                    auto fyi = S::zero();
+                    auto fzi = S::zero();
+                    auto up = S::zero();
+                    auto virial = S::zero();
+                    std::int32_t npair = 0;
+
+                    // 相手の原子の座標のうち、有効なレーンとの間に働く力を原子iに足し込み、相手の原子への反作用を求める
+                    auto const interact = [&](typename S::vec xj, typename S::vec yj, typename S::vec zj, typename S::vec valid,
+                                              typename S::vec & ffx, typename S::vec & ffy, typename S::vec & ffz) {
+                        auto const dx = adjust_periodic(S::sub(xj, xi));
+                        auto const dy = adjust_periodic(S::sub(yj, yi));
+                        auto const dz = adjust_periodic(S::sub(zj, zi));
+
+                        auto const r2 = S::fmadd(dx, dx, S::fmadd(dy, dy, S::mul(dz, dz)));
+                        auto const mask = S::and_(valid, S::le(r2, rc2));
+
+                        // カットオフの外側と端数のレーンは、ポリシーの中で0にする
+                        // （Energyがfalseなら、ポテンシャルを求める命令は最適化で消える）
+                        typename S::vec u;
+                        auto const dFdr = potential(r2, mask, u);
+
+                        if (Energy) {
+                            up = S::add(up, u);
+                            virial = S::sub(virial, S::mul(dFdr, r2));
+                            npair += S::count(mask);
+                        }
+
+                        ffx = S::mul(dFdr, dx);
+                        ffy = S::mul(dFdr, dy);
+                        ffz = S::mul(dFdr, dz);
+
+                        fxi = S::add(fxi, ffx);
+                        fyi = S::add(fyi, ffy);
+                        fzi = S::add(fzi, ffz);
+                    };
+
+                    // 相手の原子のインデックスjpのうち、先頭のn個との間に働く力を足し込む
+                    auto const gathered = [&](std::int32_t const * jp, std::int32_t n) {
+                        typename S::vec ffx, ffy, ffz;
+                        interact(S::gather(rx, jp), S::gather(ry, jp), S::gather(rz, jp), S::valid(n), ffx, ffy, ffz);
+
+                        // AVX2にはscatter命令がないので、相手の原子への反作用は1ペアずつ書き戻す
+                        S::store(dfx, ffx);
+                        S::store(dfy, ffy);
+                        S::store(dfz, ffz);
+
+                        for (auto m = 0; m < n; m++) {
+                            auto const j = jp[m];
+                            fx[j] -= dfx[m];
+                            fy[j] -= dfy[m];
+                            fz[j] -= dfz[m];
+                        }
+                    };
+
+                    // 連続して並んだ相手の原子[begin, end)との間に働く力を、個別の読み込みと書き戻しを使わずに足し込む
+                    auto const contiguous = [&](std::int32_t begin, std::int32_t end) {
+                        for (auto k = begin; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+                            auto const valid = S::valid(n);
+
+                            typename S::vec ffx, ffy, ffz;
+                            interact(S::maskload(rx + k, valid), S::maskload(ry + k, valid), S::maskload(rz + k, valid), valid, ffx, ffy, ffz);
+
+                            S::maskstore(fx + k, valid, S::sub(S::maskload(fx + k, valid), ffx));
+                            S::maskstore(fy + k, valid, S::sub(S::maskload(fy + k, valid), ffy));
+                            S::maskstore(fz + k, valid, S::sub(S::maskload(fz + k, valid), ffz));
+                        }
+                    };
+
+                    partners(i, gathered, contiguous);
+
+                    fx[i] += S::sum(fxi);
+                    fy[i] += S::sum(fyi);
+                    fz[i] += S::sum(fzi);
+
+                    if (Energy) {
+                        energy.up += static_cast<accum>(S::sum(up)) - static_cast<accum>(param.potential.vrc) * static_cast<accum>(npair);
+                        energy.virial += static_cast<accum>(S::sum(virial));
+                    }
+                }
+            }
+
+            template <typename T, typename Potential, bool Energy>
+            //! A template function.
+            /*!
+                AVX2 + FMAを用いて、番地の原子[first, last)について、番地の中の組と、隣接番地の原子の区間との間に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+            */
+            void cell(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                kernel<T, Potential, Energy>(param, first, last, [last, ranges, nranges](std::int32_t i, auto const &, auto const & contiguous) {
+                    contiguous(i + 1, last);
+
+                    for (auto r = 0; r < nranges; r++) {
+                        contiguous(ranges[r][0], ranges[r][1]);
+                    }
+                }, fx, fy, fz, energy);
+            }
+
+            template <typename T, typename Potential, bool Energy, bool Compact>
+            //! A template function.
+            /*!
+                AVX2 + FMAを用いて、ペアリストの[first, last)の行について原子に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Compact ペアリストが16ビット整数の差の形式ならtrue
+            */
+            void rows(ForceKernelParam const & param, std::int32_t first, std::int32_t last, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                auto constexpr W = Avx2<T>::WIDTH;
+
+                auto const offsets = param.offsets;
+                auto const neighbors = param.neighbors;
+                auto const deltas = param.deltas;
+                auto const faroffsets = param.faroffsets;
+                auto const farneighbors = param.farneighbors;
+
+                std::int32_t tail[W];
+
+                kernel<T, Potential, Energy>(param, first, last, [&](std::int32_t i, auto const & gathered, auto const &) {
+                    // 32ビット整数で格納された相手の原子の[begin, end)について、Wペアずつ力を足し込む
+                    auto const row = [&](std::int32_t const * list, std::int32_t begin, std::int32_t end) {
+                        for (auto k = begin; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+
+                            // 行の端数は、原子i自身のインデックスで埋めてからマスクで捨てる
+                            if (n < W) {
+                                for (auto m = 0; m < W; m++) {
+                                    tail[m] = m < n ? list[k + m] : i;
+                                }
+                                gathered(tail, n);
+                            }
+                            else {
+                                gathered(list + k, W);
+                            }
+                        }
+                    };
+
+                    if (Compact) {
+                        auto const end = offsets[i + 1];
+
+                        // 16ビット整数の差は、原子iのインデックスを足して32ビット整数のインデックスに戻す
+                        for (auto k = offsets[i]; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+
+                            for (auto m = 0; m < W; m++) {
+                                tail[m] = m < n ? i + deltas[k + m] : i;
+                            }
+                            gathered(tail, n);
+                        }
+
+                        row(farneighbors, faroffsets[i], faroffsets[i + 1]);
+                    }
+                    else {
+                        row(neighbors, offsets[i], offsets[i + 1]);
+                    }
+                }, fx, fy, fz, energy);
+            }
+        }
+
+        void cell_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                if (energy) {
+                    cell<real, Potential, true>(param, first, last, ranges, nranges, fx, fy, fz, *energy);
+                }
+                else {
+                    ForceKernelEnergy dummy;
+                    cell<real, Potential, false>(param, first, last, ranges, nranges, fx, fy, fz, dummy);
+                }
+            });
+        }
+
+        void normal_avx2(std::uint32_t const * bits, std::int32_t n, double * g)
+        {
+            for (auto m = 0; m < n; m += Avx2<double>::WIDTH) {
+                myrandom::Philox::to_normal<Avx2<double>>(bits + m, n, g + m);
+            }
+        }
+
+        void rows_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                ForceKernelEnergy dummy;
+
+                if (param.deltas) {
+                    if (energy) {
+                        rows<real, Potential, true, true>(param, first, last, fx, fy, fz, *energy);
+                    }
+                    else {
+                        rows<real, Potential, false, true>(param, first, last, fx, fy, fz, dummy);
+                    }
+                }
+                else if (energy) {
+                    rows<real, Potential, true, false>(param, first, last, fx, fy, fz, *energy);
+                }
+                else {
+                    rows<real, Potential, false, false>(param, first, last, fx, fy, fz, dummy);
+                }
+            });
+        }
+#else
+        void cell_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            // x86-64以外では、best_simd()がAVX2を返すことはない
+            cell_scalar(param, first, last, ranges, nranges, fx, fy, fz, energy);
+        }
+
+        void normal_avx2(std::uint32_t const * bits, std::int32_t n, double * g)
+        {
+            // x86-64以外では、best_simd()がAVX2を返すことはない
+            normal_scalar(bits, n, g);
+        }
+
+        void rows_avx2(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            // x86-64以外では、best_simd()がAVX2を返すことはない
+            rows_scalar(param, first, last, fx, fy, fz, energy);
+        }
+#endif
+    }
+}
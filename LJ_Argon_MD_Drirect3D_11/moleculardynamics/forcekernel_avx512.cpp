@@ -0,0 +1,502 @@
+﻿/*! \file forcekernel_avx512.cpp
+    \brief AVX-512Fを用いて、原子に働く力を計算するカーネルの実装
+    （このファイルだけをAVX-512Fを有効にしてコンパイルし、実行時に対応するCPUでのみ呼び出す）
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "forcekernel.h"
+#include "myrandom/philox.h"
+#include <array>                    // for std::array
+#include <bitset>                   // for std::bitset
+#if defined(_M_X64) || defined(__x86_64__)
+    #include <immintrin.h>          // for _mm512_i32gather_pd, _mm512_mask_i32scatter_pd
+#endif
+
+namespace moleculardynamics {
+    namespace forcekernel {
+#if defined(_M_X64) || defined(__x86_64__)
+        namespace {
+            template <typename T>
+            //! A template struct.
+            /*!
+                AVX-512Fの演算を、浮動小数点数の型によらない名前で呼び出すための構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Avx512;
+
+            template <>
+            //! A struct.
+            /*!
+                倍精度（8レーン）のAVX-512Fの演算
+            */
+            struct Avx512<double> {
+                using index = __m256i;
+
+                using mask = __mmask8;
+
+                using vec = __m512d;
+
+                static auto constexpr WIDTH = 8;
+
+                static vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+
+                static std::int32_t count(mask m) { return static_cast<std::int32_t>(std::bitset<8>(m).count()); }
+
+                static vec cvtu32(std::uint32_t const * p) { return _mm512_cvtepu32_pd(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(p))); }
+
+                static vec div(vec a, vec b) { return _mm512_div_pd(a, b); }
+
+                static vec exp(vec a) { return potential::exp<Avx512<double>, double>(a); }
+
+                static vec exponent(vec a) { return _mm512_getexp_pd(a); }
+
+                static vec floor(vec a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+                static vec fmadd(vec a, vec b, vec c) { return _mm512_fmadd_pd(a, b, c); }
+
+                static vec fmsub(vec a, vec b, vec c) { return _mm512_fmsub_pd(a, b, c); }
+
+                static vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_pd(a, b, c); }
+
+                static vec gather(index j, double const * r) { return _mm512_i32gather_pd(j, r, 8); }
+
+                static mask gt(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+
+                static vec ldexp(vec a, vec k) { return _mm512_scalef_pd(a, k); }
+
+                static mask le(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+
+                static index load(std::int32_t const * j) { return _mm256_loadu_si256(reinterpret_cast<__m256i const *>(j)); }
+
+                //! A public static member function.
+                /*!
+                    原子iからの差を8個読み込み、相手の原子のインデックスに戻す
+                    \param d 原子iからの差の配列（8要素）
+                    \param i 原子iのインデックス（全レーン）
+                    \return 相手の原子のインデックス
+                */
+                static index load16(std::int16_t const * d, index i)
+                {
+                    return _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(d))), i);
+                }
+
+                static vec lookup(double const * p, vec k) { return _mm512_i32gather_pd(_mm512_cvttpd_epi32(k), p, 8); }
+
+                static mask lt(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+
+                static vec mantissa(vec a) { return _mm512_getmant_pd(a, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_src); }
+
+                static vec mask_add(vec a, mask m, vec b) { return _mm512_mask_add_pd(a, m, a, b); }
+
+                static vec mask_sub(vec a, mask m, vec b) { return _mm512_mask_sub_pd(a, m, a, b); }
+
+                static vec maskz_loadu(mask m, double const * p) { return _mm512_maskz_loadu_pd(m, p); }
+
+                static void mask_storeu(double * p, mask m, vec a) { _mm512_mask_storeu_pd(p, m, a); }
+
+                static vec max(vec a, vec b) { return _mm512_max_pd(a, b); }
+
+                static vec min(vec a, vec b) { return _mm512_min_pd(a, b); }
+
+                static vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+
+                static vec round(vec a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+                static vec select(mask m, vec a) { return _mm512_maskz_mov_pd(m, a); }
+
+                static vec set1(double a) { return _mm512_set1_pd(a); }
+
+                static index set1i(std::int32_t a) { return _mm256_set1_epi32(a); }
+
+                static vec sqrt(vec a) { return _mm512_sqrt_pd(a); }
+
+                static void store(double * p, vec a) { _mm512_store_pd(p, a); }
+
+                static vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+
+                static double sum(vec a) { return _mm512_reduce_add_pd(a); }
+
+                //! A public static member function.
+                /*!
+                    原子に働く力から、有効なレーンの分だけ反作用を差し引く
+                    （1つの行の中に同じ相手の原子は現れないので、gatherとscatterでまとめて書き戻せる）
+                    \param f 原子に働く力の成分の配列
+                    \param m 有効なレーンのマスク
+                    \param j 相手の原子のインデックス
+                    \param a 差し引く力
+                */
+                static void scatter_sub(double * f, mask m, index j, vec a)
+                {
+                    _mm512_mask_i32scatter_pd(f, m, j, _mm512_sub_pd(_mm512_mask_i32gather_pd(_mm512_setzero_pd(), m, j, f, 8), a), 8);
+                }
+
+                static vec zero() { return _mm512_setzero_pd(); }
+            };
+
+            template <>
+            //! A struct.
+            /*!
+                単精度（16レーン）のAVX-512Fの演算
+            */
+            struct Avx512<float> {
+                using index = __m512i;
+
+                using mask = __mmask16;
+
+                using vec = __m512;
+
+                static auto constexpr WIDTH = 16;
+
+                static vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+
+                static std::int32_t count(mask m) { return static_cast<std::int32_t>(std::bitset<16>(m).count()); }
+
+                static vec div(vec a, vec b) { return _mm512_div_ps(a, b); }
+
+                static vec exp(vec a) { return potential::exp<Avx512<float>, float>(a); }
+
+                static vec floor(vec a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+                static vec fmadd(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+
+                static vec fmsub(vec a, vec b, vec c) { return _mm512_fmsub_ps(a, b, c); }
+
+                static vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_ps(a, b, c); }
+
+                static vec gather(index j, float const * r) { return _mm512_i32gather_ps(j, r, 4); }
+
+                static mask gt(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+
+                static vec ldexp(vec a, vec k) { return _mm512_scalef_ps(a, k); }
+
+                static mask le(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+
+                static index load(std::int32_t const * j) { return _mm512_loadu_si512(j); }
+
+                //! A public static member function.
+                /*!
+                    原子iからの差を16個読み込み、相手の原子のインデックスに戻す
+                    \param d 原子iからの差の配列（16要素）
+                    \param i 原子iのインデックス（全レーン）
+                    \return 相手の原子のインデックス
+                */
+                static index load16(std::int16_t const * d, index i)
+                {
+                    return _mm512_add_epi32(_mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(d))), i);
+                }
+
+                static vec lookup(float const * p, vec k) { return _mm512_i32gather_ps(_mm512_cvttps_epi32(k), p, 4); }
+
+                static mask lt(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+
+                static vec mask_add(vec a, mask m, vec b) { return _mm512_mask_add_ps(a, m, a, b); }
+
+                static vec mask_sub(vec a, mask m, vec b) { return _mm512_mask_sub_ps(a, m, a, b); }
+
+                static vec maskz_loadu(mask m, float const * p) { return _mm512_maskz_loadu_ps(m, p); }
+
+                static void mask_storeu(float * p, mask m, vec a) { _mm512_mask_storeu_ps(p, m, a); }
+
+                static vec max(vec a, vec b) { return _mm512_max_ps(a, b); }
+
+                static vec min(vec a, vec b) { return _mm512_min_ps(a, b); }
+
+                static vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+
+                static vec round(vec a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+                static vec select(mask m, vec a) { return _mm512_maskz_mov_ps(m, a); }
+
+                static vec set1(float a) { return _mm512_set1_ps(a); }
+
+                static index set1i(std::int32_t a) { return _mm512_set1_epi32(a); }
+
+                static vec sqrt(vec a) { return _mm512_sqrt_ps(a); }
+
+                static vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+
+                static float sum(vec a) { return _mm512_reduce_add_ps(a); }
+
+                //! A public static member function.
+                /*!
+                    原子に働く力から、有効なレーンの分だけ反作用を差し引く
+                    \param f 原子に働く力の成分の配列
+                    \param m 有効なレーンのマスク
+                    \param j 相手の原子のインデックス
+                    \param a 差し引く力
+                */
+                static void scatter_sub(float * f, mask m, index j, vec a)
+                {
+                    _mm512_mask_i32scatter_ps(f, m, j, _mm512_sub_ps(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, j, f, 4), a), 4);
+                }
+
+                static vec zero() { return _mm512_setzero_ps(); }
+            };
+
+            template <typename T, typename Potential, bool Energy, typename Partners>
+            //! A template function.
+            /*!
+                AVX-512Fを用いて、原子[first, last)のそれぞれについて、partnersが列挙する相手の原子との間に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Partners 原子iと、インデックスで与える相手と連続した区間で与える相手を足し込む関数を受け取り、相手の原子を列挙する関数の型
+            */
+            void kernel(ForceKernelParam const & param, std::int32_t first, std::int32_t last, Partners const & partners, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                using S = Avx512<T>;
+                auto constexpr W = S::WIDTH;
+
+                auto const rx = param.rx, ry = param.ry, rz = param.rz;
+
+                auto const l = S::set1(static_cast<T>(param.periodiclen));
+                auto const lh = S::set1(static_cast<T>(param.periodiclen * 0.5));
+                auto const mlh = S::set1(static_cast<T>(-param.periodiclen * 0.5));
+                auto const rc2 = S::set1(static_cast<T>(param.potential.rc2));
+
+                typename Potential::template Eval<S, T> const potential(param.potential);
+
+                // 周期的境界条件の補正を、分岐なしでレーンごとに行う
+                auto const adjust_periodic = [l, lh, mlh](typename S::vec d) {
+                    return S::mask_sub(S::mask_add(d, S::lt(d, mlh), l), S::gt(d, lh), l);
+                };
+
+                for (auto i = first; i < last; i++) {
+                    auto const xi = S::set1(rx[i]);
+                    auto const yi = S::set1(ry[i]);
+                    auto const zi = S::set1(rz[i]);
+
+                    // 原子iに働く力は、行の終わりまでレジスタの中で足し込む
+                    auto fxi = S::zero();
+                    auto fyi = S::zero();
+                    auto fzi = S::zero();
+                    auto up = S::zero();
+                    auto virial = S::zero();
+                    std::int32_t npair = 0;
+
+                    // 相手の原子の座標のうち、有効なレーンとの間に働く力を原子iに足し込み、相手の原子への反作用を求める
+                    auto const interact = [&](typename S::vec xj, typename S::vec yj, typename S::vec zj, typename S::mask valid,
+                                              typename S::vec & ffx, typename S::vec & ffy, typename S::vec & ffz) {
+                        auto const dx = adjust_periodic(S::sub(xj, xi));
+                        auto const dy = adjust_periodic(S::sub(yj, yi));
+                        auto const dz = adjust_periodic(S::sub(zj, zi));
+
+                        auto const r2 = S::fmadd(dx, dx, S::fmadd(dy, dy, S::mul(dz, dz)));
+                        auto const mask = static_cast<typename S::mask>(valid & S::le(r2, rc2));
+
+                        // カットオフの外側と端数のレーンは、ポリシーの中で0にする
+                        // （Energyがfalseなら、ポテンシャルを求める命令は最適化で消える）
+                        typename S::vec u;
+                        auto const dFdr = potential(r2, mask, u);
+
+                        if (Energy) {
+                            up = S::add(up, u);
+                            virial = S::sub(virial, S::mul(dFdr, r2));
+                            npair += S::count(mask);
+                        }
+
+                        ffx = S::mul(dFdr, dx);
+                        ffy = S::mul(dFdr, dy);
+                        ffz = S::mul(dFdr, dz);
+
+                        fxi = S::add(fxi, ffx);
+                        fyi = S::add(fyi, ffy);
+                        fzi = S::add(fzi, ffz);
+                    };
+
+                    // 相手の原子のインデックスidxのうち、先頭のn個のレーンとの間に働く力を足し込む
+                    auto const gathered = [&](typename S::index idx, std::int32_t n) {
+                        auto const valid = static_cast<typename S::mask>((1U << n) - 1U);
+
+                        typename S::vec ffx, ffy, ffz;
+                        interact(S::gather(idx, rx), S::gather(idx, ry), S::gather(idx, rz), valid, ffx, ffy, ffz);
+
+                        S::scatter_sub(fx, valid, idx, ffx);
+                        S::scatter_sub(fy, valid, idx, ffy);
+                        S::scatter_sub(fz, valid, idx, ffz);
+                    };
+
+                    // 連続して並んだ相手の原子[begin, end)との間に働く力を、gatherとscatterを使わずに足し込む
+                    auto const contiguous = [&](std::int32_t begin, std::int32_t end) {
+                        for (auto k = begin; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+                            auto const valid = static_cast<typename S::mask>((1U << n) - 1U);
+
+                            typename S::vec ffx, ffy, ffz;
+                            interact(S::maskz_loadu(valid, rx + k), S::maskz_loadu(valid, ry + k), S::maskz_loadu(valid, rz + k), valid, ffx, ffy, ffz);
+
+                            S::mask_storeu(fx + k, valid, S::sub(S::maskz_loadu(valid, fx + k), ffx));
+                            S::mask_storeu(fy + k, valid, S::sub(S::maskz_loadu(valid, fy + k), ffy));
+                            S::mask_storeu(fz + k, valid, S::sub(S::maskz_loadu(valid, fz + k), ffz));
+                        }
+                    };
+
+                    partners(i, gathered, contiguous);
+
+                    fx[i] += S::sum(fxi);
+                    fy[i] += S::sum(fyi);
+                    fz[i] += S::sum(fzi);
+
+                    if (Energy) {
+                        energy.up += static_cast<accum>(S::sum(up)) - static_cast<accum>(param.potential.vrc) * static_cast<accum>(npair);
+                        energy.virial += static_cast<accum>(S::sum(virial));
+                    }
+                }
+            }
+
+            template <typename T, typename Potential, bool Energy>
+            //! A template function.
+            /*!
+                AVX-512Fを用いて、番地の原子[first, last)について、番地の中の組と、隣接番地の原子の区間との間に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+            */
+            void cell(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                kernel<T, Potential, Energy>(param, first, last, [last, ranges, nranges](std::int32_t i, auto const &, auto const & contiguous) {
+                    contiguous(i + 1, last);
+
+                    for (auto r = 0; r < nranges; r++) {
+                        contiguous(ranges[r][0], ranges[r][1]);
+                    }
+                }, fx, fy, fz, energy);
+            }
+
+            template <typename T, typename Potential, bool Energy, bool Compact>
+            //! A template function.
+            /*!
+                AVX-512Fを用いて、ペアリストの[first, last)の行について原子に働く力を計算する
+                \tparam T 浮動小数点数の型
+                \tparam Potential ポテンシャルのポリシー
+                \tparam Energy ポテンシャルエネルギーとビリアルも計算するならtrue
+                \tparam Compact ペアリストが16ビット整数の差の形式ならtrue
+            */
+            void rows(ForceKernelParam const & param, std::int32_t first, std::int32_t last, T * fx, T * fy, T * fz, ForceKernelEnergy & energy)
+            {
+                using S = Avx512<T>;
+                auto constexpr W = S::WIDTH;
+
+                auto const offsets = param.offsets;
+                auto const neighbors = param.neighbors;
+                auto const deltas = param.deltas;
+                auto const faroffsets = param.faroffsets;
+                auto const farneighbors = param.farneighbors;
+
+                std::int32_t tail[W];
+
+                kernel<T, Potential, Energy>(param, first, last, [&](std::int32_t i, auto const & gathered, auto const &) {
+                    // 32ビット整数で格納された相手の原子の[begin, end)について、Wペアずつ力を足し込む
+                    auto const row = [&](std::int32_t const * list, std::int32_t begin, std::int32_t end) {
+                        for (auto k = begin; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+
+                            // 行の端数は、原子i自身のインデックスで埋めてからマスクで捨てる
+                            if (n < W) {
+                                for (auto m = 0; m < W; m++) {
+                                    tail[m] = m < n ? list[k + m] : i;
+                                }
+                                gathered(S::load(tail), n);
+                            }
+                            else {
+                                gathered(S::load(list + k), W);
+                            }
+                        }
+                    };
+
+                    if (Compact) {
+                        // 16ビット整数の差は、符号拡張して原子iのインデックスを足せば、そのままgatherに使える
+                        auto const ii = S::set1i(i);
+                        auto const end = offsets[i + 1];
+
+                        for (auto k = offsets[i]; k < end; k += W) {
+                            auto const n = end - k < W ? end - k : W;
+
+                            if (n < W) {
+                                for (auto m = 0; m < W; m++) {
+                                    tail[m] = m < n ? i + deltas[k + m] : i;
+                                }
+                                gathered(S::load(tail), n);
+                            }
+                            else {
+                                gathered(S::load16(deltas + k, ii), W);
+                            }
+                        }
+
+                        row(farneighbors, faroffsets[i], faroffsets[i + 1]);
+                    }
+                    else {
+                        row(neighbors, offsets[i], offsets[i + 1]);
+                    }
+                }, fx, fy, fz, energy);
+            }
+        }
+
+        void cell_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                if (energy) {
+                    cell<real, Potential, true>(param, first, last, ranges, nranges, fx, fy, fz, *energy);
+                }
+                else {
+                    ForceKernelEnergy dummy;
+                    cell<real, Potential, false>(param, first, last, ranges, nranges, fx, fy, fz, dummy);
+                }
+            });
+        }
+
+        void normal_avx512(std::uint32_t const * bits, std::int32_t n, double * g)
+        {
+            for (auto m = 0; m < n; m += Avx512<double>::WIDTH) {
+                myrandom::Philox::to_normal<Avx512<double>>(bits + m, n, g + m);
+            }
+        }
+
+        void rows_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            potential::dispatch(param.potential.type, [&](auto policy) {
+                using Potential = decltype(policy);
+
+                ForceKernelEnergy dummy;
+
+                if (param.deltas) {
+                    if (energy) {
+                        rows<real, Potential, true, true>(param, first, last, fx, fy, fz, *energy);
+                    }
+                    else {
+                        rows<real, Potential, false, true>(param, first, last, fx, fy, fz, dummy);
+                    }
+                }
+                else if (energy) {
+                    rows<real, Potential, true, false>(param, first, last, fx, fy, fz, *energy);
+                }
+                else {
+                    rows<real, Potential, false, false>(param, first, last, fx, fy, fz, dummy);
+                }
+            });
+        }
+#else
+        void cell_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, std::array<std::int32_t, 2> const * ranges, std::int32_t nranges, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            // x86-64以外では、best_simd()がAVX-512を返すことはない
+            cell_scalar(param, first, last, ranges, nranges, fx, fy, fz, energy);
+        }
+
+        void normal_avx512(std::uint32_t const * bits, std::int32_t n, double * g)
+        {
+            // x86-64以外では、best_simd()がAVX-512を返すことはない
+            normal_scalar(bits, n, g);
+        }
+
+        void rows_avx512(ForceKernelParam const & param, std::int32_t first, std::int32_t last, real * fx, real * fy, real * fz, ForceKernelEnergy * energy)
+        {
+            // x86-64以外では、best_simd()がAVX-512を返すことはない
+            rows_scalar(param, first, last, fx, fy, fz, energy);
+        }
+#endif
+    }
+}
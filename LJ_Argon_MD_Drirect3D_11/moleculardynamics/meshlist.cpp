@@ -6,92 +6,306 @@
 */
 
 #include "meshlist.h"
+#include <algorithm>                        // for std::copy, std::copy_n, std::min, std::sort
+#include <array>                            // for std::array
+#include <cmath>                            // for std::floor
+#include <functional>                       // for std::plus
+#include <utility>                          // for std::make_pair, std::pair
 #include <boost/assert.hpp>                 // for BOOST_ASSERT
-#include <boost/range/algorithm/fill.hpp>   // for boost::fill
+#include <tbb/parallel_for.h>               // for tbb::parallel_for
+#include <tbb/parallel_scan.h>              // for tbb::parallel_scan
 
 namespace moleculardynamics {
-    MeshList::MeshList(double periodiclen) : periodiclen_(periodiclen)
+    MeshList::MeshList(double periodiclen, double rcutoff, double margin, bool tight)
+        : div_(MeshList::divisions(periodiclen, rcutoff, margin)), ml2_((rcutoff + margin) * (rcutoff + margin)), periodiclen_(periodiclen)
     {
-        auto const SL = SystemParam::RCUTOFF + SystemParam::MARGIN;
-        
-        m_ = static_cast<std::int32_t>(periodiclen / SL) - 1;
+        auto const SL = rcutoff + margin;
+
+        BOOST_ASSERT(div_ > 0);
+
+        m_ = tight && div_ == 1 ? static_cast<std::int32_t>(periodiclen / SL) : MeshList::mesh_per_side(div_, periodiclen, SL);
         mesh_size_ = static_cast<double>(periodiclen) / m_;
-        
-        BOOST_ASSERT(m_ > 2);
-        BOOST_ASSERT(mesh_size_ > SL);
-        
+
+        BOOST_ASSERT(m_ >= 2 * div_ + 1);
+        BOOST_ASSERT(mesh_size_ * div_ >= SL);
+
+        stencil_ = MeshList::make_stencil(div_, mesh_size_, ml2_);
+
         number_of_mesh_ = m_ * m_ * m_;
         count_.resize(number_of_mesh_);
         indexes_.resize(number_of_mesh_);
+        pointer_ = std::make_unique<std::atomic<std::int32_t>[]>(number_of_mesh_);
+
+        // 番地をMorton順（Z曲線の順）に並べた表を作る
+        std::vector<std::pair<std::uint64_t, std::int32_t> > codes(number_of_mesh_);
+        for (auto id = 0; id < number_of_mesh_; id++) {
+            codes[id] = std::make_pair(MeshList::morton_code(id % m_, (id / m_) % m_, id / m_ / m_), id);
+        }
+
+        std::sort(codes.begin(), codes.end());
+
+        morton_order_.resize(number_of_mesh_);
+        for (auto k = 0; k < number_of_mesh_; k++) {
+            morton_order_[k] = codes[k].second;
+        }
     }
 
-    void MeshList::make_pair(SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs)
+    void MeshList::calc_force(std::int32_t first, std::int32_t last, forcekernel::cellfunc kernel, PotentialParam const & potential, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const
     {
-        pairs.clear();
-        
-        auto const pn = atoms.size();
+        ForceKernelParam const param = {
+            sortedx_.data(), sortedy_.data(), sortedz_.data(),
+            nullptr, nullptr, nullptr, nullptr, nullptr,
+            periodiclen_, potential };
 
-        std::vector<std::int32_t> particle_position(pn, 0);
-        std::vector<std::int32_t> pointer(number_of_mesh_, 0);
+        std::array<std::array<std::int32_t, 2>, MeshList::MAXNEIGHBORMESH> ranges;
 
-        boost::fill(count_, 0);
-
-        auto const im = 1.0 / mesh_size_;
-        for (auto i = 0U; i < pn; i++) {
-            auto ix = static_cast<std::int32_t>(atoms[i].r[0] * im);
-            auto iy = static_cast<std::int32_t>(atoms[i].r[1] * im);
-            auto iz = static_cast<std::int32_t>(atoms[i].r[2] * im);
-            
-            if (ix < 0) {
-                ix += m_;
-            }
-            else if (ix >= m_) {
-                ix -= m_;
+        for (auto id = first; id < last; id++) {
+            if (!count_[id]) {
+                continue;
             }
 
-            if (iy < 0) {
-                iy += m_;
-            }
-            else if (iy >= m_) {
-                iy -= m_;
-            }
-            if (iz < 0) {
-                iz += m_;
-            }
-            else if (iz >= m_) {
-                iz -= m_;
+            auto const ix = id % m_;
+            auto const iy = (id / m_) % m_;
+            auto const iz = (id / m_ / m_);
+
+            // 隣接番地の原子は座標が連続して並んでいるので、区間として渡す（空の番地は飛ばす）
+            auto nranges = 0;
+            for (auto const & s : stencil_) {
+                auto const id2 = mesh_index(ix + s[0], iy + s[1], iz + s[2]);
+                if (count_[id2]) {
+                    ranges[nranges++] = { indexes_[id2], indexes_[id2] + count_[id2] };
+                }
             }
 
-            auto const index = ix + iy * m_ + iz * m_ * m_;
-            
-            BOOST_ASSERT(index >= 0);
-            BOOST_ASSERT(index < number_of_mesh_);
-            
-            count_[index]++;
-            particle_position[i] = index;
+            kernel(param, indexes_[id], indexes_[id] + count_[id], ranges.data(), nranges, fx, fy, fz, energy);
         }
-        
-        indexes_[0] = 0;
-        auto sum = 0;
-        
-        for (auto i = 0; i < number_of_mesh_ - 1; i++) {
-            sum += count_[i];
-            indexes_[i + 1] = sum;
+    }
+
+    std::int32_t MeshList::divisions(double periodiclen, double rcutoff, double margin)
+    {
+        auto const SL = rcutoff + margin;
+
+        // 一辺に3個より多くの番地が取れるなら、番地の一辺をカットオフ半径とマージンの和以上にする
+        if (static_cast<std::int32_t>(periodiclen / SL) - 1 > 2) {
+            return 1;
         }
-        
-        for (auto i = 0U; i < pn; i++) {
-            auto const pos = particle_position[i];
-            auto const j = indexes_[pos] + pointer[pos];
-            sorted_buffer[j] = i;
-            ++pointer[pos];
+
+        // ±k個先の番地が自分自身や互いに重ならないためには、一辺に2k + 1個以上の番地が必要
+        // さらに、番地を辿る手間はすべての組を調べるより重いので、調べる体積が箱の体積の
+        // MAXSEARCHFRACTION以下になるkのうち、調べる体積が最も小さいものだけを用いる
+        auto div = 0;
+        auto minfraction = MeshList::MAXSEARCHFRACTION;
+        for (auto k = 2; k <= MeshList::MAXDIVISIONS; k++) {
+            auto const m = MeshList::mesh_per_side(k, periodiclen, SL);
+            if (m < 2 * k + 1) {
+                continue;
+            }
+
+            auto const stencil = MeshList::make_stencil(k, periodiclen / m, SL * SL);
+
+            // 自分自身の番地の半分も調べる
+            auto const fraction = (static_cast<double>(stencil.size()) + 0.5) / static_cast<double>(m * m * m);
+            if (fraction <= minfraction) {
+                div = k;
+                minfraction = fraction;
+            }
         }
-        
-        for (auto i = 0; i < number_of_mesh_; i++) {
-            search(i, atoms, pairs);
+
+        return div;
+    }
+
+    void MeshList::bin(SystemParam::myatomvector const & atoms)
+    {
+        auto const pn = static_cast<std::int32_t>(atoms.size());
+
+        // 各原子の番地を並列に求め、番地ごとの原子数を数える
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            [this](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    pointer_[i].store(0, std::memory_order_relaxed);
+                }
+        });
+
+        auto const im = 1.0 / mesh_size_;
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, pn),
+            [this, &atoms, im](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    auto const index = mesh_index(
+                        static_cast<std::int32_t>(std::floor(atoms.rx[i] * im)),
+                        static_cast<std::int32_t>(std::floor(atoms.ry[i] * im)),
+                        static_cast<std::int32_t>(std::floor(atoms.rz[i] * im)));
+
+                    BOOST_ASSERT(index >= 0);
+                    BOOST_ASSERT(index < number_of_mesh_);
+
+                    particle_position_[i] = index;
+                    pointer_[index].fetch_add(1, std::memory_order_relaxed);
+                }
+        });
+
+        // 番地番号の頭出しのインデックスを、番地ごとの原子数の累積和として並列に求める
+        tbb::parallel_scan(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            0,
+            [this](tbb::blocked_range<std::int32_t> const & range, std::int32_t sum, bool isfinal) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    auto const n = pointer_[i].load(std::memory_order_relaxed);
+                    if (isfinal) {
+                        count_[i] = n;
+                        indexes_[i] = sum;
+                    }
+                    sum += n;
+                }
+                return sum;
+            },
+            std::plus<>());
+
+        // 原子を番地ごとに並列に振り分ける
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            [this](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    pointer_[i].store(indexes_[i], std::memory_order_relaxed);
+                }
+        });
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, pn),
+            [this](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    sorted_buffer[pointer_[particle_position_[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+                }
+        });
+
+        // 番地の中の順番がスレッドのスケジューリングに依存しないように、番地ごとにソートする
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            [this](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    std::sort(sorted_buffer.begin() + indexes_[i], sorted_buffer.begin() + indexes_[i] + count_[i]);
+                }
+        });
+
+        // 番地の中の原子の座標が連続するように、座標を番地の順に並べた写しを作る
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, pn),
+            [this, &atoms](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto k = range.begin(); k != range.end(); ++k) {
+                    auto const i = sorted_buffer[k];
+                    sorted_position_[i] = k;
+                    sortedx_[k] = atoms.rx[i];
+                    sortedy_[k] = atoms.ry[i];
+                    sortedz_[k] = atoms.rz[i];
+                }
+        });
+    }
+
+    void MeshList::make_pair(SystemParam::myatomvector const & atoms, PairList & pairs)
+    {
+        auto const pn = static_cast<std::int32_t>(atoms.size());
+
+        bin(atoms);
+
+        // 原子ごとの行を、スレッドごとのバッファへ並列に詰める
+        for (auto && buf : buffers_) {
+            buf.clear();
+        }
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_, MeshList::MESHGRAINSIZE),
+            [this](tbb::blocked_range<std::int32_t> const & range) {
+                auto & buf = buffers_.local();
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    search(i, buf);
+                }
+        });
+
+        // 原子のインデックスの順に並べ替えて、CSR形式にする
+        pairs.clear(pn);
+
+        tbb::parallel_scan(
+            tbb::blocked_range<std::int32_t>(0, pn),
+            0,
+            [this, &pairs](tbb::blocked_range<std::int32_t> const & range, std::int32_t sum, bool isfinal) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    sum += rowcount_[i];
+                    if (isfinal) {
+                        pairs.offsets[i + 1] = sum;
+                    }
+                }
+                return sum;
+            },
+            std::plus<>());
+
+        pairs.neighbors.resize(pairs.offsets[pn]);
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, pn),
+            [this, &pairs](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    std::copy_n(rowbuffer_[i]->begin() + rowbegin_[i], rowcount_[i], pairs.neighbors.begin() + pairs.offsets[i]);
+                }
+        });
+    }
+
+    std::vector<std::array<std::int32_t, 3> > MeshList::make_stencil(std::int32_t div, double mesh_size, double ml2)
+    {
+        // 位置の差がd個の番地の間の、その方向の最短距離
+        auto const gap = [mesh_size](std::int32_t d) {
+            auto const n = (d < 0 ? -d : d) - 1;
+            return n > 0 ? static_cast<double>(n) * mesh_size : 0.0;
+        };
+
+        std::vector<std::array<std::int32_t, 3> > stencil;
+
+        // 作用・反作用の法則により、番地の位置の差が（z, y, x）の辞書式順序で正の側の半分だけを調べる
+        // （yは0, -1, 1, -2, 2, ...の順にたどる。div == 1のときは、従来の13個の隣接番地と同じ順序になる）
+        for (auto dz = 0; dz <= div; dz++) {
+            for (auto a = 0; a <= 2 * div; a++) {
+                auto const dy = (a & 1) ? -(a + 1) / 2 : a / 2;
+
+                for (auto dx = -div; dx <= div; dx++) {
+                    if (!dz && (dy < 0 || (!dy && dx <= 0))) {
+                        continue;
+                    }
+
+                    // 番地の間の最短距離がカットオフ半径とマージンの和を超える番地は、調べなくてよい
+                    auto const gx = gap(dx), gy = gap(dy), gz = gap(dz);
+                    if (gx * gx + gy * gy + gz * gz <= ml2) {
+                        stencil.push_back({ dx, dy, dz });
+                    }
+                }
+            }
         }
+
+        return stencil;
+    }
+
+    std::int32_t MeshList::mesh_per_side(std::int32_t div, double periodiclen, double sl)
+    {
+        return div == 1 ? static_cast<std::int32_t>(periodiclen / sl) - 1 : static_cast<std::int32_t>(div * periodiclen / sl);
     }
 
-    void MeshList::search_other(std::int32_t id, std::int32_t ix, std::int32_t iy, std::int32_t iz, SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs)
+    std::uint64_t MeshList::morton_code(std::int32_t ix, std::int32_t iy, std::int32_t iz)
+    {
+        // 各座標のビットを3ビットおきに散らす
+        auto const spread = [](std::uint64_t v) {
+            v &= 0x1FFFFF;
+            v = (v | v << 32) & 0x1F00000000FFFF;
+            v = (v | v << 16) & 0x1F0000FF0000FF;
+            v = (v | v << 8) & 0x100F00F00F00F00F;
+            v = (v | v << 4) & 0x10C30C30C30C30C3;
+            v = (v | v << 2) & 0x1249249249249249;
+            return v;
+        };
+
+        return spread(static_cast<std::uint64_t>(ix)) | spread(static_cast<std::uint64_t>(iy)) << 1 | spread(static_cast<std::uint64_t>(iz)) << 2;
+    }
+
+    std::int32_t MeshList::mesh_index(std::int32_t ix, std::int32_t iy, std::int32_t iz) const
     {
         if (ix < 0) {
             ix += m_;
@@ -114,64 +328,117 @@ namespace moleculardynamics {
             iz -= m_;
         }
         
-        auto const id2 = ix + iy * m_ + iz * m_ * m_;
-
-        for (auto k = indexes_[id]; k < indexes_[id] + count_[id]; k++) {
-            for (auto m_ = indexes_[id2]; m_ < indexes_[id2] + count_[id2]; m_++) {
-                auto const i = sorted_buffer[k];
-                auto const j = sorted_buffer[m_];
-
-                Eigen::Vector4d d = atoms[j].r - atoms[i].r;
-                
-                SystemParam::adjust_periodic(d, periodiclen_);
-                
-                if (d.squaredNorm() <= SystemParam::ML2) {
-                    pairs.push_back(std::make_pair(i, j));
-                }
-            }
+        return ix + iy * m_ + iz * m_ * m_;
+    }
+
+    void MeshList::sort_atoms(SystemParam::myatomvector const & atoms, std::vector<std::int32_t> & order, bool morton)
+    {
+        bin(atoms);
+
+        order.resize(atoms.size());
+
+        if (!morton) {
+            std::copy(sorted_buffer.begin(), sorted_buffer.end(), order.begin());
+            return;
         }
+
+        // 番地をMorton順にたどったときの、各番地の頭出しのインデックスを求める
+        tbb::parallel_scan(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            0,
+            [this](tbb::blocked_range<std::int32_t> const & range, std::int32_t sum, bool isfinal) {
+                for (auto k = range.begin(); k != range.end(); ++k) {
+                    auto const id = morton_order_[k];
+                    if (isfinal) {
+                        pointer_[id].store(sum, std::memory_order_relaxed);
+                    }
+                    sum += count_[id];
+                }
+                return sum;
+            },
+            std::plus<>());
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, number_of_mesh_),
+            [this, &order](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto id = range.begin(); id != range.end(); ++id) {
+                    std::copy_n(
+                        sorted_buffer.begin() + indexes_[id],
+                        count_[id],
+                        order.begin() + pointer_[id].load(std::memory_order_relaxed));
+                }
+        });
     }
 
-    void MeshList::search(std::int32_t id, SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs)
+    void MeshList::search(std::int32_t id, PairList::myindexvector & buffer)
     {
         auto const ix = id % m_;
         auto const iy = (id / m_) % m_;
         auto const iz = (id / m_ / m_);
 
-        search_other(id, ix + 1, iy, iz, atoms, pairs);
-        search_other(id, ix - 1, iy + 1, iz, atoms, pairs);
-        search_other(id, ix, iy + 1, iz, atoms, pairs);
-        search_other(id, ix + 1, iy + 1, iz, atoms, pairs);
-
-        search_other(id, ix - 1, iy, iz + 1, atoms, pairs);
-        search_other(id, ix, iy, iz + 1, atoms, pairs);
-        search_other(id, ix + 1, iy, iz + 1, atoms, pairs);
+        auto const numneighbors = static_cast<std::int32_t>(stencil_.size());
 
-        search_other(id, ix - 1, iy - 1, iz + 1, atoms, pairs);
-        search_other(id, ix, iy - 1, iz + 1, atoms, pairs);
-        search_other(id, ix + 1, iy - 1, iz + 1, atoms, pairs);
-
-        search_other(id, ix - 1, iy + 1, iz + 1, atoms, pairs);
-        search_other(id, ix, iy + 1, iz + 1, atoms, pairs);
-        search_other(id, ix + 1, iy + 1, iz + 1, atoms, pairs);
+        std::array<std::int32_t, MeshList::MAXNEIGHBORMESH> neighbors;
+        for (auto s = 0; s < numneighbors; s++) {
+            neighbors[s] = mesh_index(ix + stencil_[s][0], iy + stencil_[s][1], iz + stencil_[s][2]);
+        }
 
-        // Registration of self box
         auto const si = indexes_[id];
         auto const n = count_[id];
 
-        for (auto k = si; k < si + n - 1; k++) {
-            for (auto m_ = k + 1; m_ < si + n; m_++) {
-                auto const i = sorted_buffer[k];
-                auto const j = sorted_buffer[m_];
+        auto const L = static_cast<real>(periodiclen_);
+        auto const LH = static_cast<real>(periodiclen_ * 0.5);
+
+        for (auto k = si; k < si + n; k++) {
+            auto const i = sorted_buffer[k];
+            auto const xi = sortedx_[k], yi = sortedy_[k], zi = sortedz_[k];
+
+            rowbegin_[i] = static_cast<std::int32_t>(buffer.size());
+            rowbuffer_[i] = &buffer;
+
+            // 番地の中の原子は座標が連続しているので、まとめて距離を判定してから相手の原子を詰める
+            auto const check = [this, &buffer, xi, yi, zi, L, LH](std::int32_t first, std::int32_t last) {
+                std::array<std::uint8_t, MeshList::SEARCHBLOCKSIZE> inside;
 
-                Eigen::Vector4d d = atoms[j].r - atoms[i].r;
+                for (; first < last; first += MeshList::SEARCHBLOCKSIZE) {
+                    auto const len = std::min(MeshList::SEARCHBLOCKSIZE, last - first);
 
-                SystemParam::adjust_periodic(d, periodiclen_);
+                    // 周期境界条件の補正（SystemParam::adjust_periodic()と同じ結果になる）を分岐なしで書いて、ベクトル化させる
+                    for (auto m = 0; m < len; m++) {
+                        auto dx = sortedx_[first + m] - xi;
+                        auto dy = sortedy_[first + m] - yi;
+                        auto dz = sortedz_[first + m] - zi;
 
-                if (d.squaredNorm() <= SystemParam::ML2) {
-                    pairs.push_back(std::make_pair(i, j));
+                        dx += (dx < -LH ? L : real(0)) - (dx > LH ? L : real(0));
+                        dy += (dy < -LH ? L : real(0)) - (dy > LH ? L : real(0));
+                        dz += (dz < -LH ? L : real(0)) - (dz > LH ? L : real(0));
+
+                        inside[m] = dx * dx + dy * dy + dz * dz <= ml2_;
+                    }
+
+                    auto const size = buffer.size();
+                    buffer.resize(size + len);
+
+                    auto const row = buffer.data() + size;
+                    auto count = 0;
+                    for (auto m = 0; m < len; m++) {
+                        row[count] = sorted_buffer[first + m];
+                        count += inside[m];
+                    }
+
+                    buffer.resize(size + count);
                 }
+            };
+
+            // Registration of self box
+            check(k + 1, si + n);
+
+            for (auto s = 0; s < numneighbors; s++) {
+                auto const id2 = neighbors[s];
+                check(indexes_[id2], indexes_[id2] + count_[id2]);
             }
+
+            rowcount_[i] = static_cast<std::int32_t>(buffer.size()) - rowbegin_[i];
         }
     }
 }
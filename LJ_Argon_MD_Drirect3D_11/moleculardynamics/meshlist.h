@@ -11,7 +11,14 @@
 
 #pragma once
 
+#include "forcekernel.h"
+#include "pairlist.h"
 #include "systemparam.h"
+#include <array>                            // for std::array
+#include <atomic>                           // for std::atomic
+#include <memory>                           // for std::unique_ptr
+#include <vector>                           // for std::vector
+#include <tbb/enumerable_thread_specific.h> // for tbb::enumerable_thread_specific
 
 namespace moleculardynamics {
     //! A class.
@@ -24,10 +31,14 @@ namespace moleculardynamics {
     public:
         //! A constructor.
         /*!
-            唯一のコンストラクタ
+            唯一のコンストラクタ（divisions()が0を返す小さな箱では作れない）
             \param periodiclen 周期の長さ
+            \param rcutoff カットオフ半径
+            \param margin ペアリストのマージン
+            \param tight 番地を細かくしないとき、一辺の番地の数を余裕を持たせずに最大にするならtrue
+            （番地の組から直接力を計算するときは、調べる組の数がそのまま力の計算の量になるので、番地を小さくする）
         */
-        explicit MeshList(double periodiclen);
+        MeshList(double periodiclen, double rcutoff, double margin, bool tight = false);
 
         //! A destructor.
         /*!
@@ -38,58 +49,202 @@ namespace moleculardynamics {
         // #endregion コンストラクタ・デストラクタ
 
         // #region publicメンバ関数
+
+        //! A public member function.
+        /*!
+            原子を番地ごとに振り分けて、住所録と、番地の順に並べた座標の写しを作成する
+            \param atoms 原子の座標が格納された可変長配列
+        */
+        void bin(SystemParam::myatomvector const & atoms);
+
+        //! A public member function (constant).
+        /*!
+            直前のbin()で振り分けた原子について、番地の[first, last)にいる原子と、番地の中と隣接番地の原子との間に働く力を計算する
+            （力の配列の添字は番地の順に並べた後の順序で、原子のインデックスはsorted_position()で対応付ける）
+            \param first 最初の番地
+            \param last 最後の番地の次
+            \param kernel 番地ごとに力を計算するカーネル
+            \param potential ポテンシャルの種類と係数
+            \param fx 番地の順に並べた原子に働く力のx成分
+            \param fy 番地の順に並べた原子に働く力のy成分
+            \param fz 番地の順に並べた原子に働く力のz成分
+            \param energy ポテンシャルエネルギーとビリアルの和（nullptrなら計算しない）
+        */
+        void calc_force(std::int32_t first, std::int32_t last, forcekernel::cellfunc kernel, PotentialParam const & potential, real * fx, real * fy, real * fz, ForceKernelEnergy * energy) const;
+
+        //! A public static member function.
+        /*!
+            カットオフ半径とマージンの和を、番地の一辺で何分割するかを求める
+            通常は1（番地の一辺がカットオフ半径とマージンの和以上）だが、一辺に3個より多くの番地が
+            取れない小さな箱では、番地をk分の1に細かくして±k個先の番地まで調べる
+            \param periodiclen 周期の長さ
+            \param rcutoff カットオフ半径
+            \param margin ペアリストのマージン
+            \return 分割数（箱が小さすぎてメッシュリストを作れないか、すべての組を調べるほうが速ければ0）
+        */
+        static std::int32_t divisions(double periodiclen, double rcutoff, double margin);
         
         //! A public member function.
         /*!
-            原子の住所録を作成する
+            原子の住所録を作成し、ペアリストを構築する
             \param atoms 原子の座標が格納された可変長配列
-            \param pairs 原子のペアが格納された可変長配列
+            \param pairs 構築したペアリスト
+        */
+        void make_pair(SystemParam::myatomvector const & atoms, PairList & pairs);
+
+        //! A public member function (constant).
+        /*!
+            トータルのメッシュの数を返す
+            \return トータルのメッシュの数
         */
-        void make_pair(SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs);
+        std::int32_t number_of_mesh() const
+        {
+            return number_of_mesh_;
+        }
         
+        //! A public member function.
+        /*!
+            原子を番地の順に並べたときの順序を求める
+            \param atoms 原子の座標が格納された可変長配列
+            \param order 原子の並べ替えの順序（k番目に来る原子のインデックス）
+            \param morton 番地をMorton順（Z曲線の順）にたどるならtrue、番地番号の順ならfalse
+        */
+        void sort_atoms(SystemParam::myatomvector const & atoms, std::vector<std::int32_t> & order, bool morton);
+
         //! A public member function.
         /*!
             原子の数を設定する
             \param pn 原子の数
         */
-        void set_number_of_atoms(std::size_t pn) { sorted_buffer.resize(pn); }
+        void set_number_of_atoms(std::size_t pn)
+        {
+            particle_position_.resize(pn);
+            sorted_buffer.resize(pn);
+            sorted_position_.resize(pn);
+            sortedx_.resize(pn);
+            sortedy_.resize(pn);
+            sortedz_.resize(pn);
+            rowbegin_.resize(pn);
+            rowbuffer_.resize(pn);
+            rowcount_.resize(pn);
+        }
         
+        //! A public member function (constant).
+        /*!
+            直前のbin()で、原子を番地の順に並べたときの位置を返す
+            \param i 原子のインデックス
+            \return 番地の順に並べたときの位置
+        */
+        std::int32_t sorted_position(std::int32_t i) const
+        {
+            return sorted_position_[i];
+        }
+
         // #endregion publicメンバ関数
 
         // #region privateメンバ関数
 
     private:
-        //! A private member function.
+        //! A private static member function.
         /*!
-            住所録から逆引きして調べる関数
-            \param id 番地
-            \param atoms 原子の座標が格納された可変長配列
-            \param pairs 原子のペアが格納された可変長配列
+            相互作用を調べる隣接番地の、番地の位置の差の一覧を作る
+            \param div カットオフ半径とマージンの和を、番地の一辺で分割する数
+            \param mesh_size メッシュのサイズ
+            \param ml2 カットオフ半径とマージンの和の平方
+            \return 番地の位置の差（x, y, z）の一覧
         */
-        void search(std::int32_t id, SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs);
-        
-        //! A private member function.
+        static std::vector<std::array<std::int32_t, 3> > make_stencil(std::int32_t div, double mesh_size, double ml2);
+
+        //! A private member function (constant).
         /*!
-            隣接番地での探索を行う関数
-            \param id 番地
+            周期境界条件を考慮して、番地の番号を求める
             \param ix 番地（x座標）
             \param iy 番地（y座標）
             \param iz 番地（z座標）
-            \param atoms 原子の座標が格納された可変長配列
-            \param pairs 原子のペアが格納された可変長配列
+            \return 番地の番号
+        */
+        std::int32_t mesh_index(std::int32_t ix, std::int32_t iy, std::int32_t iz) const;
+
+        //! A private static member function.
+        /*!
+            一辺のメッシュの数を求める
+            \param div カットオフ半径とマージンの和を、番地の一辺で分割する数
+            \param periodiclen 周期の長さ
+            \param sl カットオフ半径とマージンの和
+            \return 一辺のメッシュの数
         */
-        void search_other(std::int32_t id, std::int32_t ix, std::int32_t iy, std::int32_t iz, SystemParam::myatomvector & atoms, SystemParam::mypairvector & pairs);
+        static std::int32_t mesh_per_side(std::int32_t div, double periodiclen, double sl);
+
+        //! A private static member function.
+        /*!
+            番地のMorton符号を求める
+            \param ix 番地（x座標）
+            \param iy 番地（y座標）
+            \param iz 番地（z座標）
+            \return Morton符号
+        */
+        static std::uint64_t morton_code(std::int32_t ix, std::int32_t iy, std::int32_t iz);
+
+        //! A private member function.
+        /*!
+            住所録から逆引きして、番地にいる原子ごとに相手の原子を調べる関数
+            \param id 番地
+            \param buffer 相手の原子を詰めるバッファ
+        */
+        void search(std::int32_t id, PairList::myindexvector & buffer);
 
         // #endregion privateメンバ関数
 
         // #region privateメンバ変数
 
+        //! A private member variable (static constant).
+        /*!
+            カットオフ半径とマージンの和を分割する数の最大値
+        */
+        static auto constexpr MAXDIVISIONS = 4;
+
+        //! A private member variable (static constant).
+        /*!
+            相互作用を調べる隣接番地の数の最大値（作用・反作用の法則により、(2k + 1)^3 - 1個のうち半分だけを調べる）
+        */
+        static auto constexpr MAXNEIGHBORMESH = ((2 * MAXDIVISIONS + 1) * (2 * MAXDIVISIONS + 1) * (2 * MAXDIVISIONS + 1) - 1) / 2;
+
+        //! A private member variable (static constant).
+        /*!
+            番地を細かくするときに、調べる体積が箱の体積に占める割合の上限
+        */
+        static auto constexpr MAXSEARCHFRACTION = 0.25;
+
+        //! A private member variable (static constant).
+        /*!
+            番地の中の原子について、距離の判定をまとめて行う相手の原子の数
+        */
+        static auto constexpr SEARCHBLOCKSIZE = 64;
+
+        //! A private member variable (static constant).
+        /*!
+            番地のループを並列化するときの粒度
+        */
+        static auto constexpr MESHGRAINSIZE = 16;
+
+        //! A private member variable.
+        /*!
+            原子ごとに相手の原子を一時的に格納する、スレッドごとのバッファ（番地の順に並ぶ）
+        */
+        tbb::enumerable_thread_specific<PairList::myindexvector> buffers_;
+
         //! A private member variable.
         /*!
             どの番地に何個原子がいるかの数
         */
         std::vector<std::int32_t> count_;
 
+        //! A private member variable.
+        /*!
+            カットオフ半径とマージンの和を、番地の一辺で分割する数
+        */
+        std::int32_t div_;
+
         //! A private member variable.
         /*!
             番地番号でソートした際に、番地番号の頭出しのインデックス
@@ -108,18 +263,90 @@ namespace moleculardynamics {
         */
         double mesh_size_;
 
+        //! A private member variable (constant).
+        /*!
+            カットオフ半径とマージンの和の平方
+        */
+        double const ml2_;
+
+        //! A private member variable.
+        /*!
+            番地をMorton順に並べた表
+        */
+        std::vector<std::int32_t> morton_order_;
+
         //! A private member variable.
         /*!
             トータルのメッシュの数
         */
         std::int32_t number_of_mesh_;
 
+        //! A private member variable.
+        /*!
+            各原子がどの番地にいるか
+        */
+        std::vector<std::int32_t> particle_position_;
+
+        //! A private member variable.
+        /*!
+            番地ごとの原子数を数え、原子を振り分けるためのカウンタ
+        */
+        std::unique_ptr<std::atomic<std::int32_t>[]> pointer_;
+
+        //! A private member variable.
+        /*!
+            各原子の相手の原子が、バッファのどこから始まるか
+        */
+        std::vector<std::int32_t> rowbegin_;
+
+        //! A private member variable.
+        /*!
+            各原子の相手の原子が、どのスレッドのバッファに格納されているか
+        */
+        std::vector<PairList::myindexvector const *> rowbuffer_;
+
+        //! A private member variable.
+        /*!
+            各原子の相手の原子の数
+        */
+        std::vector<std::int32_t> rowcount_;
+
         //! A private member variable.
         /*!
             番地番号でソートした原子インデックス
         */
         std::vector<std::int32_t> sorted_buffer;
 
+        //! A private member variable.
+        /*!
+            各原子を番地番号でソートしたときの位置（sorted_bufferの逆引き）
+        */
+        std::vector<std::int32_t> sorted_position_;
+
+        //! A private member variable.
+        /*!
+            番地番号でソートした原子の座標のx成分
+        */
+        AtomArray::myvector sortedx_;
+
+        //! A private member variable.
+        /*!
+            番地番号でソートした原子の座標のy成分
+        */
+        AtomArray::myvector sortedy_;
+
+        //! A private member variable.
+        /*!
+            番地番号でソートした原子の座標のz成分
+        */
+        AtomArray::myvector sortedz_;
+
+        //! A private member variable.
+        /*!
+            相互作用を調べる隣接番地の、番地の位置の差（x, y, z）の一覧
+        */
+        std::vector<std::array<std::int32_t, 3> > stencil_;
+
         //! A private member variable (constant).
         /*!
             周期の長さ
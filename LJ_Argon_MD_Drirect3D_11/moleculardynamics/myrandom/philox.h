@@ -0,0 +1,335 @@
+﻿/*! \file philox.h
+    \brief カウンタベースの乱数生成器Philox4x32-10の宣言と実装
+
+    Copyright © 2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _PHILOX_H_
+#define _PHILOX_H_
+
+#pragma once
+
+#include <array>                        // for std::array
+#include <cmath>                        // for std::cos, std::log, std::sin, std::sqrt
+#include <cstdint>                      // for std::int32_t, std::uint32_t, std::uint64_t
+
+namespace myrandom {
+    //! A class.
+    /*!
+        カウンタベースの乱数生成器Philox4x32-10
+        (J. K. Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11)
+        内部状態を持たず、（カウンタ, 鍵）の組から乱数を直接計算するので、
+        どのスレッドでどの順番で生成しても同じ乱数列が得られる
+    */
+    class Philox final {
+        // #region 型エイリアス
+
+    public:
+        using ctr_type = std::array<std::uint32_t, 4>;
+
+        using key_type = std::array<std::uint32_t, 2>;
+
+        using normal_type = std::array<double, 4>;
+
+        // #endregion 型エイリアス
+
+        // #region static publicメンバ関数
+
+        //! A public static member function.
+        /*!
+            カウンタと鍵から、4個の32ビットの乱数を生成する
+            \param ctr カウンタ
+            \param key 鍵
+            \return 4個の32ビットの乱数
+        */
+        static ctr_type generate(ctr_type ctr, key_type key)
+        {
+            for (auto i = 0; i < Philox::ROUNDS; i++) {
+                if (i) {
+                    key[0] += Philox::W0;
+                    key[1] += Philox::W1;
+                }
+
+                auto const p0 = static_cast<std::uint64_t>(Philox::M0) * ctr[0];
+                auto const p1 = static_cast<std::uint64_t>(Philox::M1) * ctr[2];
+
+                ctr = {
+                    static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+                    static_cast<std::uint32_t>(p1),
+                    static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+                    static_cast<std::uint32_t>(p0) };
+            }
+
+            return ctr;
+        }
+
+        template <std::int32_t N>
+        //! A public static member function (template function).
+        /*!
+            N組のカウンタと鍵から、それぞれ4個の32ビットの乱数を生成する
+            （組ごとに独立に計算するので、組についてのループは複数の組のラウンドを並べて実行できる）
+            \tparam N 組の数
+            \param x 成分ごとに並べたカウンタ（x[k * N + m]が、m組目のk番目の成分）で、生成した乱数で上書きされる
+            \param key 鍵
+        */
+        static void generate(std::uint32_t * x, key_type key)
+        {
+            for (auto i = 0; i < Philox::ROUNDS; i++) {
+                if (i) {
+                    key[0] += Philox::W0;
+                    key[1] += Philox::W1;
+                }
+
+                for (auto m = 0; m < N; m++) {
+                    auto const p0 = static_cast<std::uint64_t>(Philox::M0) * x[m];
+                    auto const p1 = static_cast<std::uint64_t>(Philox::M1) * x[2 * N + m];
+                    auto const y0 = static_cast<std::uint32_t>(p1 >> 32) ^ x[N + m] ^ key[0];
+                    auto const y2 = static_cast<std::uint32_t>(p0 >> 32) ^ x[3 * N + m] ^ key[1];
+
+                    x[N + m] = static_cast<std::uint32_t>(p1);
+                    x[3 * N + m] = static_cast<std::uint32_t>(p0);
+                    x[m] = y0;
+                    x[2 * N + m] = y2;
+                }
+            }
+        }
+
+        //! A public static member function.
+        /*!
+            64ビットのシードから鍵を作る
+            \param seed シード
+            \return 鍵
+        */
+        static key_type make_key(std::uint64_t seed)
+        {
+            return { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) };
+        }
+
+        //! A public static member function.
+        /*!
+            4個の32ビットの乱数から、Box-Muller法で4個の標準正規乱数を作る
+            \param bits generate()で生成した乱数
+            \return 4個の標準正規乱数
+        */
+        static normal_type to_normal(ctr_type const & bits)
+        {
+            auto const r0 = std::sqrt(-2.0 * std::log(Philox::to_uniform(bits[0])));
+            auto const t0 = Philox::TWOPI * Philox::to_uniform(bits[1]);
+            auto const r1 = std::sqrt(-2.0 * std::log(Philox::to_uniform(bits[2])));
+            auto const t1 = Philox::TWOPI * Philox::to_uniform(bits[3]);
+
+            return { r0 * std::cos(t0), r0 * std::sin(t0), r1 * std::cos(t1), r1 * std::sin(t1) };
+        }
+
+        template <typename S>
+        //! A public static member function (template function).
+        /*!
+            SIMDの演算Sを用いて、S::WIDTH組の4個の32ビットの乱数から、Box-Muller法で標準正規乱数を作る
+            （logとsin, cosを多項式で求めるので、to_normal(ctr_type const &)とは最後の数ビットが異なる）
+            \tparam S SIMDの演算の構造体（add, cvtu32, div, exponent, floor, fmadd, gt, lt, mantissa, mul, round,
+                       select, set1, sqrt, store, subを持つ倍精度の演算）
+            \param bits 成分ごとに並べた乱数（bits[k * stride + m]が、m組目のk番目の乱数）
+            \param stride 成分の間隔（S::WIDTHの倍数）
+            \param g 標準正規乱数をbitsと同じ並びで書き込む配列（S::WIDTH個のdoubleの境界に揃えたもの）
+        */
+        static void to_normal(std::uint32_t const * bits, std::int32_t stride, double * g)
+        {
+            using vec = typename S::vec;
+
+            vec u[4];
+            for (auto k = 0; k < 4; k++) {
+                u[k] = S::mul(S::add(S::cvtu32(bits + k * stride), S::set1(1.0)), S::set1(Philox::INV2POW32));
+            }
+
+            auto const r0 = S::sqrt(S::mul(S::set1(-2.0), Philox::log<S>(u[0])));
+            auto const r1 = S::sqrt(S::mul(S::set1(-2.0), Philox::log<S>(u[2])));
+
+            vec c0, s0, c1, s1;
+            Philox::sincos2pi<S>(u[1], c0, s0);
+            Philox::sincos2pi<S>(u[3], c1, s1);
+
+            S::store(g, S::mul(r0, c0));
+            S::store(g + stride, S::mul(r0, s0));
+            S::store(g + 2 * stride, S::mul(r1, c1));
+            S::store(g + 3 * stride, S::mul(r1, s1));
+        }
+
+        //! A public static member function.
+        /*!
+            32ビットの乱数を、(0, 1]の半開区間の一様乱数に変換する
+            \param x 32ビットの乱数
+            \return (0, 1]の一様乱数
+        */
+        static double to_uniform(std::uint32_t x)
+        {
+            return (static_cast<double>(x) + 1.0) * Philox::INV2POW32;
+        }
+
+        // #endregion static publicメンバ関数
+
+        // #region static privateメンバ関数
+
+    private:
+        template <typename S>
+        //! A private static member function (template function).
+        /*!
+            SIMDの演算Sを用いて、レーンごとにlog(u)を求める
+            u = m 2^e（1/√2 <= m < √2）と分け、s = (m - 1) / (m + 1)としてlog(m) = 2 atanh(s)を級数で求める
+            \tparam S SIMDの演算の構造体
+            \param u 引数（正規化数）
+            \return log(u)
+        */
+        static typename S::vec log(typename S::vec u)
+        {
+            auto m = S::mantissa(u);
+            auto e = S::exponent(u);
+
+            // mが√2を超えるレーンは、mを半分にしてeを1つ増やす（どちらも丸め誤差なし）
+            auto const big = S::gt(m, S::set1(1.4142135623730951));
+            m = S::sub(m, S::select(big, S::mul(m, S::set1(0.5))));
+            e = S::add(e, S::select(big, S::set1(1.0)));
+
+            auto const s = S::div(S::sub(m, S::set1(1.0)), S::add(m, S::set1(1.0)));
+            auto const z = S::mul(s, s);
+
+            // |s| <= 0.1716なので、z^9の項までで打ち切り誤差は1ulp以下になる
+            auto q = S::set1(1.0 / 19.0);
+            for (auto k = 8; k >= 1; k--) {
+                q = S::fmadd(q, z, S::set1(1.0 / static_cast<double>(2 * k + 1)));
+            }
+
+            auto const t = S::fmadd(S::mul(s, z), q, s);
+
+            // ln2を上位と下位に分けて掛け、e ln2の丸め誤差を抑える
+            return S::fmadd(e, S::set1(0.693147180369123816490), S::fmadd(e, S::set1(1.90821492927058770002e-10), S::add(t, t)));
+        }
+
+        template <typename S>
+        //! A private static member function (template function).
+        /*!
+            SIMDの演算Sを用いて、レーンごとにcos(2πu)とsin(2πu)を求める
+            4u = q + f（qは整数、|f| <= 1/2）と丸め誤差なしで分け、(π/2)fのcosとsinをTaylor多項式で求めてから、
+            qを4で割った余りに応じて入れ替えと符号の反転を行う
+            \tparam S SIMDの演算の構造体
+            \param u 引数（0 <= u <= 1）
+            \param c cos(2πu)
+            \param s sin(2πu)
+        */
+        static void sincos2pi(typename S::vec u, typename S::vec & c, typename S::vec & s)
+        {
+            // 1 / n!
+            static double constexpr INVFACT[] = {
+                1.0, 1.0, 1.0 / 2.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 120.0, 1.0 / 720.0, 1.0 / 5040.0,
+                1.0 / 40320.0, 1.0 / 362880.0, 1.0 / 3628800.0, 1.0 / 39916800.0, 1.0 / 479001600.0,
+                1.0 / 6227020800.0, 1.0 / 87178291200.0, 1.0 / 1307674368000.0, 1.0 / 20922789888000.0,
+                1.0 / 355687428096000.0 };
+
+            auto const x = S::mul(u, S::set1(4.0));
+            auto const q = S::round(x);
+            auto const a = S::mul(S::sub(x, q), S::set1(Philox::TWOPI * 0.25));
+            auto const a2 = S::mul(a, a);
+
+            // |a| <= π/4なので、sinはa^17、cosはa^16の項までで打ち切り誤差は1ulp以下になる
+            auto ps = S::set1(INVFACT[17]);
+            auto pc = S::set1(INVFACT[16]);
+            for (auto k = 6; k >= 0; k--) {
+                auto const sign = k % 2 ? 1.0 : -1.0;
+                ps = S::fmadd(ps, a2, S::set1(sign * INVFACT[2 * k + 3]));
+                pc = S::fmadd(pc, a2, S::set1(sign * INVFACT[2 * k + 2]));
+            }
+
+            auto const sa = S::fmadd(S::mul(a, a2), ps, a);
+            auto const ca = S::fmadd(a2, pc, S::set1(1.0));
+
+            // qを4で割った余りを、奇数かどうか（odd）と2以上かどうか（h）に分ける
+            auto const q4 = S::sub(q, S::mul(S::floor(S::mul(q, S::set1(0.25))), S::set1(4.0)));
+            auto const h = S::floor(S::mul(q4, S::set1(0.5)));
+            auto const odd = S::sub(q4, S::add(h, h));
+
+            auto const mo = S::gt(odd, S::set1(0.5));
+            auto const me = S::lt(odd, S::set1(0.5));
+            auto const signs = S::sub(S::set1(1.0), S::add(h, h));
+            auto const xoro = S::sub(S::add(odd, h), S::mul(S::set1(2.0), S::mul(odd, h)));
+            auto const signc = S::sub(S::set1(1.0), S::add(xoro, xoro));
+
+            s = S::mul(signs, S::add(S::select(mo, ca), S::select(me, sa)));
+            c = S::mul(signc, S::add(S::select(mo, sa), S::select(me, ca)));
+        }
+
+        // #endregion static privateメンバ関数
+
+        // #region privateメンバ変数
+
+        //! A private member variable (static constant).
+        /*!
+            2^32の逆数
+        */
+        static auto constexpr INV2POW32 = 1.0 / 4294967296.0;
+
+        //! A private member variable (static constant).
+        /*!
+            1番目の乗数
+        */
+        static std::uint32_t constexpr M0 = 0xD2511F53U;
+
+        //! A private member variable (static constant).
+        /*!
+            2番目の乗数
+        */
+        static std::uint32_t constexpr M1 = 0xCD9E8D57U;
+
+        //! A private member variable (static constant).
+        /*!
+            ラウンド数
+        */
+        static auto constexpr ROUNDS = 10;
+
+        //! A private member variable (static constant).
+        /*!
+            2π
+        */
+        static auto constexpr TWOPI = 6.283185307179586476925286766559;
+
+        //! A private member variable (static constant).
+        /*!
+            鍵の1番目の要素の増分（黄金比）
+        */
+        static std::uint32_t constexpr W0 = 0x9E3779B9U;
+
+        //! A private member variable (static constant).
+        /*!
+            鍵の2番目の要素の増分（√3 - 1）
+        */
+        static std::uint32_t constexpr W1 = 0xBB67AE85U;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        Philox() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        Philox(Philox const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        Philox & operator=(Philox const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _PHILOX_H_
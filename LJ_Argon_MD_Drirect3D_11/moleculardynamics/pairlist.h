@@ -0,0 +1,272 @@
+﻿/*! \file pairlist.h
+    \brief 圧縮行格納（CSR）形式のペアリストクラスの宣言と実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _PAIRLIST_H_
+#define _PAIRLIST_H_
+
+#pragma once
+
+#include <cstddef>                              // for std::size_t
+#include <cstdint>                              // for std::int16_t, std::int32_t
+#include <numeric>                              // for std::partial_sum
+#include <utility>                              // for std::swap
+#include <vector>                               // for std::vector
+#include <tbb/blocked_range.h>                  // for tbb::blocked_range
+#include <tbb/parallel_for.h>                   // for tbb::parallel_for
+
+namespace moleculardynamics {
+    //! A enum.
+    /*!
+        ペアリストの格納形式の列挙型
+    */
+    enum class PairListFormat : std::int32_t {
+        // 相手の原子のインデックスを32ビット整数で格納する
+        INDEX32 = 0,
+
+        // 相手の原子のインデックスを、原子iからの差の16ビット整数で格納する（差が収まらない相手だけ32ビット整数で格納する）
+        DELTA16 = 1
+    };
+
+    //! A class.
+    /*!
+        圧縮行格納（CSR）形式のペアリストクラス
+        原子iの相手の原子jは、neighbors[offsets[i]]からneighbors[offsets[i + 1] - 1]に格納される
+        それぞれのペアは一度だけ（どちらか一方の原子の行に）格納される
+        compress()を呼ぶと、相手の原子jをi + deltas[offsets[i]]からi + deltas[offsets[i + 1] - 1]と、
+        farneighbors[faroffsets[i]]からfarneighbors[faroffsets[i + 1] - 1]に分けて格納し直す
+        （原子を番地の順に並べ替えておけば、ほとんどの相手は16ビットの差に収まり、力の計算で読む量が半分近くになる）
+    */
+    class PairList final {
+        // #region 型エイリアス
+
+    public:
+        using myindexvector = std::vector<std::int32_t>;
+
+        // #endregion 型エイリアス
+
+        // #region コンストラクタ・デストラクタ
+
+        //! A constructor.
+        /*!
+            デフォルトコンストラクタ
+        */
+        PairList() = default;
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~PairList() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (constant).
+        /*!
+            力の計算で読み出す配列の大きさを返す
+            \return 配列の大きさの和（バイト）
+        */
+        std::size_t bytes() const
+        {
+            return offsets.size() * sizeof(std::int32_t) + neighbors.size() * sizeof(std::int32_t) +
+                   deltas.size() * sizeof(std::int16_t) +
+                   (faroffsets.size() + farneighbors.size()) * sizeof(std::int32_t);
+        }
+
+        //! A public member function.
+        /*!
+            ペアリストを空にする（確保済みのメモリは再利用する）
+            \param n 原子数
+        */
+        void clear(std::size_t n)
+        {
+            offsets.assign(n + 1, 0);
+            neighbors.clear();
+            deltas.clear();
+            faroffsets.clear();
+            farneighbors.clear();
+            format = PairListFormat::INDEX32;
+        }
+
+        //! A public member function.
+        /*!
+            32ビット整数で格納したペアリストを、16ビット整数の差の形式に格納し直す
+            （行の中の相手の順序は、差に収まる相手、収まらない相手の順になる）
+        */
+        void compress()
+        {
+            auto const n = number_of_atoms();
+
+            // 各行の、差が16ビット整数に収まらない相手の数を数える
+            faroffsets.assign(n + 1, 0);
+            tbb::parallel_for(
+                tbb::blocked_range<std::int32_t>(0, n, PairList::GRAINSIZE),
+                [this](tbb::blocked_range<std::int32_t> const & range) {
+                    for (auto i = range.begin(); i != range.end(); ++i) {
+                        std::int32_t count = 0;
+                        for (auto k = offsets[i]; k < offsets[i + 1]; k++) {
+                            count += near(i, neighbors[k]) ? 0 : 1;
+                        }
+
+                        faroffsets[i + 1] = count;
+                    }
+            });
+            std::partial_sum(faroffsets.begin() + 1, faroffsets.end(), faroffsets.begin() + 1);
+
+            // 行iの差の先頭は、行iより前の相手の数から、収まらない相手の数を引いたもの
+            deltas.resize(neighbors.size() - faroffsets[n]);
+            farneighbors.resize(faroffsets[n]);
+            tbb::parallel_for(
+                tbb::blocked_range<std::int32_t>(0, n, PairList::GRAINSIZE),
+                [this](tbb::blocked_range<std::int32_t> const & range) {
+                    for (auto i = range.begin(); i != range.end(); ++i) {
+                        auto d = offsets[i] - faroffsets[i];
+                        auto f = faroffsets[i];
+                        for (auto k = offsets[i]; k < offsets[i + 1]; k++) {
+                            auto const j = neighbors[k];
+                            if (near(i, j)) {
+                                deltas[d++] = static_cast<std::int16_t>(j - i);
+                            }
+                            else {
+                                farneighbors[f++] = j;
+                            }
+                        }
+                    }
+            });
+
+            for (auto i = 1; i <= n; i++) {
+                offsets[i] -= faroffsets[i];
+            }
+
+            // 確保済みのメモリは、次に作り直すときに再利用する
+            neighbors.clear();
+            format = PairListFormat::DELTA16;
+        }
+
+        //! A public member function (constant).
+        /*!
+            原子数を返す
+            \return 原子数
+        */
+        std::int32_t number_of_atoms() const
+        {
+            return offsets.empty() ? 0 : static_cast<std::int32_t>(offsets.size() - 1);
+        }
+
+        //! A public member function (constant).
+        /*!
+            ペアの数を返す
+            \return ペアの数
+        */
+        std::size_t size() const
+        {
+            return neighbors.size() + deltas.size() + farneighbors.size();
+        }
+
+        //! A public member function.
+        /*!
+            別のペアリストと中身を入れ替える
+            \param other 入れ替えるペアリスト
+        */
+        void swap(PairList & other)
+        {
+            deltas.swap(other.deltas);
+            farneighbors.swap(other.farneighbors);
+            faroffsets.swap(other.faroffsets);
+            neighbors.swap(other.neighbors);
+            offsets.swap(other.offsets);
+            std::swap(format, other.format);
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ関数
+
+    private:
+        //! A private static member function.
+        /*!
+            原子jのインデックスの、原子iからの差が16ビット整数に収まるかどうか
+            \param i 原子i
+            \param j 原子j
+            \return 収まるならtrue
+        */
+        static bool near(std::int32_t i, std::int32_t j)
+        {
+            return j - i >= INT16_MIN && j - i <= INT16_MAX;
+        }
+
+        // #endregion privateメンバ関数
+
+        // #region メンバ変数
+
+        //! A private member variable (static constant).
+        /*!
+            格納し直すループを並列化するときの粒度
+        */
+        static auto constexpr GRAINSIZE = 256;
+
+    public:
+        //! A public member variable.
+        /*!
+            相手の原子のインデックスの、原子iからの差を詰めて格納した配列（DELTA16の形式のとき）
+        */
+        std::vector<std::int16_t> deltas;
+
+        //! A public member variable.
+        /*!
+            差が16ビット整数に収まらない相手の原子のインデックスを詰めて格納した配列（DELTA16の形式のとき）
+        */
+        myindexvector farneighbors;
+
+        //! A public member variable.
+        /*!
+            farneighborsの各原子の行の先頭のインデックス（DELTA16の形式のとき、要素数は原子数 + 1）
+        */
+        myindexvector faroffsets;
+
+        //! A public member variable.
+        /*!
+            格納形式
+        */
+        PairListFormat format = PairListFormat::INDEX32;
+
+        //! A public member variable.
+        /*!
+            相手の原子のインデックスを詰めて格納した配列（INDEX32の形式のとき）
+        */
+        myindexvector neighbors;
+
+        //! A public member variable.
+        /*!
+            各原子の行の先頭のインデックス（要素数は原子数 + 1、DELTA16の形式のときはdeltasの行の先頭）
+        */
+        myindexvector offsets;
+
+        // #endregion メンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        PairList(PairList const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        PairList & operator=(PairList const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _PAIRLIST_H_
@@ -0,0 +1,232 @@
+﻿/*! \file potential.cpp
+    \brief 原子の組の間に働くポテンシャルの係数を作る関数の実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "potential.h"
+#include "systemparam.h"
+#include <cmath>                    // for std::exp, std::pow, std::sqrt
+#include <boost/assert.hpp>         // for BOOST_ASSERT
+
+namespace moleculardynamics {
+    namespace {
+        template <typename Potential>
+        //! A template function.
+        /*!
+            解析的なポテンシャルを、スカラーの演算で倍精度で求める
+            \tparam Potential ポテンシャルのポリシー
+            \param source ポテンシャルの種類と係数
+            \param r2 距離の2乗
+            \param u ポテンシャル（ずらす前の値）
+            \return u'(r) / r
+        */
+        double evaluate_as(PotentialParam const & source, double r2, double & u)
+        {
+            return typename Potential::template Eval<potential::Scalar<double>, double>(source)(r2, true, u);
+        }
+
+        //! A function.
+        /*!
+            解析的なポテンシャルを、その種類に対応するポリシーで求める
+            \param source ポテンシャルの種類と係数（表引きではないもの）
+            \param r2 距離の2乗
+            \param u ポテンシャル（ずらす前の値）
+            \return u'(r) / r
+        */
+        double evaluate(PotentialParam const & source, double r2, double & u)
+        {
+            switch (source.type) {
+            case PotentialType::SHIFTEDFORCE:
+                return evaluate_as<potential::ShiftedForce>(source, r2, u);
+
+            case PotentialType::MORSE:
+                return evaluate_as<potential::Morse>(source, r2, u);
+
+            case PotentialType::BUCKINGHAM:
+                return evaluate_as<potential::Buckingham>(source, r2, u);
+
+            default:
+                return evaluate_as<potential::LennardJones>(source, r2, u);
+            }
+        }
+    }
+
+    // #region コンストラクタ
+
+    PotentialTable::PotentialTable(PotentialParam const & source, PotentialType interpolation, std::int32_t size, double rmin)
+        : param_(source)
+    {
+        BOOST_ASSERT(interpolation == PotentialType::LINEARTABLE || interpolation == PotentialType::CUBICTABLE);
+        BOOST_ASSERT(source.type != PotentialType::LINEARTABLE && source.type != PotentialType::CUBICTABLE);
+        BOOST_ASSERT(size > 0 && rmin > 0.0 && rmin < source.rc);
+
+        // 点は距離の2乗で等間隔に置くので、カーネルは平方根を取らずに区間を引ける
+        auto const s0 = rmin * rmin;
+        auto const h = (source.rc2 - s0) / static_cast<double>(size);
+
+        // 各点の、u'(r) / r（w）とその距離の2乗sについての微分（中心差分で求める）
+        std::vector<double> w(size + 1), dw(size + 1);
+        for (auto k = 0; k <= size; k++) {
+            auto const s = s0 + h * static_cast<double>(k);
+            auto const delta = 1.0E-6 * s;
+
+            double u, up, um;
+            w[k] = evaluate(source, s, u);
+            dw[k] = (evaluate(source, s + delta, up) - evaluate(source, s - delta, um)) / (2.0 * delta);
+        }
+
+        // 区間の中の位置t（0 <= t < 1）についてのu'(r) / rの多項式の係数を低次から順に並べ、最後に区間の左端のポテンシャルを置く
+        // （区間の中のポテンシャルは、カーネルが多項式を積分して求める）
+        auto const cubic = interpolation == PotentialType::CUBICTABLE;
+        auto const stride = cubic ? potential::Tabulated<true>::STRIDE : potential::Tabulated<false>::STRIDE;
+        coefficients_.reserve(static_cast<std::size_t>(size) * stride);
+
+        for (auto k = 0; k < size; k++) {
+            auto const g0 = w[k], g1 = w[k + 1];
+            coefficients_.push_back(static_cast<real>(g0));
+
+            if (cubic) {
+                // 両端の値と傾きを合わせるHermite補間
+                auto const m0 = h * dw[k], m1 = h * dw[k + 1];
+                coefficients_.push_back(static_cast<real>(m0));
+                coefficients_.push_back(static_cast<real>(3.0 * (g1 - g0) - 2.0 * m0 - m1));
+                coefficients_.push_back(static_cast<real>(2.0 * (g0 - g1) + m0 + m1));
+            }
+            else {
+                coefficients_.push_back(static_cast<real>(g1 - g0));
+            }
+
+            // 区間の左端のポテンシャルは、次のループで求める
+            coefficients_.push_back(static_cast<real>(0));
+        }
+
+        // 区間の左端のポテンシャルは、カットオフ半径での値から、格納した多項式（丸めた後の係数）を内側へ積分して求める
+        // （解析的な値を置くと、各点でポテンシャルがその区間の積分の誤差だけ跳び、補間した力と矛盾する）
+        double ul;
+        evaluate(source, source.rc2, ul);
+        for (auto k = size - 1; k >= 0; k--) {
+            auto const a = coefficients_.data() + static_cast<std::size_t>(k) * stride;
+
+            // u(t = 1) - u(t = 0) = h / 2 (a0 + a1 / 2 (+ a2 / 3 + a3 / 4))
+            auto integral = static_cast<double>(a[0]) + static_cast<double>(a[1]) / 2.0;
+            if (cubic) {
+                integral += static_cast<double>(a[2]) / 3.0 + static_cast<double>(a[3]) / 4.0;
+            }
+
+            ul -= 0.5 * h * integral;
+            a[stride - 1] = static_cast<real>(ul);
+        }
+
+        param_.type = interpolation;
+        param_.table = coefficients_.data();
+        param_.tablemin = s0;
+        param_.tablescale = 1.0 / h;
+        param_.tablesize = size;
+    }
+
+    // #endregion コンストラクタ
+
+    namespace potential {
+        namespace {
+            //! A function.
+            /*!
+                Lennard-Jonesポテンシャルの値を求める
+                \param r 距離
+                \return u(r)
+            */
+            double lennardjones_u(double r)
+            {
+                auto const rm6 = std::pow(r, -6.0);
+
+                return 4.0 * (rm6 * rm6 - rm6);
+            }
+
+            //! A function.
+            /*!
+                Lennard-Jonesポテンシャルの微分を求める
+                \param r 距離
+                \return u'(r)
+            */
+            double lennardjones_du(double r)
+            {
+                auto const rm6 = std::pow(r, -6.0);
+
+                return (24.0 * rm6 - 48.0 * rm6 * rm6) / r;
+            }
+        }
+
+        PotentialParam argon(PotentialType type)
+        {
+            // Lennard-Jonesポテンシャルの極小点の位置（深さは1）
+            auto const rmin = std::pow(2.0, 1.0 / 6.0);
+
+            switch (type) {
+            case PotentialType::WCA:
+                return wca();
+
+            case PotentialType::SHIFTEDFORCE:
+                return shiftedforce(SystemParam::RCUTOFF);
+
+            case PotentialType::MORSE:
+                // 極小点での曲率もLennard-Jonesポテンシャルに合わせると、αr0 = 6になる
+                return morse(1.0, 6.0 / rmin, rmin, SystemParam::RCUTOFF);
+
+            case PotentialType::BUCKINGHAM:
+            {
+                // exp-6ポテンシャル（α = 14）をBuckinghamポテンシャルの形に書き直す
+                auto const alpha = 14.0;
+
+                return buckingham(6.0 / (alpha - 6.0) * std::exp(alpha), rmin / alpha, alpha / (alpha - 6.0) * std::pow(rmin, 6.0), SystemParam::RCUTOFF);
+            }
+
+            default:
+                return lennardjones(SystemParam::RCUTOFF);
+            }
+        }
+
+        PotentialParam buckingham(double a, double rho, double c, double rc)
+        {
+            BOOST_ASSERT(rho > 0.0 && rc > 0.0);
+
+            auto const e = std::exp(-rc / rho);
+            auto const rcm6 = std::pow(rc, -6.0);
+
+            return { PotentialType::BUCKINGHAM, rc, rc * rc, a * e - c * rcm6, -a / rho * e + 6.0 * c * rcm6 / rc, a, 1.0 / rho, c };
+        }
+
+        PotentialParam lennardjones(double rc)
+        {
+            BOOST_ASSERT(rc > 0.0);
+
+            return { PotentialType::LENNARDJONES, rc, rc * rc, lennardjones_u(rc), lennardjones_du(rc), 0.0, 0.0, 0.0 };
+        }
+
+        PotentialParam morse(double d, double alpha, double r0, double rc)
+        {
+            BOOST_ASSERT(alpha > 0.0 && rc > 0.0);
+
+            auto const e = std::exp(-alpha * (rc - r0));
+
+            return { PotentialType::MORSE, rc, rc * rc, d * e * (e - 2.0), -2.0 * alpha * d * e * (e - 1.0), d, alpha, r0 };
+        }
+
+        PotentialParam shiftedforce(double rc)
+        {
+            auto param = lennardjones(rc);
+            param.type = PotentialType::SHIFTEDFORCE;
+
+            return param;
+        }
+
+        PotentialParam wca()
+        {
+            // 極小点でカットオフし、極小点の値（-1）だけ持ち上げて、斥力だけのポテンシャルにする
+            auto param = lennardjones(std::pow(2.0, 1.0 / 6.0));
+            param.type = PotentialType::WCA;
+
+            return param;
+        }
+    }
+}
@@ -0,0 +1,690 @@
+﻿/*! \file potential.h
+    \brief 原子の組の間に働くポテンシャルの係数と、力の計算のカーネルをポテンシャルごとに特殊化するポリシーの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _POTENTIAL_H_
+#define _POTENTIAL_H_
+
+#pragma once
+
+#include "precision.h"
+#include <cmath>                    // for std::exp, std::floor, std::sqrt
+#include <cstddef>                  // for std::size_t
+#include <cstdint>                  // for std::int32_t
+#include <type_traits>              // for std::is_same
+#include <vector>                   // for std::vector
+
+namespace moleculardynamics {
+    //! A enum.
+    /*!
+        原子の組の間に働くポテンシャルの種類の列挙型
+    */
+    enum class PotentialType : std::int32_t {
+        // Lennard-Jonesポテンシャル（カットオフ半径で0になるようにずらす）
+        LENNARDJONES = 0,
+
+        // Weeks-Chandler-Andersenポテンシャル（Lennard-Jonesポテンシャルの斥力部分だけを、極小点でカットオフする）
+        WCA = 1,
+
+        // shifted-force Lennard-Jonesポテンシャル（カットオフ半径でポテンシャルと力の両方が0になる）
+        SHIFTEDFORCE = 2,
+
+        // Morseポテンシャル
+        MORSE = 3,
+
+        // Buckingham（exp-6）ポテンシャル
+        BUCKINGHAM = 4,
+
+        // 距離の2乗で引く表を、区間ごとに1次式で補間する（PotentialTableで作る）
+        LINEARTABLE = 5,
+
+        // 距離の2乗で引く表を、区間ごとに3次のHermite補間で補間する（PotentialTableで作る）
+        CUBICTABLE = 6
+    };
+
+    //! A struct.
+    /*!
+        ポテンシャルの種類と係数（無次元単位、長さはσ、エネルギーはεを単位とする）
+    */
+    struct PotentialParam final {
+        //! A public member variable.
+        /*!
+            ポテンシャルの種類
+        */
+        PotentialType type;
+
+        //! A public member variable.
+        /*!
+            カットオフ半径
+        */
+        double rc;
+
+        //! A public member variable.
+        /*!
+            カットオフ半径の2乗
+        */
+        double rc2;
+
+        //! A public member variable.
+        /*!
+            カットオフ半径でのポテンシャルの値（ポテンシャルを0にずらすために差し引く）
+        */
+        double vrc;
+
+        //! A public member variable.
+        /*!
+            カットオフ半径でのポテンシャルの微分（shifted-forceで、力を0にずらすために差し引く）
+        */
+        double dvrc;
+
+        //! A public member variable.
+        /*!
+            1番目の係数（MorseならD、BuckinghamならA）
+        */
+        double a;
+
+        //! A public member variable.
+        /*!
+            2番目の係数（Morseならα、Buckinghamなら1 / ρ）
+        */
+        double b;
+
+        //! A public member variable.
+        /*!
+            3番目の係数（Morseならr0、BuckinghamならC）
+        */
+        double c;
+
+        //! A public member variable.
+        /*!
+            表引きのときの、区間ごとのu'(r) / rの多項式の係数と、区間の左端のポテンシャル
+        */
+        real const * table = nullptr;
+
+        //! A public member variable.
+        /*!
+            表引きのときの、表の最初の点の距離の2乗
+        */
+        double tablemin = 0.0;
+
+        //! A public member variable.
+        /*!
+            表引きのときの、区間の幅（距離の2乗）の逆数
+        */
+        double tablescale = 0.0;
+
+        //! A public member variable.
+        /*!
+            表引きのときの、区間の数
+        */
+        std::int32_t tablesize = 0;
+    };
+
+    //! A class.
+    /*!
+        解析的なポテンシャルから、距離の2乗で直接引くu'(r) / rとポテンシャルの表を作るクラス
+        （param()が返す係数は、このオブジェクトが持つ表を指す）
+    */
+    class PotentialTable final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+            \param source 表にする解析的なポテンシャルの種類と係数
+            \param interpolation 補間の方法（PotentialType::LINEARTABLEかPotentialType::CUBICTABLE）
+            \param size 区間の数
+            \param rmin 表の最初の点の距離（これより近い組は、この距離の値で代用する）
+        */
+        PotentialTable(PotentialParam const & source, PotentialType interpolation, std::int32_t size, double rmin = PotentialTable::RMIN);
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~PotentialTable() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (constant).
+        /*!
+            表の大きさを返す
+            \return 表の大きさ（バイト）
+        */
+        std::size_t bytes() const
+        {
+            return coefficients_.size() * sizeof(real);
+        }
+
+        //! A public member function (constant).
+        /*!
+            力の計算のカーネルに渡す、表引きのポテンシャルの係数を返す
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam const & param() const
+        {
+            return param_;
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region publicメンバ変数
+
+        //! A public member variable (static constant).
+        /*!
+            表の最初の点の距離の既定値（30000 Kでも、原子はこれより近づかない）
+        */
+        static auto constexpr RMIN = 0.5;
+
+        // #endregion publicメンバ変数
+
+        // #region privateメンバ変数
+
+    private:
+        //! A private member variable.
+        /*!
+            区間ごとの多項式の係数
+        */
+        std::vector<real> coefficients_;
+
+        //! A private member variable.
+        /*!
+            表引きのポテンシャルの種類と係数
+        */
+        PotentialParam param_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        PotentialTable() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        PotentialTable(PotentialTable const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        PotentialTable & operator=(PotentialTable const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+
+    namespace potential {
+        //! A function.
+        /*!
+            アルゴンを近似する既定の係数で、ポテンシャルを作る
+            （MorseとBuckinghamは、Lennard-Jonesポテンシャルと極小点の位置と深さが一致するように選ぶ）
+            \param type ポテンシャルの種類
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam argon(PotentialType type);
+
+        //! A function.
+        /*!
+            Buckinghamポテンシャル u(r) = A exp(-r / ρ) - C / r^6 を作る
+            \param a 斥力の強さA
+            \param rho 斥力の到達距離ρ
+            \param c 分散力の強さC
+            \param rc カットオフ半径
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam buckingham(double a, double rho, double c, double rc);
+
+        //! A function.
+        /*!
+            Lennard-Jonesポテンシャル u(r) = 4(r^-12 - r^-6) を作る
+            \param rc カットオフ半径
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam lennardjones(double rc);
+
+        //! A function.
+        /*!
+            Morseポテンシャル u(r) = D[(1 - exp(-α(r - r0)))^2 - 1] を作る
+            \param d 井戸の深さD
+            \param alpha 井戸の幅の逆数α
+            \param r0 極小点の位置r0
+            \param rc カットオフ半径
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam morse(double d, double alpha, double r0, double rc);
+
+        //! A function.
+        /*!
+            shifted-force Lennard-Jonesポテンシャル u(r) - u(rc) - (r - rc)u'(rc) を作る
+            \param rc カットオフ半径
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam shiftedforce(double rc);
+
+        //! A function.
+        /*!
+            WCAポテンシャルを作る（カットオフ半径は2^(1/6)）
+            \return ポテンシャルの種類と係数
+        */
+        PotentialParam wca();
+
+        template <typename T>
+        //! A template struct.
+        /*!
+            ポテンシャルのポリシーに、SIMDの演算と同じ名前でスカラーの演算を渡すための構造体
+            \tparam T 浮動小数点数の型
+        */
+        struct Scalar final {
+            using vec = T;
+
+            static vec div(vec a, vec b) { return a / b; }
+
+            static vec exp(vec a) { return std::exp(a); }
+
+            static vec floor(vec a) { return std::floor(a); }
+
+            static vec fmadd(vec a, vec b, vec c) { return a * b + c; }
+
+            static vec fmsub(vec a, vec b, vec c) { return a * b - c; }
+
+            static vec fnmadd(vec a, vec b, vec c) { return c - a * b; }
+
+            static vec lookup(T const * p, vec k) { return p[static_cast<std::int32_t>(k)]; }
+
+            static vec max(vec a, vec b) { return a > b ? a : b; }
+
+            static vec min(vec a, vec b) { return a < b ? a : b; }
+
+            static vec mul(vec a, vec b) { return a * b; }
+
+            static vec select(bool m, vec a) { return m ? a : static_cast<T>(0); }
+
+            static vec set1(T a) { return a; }
+
+            static vec sqrt(vec a) { return std::sqrt(a); }
+
+            static vec sub(vec a, vec b) { return a - b; }
+        };
+
+        template <typename S, typename T>
+        //! A template function.
+        /*!
+            SIMDの演算Sを用いて、レーンごとにexp(x)を求める
+            x = k ln2 + r（|r| <= ln2 / 2）と分け、exp(r)をTaylor多項式で、2^kを指数部への加算で求める
+            \tparam S SIMDの演算の構造体（fmadd, fnmadd, ldexp, max, min, mul, round, set1を持つ）
+            \tparam T 浮動小数点数の型
+            \param x 引数
+            \return exp(x)
+        */
+        typename S::vec exp(typename S::vec x)
+        {
+            // 1 / n!
+            static double constexpr INVFACT[] = {
+                1.0, 1.0, 1.0 / 2.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 120.0, 1.0 / 720.0, 1.0 / 5040.0,
+                1.0 / 40320.0, 1.0 / 362880.0, 1.0 / 3628800.0, 1.0 / 39916800.0, 1.0 / 479001600.0 };
+
+            // 多項式の次数は、|r| <= ln2 / 2での打ち切り誤差が1ulp程度になるように選ぶ
+            auto constexpr DEGREE = std::is_same<T, double>::value ? 12 : 7;
+
+            // 2^kが正規化数に収まる範囲に切り詰める
+            auto constexpr XMAX = std::is_same<T, double>::value ? 708.0 : 87.0;
+
+            x = S::max(S::min(x, S::set1(static_cast<T>(XMAX))), S::set1(static_cast<T>(-XMAX)));
+
+            auto const k = S::round(S::mul(x, S::set1(static_cast<T>(1.4426950408889634))));
+
+            // ln2を上位と下位に分けて引き、k ln2の丸め誤差を抑える（Cody-Waiteの方法）
+            auto const r = S::fnmadd(k, S::set1(static_cast<T>(-2.1219444005469058e-4)),
+                                     S::fnmadd(k, S::set1(static_cast<T>(0.693359375)), x));
+
+            auto p = S::set1(static_cast<T>(INVFACT[DEGREE]));
+            for (auto n = DEGREE - 1; n >= 0; n--) {
+                p = S::fmadd(p, r, S::set1(static_cast<T>(INVFACT[n])));
+            }
+
+            return S::ldexp(p, k);
+        }
+
+        //! A struct.
+        /*!
+            Lennard-Jonesポテンシャルのポリシー（WCAポテンシャルも、カットオフ半径とずらす値を変えてこれで計算する）
+        */
+        struct LennardJones final {
+            template <typename S, typename T>
+            //! A template struct.
+            /*!
+                SIMDの演算Sを用いて、レーンごとに力とポテンシャルを求める関数オブジェクト
+                \tparam S SIMDの演算の構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Eval final {
+                using vec = typename S::vec;
+
+                //! A constructor.
+                /*!
+                    係数をレーンに広げておく
+                    \param param ポテンシャルの係数（未使用）
+                */
+                explicit Eval(PotentialParam const &)
+                    : c1_(S::set1(static_cast<T>(1))), c4_(S::set1(static_cast<T>(4))), c24_(S::set1(static_cast<T>(24))), c48_(S::set1(static_cast<T>(48)))
+                {
+                }
+
+                template <typename Mask>
+                //! A public member function (constant).
+                /*!
+                    距離の2乗から、u'(r) / rとポテンシャルを求める（maskの立っていないレーンは0にする）
+                    \param r2 距離の2乗
+                    \param mask カットオフ半径の内側の、有効なレーンのマスク
+                    \param u ポテンシャル（ずらす前の値）
+                    \return u'(r) / r（相手の原子への変位に掛けると、原子に働く力になる）
+                */
+                vec operator()(vec r2, Mask mask, vec & u) const
+                {
+                    auto const r6 = S::mul(S::mul(r2, r2), r2);
+
+                    // q = 1 / (r^12 r^2)から、力とポテンシャルの両方を割り算1回で求める
+                    // （0除算の結果もここで捨てられる）
+                    auto const q = S::select(mask, S::div(c1_, S::mul(S::mul(r6, r6), r2)));
+
+                    u = S::mul(S::mul(c4_, S::sub(c1_, r6)), S::mul(q, r2));
+
+                    return S::mul(S::fmsub(c24_, r6, c48_), q);
+                }
+
+                vec const c1_, c4_, c24_, c48_;
+            };
+        };
+
+        //! A struct.
+        /*!
+            shifted-force Lennard-Jonesポテンシャルのポリシー
+        */
+        struct ShiftedForce final {
+            template <typename S, typename T>
+            //! A template struct.
+            /*!
+                SIMDの演算Sを用いて、レーンごとに力とポテンシャルを求める関数オブジェクト
+                \tparam S SIMDの演算の構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Eval final {
+                using vec = typename S::vec;
+
+                //! A constructor.
+                /*!
+                    係数をレーンに広げておく
+                    \param param ポテンシャルの係数
+                */
+                explicit Eval(PotentialParam const & param)
+                    : c1_(S::set1(static_cast<T>(1))), c4_(S::set1(static_cast<T>(4))), c24_(S::set1(static_cast<T>(24))), c48_(S::set1(static_cast<T>(48))),
+                      dvrc_(S::set1(static_cast<T>(param.dvrc))), rc_(S::set1(static_cast<T>(param.rc)))
+                {
+                }
+
+                template <typename Mask>
+                //! A public member function (constant).
+                /*!
+                    距離の2乗から、u'(r) / rとポテンシャルを求める（maskの立っていないレーンは0にする）
+                    \param r2 距離の2乗
+                    \param mask カットオフ半径の内側の、有効なレーンのマスク
+                    \param u ポテンシャル（u(rc)をずらす前の値）
+                    \return u'(r) / r
+                */
+                vec operator()(vec r2, Mask mask, vec & u) const
+                {
+                    auto const r = S::sqrt(r2);
+                    auto const r6 = S::mul(S::mul(r2, r2), r2);
+                    auto const q = S::select(mask, S::div(c1_, S::mul(S::mul(r6, r6), r2)));
+
+                    // 1 / r = r r^12 qとすれば、割り算を増やさずに済む
+                    auto const rinv = S::mul(S::mul(r, S::mul(r6, r6)), q);
+
+                    u = S::select(mask, S::fnmadd(S::sub(r, rc_), dvrc_, S::mul(S::mul(c4_, S::sub(c1_, r6)), S::mul(q, r2))));
+
+                    return S::fnmadd(dvrc_, rinv, S::mul(S::fmsub(c24_, r6, c48_), q));
+                }
+
+                vec const c1_, c4_, c24_, c48_, dvrc_, rc_;
+            };
+        };
+
+        //! A struct.
+        /*!
+            Morseポテンシャルのポリシー
+        */
+        struct Morse final {
+            template <typename S, typename T>
+            //! A template struct.
+            /*!
+                SIMDの演算Sを用いて、レーンごとに力とポテンシャルを求める関数オブジェクト
+                \tparam S SIMDの演算の構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Eval final {
+                using vec = typename S::vec;
+
+                //! A constructor.
+                /*!
+                    係数をレーンに広げておく
+                    \param param ポテンシャルの係数
+                */
+                explicit Eval(PotentialParam const & param)
+                    : alpha_(S::set1(static_cast<T>(param.b))), c1_(S::set1(static_cast<T>(1))), c2_(S::set1(static_cast<T>(2))),
+                      d_(S::set1(static_cast<T>(param.a))), m2ad_(S::set1(static_cast<T>(-2.0 * param.a * param.b))), r0_(S::set1(static_cast<T>(param.c)))
+                {
+                }
+
+                template <typename Mask>
+                //! A public member function (constant).
+                /*!
+                    距離の2乗から、u'(r) / rとポテンシャルを求める（maskの立っていないレーンは0にする）
+                    \param r2 距離の2乗
+                    \param mask カットオフ半径の内側の、有効なレーンのマスク
+                    \param u ポテンシャル（ずらす前の値）
+                    \return u'(r) / r
+                */
+                vec operator()(vec r2, Mask mask, vec & u) const
+                {
+                    auto const r = S::sqrt(r2);
+
+                    // e = exp(-α(r - r0))とすると、u = D e (e - 2)、u' = -2αD e (e - 1)
+                    auto const e = S::exp(S::mul(alpha_, S::sub(r0_, r)));
+
+                    u = S::select(mask, S::mul(d_, S::mul(e, S::sub(e, c2_))));
+
+                    return S::select(mask, S::div(S::mul(m2ad_, S::mul(e, S::sub(e, c1_))), r));
+                }
+
+                vec const alpha_, c1_, c2_, d_, m2ad_, r0_;
+            };
+        };
+
+        //! A struct.
+        /*!
+            Buckinghamポテンシャルのポリシー
+        */
+        struct Buckingham final {
+            template <typename S, typename T>
+            //! A template struct.
+            /*!
+                SIMDの演算Sを用いて、レーンごとに力とポテンシャルを求める関数オブジェクト
+                \tparam S SIMDの演算の構造体
+                \tparam T 浮動小数点数の型
+            */
+            struct Eval final {
+                using vec = typename S::vec;
+
+                //! A constructor.
+                /*!
+                    係数をレーンに広げておく
+                    \param param ポテンシャルの係数
+                */
+                explicit Eval(PotentialParam const & param)
+                    : a_(S::set1(static_cast<T>(param.a))), ab_(S::set1(static_cast<T>(param.a * param.b))), c_(S::set1(static_cast<T>(param.c))),
+                      c1_(S::set1(static_cast<T>(1))), c6c_(S::set1(static_cast<T>(6.0 * param.c))), mb_(S::set1(static_cast<T>(-param.b)))
+                {
+                }
+
+                template <typename Mask>
+                //! A public member function (constant).
+                /*!
+                    距離の2乗から、u'(r) / rとポテンシャルを求める（maskの立っていないレーンは0にする）
+                    \param r2 距離の2乗
+                    \param mask カットオフ半径の内側の、有効なレーンのマスク
+                    \param u ポテンシャル（ずらす前の値）
+                    \return u'(r) / r
+                */
+                vec operator()(vec r2, Mask mask, vec & u) const
+                {
+                    auto const r = S::sqrt(r2);
+                    auto const r2inv = S::select(mask, S::div(c1_, r2));
+                    auto const r6inv = S::mul(S::mul(r2inv, r2inv), r2inv);
+
+                    // e = exp(-r / ρ)とすると、u = A e - C r^-6、u' / r = -(A / ρ) e / r + 6C r^-8
+                    auto const e = S::exp(S::mul(mb_, r));
+
+                    u = S::select(mask, S::fmsub(a_, e, S::mul(c_, r6inv)));
+
+                    return S::fnmadd(S::mul(ab_, e), S::mul(r, r2inv), S::mul(c6c_, S::mul(r6inv, r2inv)));
+                }
+
+                vec const a_, ab_, c_, c1_, c6c_, mb_;
+            };
+        };
+
+        template <bool Cubic>
+        //! A template struct.
+        /*!
+            距離の2乗で直接引く表から、力とポテンシャルを補間するポリシー
+            u'(r) / rだけを区間ごとの多項式で表し、ポテンシャルはdu / d(r^2) = u'(r) / (2r)を積分して求めるので、
+            エネルギーは補間した力と矛盾しない
+            \tparam Cubic 3次のHermite補間ならtrue、1次式の補間ならfalse
+        */
+        struct Tabulated final {
+            //! A public member variable (static constant).
+            /*!
+                1つの区間の係数の数（u'(r) / rの多項式の係数と、区間の左端のポテンシャル）
+            */
+            static auto constexpr STRIDE = Cubic ? 5 : 3;
+
+            template <typename S, typename T>
+            //! A template struct.
+            /*!
+                SIMDの演算Sを用いて、レーンごとに力とポテンシャルを求める関数オブジェクト
+                \tparam S SIMDの演算の構造体（表はgatherで引く）
+                \tparam T 浮動小数点数の型（表の係数の型と同じ）
+            */
+            struct Eval final {
+                using vec = typename S::vec;
+
+                //! A constructor.
+                /*!
+                    係数をレーンに広げておく
+                    \param param ポテンシャルの係数（表を指す）
+                */
+                explicit Eval(PotentialParam const & param)
+                    : c0_(S::set1(static_cast<T>(0))), c1_2_(S::set1(static_cast<T>(1.0 / 2.0))), c1_3_(S::set1(static_cast<T>(1.0 / 3.0))), c1_4_(S::set1(static_cast<T>(1.0 / 4.0))),
+                      halfwidth_(S::set1(static_cast<T>(0.5 / param.tablescale))), last_(S::set1(static_cast<T>(param.tablesize - 1))), min_(S::set1(static_cast<T>(param.tablemin))),
+                      scale_(S::set1(static_cast<T>(param.tablescale))), stride_(S::set1(static_cast<T>(STRIDE))), table_(param.table)
+                {
+                }
+
+                template <typename Mask>
+                //! A public member function (constant).
+                /*!
+                    距離の2乗から、u'(r) / rとポテンシャルを表から補間する（maskの立っていないレーンは0にする）
+                    \param r2 距離の2乗
+                    \param mask カットオフ半径の内側の、有効なレーンのマスク
+                    \param u ポテンシャル（ずらす前の値）
+                    \return u'(r) / r
+                */
+                vec operator()(vec r2, Mask mask, vec & u) const
+                {
+                    // 表の位置を、区間の番号kと区間の中の位置t（0 <= t < 1）に分ける
+                    // （表の外側のレーンも、表の中を指すように切り詰めてから引く）
+                    auto const x = S::mul(S::sub(r2, min_), scale_);
+                    auto const k = S::min(S::max(S::floor(x), c0_), last_);
+                    auto const t = S::max(S::sub(x, k), c0_);
+                    auto const base = S::mul(k, stride_);
+
+                    // w(t) = a0 + a1 t (+ a2 t^2 + a3 t^3)
+                    // u(t) = u0 + h / 2 t (a0 + a1 t / 2 (+ a2 t^2 / 3 + a3 t^3 / 4))
+                    auto const a0 = S::lookup(table_, base);
+                    auto const a1 = S::lookup(table_ + 1, base);
+                    auto w = a1;
+                    auto v = S::mul(a1, c1_2_);
+                    if (Cubic) {
+                        auto const a2 = S::lookup(table_ + 2, base);
+                        auto const a3 = S::lookup(table_ + 3, base);
+                        w = S::fmadd(S::fmadd(a3, t, a2), t, a1);
+                        v = S::fmadd(S::fmadd(S::mul(a3, c1_4_), t, S::mul(a2, c1_3_)), t, v);
+                    }
+
+                    w = S::fmadd(w, t, a0);
+                    v = S::fmadd(v, t, a0);
+
+                    u = S::select(mask, S::fmadd(S::mul(halfwidth_, t), v, S::lookup(table_ + STRIDE - 1, base)));
+
+                    return S::select(mask, w);
+                }
+
+                vec const c0_, c1_2_, c1_3_, c1_4_, halfwidth_, last_, min_, scale_, stride_;
+
+                T const * const table_;
+            };
+        };
+
+        template <typename Function>
+        //! A template function.
+        /*!
+            ポテンシャルの種類に対応するポリシーを渡して、funcを呼び出す
+            （カーネルの呼び出しごとに一度だけ分岐し、ペアのループはポリシーで特殊化されたものを用いる）
+            \param type ポテンシャルの種類
+            \param func ポリシーの値を受け取る関数
+        */
+        void dispatch(PotentialType type, Function && func)
+        {
+            switch (type) {
+            case PotentialType::SHIFTEDFORCE:
+                func(ShiftedForce());
+                break;
+
+            case PotentialType::MORSE:
+                func(Morse());
+                break;
+
+            case PotentialType::BUCKINGHAM:
+                func(Buckingham());
+                break;
+
+            case PotentialType::LINEARTABLE:
+                func(Tabulated<false>());
+                break;
+
+            case PotentialType::CUBICTABLE:
+                func(Tabulated<true>());
+                break;
+
+            default:
+                func(LennardJones());
+                break;
+            }
+        }
+    }
+}
+
+#endif  // _POTENTIAL_H_
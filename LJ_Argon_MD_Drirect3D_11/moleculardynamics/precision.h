@@ -0,0 +1,72 @@
+﻿/*! \file precision.h
+    \brief 座標、運動量、力と、エネルギーなどの総和に用いる浮動小数点数の型の定義
+    （MOLECULARDYNAMICS_PRECISION_MIXEDまたはMOLECULARDYNAMICS_PRECISION_SINGLEを定義すると、単精度に切り替わる）
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _PRECISION_H_
+#define _PRECISION_H_
+
+#pragma once
+
+namespace moleculardynamics {
+#if defined(MOLECULARDYNAMICS_PRECISION_SINGLE)
+    //! A typedef.
+    /*!
+        原子の座標、運動量、力の型
+    */
+    using real = float;
+
+    //! A typedef.
+    /*!
+        エネルギーやビリアルなど、原子についての総和の型
+    */
+    using accum = float;
+
+    //! A global variable (constant).
+    /*!
+        精度の名前
+    */
+    static auto constexpr PRECISION_NAME = "single";
+#elif defined(MOLECULARDYNAMICS_PRECISION_MIXED)
+    //! A typedef.
+    /*!
+        原子の座標、運動量、力の型
+    */
+    using real = float;
+
+    //! A typedef.
+    /*!
+        エネルギーやビリアルなど、原子についての総和の型
+    */
+    using accum = double;
+
+    //! A global variable (constant).
+    /*!
+        精度の名前
+    */
+    static auto constexpr PRECISION_NAME = "mixed";
+#else
+    //! A typedef.
+    /*!
+        原子の座標、運動量、力の型
+    */
+    using real = double;
+
+    //! A typedef.
+    /*!
+        エネルギーやビリアルなど、原子についての総和の型
+    */
+    using accum = double;
+
+    //! A global variable (constant).
+    /*!
+        精度の名前
+    */
+    static auto constexpr PRECISION_NAME = "double";
+#endif
+}
+
+#endif  // _PRECISION_H_
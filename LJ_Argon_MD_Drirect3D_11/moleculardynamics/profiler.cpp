@@ -0,0 +1,75 @@
+﻿/*! \file profiler.cpp
+    \brief MDの1ステップの段階ごとの経過時間を計測するクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "profiler.h"
+#include <boost/assert.hpp>                     // for BOOST_ASSERT
+
+namespace moleculardynamics {
+    // #region publicメンバ関数
+
+    char const * Profiler::name(Phase phase)
+    {
+        switch (phase) {
+        case Phase::MOVE_FIRST:
+            return "moveAtoms (first half)";
+
+        case Phase::CHECK_PAIRLIST:
+            return "checkPairlist";
+
+        case Phase::REBUILD:
+            return "rebuildPairlist";
+
+        case Phase::FORCE:
+            return "calcForcePair";
+
+        case Phase::MOVE_SECOND:
+            return "moveAtoms (second half)";
+
+        default:
+            BOOST_ASSERT(!"何かがおかしい！");
+            return "";
+        }
+    }
+
+    void Profiler::record(Phase phase, clock::time_point begin, clock::time_point end)
+    {
+        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        auto & stat = stats_[static_cast<std::int32_t>(phase)];
+
+        stat.last_ns = static_cast<double>(ns);
+        stat.smooth_ns = stat.calls ? stat.smooth_ns + Profiler::SMOOTHING * (stat.last_ns - stat.smooth_ns) : stat.last_ns;
+        stat.total_ns += stat.last_ns;
+        stat.calls++;
+
+        if (tracing_ && events_.size() < Profiler::MAXEVENTS) {
+            events_.push_back({ std::chrono::duration_cast<std::chrono::nanoseconds>(begin - origin_).count(), ns, phase });
+        }
+    }
+
+    void Profiler::reset()
+    {
+        events_.clear();
+        origin_ = clock::now();
+        stats_.fill(PhaseStat());
+    }
+
+    void Profiler::write_chrome_trace(std::FILE * fp) const
+    {
+        // 時刻の単位はμs（小数で与えれば、ns単位の精度が保たれる）
+        std::fprintf(fp, "{\"traceEvents\":[\n");
+        std::fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"MD main thread\"}}");
+
+        for (auto const & e : events_) {
+            std::fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"md\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                Profiler::name(e.phase), static_cast<double>(e.begin) * 1.0E-3, static_cast<double>(e.duration) * 1.0E-3);
+        }
+
+        std::fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    }
+
+    // #endregion publicメンバ関数
+}
@@ -0,0 +1,367 @@
+﻿/*! \file profiler.h
+    \brief MDの1ステップの段階ごとの経過時間を計測するクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#pragma once
+
+#include <array>                                // for std::array
+#include <chrono>                               // for std::chrono::steady_clock
+#include <cstdint>                              // for std::int32_t, std::int64_t
+#include <cstdio>                               // for std::FILE
+#include <vector>                               // for std::vector
+
+namespace moleculardynamics {
+    //! A enum.
+    /*!
+        MDの1ステップの段階の列挙型
+    */
+    enum class Phase : std::int32_t {
+        // ステップの前半の温度制御と原子の移動
+        MOVE_FIRST = 0,
+
+        // ペアリストの寿命のチェック（作り直しを含む）
+        CHECK_PAIRLIST = 1,
+
+        // ペアリストの作り直し
+        REBUILD = 2,
+
+        // 原子に働く力の計算と運動量の更新
+        FORCE = 3,
+
+        // ステップの後半の温度制御と原子の移動（周期境界条件の補正を含む）
+        MOVE_SECOND = 4,
+
+        // 段階の数
+        COUNT = 5
+    };
+
+    //! A struct.
+    /*!
+        ある段階の経過時間の統計
+    */
+    struct PhaseStat {
+        //! A public member variable.
+        /*!
+            呼び出された回数
+        */
+        std::int64_t calls = 0;
+
+        //! A public member variable.
+        /*!
+            最後の呼び出しの経過時間（ns）
+        */
+        double last_ns = 0.0;
+
+        //! A public member variable.
+        /*!
+            経過時間の指数移動平均（ns、表示用）
+        */
+        double smooth_ns = 0.0;
+
+        //! A public member variable.
+        /*!
+            経過時間の合計（ns）
+        */
+        double total_ns = 0.0;
+    };
+
+    //! A struct.
+    /*!
+        ペアリストやメッシュリストに関するカウンタ
+    */
+    struct PerfCounters {
+        //! A public member variable.
+        /*!
+            ペアリストを非同期に作り直すときに、間に合わないか安全の確認に失敗して、同期的に作り直した回数
+        */
+        std::int32_t asyncfallbacks;
+
+        //! A public member variable.
+        /*!
+            セル（メッシュ）1個あたりの平均の原子数（メッシュリストを使っていなければ0）
+        */
+        double atomspercell;
+
+        //! A public member variable.
+        /*!
+            力の計算で読み出すペアリストの配列の大きさ（バイト）
+        */
+        std::int64_t pairlistbytes;
+
+        //! A public member variable.
+        /*!
+            ペアリストに含まれるペアの数
+        */
+        std::int64_t pairs;
+
+        //! A public member variable.
+        /*!
+            直前の2回のペアリストの作り直しの間隔（ステップ数、まだ作り直していなければ0）
+        */
+        std::int32_t rebuildinterval;
+
+        //! A public member variable.
+        /*!
+            初期状態を作ってからペアリストを作り直した回数
+        */
+        std::int32_t rebuilds;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン
+        */
+        double skin;
+    };
+
+    //! A class.
+    /*!
+        MDの1ステップの段階ごとの経過時間を計測し、Chrome trace形式のタイムラインを記録するクラス
+        計測はMD_PROFILE_SCOPEマクロで行い、MOLECULARDYNAMICS_DISABLE_PROFILEを定義すると、マクロは何も生成しない
+    */
+    class Profiler final {
+        // #region 型エイリアス
+
+    public:
+        using clock = std::chrono::steady_clock;
+
+        // #endregion 型エイリアス
+
+        // #region 内部クラス
+
+        //! A class.
+        /*!
+            スコープの経過時間を、ある段階の経過時間として記録するクラス
+        */
+        class Scope final {
+        public:
+            //! A constructor.
+            /*!
+                唯一のコンストラクタ
+                \param profiler 記録先
+                \param phase 段階
+            */
+            Scope(Profiler & profiler, Phase phase) : begin_(clock::now()), phase_(phase), profiler_(profiler) {}
+
+            //! A destructor.
+            /*!
+                経過時間を記録する
+            */
+            ~Scope()
+            {
+                profiler_.record(phase_, begin_, clock::now());
+            }
+
+        private:
+            //! A private member variable (constant).
+            /*!
+                スコープに入った時刻
+            */
+            clock::time_point const begin_;
+
+            //! A private member variable (constant).
+            /*!
+                段階
+            */
+            Phase const phase_;
+
+            //! A private member variable.
+            /*!
+                記録先
+            */
+            Profiler & profiler_;
+
+            // #region 禁止されたコンストラクタ・メンバ関数
+
+        public:
+            //! A private copy constructor (deleted).
+            /*!
+                コピーコンストラクタ（禁止）
+            */
+            Scope(Scope const &) = delete;
+
+            //! A private member function (deleted).
+            /*!
+                operator=()の宣言（禁止）
+                \param コピー元のオブジェクト（未使用）
+                \return コピー元のオブジェクト
+            */
+            Scope & operator=(Scope const &) = delete;
+
+            // #endregion 禁止されたコンストラクタ・メンバ関数
+        };
+
+        // #endregion 内部クラス
+
+        // #region コンストラクタ・デストラクタ
+
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+        */
+        Profiler() : origin_(clock::now()) {}
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~Profiler() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public static member function.
+        /*!
+            段階の名前を返す
+            \param phase 段階
+            \return 段階の名前
+        */
+        static char const * name(Phase phase);
+
+        //! A public member function.
+        /*!
+            ある段階の経過時間を記録する
+            \param phase 段階
+            \param begin 開始時刻
+            \param end 終了時刻
+        */
+        void record(Phase phase, clock::time_point begin, clock::time_point end);
+
+        //! A public member function.
+        /*!
+            経過時間の統計とタイムラインを消去する
+        */
+        void reset();
+
+        //! A public member function.
+        /*!
+            タイムラインを記録するかどうかを設定する
+            \param tracing タイムラインを記録するならtrue
+        */
+        void set_tracing(bool tracing)
+        {
+            tracing_ = tracing;
+        }
+
+        //! A public member function (constant).
+        /*!
+            ある段階の経過時間の統計を返す
+            \param phase 段階
+            \return 経過時間の統計
+        */
+        PhaseStat const & stat(Phase phase) const
+        {
+            return stats_[static_cast<std::int32_t>(phase)];
+        }
+
+        //! A public member function (constant).
+        /*!
+            記録したタイムラインを、Chrome trace（Perfettoでも読める）のJSON形式で書き出す
+            \param fp 出力先
+        */
+        void write_chrome_trace(std::FILE * fp) const;
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ変数
+
+    private:
+        //! A struct.
+        /*!
+            タイムラインの1個のイベント
+        */
+        struct TraceEvent {
+            //! A public member variable.
+            /*!
+                開始時刻（ns、計測を始めた時刻から）
+            */
+            std::int64_t begin;
+
+            //! A public member variable.
+            /*!
+                経過時間（ns）
+            */
+            std::int64_t duration;
+
+            //! A public member variable.
+            /*!
+                段階
+            */
+            Phase phase;
+        };
+
+        //! A private member variable (static constant).
+        /*!
+            タイムラインに記録するイベントの最大数（これを超えたら記録をやめる）
+        */
+        static auto constexpr MAXEVENTS = 4000000U;
+
+        //! A private member variable (static constant).
+        /*!
+            表示用の指数移動平均の重み
+        */
+        static auto constexpr SMOOTHING = 0.05;
+
+        //! A private member variable.
+        /*!
+            タイムラインのイベント
+        */
+        std::vector<TraceEvent> events_;
+
+        //! A private member variable.
+        /*!
+            タイムラインの時刻の原点
+        */
+        clock::time_point origin_;
+
+        //! A private member variable.
+        /*!
+            段階ごとの経過時間の統計
+        */
+        std::array<PhaseStat, static_cast<std::size_t>(Phase::COUNT)> stats_;
+
+        //! A private member variable.
+        /*!
+            タイムラインを記録するかどうか
+        */
+        bool tracing_ = false;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        Profiler(Profiler const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        Profiler & operator=(Profiler const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#ifdef MOLECULARDYNAMICS_DISABLE_PROFILE
+    #define MD_PROFILE_SCOPE(profiler, phase)
+#else
+    #define MD_PROFILE_SCOPE_CAT2(a, b) a##b
+    #define MD_PROFILE_SCOPE_CAT(a, b) MD_PROFILE_SCOPE_CAT2(a, b)
+    #define MD_PROFILE_SCOPE(profiler, phase) \
+        moleculardynamics::Profiler::Scope MD_PROFILE_SCOPE_CAT(mdprofilescope, __LINE__)(profiler, phase)
+#endif
+
+#endif  // _PROFILER_H_
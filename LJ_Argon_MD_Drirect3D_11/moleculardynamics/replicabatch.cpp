@@ -0,0 +1,83 @@
+﻿/*! \file replicabatch.cpp
+    \brief 独立した小さな系（レプリカ）を、まとめて並列に計算するクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "replicabatch.h"
+#include <chrono>                               // for std::chrono::steady_clock
+#include <utility>                              // for std::move
+#include <tbb/task_arena.h>                     // for tbb::this_task_arena::isolate
+
+namespace moleculardynamics {
+    // #region コンストラクタ
+
+    ReplicaBatch::ReplicaBatch(std::int32_t Nc, std::vector<ReplicaParam> const & params)
+        : elapsed_(params.size(), 0.0), replicas_(params.size())
+    {
+        tbb::parallel_for(
+            tbb::blocked_range<std::size_t>(0, params.size(), 1),
+            [this, Nc, &params](tbb::blocked_range<std::size_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    auto armd = std::make_unique<Ar_moleculardynamics>();
+
+                    // 小さな系の中を並列化しても割に合わないので、力はレプリカごとに逐次計算する
+                    armd->setForceEngine(ForceEngine::SERIAL);
+
+                    // recalc()の前に温度を与えておかないと、初期速度が既定の温度で決まってしまう
+                    // （先に原子数を減らしておき、以降のrecalc()を安くする）
+                    armd->setTgiven(params[i].temperature);
+                    armd->setNc(Nc);
+                    armd->setScale(params[i].scale);
+                    armd->setSeed(params[i].seed);
+
+                    replicas_[i] = std::move(armd);
+                }
+        });
+    }
+
+    // #endregion コンストラクタ
+
+    // #region publicメンバ関数
+
+    double ReplicaBatch::getElapsed(std::size_t i) const
+    {
+        return elapsed_[i];
+    }
+
+    Ar_moleculardynamics & ReplicaBatch::replica(std::size_t i)
+    {
+        return *replicas_[i];
+    }
+
+    Ar_moleculardynamics const & ReplicaBatch::replica(std::size_t i) const
+    {
+        return *replicas_[i];
+    }
+
+    void ReplicaBatch::runCalc(std::int32_t steps)
+    {
+        // 1つのレプリカを1つのタスクとし、手の空いたスレッドが残りのレプリカを盗んで計算する
+        tbb::parallel_for(
+            tbb::blocked_range<std::size_t>(0, replicas_.size(), 1),
+            [this, steps](tbb::blocked_range<std::size_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    auto const begin = std::chrono::steady_clock::now();
+
+                    // レプリカの中の並列ループの完了を待つ間に、別のレプリカを丸ごと盗んで
+                    // このレプリカの計算が遅れないように、レプリカの中のタスクだけを実行させる
+                    tbb::this_task_arena::isolate([this, i, steps] {
+                        for (auto n = 0; n < steps; n++) {
+                            replicas_[i]->runCalc();
+                        }
+                    });
+
+                    elapsed_[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                }
+            },
+            affinity_);
+    }
+
+    // #endregion publicメンバ関数
+}
@@ -0,0 +1,186 @@
+﻿/*! \file replicabatch.h
+    \brief 独立した小さな系（レプリカ）を、まとめて並列に計算するクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _REPLICABATCH_H_
+#define _REPLICABATCH_H_
+
+#pragma once
+
+#include "Ar_moleculardynamics.h"
+#include <cstddef>                              // for std::size_t
+#include <cstdint>                              // for std::int32_t, std::uint64_t
+#include <memory>                               // for std::unique_ptr
+#include <vector>                               // for std::vector
+#include <tbb/blocked_range.h>                  // for tbb::blocked_range
+#include <tbb/parallel_for.h>                   // for tbb::parallel_for
+#include <tbb/partitioner.h>                    // for tbb::affinity_partitioner
+
+namespace moleculardynamics {
+    //! A struct.
+    /*!
+        レプリカごとに異なる計算条件
+    */
+    struct ReplicaParam {
+        //! A public member variable.
+        /*!
+            格子定数のスケール
+        */
+        double scale;
+
+        //! A public member variable.
+        /*!
+            初期速度と揺動力の乱数のシード
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）
+        */
+        double temperature;
+    };
+
+    //! A class.
+    /*!
+        独立した小さな系（レプリカ）を、まとめて並列に計算するクラス
+        小さな系は1つだけでは多数のコアを使い切れないので、系の中ではなく、系の単位で並列化する
+        （各レプリカはワークスティーリングで空いたスレッドに割り振られ、力の計算のカーネルも共有する）
+    */
+    class ReplicaBatch final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ（レプリカを並列に作成する）
+            \param Nc スーパーセルの個数（すべてのレプリカで共通）
+            \param params レプリカごとの計算条件
+        */
+        ReplicaBatch(std::int32_t Nc, std::vector<ReplicaParam> const & params);
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~ReplicaBatch() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (template function).
+        /*!
+            すべてのレプリカに、同じ設定を並列に行う
+            （recalc()を伴う設定も、レプリカごとに別のスレッドで行われる）
+            \param func レプリカを受け取って設定を行う関数オブジェクト
+        */
+        template <typename Function>
+        void apply(Function func)
+        {
+            tbb::parallel_for(
+                tbb::blocked_range<std::size_t>(0, replicas_.size(), 1),
+                [this, &func](tbb::blocked_range<std::size_t> const & range) {
+                    for (auto i = range.begin(); i != range.end(); ++i) {
+                        func(*replicas_[i]);
+                    }
+            });
+        }
+
+        //! A public member function (constant).
+        /*!
+            直前のrunCalc()で、レプリカを計算するのにかかった時間を返す
+            \param i レプリカのインデックス
+            \return 直前のrunCalc()でかかった時間（秒）
+        */
+        double getElapsed(std::size_t i) const;
+
+        //! A public member function.
+        /*!
+            レプリカを返す
+            \param i レプリカのインデックス
+            \return レプリカ
+        */
+        Ar_moleculardynamics & replica(std::size_t i);
+
+        //! A public member function (constant).
+        /*!
+            レプリカを返す
+            \param i レプリカのインデックス
+            \return レプリカ
+        */
+        Ar_moleculardynamics const & replica(std::size_t i) const;
+
+        //! A public member function.
+        /*!
+            すべてのレプリカを、それぞれstepsステップ進める
+            \param steps 進めるMDのステップ数
+        */
+        void runCalc(std::int32_t steps);
+
+        //! A public member function (constant).
+        /*!
+            レプリカの数を返す
+            \return レプリカの数
+        */
+        std::size_t size() const
+        {
+            return replicas_.size();
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ変数
+
+    private:
+        //! A private member variable.
+        /*!
+            runCalc()を繰り返し呼んだときに、同じレプリカをなるべく同じスレッドで計算させるための分割器
+            （原子の配列がそのスレッドのキャッシュに残り、スレッドごとのバッファも増えない）
+        */
+        tbb::affinity_partitioner affinity_;
+
+        //! A private member variable.
+        /*!
+            直前のrunCalc()で、レプリカごとにかかった時間（秒）
+        */
+        std::vector<double> elapsed_;
+
+        //! A private member variable.
+        /*!
+            レプリカ
+        */
+        std::vector<std::unique_ptr<Ar_moleculardynamics> > replicas_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        ReplicaBatch() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        ReplicaBatch(ReplicaBatch const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        ReplicaBatch & operator=(ReplicaBatch const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _REPLICABATCH_H_
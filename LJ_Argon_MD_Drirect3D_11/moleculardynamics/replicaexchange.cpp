@@ -0,0 +1,111 @@
+﻿/*! \file replicaexchange.cpp
+    \brief 温度の異なるレプリカの間で、配置を交換しながらMDを行うクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "replicaexchange.h"
+#include "myrandom/philox.h"
+#include <algorithm>                            // for std::fill, std::is_sorted
+#include <cmath>                                // for std::exp
+#include <numeric>                              // for std::iota
+#include <utility>                              // for std::swap
+#include <boost/assert.hpp>                     // for BOOST_ASSERT
+
+namespace moleculardynamics {
+    namespace {
+        //! A function.
+        /*!
+            温度の段ごとに、レプリカの計算条件を作る
+            \param scale 格子定数のスケール
+            \param temperatures 温度（絶対温度）の一覧
+            \param seed 乱数のシード
+            \return レプリカごとの計算条件
+        */
+        std::vector<ReplicaParam> make_params(double scale, std::vector<double> const & temperatures, std::uint64_t seed)
+        {
+            std::vector<ReplicaParam> params;
+            for (auto k = 0U; k < temperatures.size(); k++) {
+                params.push_back({ scale, seed + k, temperatures[k] });
+            }
+
+            return params;
+        }
+    }
+
+    // #region コンストラクタ
+
+    ReplicaExchange::ReplicaExchange(std::int32_t Nc, double scale, std::vector<double> const & temperatures, std::uint64_t seed)
+        : accepted_(temperatures.size(), 0), attempts_(temperatures.size(), 0), batch_(Nc, make_params(scale, temperatures, seed)), seed_(seed), slot_(temperatures.size()), temperatures_(temperatures)
+    {
+        BOOST_ASSERT(!temperatures_.empty() && std::is_sorted(temperatures_.begin(), temperatures_.end()));
+
+        // 最初は、k番目のレプリカがk番目の温度の段にいる
+        std::iota(slot_.begin(), slot_.end(), 0);
+    }
+
+    // #endregion コンストラクタ
+
+    // #region publicメンバ関数
+
+    void ReplicaExchange::exchange()
+    {
+        auto const key = myrandom::Philox::make_key(seed_);
+        auto const c1 = static_cast<std::uint32_t>(round_);
+        auto const c2 = static_cast<std::uint32_t>(round_ >> 32);
+
+        for (auto k = static_cast<std::size_t>(round_ % 2); k + 1 < temperatures_.size(); k += 2) {
+            auto & lo = batch_.replica(slot_[k]);
+            auto & hi = batch_.replica(slot_[k + 1]);
+
+            // 受理確率はmin(1, exp[(1 / T_k - 1 / T_k+1)(U_lo - U_hi)])（無次元単位ではk_B = 1）
+            // ポテンシャルエネルギーは、直前のステップで力と同時に求めたものを用いる
+            auto const delta = (1.0 / lo.Tg_ - 1.0 / hi.Tg_) * (lo.Up_ - hi.Up_);
+
+            // 乱数は（シード, 交換の回数, 温度の段）だけで決まるので、スレッド数によらない
+            auto const bits = myrandom::Philox::generate(
+                { static_cast<std::uint32_t>(k), c1, c2, Ar_moleculardynamics::STREAM_EXCHANGE }, key);
+
+            attempts_[k]++;
+
+            if (delta >= 0.0 || myrandom::Philox::to_uniform(bits[0]) < std::exp(delta)) {
+                lo.exchangeTgiven(temperatures_[k + 1]);
+                hi.exchangeTgiven(temperatures_[k]);
+                std::swap(slot_[k], slot_[k + 1]);
+
+                accepted_[k]++;
+            }
+        }
+
+        round_++;
+    }
+
+    std::int64_t ReplicaExchange::getAccepted(std::size_t k) const
+    {
+        return accepted_[k];
+    }
+
+    std::int64_t ReplicaExchange::getAttempts(std::size_t k) const
+    {
+        return attempts_[k];
+    }
+
+    std::size_t ReplicaExchange::getReplica(std::size_t k) const
+    {
+        return slot_[k];
+    }
+
+    double ReplicaExchange::getTemperature(std::size_t k) const
+    {
+        return temperatures_[k];
+    }
+
+    void ReplicaExchange::resetStatistics()
+    {
+        std::fill(accepted_.begin(), accepted_.end(), 0);
+        std::fill(attempts_.begin(), attempts_.end(), 0);
+    }
+
+    // #endregion publicメンバ関数
+}
@@ -0,0 +1,198 @@
+﻿/*! \file replicaexchange.h
+    \brief 温度の異なるレプリカの間で、配置を交換しながらMDを行うクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _REPLICAEXCHANGE_H_
+#define _REPLICAEXCHANGE_H_
+
+#pragma once
+
+#include "replicabatch.h"
+#include <cstddef>                              // for std::size_t
+#include <cstdint>                              // for std::int32_t, std::int64_t, std::uint64_t
+#include <vector>                               // for std::vector
+
+namespace moleculardynamics {
+    //! A class.
+    /*!
+        温度の異なるレプリカの間で、配置を交換しながらMDを行うクラス（レプリカ交換法）
+        交換では原子の配列をコピーせず、レプリカの温度を入れ替えて運動量をスケールする
+    */
+    class ReplicaExchange final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+            \param Nc スーパーセルの個数（すべてのレプリカで共通）
+            \param scale 格子定数のスケール（すべてのレプリカで共通）
+            \param temperatures 温度（絶対温度）の一覧（昇順）
+            \param seed 乱数のシード（k番目のレプリカはseed + kを用い、交換の判定にはseedを用いる）
+        */
+        ReplicaExchange(std::int32_t Nc, double scale, std::vector<double> const & temperatures, std::uint64_t seed);
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~ReplicaExchange() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function.
+        /*!
+            レプリカの集まりを返す（すべてのレプリカに共通の設定を行うのに用いる）
+            \return レプリカの集まり
+        */
+        ReplicaBatch & batch()
+        {
+            return batch_;
+        }
+
+        //! A public member function.
+        /*!
+            隣り合う温度のレプリカの組について、Metropolis法で交換を試みる
+            （温度の段の(0, 1), (2, 3), ...の組と、(1, 2), (3, 4), ...の組を、呼び出すごとに交互に試す）
+        */
+        void exchange();
+
+        //! A public member function (constant).
+        /*!
+            温度の段kとk + 1の間の交換が受理された回数を返す
+            \param k 温度の段
+            \return 交換が受理された回数
+        */
+        std::int64_t getAccepted(std::size_t k) const;
+
+        //! A public member function (constant).
+        /*!
+            温度の段kとk + 1の間の交換を試みた回数を返す
+            \param k 温度の段
+            \return 交換を試みた回数
+        */
+        std::int64_t getAttempts(std::size_t k) const;
+
+        //! A public member function (constant).
+        /*!
+            温度の段kにいるレプリカのインデックスを返す
+            \param k 温度の段
+            \return レプリカのインデックス
+        */
+        std::size_t getReplica(std::size_t k) const;
+
+        //! A public member function (constant).
+        /*!
+            温度の段kの温度を返す
+            \param k 温度の段
+            \return 温度（絶対温度）
+        */
+        double getTemperature(std::size_t k) const;
+
+        //! A public member function.
+        /*!
+            交換の統計をリセットする
+        */
+        void resetStatistics();
+
+        //! A public member function.
+        /*!
+            すべてのレプリカを、それぞれstepsステップ並列に進める
+            \param steps 進めるMDのステップ数
+        */
+        void runCalc(std::int32_t steps)
+        {
+            batch_.runCalc(steps);
+        }
+
+        //! A public member function (constant).
+        /*!
+            レプリカ（温度の段）の数を返す
+            \return レプリカの数
+        */
+        std::size_t size() const
+        {
+            return temperatures_.size();
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ変数
+
+    private:
+        //! A private member variable.
+        /*!
+            温度の段ごとの、交換が受理された回数
+        */
+        std::vector<std::int64_t> accepted_;
+
+        //! A private member variable.
+        /*!
+            温度の段ごとの、交換を試みた回数
+        */
+        std::vector<std::int64_t> attempts_;
+
+        //! A private member variable.
+        /*!
+            レプリカの集まり
+        */
+        ReplicaBatch batch_;
+
+        //! A private member variable.
+        /*!
+            exchange()を呼び出した回数（交換の判定の乱数のカウンタにも用いる）
+        */
+        std::uint64_t round_ = 0;
+
+        //! A private member variable (constant).
+        /*!
+            交換の判定の乱数のシード
+        */
+        std::uint64_t const seed_;
+
+        //! A private member variable.
+        /*!
+            温度の段ごとの、その段にいるレプリカのインデックス
+        */
+        std::vector<std::size_t> slot_;
+
+        //! A private member variable (constant).
+        /*!
+            温度の段ごとの温度（絶対温度）
+        */
+        std::vector<double> const temperatures_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        ReplicaExchange() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        ReplicaExchange(ReplicaExchange const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        ReplicaExchange & operator=(ReplicaExchange const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _REPLICAEXCHANGE_H_
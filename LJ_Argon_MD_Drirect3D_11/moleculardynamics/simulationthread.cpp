@@ -0,0 +1,274 @@
+﻿/*! \file simulationthread.cpp
+    \brief 描画とは別のスレッドでMDを実行するクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "simulationthread.h"
+#include <chrono>                               // for std::chrono::steady_clock
+#include <boost/assert.hpp>                     // for BOOST_ASSERT
+
+namespace moleculardynamics {
+    // #region staticメンバ変数
+
+    std::array<CommandType, static_cast<std::size_t>(CommandType::COUNT)> const SimulationThread::COMMANDORDER = {
+        CommandType::SET_TGIVEN,
+        CommandType::SET_TEMPCONTMETHOD,
+        CommandType::SET_ENSEMBLE,
+        CommandType::SET_SCALE,
+        CommandType::SET_NC,
+        CommandType::RECALC
+    };
+
+    // #endregion staticメンバ変数
+
+    // #region コンストラクタ・デストラクタ
+
+    SimulationThread::SimulationThread(Ar_moleculardynamics & armd, std::int32_t stepsperframe) :
+        armd_(armd),
+        pending_(0),
+        stepsperframe_(stepsperframe),
+        stop_(false)
+    {
+        BOOST_ASSERT(stepsperframe >= 0);
+
+        // スレッドを開始する前から、描画側がスナップショットを読めるようにしておく
+        capture(snapshots_.back());
+        snapshots_.publish();
+    }
+
+    SimulationThread::~SimulationThread()
+    {
+        stop();
+    }
+
+    // #endregion コンストラクタ・デストラクタ
+
+    // #region publicメンバ関数
+
+    Snapshot const & SimulationThread::acquire()
+    {
+        snapshots_.acquire();
+
+        return snapshots_.front();
+    }
+
+    void SimulationThread::frame()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frames_++;
+        }
+
+        cv_.notify_one();
+    }
+
+    std::int32_t SimulationThread::getStepsPerFrame() const
+    {
+        return stepsperframe_.load(std::memory_order_relaxed);
+    }
+
+    void SimulationThread::post(Command const & command)
+    {
+        auto const type = static_cast<std::int32_t>(command.type);
+        BOOST_ASSERT(type >= 0 && type < static_cast<std::int32_t>(CommandType::COUNT));
+
+        // 値を書いてからビットを立てるので、ビットを見たMDのスレッドは、この値かそれより新しい値を読む
+        values_[type].store(command.value, std::memory_order_relaxed);
+        pending_.fetch_or(1U << type, std::memory_order_release);
+    }
+
+    void SimulationThread::setStepsPerFrame(std::int32_t stepsperframe)
+    {
+        BOOST_ASSERT(stepsperframe >= 0);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stepsperframe_.store(stepsperframe, std::memory_order_relaxed);
+        }
+
+        cv_.notify_one();
+    }
+
+    void SimulationThread::start()
+    {
+        BOOST_ASSERT(!thread_.joinable());
+
+        stop_.store(false, std::memory_order_relaxed);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    void SimulationThread::stop()
+    {
+        if (!thread_.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_.store(true, std::memory_order_relaxed);
+        }
+
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    // #endregion publicメンバ関数
+
+    // #region privateメンバ関数
+
+    void SimulationThread::apply(Command const & command)
+    {
+        switch (command.type) {
+        case CommandType::RECALC:
+            armd_.recalc();
+            break;
+
+        case CommandType::SET_ENSEMBLE:
+            armd_.setEnsemble(static_cast<EnsembleType>(static_cast<std::int32_t>(command.value)));
+            break;
+
+        case CommandType::SET_NC:
+            armd_.setNc(static_cast<std::int32_t>(command.value));
+            break;
+
+        case CommandType::SET_SCALE:
+            armd_.setScale(command.value);
+            break;
+
+        case CommandType::SET_TEMPCONTMETHOD:
+            armd_.setTempContMethod(static_cast<TempControlMethod>(static_cast<std::int32_t>(command.value)));
+            break;
+
+        case CommandType::SET_TGIVEN:
+            armd_.setTgiven(command.value);
+            break;
+
+        default:
+            BOOST_ASSERT(!"何かがおかしい！");
+            break;
+        }
+    }
+
+    void SimulationThread::applyCommands()
+    {
+        // スライダーを動かすと同じ種類の命令が続けて届くが、setNc()などは重いので最新の値だけを実行する
+        // 値は上書きされるだけなので、MDが重い処理の最中に送られた最後の値も必ず届く
+        auto const pending = pending_.exchange(0, std::memory_order_acquire);
+        if (!pending) {
+            return;
+        }
+
+        for (auto const type : SimulationThread::COMMANDORDER) {
+            auto const index = static_cast<std::int32_t>(type);
+            if (pending & (1U << index)) {
+                apply({ type, values_[index].load(std::memory_order_relaxed) });
+            }
+        }
+    }
+
+    void SimulationThread::capture(Snapshot & snapshot) const
+    {
+        auto const & atoms = armd_.Atoms();
+        auto const size = atoms.size();
+
+        snapshot.force.resize(size);
+        snapshot.x.resize(size);
+        snapshot.y.resize(size);
+        snapshot.z.resize(size);
+
+        for (auto i = 0U; i < size; i++) {
+            auto const atom = atoms[i];
+            snapshot.force[i] = armd_.getForce(static_cast<std::int32_t>(i));
+            snapshot.x[i] = static_cast<float>(atom.r[0]);
+            snapshot.y[i] = static_cast<float>(atom.r[1]);
+            snapshot.z[i] = static_cast<float>(atom.r[2]);
+        }
+
+        snapshot.counters = armd_.getCounters();
+        snapshot.deltat = armd_.getDeltat();
+        snapshot.latticeconst = armd_.getLatticeconst();
+        snapshot.mditer = armd_.MD_iter;
+        snapshot.nc = armd_.Nc;
+        snapshot.numatom = armd_.NumAtom;
+        snapshot.periodiclen = armd_.periodiclen;
+        snapshot.periodiclennm = armd_.getPeriodiclen();
+
+        auto const & profiler = armd_.getProfiler();
+        for (auto i = 0; i < static_cast<std::int32_t>(Phase::COUNT); i++) {
+            snapshot.phasens[i] = profiler.stat(static_cast<Phase>(i)).smooth_ns;
+        }
+
+        snapshot.pressure = armd_.getPressure();
+        snapshot.stepspersecond = stepspersecond_;
+        snapshot.tcalc = armd_.getTcalc();
+        snapshot.tgiven = armd_.getTgiven();
+        snapshot.uk = armd_.Uk;
+        snapshot.up = armd_.Up;
+        snapshot.utot = armd_.Utot;
+    }
+
+    void SimulationThread::run()
+    {
+        using clock = std::chrono::steady_clock;
+
+        auto lastframe = std::uint64_t(0);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lastframe = frames_;
+        }
+
+        auto steps = 0;
+        auto begin = clock::now();
+        auto published = begin;
+
+        while (!stop_.load(std::memory_order_relaxed)) {
+            auto count = 1;
+            auto paced = false;
+
+            // 1フレームあたりのステップ数を決めているときは、次のフレームが描画されるまで待つ
+            // （描画より計算が遅いときは、溜まったフレームの分をまとめて1回と数え、遅れを追いかけない）
+            if (stepsperframe_.load(std::memory_order_relaxed) > 0) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this, lastframe] {
+                    return stop_.load(std::memory_order_relaxed) || !stepsperframe_.load(std::memory_order_relaxed) || frames_ != lastframe;
+                });
+
+                if (stop_.load(std::memory_order_relaxed)) {
+                    break;
+                }
+
+                lastframe = frames_;
+                count = stepsperframe_.load(std::memory_order_relaxed);
+                paced = count > 0;
+                count = paced ? count : 1;
+            }
+
+            for (auto i = 0; i < count; i++) {
+                applyCommands();
+                armd_.runCalc();
+            }
+
+            steps += count;
+
+            auto const end = clock::now();
+            auto const elapsed = std::chrono::duration<double>(end - begin).count();
+            if (elapsed >= SimulationThread::RATEINTERVAL) {
+                stepspersecond_ = static_cast<double>(steps) / elapsed;
+                steps = 0;
+                begin = end;
+            }
+
+            // できるだけ速く計算しているときは、毎ステップのコピーを省くため、描画側が前のスナップショットを
+            // 受け取ったか、前のスナップショットが古くなったときだけ、新しいスナップショットを作る
+            if (paced || snapshots_.consumed() || std::chrono::duration<double>(end - published).count() >= SimulationThread::PUBLISHINTERVAL) {
+                capture(snapshots_.back());
+                snapshots_.publish();
+                published = end;
+            }
+        }
+    }
+
+    // #endregion privateメンバ関数
+}
@@ -0,0 +1,420 @@
+﻿/*! \file simulationthread.h
+    \brief 描画とは別のスレッドでMDを実行するクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _SIMULATIONTHREAD_H_
+#define _SIMULATIONTHREAD_H_
+
+#pragma once
+
+#include "Ar_moleculardynamics.h"
+#include "utility/triplebuffer.h"
+#include <array>                                // for std::array
+#include <atomic>                               // for std::atomic
+#include <condition_variable>                   // for std::condition_variable
+#include <cstdint>                              // for std::int32_t, std::uint32_t, std::uint64_t
+#include <mutex>                                // for std::mutex
+#include <thread>                               // for std::thread
+#include <vector>                               // for std::vector
+
+namespace moleculardynamics {
+    //! A enum.
+    /*!
+        描画側のスレッドからMDのスレッドに送る命令の種類の列挙型
+    */
+    enum class CommandType : std::int32_t {
+        // 再計算する
+        RECALC = 0,
+
+        // アンサンブルを設定する（値はEnsembleType）
+        SET_ENSEMBLE = 1,
+
+        // スーパーセルの個数を設定する
+        SET_NC = 2,
+
+        // 格子定数のスケールを設定する
+        SET_SCALE = 3,
+
+        // 温度制御の方法を設定する（値はTempControlMethod）
+        SET_TEMPCONTMETHOD = 4,
+
+        // 温度を設定する（絶対温度）
+        SET_TGIVEN = 5,
+
+        // 命令の種類の数
+        COUNT = 6
+    };
+
+    //! A struct.
+    /*!
+        描画側のスレッドからMDのスレッドに送る命令
+    */
+    struct Command {
+        //! A public member variable.
+        /*!
+            命令の種類
+        */
+        CommandType type;
+
+        //! A public member variable.
+        /*!
+            命令の値（列挙型や整数の値も、この型で送る）
+        */
+        double value;
+    };
+
+    //! A struct.
+    /*!
+        描画側のスレッドに渡す、あるステップのMDの状態のスナップショット
+    */
+    struct Snapshot {
+        //! A public member variable.
+        /*!
+            ペアリストやメッシュリストに関するカウンタ
+        */
+        PerfCounters counters;
+
+        //! A public member variable.
+        /*!
+            経過時間（ps）
+        */
+        double deltat;
+
+        //! A public member variable.
+        /*!
+            原子に働く力の大きさ
+        */
+        std::vector<float> force;
+
+        //! A public member variable.
+        /*!
+            格子定数（nm）
+        */
+        double latticeconst;
+
+        //! A public member variable.
+        /*!
+            MDのステップ数
+        */
+        std::int32_t mditer;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数
+        */
+        std::int32_t nc;
+
+        //! A public member variable.
+        /*!
+            原子数
+        */
+        std::int32_t numatom;
+
+        //! A public member variable.
+        /*!
+            周期境界条件の長さ（σ単位）
+        */
+        double periodiclen;
+
+        //! A public member variable.
+        /*!
+            周期境界条件の長さ（nm）
+        */
+        double periodiclennm;
+
+        //! A public member variable.
+        /*!
+            runCalc()の段階ごとの経過時間の指数移動平均（ns）
+        */
+        std::array<double, static_cast<std::size_t>(Phase::COUNT)> phasens;
+
+        //! A public member variable.
+        /*!
+            圧力（atm）
+        */
+        double pressure;
+
+        //! A public member variable.
+        /*!
+            1秒あたりに計算したMDのステップ数
+        */
+        double stepspersecond;
+
+        //! A public member variable.
+        /*!
+            計算された温度（絶対温度）
+        */
+        double tcalc;
+
+        //! A public member variable.
+        /*!
+            与えた温度（絶対温度）
+        */
+        double tgiven;
+
+        //! A public member variable.
+        /*!
+            運動エネルギー（Hartree）
+        */
+        double uk;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルエネルギー（Hartree）
+        */
+        double up;
+
+        //! A public member variable.
+        /*!
+            全エネルギー（Hartree）
+        */
+        double utot;
+
+        //! A public member variable.
+        /*!
+            原子の座標のx成分
+        */
+        std::vector<float> x;
+
+        //! A public member variable.
+        /*!
+            原子の座標のy成分
+        */
+        std::vector<float> y;
+
+        //! A public member variable.
+        /*!
+            原子の座標のz成分
+        */
+        std::vector<float> z;
+    };
+
+    //! A class.
+    /*!
+        描画とは別のスレッドでMDを実行するクラス
+        描画側のスレッドとは、ロックフリーのトリプルバッファでスナップショットを、
+        命令の種類ごとの最新の値を入れるアトミックな変数で命令を受け渡すので、重いステップが描画を止めることも、
+        遅いフレームがMDを遅らせることも、MDが重い処理の最中に送った命令が失われることもない
+    */
+    class SimulationThread final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ（最初のスナップショットを作るが、スレッドはまだ開始しない）
+            \param armd 実行する分子動力学シミュレーションのオブジェクト（スレッドの実行中は、このクラスからだけ触る）
+            \param stepsperframe 1フレームあたりのMDのステップ数（0なら、できるだけ速く計算する）
+        */
+        SimulationThread(Ar_moleculardynamics & armd, std::int32_t stepsperframe);
+
+        //! A destructor.
+        /*!
+            スレッドを停止する
+        */
+        ~SimulationThread();
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function.
+        /*!
+            最新のスナップショットを受け取って返す（描画側のスレッドからだけ呼ぶ）
+            返した参照は、次にacquire()を呼ぶまで有効
+            \return 最新のスナップショット
+        */
+        Snapshot const & acquire();
+
+        //! A public member function.
+        /*!
+            1フレームを描画したことを通知する（1フレームあたりのステップ数を決めているときは、これでMDが進む）
+        */
+        void frame();
+
+        //! A public member function (constant).
+        /*!
+            1フレームあたりのMDのステップ数を求める
+            \return 1フレームあたりのMDのステップ数（0なら、できるだけ速く計算する）
+        */
+        std::int32_t getStepsPerFrame() const;
+
+        //! A public member function.
+        /*!
+            命令を送る（描画側のスレッドからだけ呼ぶ）、命令はMDのステップの合間に実行される
+            実行される前に同じ種類の命令を送ると、最後に送った値だけが実行される
+            \param command 命令
+        */
+        void post(Command const & command);
+
+        //! A public member function.
+        /*!
+            1フレームあたりのMDのステップ数を設定する
+            \param stepsperframe 1フレームあたりのMDのステップ数（0なら、できるだけ速く計算する）
+        */
+        void setStepsPerFrame(std::int32_t stepsperframe);
+
+        //! A public member function.
+        /*!
+            スレッドを開始する
+        */
+        void start();
+
+        //! A public member function.
+        /*!
+            スレッドを停止して、終了を待つ
+        */
+        void stop();
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ関数
+
+    private:
+        //! A private member function.
+        /*!
+            命令を実行する
+            \param command 命令
+        */
+        void apply(Command const & command);
+
+        //! A private member function.
+        /*!
+            届いている命令を、種類ごとに最新の値で実行する
+        */
+        void applyCommands();
+
+        //! A private member function (constant).
+        /*!
+            現在のMDの状態をスナップショットに書き込む
+            \param snapshot 書き込み先のスナップショット
+        */
+        void capture(Snapshot & snapshot) const;
+
+        //! A private member function.
+        /*!
+            スレッドで実行する関数
+        */
+        void run();
+
+        // #endregion privateメンバ関数
+
+        // #region privateメンバ変数
+
+        //! A private member variable (static constant).
+        /*!
+            できるだけ速く計算しているときに、スナップショットを作り直す最大の間隔（秒）
+        */
+        static auto constexpr PUBLISHINTERVAL = 0.002;
+
+        //! A private member variable (static constant).
+        /*!
+            1秒あたりのステップ数を求める区間の長さ（秒）
+        */
+        static auto constexpr RATEINTERVAL = 0.5;
+
+        //! A private member variable.
+        /*!
+            分子動力学シミュレーションのオブジェクト
+        */
+        Ar_moleculardynamics & armd_;
+
+        //! A private member variable (static constant).
+        /*!
+            届いている命令を実行する順番（温度はrecalc()を伴う命令より先に、再計算は最後に実行する）
+        */
+        static std::array<CommandType, static_cast<std::size_t>(CommandType::COUNT)> const COMMANDORDER;
+
+        //! A private member variable.
+        /*!
+            フレームの通知と停止を待つための条件変数
+        */
+        std::condition_variable cv_;
+
+        //! A private member variable.
+        /*!
+            命令の種類ごとの、まだ実行していない命令のビット（描画側のスレッドが立て、MDのスレッドが下ろす）
+        */
+        std::atomic<std::uint32_t> pending_;
+
+        //! A private member variable.
+        /*!
+            描画したフレームの数（mutex_で保護する）
+        */
+        std::uint64_t frames_ = 0;
+
+        //! A private member variable.
+        /*!
+            frames_と、待機の条件を変えるときに用いるミューテックス
+        */
+        std::mutex mutex_;
+
+        //! A private member variable.
+        /*!
+            描画側のスレッドに渡すスナップショット
+        */
+        utility::TripleBuffer<Snapshot> snapshots_;
+
+        //! A private member variable.
+        /*!
+            1秒あたりに計算したMDのステップ数（MDのスレッドだけが触る）
+        */
+        double stepspersecond_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            1フレームあたりのMDのステップ数
+        */
+        std::atomic<std::int32_t> stepsperframe_;
+
+        //! A private member variable.
+        /*!
+            スレッドを停止するかどうか
+        */
+        std::atomic<bool> stop_;
+
+        //! A private member variable.
+        /*!
+            MDを実行するスレッド
+        */
+        std::thread thread_;
+
+        //! A private member variable.
+        /*!
+            命令の種類ごとの、最後に送られた命令の値
+        */
+        std::array<std::atomic<double>, static_cast<std::size_t>(CommandType::COUNT)> values_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        SimulationThread() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        SimulationThread(SimulationThread const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        SimulationThread & operator=(SimulationThread const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _SIMULATIONTHREAD_H_
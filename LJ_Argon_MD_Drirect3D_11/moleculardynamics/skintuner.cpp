@@ -0,0 +1,155 @@
+﻿/*! \file skintuner.cpp
+    \brief ペアリストのマージン（Verletのスキン）を実行時に調整するクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "skintuner.h"
+#include <algorithm>                        // for std::max, std::min
+
+namespace moleculardynamics {
+    // #region コンストラクタ
+
+    SkinTuner::SkinTuner(double skin)
+    {
+        reset(skin);
+    }
+
+    // #endregion コンストラクタ
+
+    // #region publicメンバ関数
+
+    double SkinTuner::next(double progress)
+    {
+        if (converged_) {
+            // 収束してから十分なステップが経ったら、温度や密度の変化に追従するために探索をやり直す
+            if (steps_ >= SkinTuner::RETUNESTEPS) {
+                reset(bestskin_);
+            }
+
+            return skin_;
+        }
+
+        // 区間が短すぎると計測の揺らぎが大きいので、次に作り直すまで計測を続ける
+        if (steps_ < SkinTuner::MINSTEPS) {
+            return skin_;
+        }
+
+        // 区間の先頭で作り直していない（探索を始めた直後の）区間は、作り直しのコストがわからないので捨てる
+        if (rebuild_ < 0.0) {
+            elapsed_ = 0.0;
+            rebuild_ = 0.0;
+            steps_ = 0;
+
+            return skin_;
+        }
+
+        // 作り直しの経過時間は、マージンを消費する速さから見積もった作り直しの周期で按分する
+        // （自然に作り直したときは、区間の経過時間をそのままステップ数で割るのと同じ）
+        auto const p = std::min(std::max(progress, SkinTuner::PROGRESSMIN), 1.0);
+        auto const cost = (elapsed_ - rebuild_ + rebuild_ * p) / static_cast<double>(steps_);
+        elapsed_ = 0.0;
+        rebuild_ = 0.0;
+        steps_ = 0;
+
+        if (measuringbest_) {
+            // 最良のマージンを測り直した（系の状態は時間とともに変わるので、比較は隣り合う区間どうしで行う）
+            bestcost_ = cost;
+            measuringbest_ = false;
+        }
+        else if (cost < bestcost_ * (1.0 - SkinTuner::TOLERANCE)) {
+            // 改善したので、同じ方向にさらに進める（来た方向は試すまでもない）
+            bestcost_ = cost;
+            bestskin_ = skin_;
+            reversed_ = true;
+        }
+        else {
+            if (!turn()) {
+                skin_ = bestskin_;
+
+                return skin_;
+            }
+
+            // 次の候補と比べる前に、最良のマージンを測り直す
+            skin_ = bestskin_;
+            measuringbest_ = true;
+
+            return skin_;
+        }
+
+        skin_ = probe();
+
+        return skin_;
+    }
+
+    void SkinTuner::record(double seconds)
+    {
+        elapsed_ += seconds;
+        steps_++;
+    }
+
+    void SkinTuner::record_rebuild(double seconds)
+    {
+        rebuild_ += seconds;
+    }
+
+    void SkinTuner::reset(double skin)
+    {
+        bestcost_ = 0.0;
+        bestskin_ = skin;
+        converged_ = false;
+        delta_ = SkinTuner::DSTART;
+        direction_ = 1;
+        elapsed_ = 0.0;
+        measuringbest_ = true;
+        rebuild_ = -1.0;
+        reversed_ = false;
+        skin_ = skin;
+        steps_ = 0;
+    }
+
+    // #endregion publicメンバ関数
+
+    // #region privateメンバ関数
+
+    double SkinTuner::probe()
+    {
+        for (;;) {
+            auto const skin = bestskin_ + static_cast<double>(direction_) * delta_;
+            if (skin >= SkinTuner::SKINMIN && skin <= SkinTuner::SKINMAX) {
+                return skin;
+            }
+
+            // 範囲外のマージンは、改善しなかったものとして扱う
+            if (!turn()) {
+                return bestskin_;
+            }
+        }
+    }
+
+    bool SkinTuner::turn()
+    {
+        if (!reversed_) {
+            direction_ = -direction_;
+            reversed_ = true;
+
+            return true;
+        }
+
+        delta_ *= 0.5;
+        reversed_ = false;
+
+        if (delta_ < SkinTuner::DMIN) {
+            converged_ = true;
+            elapsed_ = 0.0;
+            steps_ = 0;
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // #endregion privateメンバ関数
+}
@@ -0,0 +1,265 @@
+﻿/*! \file skintuner.h
+    \brief ペアリストのマージン（Verletのスキン）を実行時に調整するクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _SKINTUNER_H_
+#define _SKINTUNER_H_
+
+#pragma once
+
+#include <cstdint>                              // for std::int32_t
+
+namespace moleculardynamics {
+    //! A class.
+    /*!
+        ペアリストのマージンを、1ステップあたりの実測の経過時間が最小になるように調整するクラス
+        マージンを広げると力の計算が重くなり、狭めるとペアリストを作り直す回数が増えるので、
+        ペアリストを作り直してから次に作り直すまでを区間として、1ステップあたりの経過時間
+        （作り直しの経過時間は、作り直す周期で按分する）を計測し、マージンを山登り法で探索する
+    */
+    class SkinTuner final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+            \param skin マージンの初期値
+        */
+        explicit SkinTuner(double skin);
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~SkinTuner() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (constant).
+        /*!
+            探索が収束したかどうかを返す
+            \return 探索が収束していればtrue
+        */
+        bool converged() const
+        {
+            return converged_;
+        }
+
+        //! A public member function.
+        /*!
+            ペアリストを作り直す直前に呼び、計測の区間を締めて次のマージンを決める
+            \param progress 区間の終わりまでに消費したマージンの割合（自然に作り直すときは1）
+            \return 次のペアリストに用いるマージン
+        */
+        double next(double progress);
+
+        //! A public member function.
+        /*!
+            1ステップの経過時間を記録する
+            \param seconds 1ステップの経過時間（秒、ペアリストを作り直した経過時間を含む）
+        */
+        void record(double seconds);
+
+        //! A public member function.
+        /*!
+            ペアリストを作り直した経過時間を記録する
+            \param seconds ペアリストを作り直した経過時間（秒）
+        */
+        void record_rebuild(double seconds);
+
+        //! A public member function.
+        /*!
+            現在のマージンから探索をやり直す（温度や密度が変わったときに呼ぶ）
+            \param skin 探索を始めるマージン
+        */
+        void reset(double skin);
+
+        //! A public member function (constant).
+        /*!
+            ペアリストが作り直されなくても、計測の区間を締める（収束後なら探索をやり直す）べきかどうかを返す
+            \return 計測の区間が最大の長さに達しているか、収束してから十分なステップが経っていればtrue
+        */
+        bool window_full() const
+        {
+            return steps_ >= (converged_ ? SkinTuner::RETUNESTEPS : SkinTuner::MAXSTEPS);
+        }
+
+        // #endregion publicメンバ関数
+
+        // #region privateメンバ関数
+
+    private:
+        //! A private member function.
+        /*!
+            最良のマージンから探索の方向に刻みだけ進めて、次に試すマージンを決める
+            \return 次に試すマージン（その前に収束したら、最良のマージン）
+        */
+        double probe();
+
+        //! A private member function.
+        /*!
+            試したマージンが改善しなかったときに、探索の方向を反転するか刻みを半分にする
+            \return 探索を続けるならtrue、収束したならfalse
+        */
+        bool turn();
+
+        // #endregion privateメンバ関数
+
+        // #region privateメンバ変数
+
+        //! A private member variable (static constant).
+        /*!
+            探索を打ち切るマージンの刻み
+        */
+        static auto constexpr DMIN = 0.05;
+
+        //! A private member variable (static constant).
+        /*!
+            探索を始めるときのマージンの刻み
+        */
+        static auto constexpr DSTART = 0.2;
+
+        //! A private member variable (static constant).
+        /*!
+            計測の区間の最大のステップ数（ペアリストが作り直されなくても、ここで区間を締める）
+        */
+        static auto constexpr MAXSTEPS = 40;
+
+        //! A private member variable (static constant).
+        /*!
+            計測の区間の最小のステップ数
+        */
+        static auto constexpr MINSTEPS = 10;
+
+        //! A private member variable (static constant).
+        /*!
+            区間の終わりまでに消費したマージンの割合の下限（作り直す周期の見積もりが発散しないようにする）
+        */
+        static auto constexpr PROGRESSMIN = 0.01;
+
+        //! A private member variable (static constant).
+        /*!
+            収束してから探索をやり直すまでのステップ数
+        */
+        static auto constexpr RETUNESTEPS = 20000;
+
+        //! A private member variable (static constant).
+        /*!
+            マージンの最大値
+        */
+        static auto constexpr SKINMAX = 1.5;
+
+        //! A private member variable (static constant).
+        /*!
+            マージンの最小値
+        */
+        static auto constexpr SKINMIN = 0.1;
+
+        //! A private member variable (static constant).
+        /*!
+            改善とみなす、1ステップあたりの経過時間の相対的な減少の閾値（計測の揺らぎを無視する）
+        */
+        static auto constexpr TOLERANCE = 0.02;
+
+        //! A private member variable.
+        /*!
+            これまでに計測した中で最良の、1ステップあたりの経過時間
+        */
+        double bestcost_;
+
+        //! A private member variable.
+        /*!
+            これまでに計測した中で最良のマージン
+        */
+        double bestskin_;
+
+        //! A private member variable.
+        /*!
+            探索が収束したかどうか
+        */
+        bool converged_;
+
+        //! A private member variable.
+        /*!
+            現在のマージンの刻み
+        */
+        double delta_;
+
+        //! A private member variable.
+        /*!
+            探索の方向（+1か-1）
+        */
+        std::int32_t direction_;
+
+        //! A private member variable.
+        /*!
+            計測の区間の経過時間の和（秒）
+        */
+        double elapsed_;
+
+        //! A private member variable.
+        /*!
+            最良のマージンを測り直している区間かどうか
+        */
+        bool measuringbest_;
+
+        //! A private member variable.
+        /*!
+            計測の区間でペアリストを作り直した経過時間（秒、負なら区間の中で作り直していない）
+        */
+        double rebuild_;
+
+        //! A private member variable.
+        /*!
+            今の刻みで、もう一方の方向を試し終えたかどうか
+        */
+        bool reversed_;
+
+        //! A private member variable.
+        /*!
+            現在計測しているマージン
+        */
+        double skin_;
+
+        //! A private member variable.
+        /*!
+            計測の区間のステップ数（収束後は、収束してからのステップ数）
+        */
+        std::int32_t steps_;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        SkinTuner() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        SkinTuner(SkinTuner const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        SkinTuner & operator=(SkinTuner const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _SKINTUNER_H_
@@ -11,25 +11,10 @@
 
 #pragma once
 
+#include "atomarray.h"
 #include <cstdint>                              // for std::int32_t
-#include <utility>                              // for std::pair
-#include <vector>                               // for std::vector
-#include <Eigen/Core>                           // for Eigen::Vector4d
-#include <boost/align/aligned_allocator.hpp>    // for boost::alignment::aligned_allocator
 
 namespace moleculardynamics {
-    //! A struct.
-    /*!
-        原子の情報が格納された構造体
-    */
-	#pragma pack(push, 16)
-    struct Atom {
-        Eigen::Vector4d f;
-        Eigen::Vector4d p;
-        Eigen::Vector4d r;
-    };
-	#pragma pack(pop)
-
     //! A struct.
     /*!
         型エイリアスや定数が格納された構造体
@@ -37,21 +22,21 @@ namespace moleculardynamics {
 	struct SystemParam {
         // #region 型エイリアス
 
-        using myatomvector = std::vector<Atom, boost::alignment::aligned_allocator<Atom> >;
-
-        using mypairvector = std::vector<std::pair<std::int32_t, std::int32_t> >;
+        using myatomvector = AtomArray;
 
         // #endregion 型エイリアス
 
         // #region static publicメンバ関数
 
-        //! A public static member function.
+        template <typename T>
+        //! A public static member function (template function).
         /*!
             周期的境界条件の補正をする
-            \param d x方向の補正
+            \tparam T 座標の差の型
+            \param d 補正する座標の差（x, y, zのいずれかの成分）
             \param periodiclen 周期の長さ
         */
-        inline static void adjust_periodic(Eigen::Vector4d & d, double periodiclen);
+        inline static void adjust_periodic(T & d, double periodiclen);
 
         // #endregion static publicメンバ関数
 
@@ -59,7 +44,32 @@ namespace moleculardynamics {
 
         //! A public member variable (static constant).
         /*!
-            マージン
+            原子のループ（積分や力の集計）を並列化するときの粒度
+        */
+        static auto constexpr ATOMGRAINSIZE = 1024;
+
+        //! A public member variable (static constant).
+        /*!
+            番地ごとに力を計算するときの、番地のループを並列化するときの粒度
+        */
+        static auto constexpr CELLGRAINSIZE = 4;
+
+        //! A public member variable (static constant).
+        /*!
+            力の計算を並列化するときの、行（番地）の区間の最大の個数
+            （区間の分け方はスレッド数によらないので、力の和を取る順序も変わらない）
+        */
+        static auto constexpr FORCECHUNKS = 8;
+
+        //! A public member variable (static constant).
+        /*!
+            ペアリストの行（原子）のループを並列化するときの粒度
+        */
+        static auto constexpr ROWGRAINSIZE = 64;
+
+        //! A public member variable (static constant).
+        /*!
+            マージンの既定値（自動調整するときは、探索の初期値）
         */
         static auto constexpr MARGIN = 0.75;
 
@@ -68,41 +78,23 @@ namespace moleculardynamics {
 			カットオフ半径
 		*/
 		static auto constexpr RCUTOFF = 2.5;
-		
-        //! A public member variable (static constant).
-        /*!
-            マージンと、マージンのカットオフの和の平方
-        */
-        static auto constexpr ML2 = (SystemParam::RCUTOFF + SystemParam::MARGIN) * (SystemParam::RCUTOFF + SystemParam::MARGIN);
 		        
         // #endregion publicメンバ変数
 	};
 
     // #region publicメンバ関数の実装
 
-    void SystemParam::adjust_periodic(Eigen::Vector4d & d, double periodiclen)
+    template <typename T>
+    void SystemParam::adjust_periodic(T & d, double periodiclen)
     {
-        auto const LH = periodiclen * 0.5;
-
-        if (d[0] < -LH) {
-            d[0] += periodiclen;
-        }
-        else if (d[0] > LH) {
-            d[0] -= periodiclen;
-        }
-
-        if (d[1] < -LH) {
-            d[1] += periodiclen;
-        }
-        else if (d[1] > LH) {
-            d[1] -= periodiclen;
-        }
+        auto const L = static_cast<T>(periodiclen);
+        auto const LH = static_cast<T>(periodiclen * 0.5);
 
-        if (d[2] < -LH) {
-            d[2] += periodiclen;
+        if (d < -LH) {
+            d += L;
         }
-        else if (d[2] > LH) {
-            d[2] -= periodiclen;
+        else if (d > LH) {
+            d -= L;
         }
     }
 
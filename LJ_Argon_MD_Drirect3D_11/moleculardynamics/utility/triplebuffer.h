@@ -0,0 +1,165 @@
+﻿/*! \file triplebuffer.h
+    \brief 1つのスレッドが書き込み、1つのスレッドが読み出すロックフリーのトリプルバッファの宣言と実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+
+#pragma once
+
+#include <array>        // for std::array
+#include <atomic>       // for std::atomic
+#include <cstdint>      // for std::uint8_t
+
+namespace utility {
+    template <typename T>
+    //! A template class.
+    /*!
+        1つのスレッドが書き込み、1つのスレッドが読み出すロックフリーのトリプルバッファ
+        書き込む側はback()に書いてpublish()し、読み出す側はacquire()してからfront()を読む
+        3つのバッファを、書き込み中、受け渡し、読み出し中に割り当てて、受け渡しのバッファとだけ交換するので、
+        どちらの側も相手を待たず、読み出し中のバッファが書き換えられることもない
+    */
+    class TripleBuffer final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ
+        */
+        TripleBuffer() : back_(2), front_(0), middle_(1) {}
+
+        //! A destructor.
+        /*!
+            デフォルトデストラクタ
+        */
+        ~TripleBuffer() = default;
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region メンバ関数
+
+        //! A public member function.
+        /*!
+            書き込んだバッファが公開されていれば、読み出し中のバッファと交換する（読み出す側のスレッドからだけ呼ぶ）
+            \return 新しいバッファを受け取ったならtrue
+        */
+        bool acquire()
+        {
+            if (!(middle_.load(std::memory_order_relaxed) & TripleBuffer::FRESH)) {
+                return false;
+            }
+
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & TripleBuffer::INDEXMASK;
+
+            return true;
+        }
+
+        //! A public member function.
+        /*!
+            書き込み中のバッファを返す（書き込む側のスレッドからだけ呼ぶ）
+            \return 書き込み中のバッファ
+        */
+        T & back()
+        {
+            return buffers_[back_];
+        }
+
+        //! A public member function (constant).
+        /*!
+            最後に公開したバッファを、読み出す側がもう受け取ったかどうかを返す（書き込む側のスレッドからだけ呼ぶ）
+            \return 受け取っていればtrue
+        */
+        bool consumed() const
+        {
+            return !(middle_.load(std::memory_order_acquire) & TripleBuffer::FRESH);
+        }
+
+        //! A public member function (constant).
+        /*!
+            読み出し中のバッファを返す（読み出す側のスレッドからだけ呼ぶ）
+            \return 読み出し中のバッファ
+        */
+        T const & front() const
+        {
+            return buffers_[front_];
+        }
+
+        //! A public member function.
+        /*!
+            書き込み中のバッファを公開し、受け渡しのバッファを次の書き込みに使う（書き込む側のスレッドからだけ呼ぶ）
+        */
+        void publish()
+        {
+            back_ = middle_.exchange(static_cast<std::uint8_t>(back_ | TripleBuffer::FRESH), std::memory_order_acq_rel) & TripleBuffer::INDEXMASK;
+        }
+
+        // #endregion メンバ関数
+
+        // #region メンバ変数
+
+    private:
+        //! A private member variable (static constant).
+        /*!
+            受け渡しのバッファが、まだ読み出す側に受け取られていないことを表すビット
+        */
+        static std::uint8_t constexpr FRESH = 4U;
+
+        //! A private member variable (static constant).
+        /*!
+            バッファのインデックスを取り出すマスク
+        */
+        static std::uint8_t constexpr INDEXMASK = 3U;
+
+        //! A private member variable.
+        /*!
+            書き込み中のバッファのインデックス（書き込む側のスレッドだけが触る）
+        */
+        std::uint8_t back_;
+
+        //! A private member variable.
+        /*!
+            3つのバッファ
+        */
+        std::array<T, 3> buffers_;
+
+        //! A private member variable.
+        /*!
+            読み出し中のバッファのインデックス（読み出す側のスレッドだけが触る）
+        */
+        std::uint8_t front_;
+
+        //! A private member variable.
+        /*!
+            受け渡しのバッファのインデックスとFRESHのビット
+        */
+        alignas(64) std::atomic<std::uint8_t> middle_;
+
+        // #endregion メンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        TripleBuffer(TripleBuffer const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        TripleBuffer & operator=(TripleBuffer const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _TRIPLEBUFFER_H_
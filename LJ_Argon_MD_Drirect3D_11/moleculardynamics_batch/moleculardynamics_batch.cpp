@@ -0,0 +1,714 @@
+﻿/*! \file moleculardynamics_batch.cpp
+    \brief 描画を行わずに、アルゴンの分子動力学シミュレーションを全速力で実行するドライバ
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "Ar_moleculardynamics.h"
+#include <chrono>                           // for std::chrono::steady_clock
+#include <cstdint>                          // for std::int32_t, std::uint64_t
+#include <cstdio>                           // for std::fclose, std::fopen, std::printf
+#include <exception>                        // for std::exception
+#include <iostream>                         // for std::cerr
+#include <memory>                           // for std::unique_ptr
+#include <string>                           // for std::string
+#include <boost/program_options.hpp>        // for boost::program_options
+#include <tbb/global_control.h>             // for tbb::global_control
+#include <tbb/task_arena.h>                 // for tbb::task_arena
+
+namespace {
+    //! A struct.
+    /*!
+        コマンドライン引数で与えられる計算条件
+    */
+    struct BatchParam {
+        //! A public member variable.
+        /*!
+            ペアリストの作り直しを非同期に行うかどうか
+        */
+        bool asyncrebuild;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルエネルギーとビリアルを計算する間隔（ステップ数）
+        */
+        std::int32_t energyinterval;
+
+        //! A public member variable.
+        /*!
+            アンサンブル
+        */
+        moleculardynamics::EnsembleType ensemble;
+
+        //! A public member variable.
+        /*!
+            原子に働く力を計算するエンジン
+        */
+        moleculardynamics::ForceEngine forceengine;
+
+        //! A public member variable.
+        /*!
+            原子に働く力を計算するときの、相手の原子の探し方
+        */
+        moleculardynamics::ForceMethod forcemethod;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数
+        */
+        std::int32_t nc;
+
+        //! A public member variable.
+        /*!
+            ペアリストの格納形式
+        */
+        moleculardynamics::PairListFormat pairlistformat;
+
+        //! A public member variable.
+        /*!
+            原子の組の間に働くポテンシャルの種類
+        */
+        moleculardynamics::PotentialType potential;
+
+        //! A public member variable.
+        /*!
+            ペアリストを作り直すかどうかの判定方法
+        */
+        moleculardynamics::RebuildCriterion rebuildcriterion;
+
+        //! A public member variable.
+        /*!
+            ペアリストを作り直すときの原子の並べ替えの方法
+        */
+        moleculardynamics::ReorderType reorder;
+
+        //! A public member variable.
+        /*!
+            格子定数のスケール
+        */
+        double scale;
+
+        //! A public member variable.
+        /*!
+            乱数のシード
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            乱数のシードが与えられたかどうか
+        */
+        bool seeded;
+
+        //! A public member variable.
+        /*!
+            力の計算に用いるSIMD命令セット
+        */
+        moleculardynamics::SimdType simd;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルの表の補間の方法（表を用いないなら、表引きでない種類）
+        */
+        moleculardynamics::PotentialType table;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルの表の区間の数
+        */
+        std::int32_t tablesize;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン（0なら自動調整する）
+        */
+        double skin;
+
+        //! A public member variable.
+        /*!
+            計測するMDのステップ数
+        */
+        std::int32_t steps;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）
+        */
+        double temperature;
+
+        //! A public member variable.
+        /*!
+            温度制御の方法
+        */
+        moleculardynamics::TempControlMethod tempcontmethod;
+
+        //! A public member variable.
+        /*!
+            段階ごとのタイムラインを書き出すファイル名（空ならタイムラインを記録しない）
+        */
+        std::string trace;
+
+        //! A public member variable.
+        /*!
+            スレッド数（0ならTBBに任せる）
+        */
+        std::int32_t threads;
+
+        //! A public member variable.
+        /*!
+            計測前に捨てるMDのステップ数
+        */
+        std::int32_t warmup;
+    };
+
+    //! A function.
+    /*!
+        文字列からアンサンブルを求める
+        \param str アンサンブルを表す文字列
+        \return アンサンブル
+    */
+    moleculardynamics::EnsembleType parse_ensemble(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から原子に働く力を計算するエンジンを求める
+        \param str 原子に働く力を計算するエンジンを表す文字列
+        \return 原子に働く力を計算するエンジン
+    */
+    moleculardynamics::ForceEngine parse_forceengine(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から原子に働く力を計算するときの相手の原子の探し方を求める
+        \param str 相手の原子の探し方を表す文字列
+        \return 相手の原子の探し方
+    */
+    moleculardynamics::ForceMethod parse_forcemethod(std::string const & str);
+
+    //! A function.
+    /*!
+        コマンドライン引数を解析する
+        \param argc コマンドライン引数の数
+        \param argv コマンドライン引数
+        \param param 解析結果の格納先
+        \return 計算を続行するならtrue
+    */
+    bool parse_options(int argc, char * argv[], BatchParam & param);
+
+    //! A function.
+    /*!
+        文字列からペアリストの格納形式を求める
+        \param str ペアリストの格納形式を表す文字列
+        \return ペアリストの格納形式
+    */
+    moleculardynamics::PairListFormat parse_pairlistformat(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からポテンシャルの種類を求める
+        \param str ポテンシャルの種類を表す文字列
+        \return ポテンシャルの種類
+    */
+    moleculardynamics::PotentialType parse_potential(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からペアリストを作り直すかどうかの判定方法を求める
+        \param str ペアリストを作り直すかどうかの判定方法を表す文字列
+        \return ペアリストを作り直すかどうかの判定方法
+    */
+    moleculardynamics::RebuildCriterion parse_rebuildcriterion(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から原子の並べ替えの方法を求める
+        \param str 原子の並べ替えの方法を表す文字列
+        \return 原子の並べ替えの方法
+    */
+    moleculardynamics::RebuildCriterion parse_rebuildcriterion(std::string const & str)
+    {
+        using moleculardynamics::RebuildCriterion;
+
+        if (str == "displacement") {
+            return RebuildCriterion::DISPLACEMENT;
+        }
+        else if (str == "velocity") {
+            return RebuildCriterion::VELOCITY;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::ReorderType parse_reorder(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からSIMD命令セットを求める
+        \param str SIMD命令セットを表す文字列
+        \return SIMD命令セット
+    */
+    moleculardynamics::SimdType parse_simd(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からペアリストのマージンを求める
+        \param str ペアリストのマージンを表す文字列（autoなら自動調整）
+        \return ペアリストのマージン（自動調整なら0）
+    */
+    double parse_skin(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からポテンシャルの表の補間の方法を求める
+        \param str ポテンシャルの表の補間の方法を表す文字列
+        \return ポテンシャルの表の補間の方法（表を用いないならPotentialType::LENNARDJONES）
+    */
+    moleculardynamics::PotentialType parse_table(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から温度制御の方法を求める
+        \param str 温度制御の方法を表す文字列
+        \return 温度制御の方法
+    */
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str);
+
+    //! A function.
+    /*!
+        計測結果を表示する
+        \param armd 分子動力学シミュレーションのオブジェクト
+        \param param 計算条件
+        \param elapsed 計測されたMDの経過時間（秒）
+        \param simtime 計測された区間のシミュレーション時間（ps）
+        \param rebuilds 計測された区間でペアリストを作り直した回数
+        \param longest 計測された区間で最も長くかかった1ステップの経過時間（秒）
+    */
+    void print_result(moleculardynamics::Ar_moleculardynamics & armd, BatchParam const & param, double elapsed, double simtime, std::int32_t rebuilds, double longest);
+
+    //! A function.
+    /*!
+        MDを実行して、計測結果を表示する
+        \param param 計算条件
+    */
+    void run(BatchParam const & param);
+
+    //! A function.
+    /*!
+        計測した区間の段階ごとのタイムラインを、Chrome traceのJSON形式で書き出す
+        \param armd 分子動力学シミュレーションのオブジェクト
+        \param filename 書き出すファイル名
+    */
+    void write_trace(moleculardynamics::Ar_moleculardynamics const & armd, std::string const & filename);
+}
+
+int main(int argc, char * argv[])
+{
+    using namespace moleculardynamics;
+
+    BatchParam param;
+
+    try {
+        if (!parse_options(argc, argv, param)) {
+            return 0;
+        }
+    }
+    catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<tbb::global_control> pcontrol;
+    if (param.threads > 0) {
+        pcontrol = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, param.threads);
+    }
+
+    // スレッド数を指定したときは、TBBの上限を引き上げたうえで専用のアリーナで実行する
+    tbb::task_arena arena(param.threads > 0 ? param.threads : static_cast<std::int32_t>(tbb::task_arena::automatic));
+    arena.execute([&param] { run(param); });
+
+    return 0;
+}
+
+namespace {
+    moleculardynamics::EnsembleType parse_ensemble(std::string const & str)
+    {
+        using moleculardynamics::EnsembleType;
+
+        if (str == "nve") {
+            return EnsembleType::NVE;
+        }
+        else if (str == "nvt") {
+            return EnsembleType::NVT;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::ForceEngine parse_forceengine(std::string const & str)
+    {
+        using moleculardynamics::ForceEngine;
+
+        if (str == "serial") {
+            return ForceEngine::SERIAL;
+        }
+        else if (str == "parallel") {
+            return ForceEngine::PARALLEL;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::ForceMethod parse_forcemethod(std::string const & str)
+    {
+        using moleculardynamics::ForceMethod;
+
+        if (str == "pairlist") {
+            return ForceMethod::PAIRLIST;
+        }
+        else if (str == "cellpair") {
+            return ForceMethod::CELLPAIR;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    bool parse_options(int argc, char * argv[], BatchParam & param)
+    {
+        namespace po = boost::program_options;
+        using moleculardynamics::Ar_moleculardynamics;
+
+        std::string ensemble, forceengine, forcemethod, pairlistformat, potential, rebuildcriterion, reorder, simd, skin, table, tempcontmethod;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "show this help message")
+            ("nc,n", po::value<std::int32_t>(&param.nc)->default_value(Ar_moleculardynamics::FIRSTNC), "number of FCC unit cells per side")
+            ("scale,s", po::value<double>(&param.scale)->default_value(Ar_moleculardynamics::FIRSTSCALE), "scale of the lattice constant")
+            ("temperature,T", po::value<double>(&param.temperature)->default_value(Ar_moleculardynamics::FIRSTTEMP), "given temperature (K)")
+            ("energy-interval,E", po::value<std::int32_t>(&param.energyinterval)->default_value(1), "compute the potential energy and virial every this many steps")
+            ("ensemble,e", po::value<std::string>(&ensemble)->default_value("nvt"), "ensemble (nve | nvt)")
+            ("thermostat,t", po::value<std::string>(&tempcontmethod)->default_value("velocity"), "thermostat (langevin | nosehoover | velocity)")
+            ("force-engine,f", po::value<std::string>(&forceengine)->default_value("parallel"), "force engine (serial | parallel)")
+            ("force-method", po::value<std::string>(&forcemethod)->default_value("pairlist"), "neighbour search (pairlist: Verlet list | cellpair: cell pairs every step, no list)")
+            ("potential", po::value<std::string>(&potential)->default_value("lj"), "pair potential with argon-fitted coefficients (lj | wca | lj-sf: shifted force | morse | buckingham)")
+            ("table", po::value<std::string>(&table)->default_value("none"), "tabulate the pair potential on an r^2 grid (none | linear | cubic: Hermite)")
+            ("table-size", po::value<std::int32_t>(&param.tablesize)->default_value(1024), "number of intervals of the potential table")
+            ("simd", po::value<std::string>(&simd)->default_value("auto"), "SIMD instruction set of the force kernel (auto | scalar | avx2 | avx512)")
+            ("rebuild", po::value<std::string>(&rebuildcriterion)->default_value("displacement"), "pair list rebuild criterion (displacement | velocity)")
+            ("skin", po::value<std::string>(&skin)->default_value("0.75"), "pair list margin in units of sigma (value | auto: tuned by elapsed time, not reproducible)")
+            ("reorder,r", po::value<std::string>(&reorder)->default_value("none"), "atom reordering on pair list rebuild (none | cell | morton)")
+            ("pairlist", po::value<std::string>(&pairlistformat)->default_value("index32"), "pair list format (index32 | delta16: 16-bit j - i, best with --reorder cell or morton)")
+            ("async-rebuild", po::bool_switch(&param.asyncrebuild), "rebuild the pair list on another thread while the current one is still in use")
+            ("seed", po::value<std::uint64_t>(&param.seed), "random seed for the initial velocities and the Langevin thermostat (default: random)")
+            ("threads,j", po::value<std::int32_t>(&param.threads)->default_value(0), "number of threads (0: let TBB decide)")
+            ("steps,N", po::value<std::int32_t>(&param.steps)->default_value(1000), "number of timed MD steps")
+            ("warmup,w", po::value<std::int32_t>(&param.warmup)->default_value(0), "number of untimed MD steps before timing")
+            ("trace", po::value<std::string>(&param.trace), "write a Chrome trace (chrome://tracing, Perfetto) of the timed steps to this file");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n" << desc << std::endl;
+            return false;
+        }
+
+        if (param.nc < 1 || param.steps < 1 || param.energyinterval < 1 || param.warmup < 0 || param.threads < 0 || param.tablesize < 1 || param.scale <= 0.0 || param.temperature <= 0.0) {
+            throw po::error("nc, steps, energy-interval, table-size, scale and temperature must be positive");
+        }
+
+        param.seeded = vm.count("seed") != 0;
+        param.ensemble = parse_ensemble(ensemble);
+        param.forceengine = parse_forceengine(forceengine);
+        param.forcemethod = parse_forcemethod(forcemethod);
+        param.pairlistformat = parse_pairlistformat(pairlistformat);
+        param.potential = parse_potential(potential);
+        param.rebuildcriterion = parse_rebuildcriterion(rebuildcriterion);
+        param.reorder = parse_reorder(reorder);
+        param.simd = parse_simd(simd);
+        param.skin = parse_skin(skin);
+        param.table = parse_table(table);
+        param.tempcontmethod = parse_tempcontmethod(tempcontmethod);
+
+        return true;
+    }
+
+    moleculardynamics::PairListFormat parse_pairlistformat(std::string const & str)
+    {
+        using moleculardynamics::PairListFormat;
+
+        if (str == "index32") {
+            return PairListFormat::INDEX32;
+        }
+        else if (str == "delta16") {
+            return PairListFormat::DELTA16;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::PotentialType parse_potential(std::string const & str)
+    {
+        using moleculardynamics::PotentialType;
+
+        if (str == "lj") {
+            return PotentialType::LENNARDJONES;
+        }
+        else if (str == "wca") {
+            return PotentialType::WCA;
+        }
+        else if (str == "lj-sf") {
+            return PotentialType::SHIFTEDFORCE;
+        }
+        else if (str == "morse") {
+            return PotentialType::MORSE;
+        }
+        else if (str == "buckingham") {
+            return PotentialType::BUCKINGHAM;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::ReorderType parse_reorder(std::string const & str)
+    {
+        using moleculardynamics::ReorderType;
+
+        if (str == "none") {
+            return ReorderType::NONE;
+        }
+        else if (str == "cell") {
+            return ReorderType::CELL;
+        }
+        else if (str == "morton") {
+            return ReorderType::MORTON;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::SimdType parse_simd(std::string const & str)
+    {
+        using moleculardynamics::SimdType;
+
+        if (str == "auto") {
+            return moleculardynamics::forcekernel::best_simd();
+        }
+        else if (str == "scalar") {
+            return SimdType::SCALAR;
+        }
+        else if (str == "avx2") {
+            return SimdType::AVX2;
+        }
+        else if (str == "avx512") {
+            return SimdType::AVX512;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    double parse_skin(std::string const & str)
+    {
+        if (str == "auto") {
+            return 0.0;
+        }
+
+        try {
+            auto const skin = std::stod(str);
+            if (skin > 0.0) {
+                return skin;
+            }
+        }
+        catch (std::exception const &) {
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::PotentialType parse_table(std::string const & str)
+    {
+        using moleculardynamics::PotentialType;
+
+        if (str == "none") {
+            return PotentialType::LENNARDJONES;
+        }
+        else if (str == "linear") {
+            return PotentialType::LINEARTABLE;
+        }
+        else if (str == "cubic") {
+            return PotentialType::CUBICTABLE;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str)
+    {
+        using moleculardynamics::TempControlMethod;
+
+        if (str == "langevin") {
+            return TempControlMethod::LANGEVIN;
+        }
+        else if (str == "nosehoover") {
+            return TempControlMethod::NOSE_HOOVER;
+        }
+        else if (str == "velocity") {
+            return TempControlMethod::VELOCITY;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    void print_result(moleculardynamics::Ar_moleculardynamics & armd, BatchParam const & param, double elapsed, double simtime, std::int32_t rebuilds, double longest)
+    {
+        auto const atomsteps = static_cast<double>(armd.NumAtom) * static_cast<double>(param.steps);
+
+        // 1日あたりに計算できるシミュレーション時間（ns）
+        auto const nsperday = simtime * 1.0E-3 / elapsed * 86400.0;
+
+        auto const pressure = armd.getPressure();
+
+        static char const * const potentialname[] = { "Lennard-Jones", "WCA", "shifted-force Lennard-Jones", "Morse", "Buckingham" };
+
+        static char const * const simdname[] = { "scalar", "AVX2", "AVX-512" };
+
+        std::printf("Number of atoms            : %d\n", static_cast<std::int32_t>(armd.NumAtom));
+        std::printf("Number of supercell        : %d\n", static_cast<std::int32_t>(armd.Nc));
+        std::printf("Lattice constant           : %.3f (nm)\n", armd.getLatticeconst());
+        std::printf("Preset temperture          : %.3f (K)\n", armd.getTgiven());
+        std::printf("Calculation temperture     : %.3f (K)\n", armd.getTcalc());
+        std::printf("Pressure                   : %.3f (atm)\n", pressure);
+        std::printf("Potential energy           : %.6f (Hartree)\n", static_cast<double>(armd.Up));
+        std::printf("Total energy               : %.6f (Hartree)\n", static_cast<double>(armd.Utot));
+        std::printf("Potential                  : %s\n", potentialname[static_cast<std::int32_t>(param.potential)]);
+        if (auto const table = armd.getPotentialTable()) {
+            std::printf("Potential table            : %s, %d intervals (%.1f KiB)\n",
+                table->param().type == moleculardynamics::PotentialType::CUBICTABLE ? "cubic" : "linear",
+                table->param().tablesize, static_cast<double>(table->bytes()) / 1024.0);
+        }
+
+        std::printf("Precision                  : %s\n", moleculardynamics::PRECISION_NAME);
+        std::printf("Force kernel               : %s\n", simdname[static_cast<std::int32_t>(armd.getSimd())]);
+        std::printf("Force method               : %s\n", armd.getForceMethod() == moleculardynamics::ForceMethod::CELLPAIR ? "cell pairs" : "pair list");
+        std::printf("MD steps                   : %d\n", param.steps);
+        std::printf("Pair list rebuilds         : %d\n", rebuilds);
+        std::printf("Pair list skin             : %.3f (%s)\n", armd.getSkin(), param.skin > 0.0 ? "fixed" : "auto");
+        std::printf("Wall time                  : %.6f (s)\n", elapsed);
+        std::printf("Steps per second           : %.3f\n", static_cast<double>(param.steps) / elapsed);
+        std::printf("Longest step               : %.3f (ms)\n", longest * 1.0E+3);
+        std::printf("Performance                : %.6f (ns/day)\n", nsperday);
+        std::printf("Cost per atom-step         : %.3f (ns)\n", elapsed / atomsteps * 1.0E+9);
+
+        auto const counters = armd.getCounters();
+        std::printf("Pairs in pair list         : %lld\n", static_cast<long long>(counters.pairs));
+        std::printf("Pair list size             : %.3f (MiB, %.2f bytes/pair)\n",
+            static_cast<double>(counters.pairlistbytes) / 1048576.0,
+            counters.pairs ? static_cast<double>(counters.pairlistbytes) / static_cast<double>(counters.pairs) : 0.0);
+        std::printf("Pair list rebuild interval : %d (steps)\n", counters.rebuildinterval);
+        std::printf("Atoms per cell             : %.3f\n", counters.atomspercell);
+
+        if (param.asyncrebuild) {
+            std::printf("Async rebuild fallbacks    : %d\n", counters.asyncfallbacks);
+        }
+
+        // 段階ごとの経過時間（計測のコードを生成しないでビルドしたときは表示しない）
+        // ペアリストの作り直しはcheckPairlistの内訳なので、字下げして表示する
+        auto const & profiler = armd.getProfiler();
+        for (auto i = 0; i < static_cast<std::int32_t>(moleculardynamics::Phase::COUNT); i++) {
+            auto const phase = static_cast<moleculardynamics::Phase>(i);
+            auto const & stat = profiler.stat(phase);
+            if (stat.calls) {
+                std::printf("%s%-*s : %12.3f (ns/step) %6.2f (%%)\n",
+                    phase == moleculardynamics::Phase::REBUILD ? "    " : "  ",
+                    phase == moleculardynamics::Phase::REBUILD ? 22 : 24,
+                    moleculardynamics::Profiler::name(phase),
+                    stat.total_ns / static_cast<double>(param.steps),
+                    stat.total_ns / (elapsed * 1.0E+9) * 100.0);
+            }
+        }
+    }
+
+    void run(BatchParam const & param)
+    {
+        using namespace moleculardynamics;
+
+        Ar_moleculardynamics armd;
+
+        // recalc()の前に温度を与えておかないと、初期速度が既定の温度で決まってしまう
+        armd.setTgiven(param.temperature);
+        armd.setTempContMethod(param.tempcontmethod);
+        armd.setForceEngine(param.forceengine);
+        armd.setForceMethod(param.forcemethod);
+        armd.setRebuildCriterion(param.rebuildcriterion);
+        armd.setReorder(param.reorder);
+        armd.setPairListFormat(param.pairlistformat);
+        armd.setAsyncRebuild(param.asyncrebuild);
+        armd.setSimd(param.simd);
+        armd.setEnergyInterval(param.energyinterval);
+        armd.setEnsemble(param.ensemble);
+        armd.setPotential(potential::argon(param.potential));
+        armd.setPotentialTable(param.table, param.tablesize);
+        armd.setScale(param.scale);
+
+        // シードを与えたときは、スレッド数によらず同じ初期速度と揺動力になる
+        if (param.seeded) {
+            armd.setSeed(param.seed);
+        }
+
+        armd.setNc(param.nc);
+
+        if (param.skin > 0.0) {
+            armd.setSkin(param.skin);
+        }
+        else {
+            armd.setSkinAutoTune(true);
+        }
+
+        for (auto i = 0; i < param.warmup; i++) {
+            armd.runCalc();
+        }
+
+        // 段階ごとの経過時間は、計測する区間だけを集計する
+        armd.resetProfiler();
+        armd.setTracing(!param.trace.empty());
+
+        auto const t0 = armd.getDeltat();
+        auto const rebuilds0 = armd.getRebuilds();
+        auto const begin = std::chrono::steady_clock::now();
+
+        // ペアリストの作り直しによるステップの引っかかりを見るため、最も長くかかったステップも記録する
+        auto longest = 0.0;
+        auto last = begin;
+
+        for (auto i = 0; i < param.steps; i++) {
+            armd.runCalc();
+
+            auto const now = std::chrono::steady_clock::now();
+            auto const step = std::chrono::duration<double>(now - last).count();
+            longest = step > longest ? step : longest;
+            last = now;
+        }
+
+        auto const end = last;
+        auto const elapsed = std::chrono::duration<double>(end - begin).count();
+
+        print_result(armd, param, elapsed, armd.getDeltat() - t0, armd.getRebuilds() - rebuilds0, longest);
+
+        if (!param.trace.empty()) {
+            write_trace(armd, param.trace);
+        }
+    }
+
+    void write_trace(moleculardynamics::Ar_moleculardynamics const & armd, std::string const & filename)
+    {
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> fp(std::fopen(filename.c_str(), "w"), &std::fclose);
+        if (!fp) {
+            std::cerr << "Cannot open " << filename << std::endl;
+            return;
+        }
+
+        armd.getProfiler().write_chrome_trace(fp.get());
+    }
+}
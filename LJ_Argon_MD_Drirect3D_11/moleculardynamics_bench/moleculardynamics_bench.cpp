@@ -0,0 +1,630 @@
+﻿/*! \file moleculardynamics_bench.cpp
+    \brief 分子動力学エンジンの主要な関数の経過時間を個別に計測し、JSONで出力するベンチマーク
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "Ar_moleculardynamics.h"
+#include <algorithm>                        // for std::max, std::min
+#include <chrono>                           // for std::chrono::steady_clock
+#include <cmath>                            // for std::fabs, std::sqrt
+#include <cstddef>                          // for std::size_t
+#include <cstdint>                          // for std::int32_t, std::uint64_t
+#include <cstdio>                           // for std::fclose, std::fflush, std::fopen, std::fprintf
+#include <exception>                        // for std::exception
+#include <iostream>                         // for std::cerr
+#include <memory>                           // for std::unique_ptr
+#include <sstream>                          // for std::istringstream
+#include <string>                           // for std::string
+#include <vector>                           // for std::vector
+#include <boost/program_options.hpp>        // for boost::program_options
+#include <tbb/global_control.h>             // for tbb::global_control
+#include <tbb/task_arena.h>                 // for tbb::task_arena
+
+namespace moleculardynamics {
+    //! A class.
+    /*!
+        Ar_moleculardynamicsのprivateメンバ関数を個別に呼び出すためのクラス
+    */
+    class Benchmark final {
+        // #region static publicメンバ関数
+
+    public:
+        //! A public static member function.
+        /*!
+            原子に働く力を計算する
+            \param armd 分子動力学シミュレーションのオブジェクト
+        */
+        static void calcForcePair(Ar_moleculardynamics & armd)
+        {
+            armd.calcForcePair();
+        }
+
+        //! A public static member function.
+        /*!
+            原子1個あたりのメモリ使用量（原子の配列、変位の基準の座標、ペアリスト）を求める
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return 原子1個あたりのメモリ使用量（バイト）
+        */
+        static double bytes_per_atom(Ar_moleculardynamics const & armd)
+        {
+            auto const n = static_cast<double>(armd.NumAtom_);
+
+            // 力、運動量、座標の9成分、IDの対応表2つ、変位の基準の座標3成分
+            auto const atoms = n * static_cast<double>(12 * sizeof(real) + 2 * sizeof(std::int32_t));
+            auto const pairs = static_cast<double>(armd.pairs_.bytes());
+
+            return (atoms + pairs) / n;
+        }
+
+        //! A public static member function (constant).
+        /*!
+            原子に働く力を、倍精度で写し取る
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return 原子に働く力（x成分、y成分、z成分の順に並べたもの）
+        */
+        static std::vector<double> forces(Ar_moleculardynamics const & armd)
+        {
+            std::vector<double> f;
+            f.reserve(3 * armd.atoms_.fx.size());
+            f.insert(f.end(), armd.atoms_.fx.begin(), armd.atoms_.fx.end());
+            f.insert(f.end(), armd.atoms_.fy.begin(), armd.atoms_.fy.end());
+            f.insert(f.end(), armd.atoms_.fz.begin(), armd.atoms_.fz.end());
+
+            return f;
+        }
+
+        //! A public static member function.
+        /*!
+            メッシュリストを用いてペアリストを構築する
+            \param armd 分子動力学シミュレーションのオブジェクト
+        */
+        static void make_pair(Ar_moleculardynamics & armd)
+        {
+            armd.pmesh_->make_pair(armd.atoms_, armd.pairs_);
+        }
+
+        //! A public static member function.
+        /*!
+            全ての原子の組を調べて（O(N^2)）ペアリストを構築する
+            \param armd 分子動力学シミュレーションのオブジェクト
+        */
+        static void makePair(Ar_moleculardynamics & armd)
+        {
+            armd.makePair(armd.atoms_, armd.pairs_);
+        }
+
+        //! A public static member function (constant).
+        /*!
+            メッシュリストが使われているかどうかを返す
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return メッシュリストが使われていればtrue
+        */
+        static bool mesh(Ar_moleculardynamics const & armd)
+        {
+            return armd.pmesh_ != nullptr;
+        }
+
+        //! A public static member function.
+        /*!
+            温度制御を行い、原子を半ステップ分移動させる
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \param second ステップの後半（周期境界条件の補正を行う）ならtrue
+        */
+        static void moveAtoms(Ar_moleculardynamics & armd, bool second)
+        {
+            armd.moveAtoms(second);
+        }
+
+        //! A public static member function.
+        /*!
+            力の計算で読み出すペアリストの配列の大きさを求める
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return ペアリストの配列の大きさ（バイト）
+        */
+        static std::size_t pairlist_bytes(Ar_moleculardynamics const & armd)
+        {
+            return armd.pairs_.bytes();
+        }
+
+        //! A public static member function.
+        /*!
+            ペアリストに含まれるペアの数を求める
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return ペアの数
+        */
+        static std::size_t pairs(Ar_moleculardynamics const & armd)
+        {
+            return armd.pairs_.size();
+        }
+
+        //! A public static member function (constant).
+        /*!
+            最後に力を計算したときのビリアルを求める
+            \param armd 分子動力学シミュレーションのオブジェクト
+            \return ビリアル
+        */
+        static double virial(Ar_moleculardynamics const & armd)
+        {
+            return armd.virial_;
+        }
+
+        // #endregion static publicメンバ関数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        Benchmark() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        Benchmark(Benchmark const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        Benchmark & operator=(Benchmark const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+namespace {
+    //! A struct.
+    /*!
+        コマンドライン引数で与えられる計測条件
+    */
+    struct BenchParam {
+        //! A public member variable.
+        /*!
+            O(N^2)のペアリストの構築を計測する最大の原子数
+        */
+        std::int32_t maxallpairs;
+
+        //! A public member variable.
+        /*!
+            1回の計測（バッチ）の最小の経過時間（秒）
+        */
+        double mintime;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数のリスト
+        */
+        std::vector<std::int32_t> ncs;
+
+        //! A public member variable.
+        /*!
+            出力するファイル名（空なら標準出力）
+        */
+        std::string output;
+
+        //! A public member variable.
+        /*!
+            格子定数のスケールのリスト
+        */
+        std::vector<double> scales;
+
+        //! A public member variable.
+        /*!
+            乱数のシード
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン
+        */
+        double skin;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルの表の区間の数
+        */
+        std::int32_t tablesize;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）のリスト
+        */
+        std::vector<double> temperatures;
+
+        //! A public member variable.
+        /*!
+            スレッド数（0ならTBBに任せる）
+        */
+        std::int32_t threads;
+
+        //! A public member variable.
+        /*!
+            計測前に進めるMDのステップ数（原子の配置を温度に応じたものにする）
+        */
+        std::int32_t warmup;
+    };
+
+    //! A struct.
+    /*!
+        ある関数の計測結果
+    */
+    struct KernelResult {
+        //! A public member variable.
+        /*!
+            関数の名前
+        */
+        char const * name;
+
+        //! A public member variable.
+        /*!
+            1回の呼び出しの経過時間（ns、負なら計測していない）
+        */
+        double ns;
+
+        //! A public member variable.
+        /*!
+            ペア1個あたりの経過時間を出力するかどうか
+        */
+        bool perpair;
+    };
+
+    //! A struct.
+    /*!
+        ポテンシャルの表の、解析的なポテンシャルに対する誤差
+    */
+    struct TableError {
+        //! A public member variable.
+        /*!
+            表の大きさ（バイト）
+        */
+        std::size_t bytes;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルエネルギーの相対誤差
+        */
+        double energy;
+
+        //! A public member variable.
+        /*!
+            力の成分の誤差の最大値を、力の成分の二乗平均平方根で割ったもの
+        */
+        double force;
+
+        //! A public member variable.
+        /*!
+            ビリアルの相対誤差
+        */
+        double virial;
+    };
+
+    //! A function.
+    /*!
+        コマンドライン引数を解析する
+        \param argc コマンドライン引数の数
+        \param argv コマンドライン引数
+        \param param 解析結果の格納先
+        \return 計測を続行するならtrue
+    */
+    bool parse_options(int argc, char * argv[], BenchParam & param);
+
+    //! A function.
+    /*!
+        力の、基準の値に対する誤差を求める
+        \param reference 基準の力
+        \param f 比べる力
+        \return 力の成分の誤差の最大値を、基準の力の成分の二乗平均平方根で割ったもの
+    */
+    double force_error(std::vector<double> const & reference, std::vector<double> const & f);
+
+    //! A function template.
+    /*!
+        カンマ区切りの文字列を数値のリストに変換する
+        \tparam T 数値の型
+        \param str カンマ区切りの文字列
+        \return 数値のリスト
+    */
+    template <typename T>
+    std::vector<T> parse_list(std::string const & str);
+
+    //! A function.
+    /*!
+        全ての計測条件について計測し、結果をJSONで出力する
+        \param param 計測条件
+        \param fp 出力先
+    */
+    void run(BenchParam const & param, std::FILE * fp);
+
+    //! A function template.
+    /*!
+        関数の1回の呼び出しの経過時間を計測する（mintime以上かかる回数だけ呼び出すバッチを繰り返し、最小値を取る）
+        \tparam Function 計測する関数の型
+        \param func 計測する関数
+        \param mintime 1回のバッチの最小の経過時間（秒）
+        \return 1回の呼び出しの経過時間（ns）
+    */
+    template <typename Function>
+    double time_ns(Function && func, double mintime);
+
+    //! A global variable (constant expression).
+    /*!
+        計測を繰り返すバッチの数
+    */
+    auto constexpr BATCHES = 5;
+}
+
+int main(int argc, char * argv[])
+{
+    BenchParam param;
+
+    try {
+        if (!parse_options(argc, argv, param)) {
+            return 0;
+        }
+    }
+    catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> fp(nullptr, &std::fclose);
+    if (!param.output.empty()) {
+        fp.reset(std::fopen(param.output.c_str(), "w"));
+        if (!fp) {
+            std::cerr << "cannot open " << param.output << std::endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<tbb::global_control> pcontrol;
+    if (param.threads > 0) {
+        pcontrol = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, param.threads);
+    }
+
+    // スレッド数を指定したときは、TBBの上限を引き上げたうえで専用のアリーナで実行する
+    tbb::task_arena arena(param.threads > 0 ? param.threads : static_cast<std::int32_t>(tbb::task_arena::automatic));
+    arena.execute([&param, &fp] { run(param, fp ? fp.get() : stdout); });
+
+    return 0;
+}
+
+namespace {
+    double force_error(std::vector<double> const & reference, std::vector<double> const & f)
+    {
+        auto maxerror = 0.0, sumsq = 0.0;
+        for (auto i = 0U; i < reference.size(); i++) {
+            maxerror = std::max(maxerror, std::fabs(f[i] - reference[i]));
+            sumsq += reference[i] * reference[i];
+        }
+
+        return sumsq > 0.0 ? maxerror / std::sqrt(sumsq / static_cast<double>(reference.size())) : 0.0;
+    }
+
+    bool parse_options(int argc, char * argv[], BenchParam & param)
+    {
+        namespace po = boost::program_options;
+
+        std::string ncs, scales, temperatures;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "show this help message")
+            ("nc,n", po::value<std::string>(&ncs)->default_value("1,2,4,8,16,32"), "comma-separated numbers of FCC unit cells per side")
+            ("scale,s", po::value<std::string>(&scales)->default_value("1.0,1.2,5.0"), "comma-separated scales of the lattice constant")
+            ("temperature,T", po::value<std::string>(&temperatures)->default_value("30,300,3000"), "comma-separated temperatures (K)")
+            ("skin", po::value<double>(&param.skin)->default_value(moleculardynamics::SystemParam::MARGIN), "fixed pair list margin in units of sigma")
+            ("seed", po::value<std::uint64_t>(&param.seed)->default_value(1), "random seed for the initial velocities")
+            ("table-size", po::value<std::int32_t>(&param.tablesize)->default_value(1024), "number of intervals of the potential tables compared with the analytic Lennard-Jones potential")
+            ("warmup,w", po::value<std::int32_t>(&param.warmup)->default_value(20), "number of MD steps before timing")
+            ("min-time", po::value<double>(&param.mintime)->default_value(0.01), "minimum duration of one timed batch (s)")
+            ("max-allpairs", po::value<std::int32_t>(&param.maxallpairs)->default_value(8192), "largest number of atoms for which the O(N^2) pair search is timed")
+            ("threads,j", po::value<std::int32_t>(&param.threads)->default_value(0), "number of threads (0: let TBB decide)")
+            ("output,o", po::value<std::string>(&param.output), "output JSON file (default: standard output)");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n" << desc << std::endl;
+            return false;
+        }
+
+        param.ncs = parse_list<std::int32_t>(ncs);
+        param.scales = parse_list<double>(scales);
+        param.temperatures = parse_list<double>(temperatures);
+
+        for (auto nc : param.ncs) {
+            if (nc < 1) {
+                throw po::error("nc must be positive");
+            }
+        }
+
+        if (param.skin <= 0.0 || param.warmup < 0 || param.mintime <= 0.0 || param.threads < 0 || param.tablesize < 1) {
+            throw po::error("skin, min-time and table-size must be positive");
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    std::vector<T> parse_list(std::string const & str)
+    {
+        std::vector<T> list;
+        std::istringstream is(str);
+
+        for (std::string item; std::getline(is, item, ',');) {
+            std::istringstream iss(item);
+            T value;
+            if (!(iss >> value)) {
+                throw boost::program_options::invalid_option_value(str);
+            }
+
+            list.push_back(value);
+        }
+
+        if (list.empty()) {
+            throw boost::program_options::invalid_option_value(str);
+        }
+
+        return list;
+    }
+
+    void run(BenchParam const & param, std::FILE * fp)
+    {
+        using namespace moleculardynamics;
+
+        static char const * const simdname[] = { "scalar", "AVX2", "AVX-512" };
+
+        std::fprintf(fp, "{\n");
+        std::fprintf(fp, "  \"precision\": \"%s\",\n", PRECISION_NAME);
+        std::fprintf(fp, "  \"simd\": \"%s\",\n", simdname[static_cast<std::int32_t>(forcekernel::best_simd())]);
+        std::fprintf(fp, "  \"threads\": %d,\n", tbb::this_task_arena::max_concurrency());
+        std::fprintf(fp, "  \"skin\": %g,\n", param.skin);
+        std::fprintf(fp, "  \"results\": [");
+
+        auto first = true;
+        for (auto nc : param.ncs) {
+            for (auto scale : param.scales) {
+                for (auto temperature : param.temperatures) {
+                    Ar_moleculardynamics armd;
+
+                    // 計測が再現するように、乱数のシードとマージンを固定する
+                    armd.setTgiven(temperature);
+                    armd.setScale(scale);
+                    armd.setSeed(param.seed);
+                    armd.setNc(nc);
+                    armd.setSkin(param.skin);
+
+                    for (auto i = 0; i < param.warmup; i++) {
+                        armd.runCalc();
+                    }
+
+                    auto const atoms = static_cast<double>(armd.NumAtom);
+                    auto const pairs = static_cast<double>(Benchmark::pairs(armd));
+                    auto const bytes = Benchmark::bytes_per_atom(armd);
+
+                    // 状態を壊す（運動量が増え続ける、原子が移動し続ける）関数ほど後で計測する
+                    std::vector<KernelResult> results;
+                    results.push_back({ "runCalc", time_ns([&armd] { armd.runCalc(); }, param.mintime), false });
+                    results.push_back({ "getPressure", time_ns([&armd] { volatile auto p = armd.getPressure(); static_cast<void>(p); }, param.mintime), false });
+                    results.push_back({ "make_pair", Benchmark::mesh(armd) ? time_ns([&armd] { Benchmark::make_pair(armd); }, param.mintime) : -1.0, true });
+                    results.push_back({ "makePair", static_cast<std::int32_t>(armd.NumAtom) <= param.maxallpairs ? time_ns([&armd] { Benchmark::makePair(armd); }, param.mintime) : -1.0, true });
+                    results.push_back({ "calcForcePair", time_ns([&armd] { Benchmark::calcForcePair(armd); }, param.mintime), true });
+
+                    // 同じ原子の配置で、解析的なポテンシャルを基準に、表引きの誤差と経過時間を比べる
+                    auto const reference = Benchmark::forces(armd);
+                    auto const upref = static_cast<double>(armd.Up);
+                    auto const virialref = Benchmark::virial(armd);
+
+                    std::vector<TableError> tables;
+                    for (auto interpolation : { PotentialType::LINEARTABLE, PotentialType::CUBICTABLE }) {
+                        armd.setPotentialTable(interpolation, param.tablesize);
+                        results.push_back({ interpolation == PotentialType::CUBICTABLE ? "calcForcePair_cubic" : "calcForcePair_linear",
+                            time_ns([&armd] { Benchmark::calcForcePair(armd); }, param.mintime), true });
+                        tables.push_back({ armd.getPotentialTable()->bytes(),
+                            std::fabs(static_cast<double>(armd.Up) / upref - 1.0),
+                            force_error(reference, Benchmark::forces(armd)),
+                            std::fabs(Benchmark::virial(armd) / virialref - 1.0) });
+                    }
+
+                    armd.setPotentialTable(PotentialType::LENNARDJONES, param.tablesize);
+
+                    // 同じ原子の配置で、ペアリストを使わずに番地の組から直接計算して比べる（番地を作れない小さな箱ではnull）
+                    armd.setForceMethod(ForceMethod::CELLPAIR);
+                    results.push_back({ "calcForcePair_cellpair",
+                        armd.getForceMethod() == ForceMethod::CELLPAIR ? time_ns([&armd] { Benchmark::calcForcePair(armd); }, param.mintime) : -1.0, true });
+                    armd.setForceMethod(ForceMethod::PAIRLIST);
+
+                    // 同じ原子の配置で、ペアリストを16ビット整数の差の形式に作り直して比べる
+                    auto const index32bytes = static_cast<double>(Benchmark::pairlist_bytes(armd));
+                    armd.setPairListFormat(PairListFormat::DELTA16);
+                    auto const delta16bytes = static_cast<double>(Benchmark::pairlist_bytes(armd));
+                    results.push_back({ "calcForcePair_delta16", time_ns([&armd] { Benchmark::calcForcePair(armd); }, param.mintime), true });
+                    results.push_back({ "moveAtoms", time_ns([&armd] { Benchmark::moveAtoms(armd, false); }, param.mintime), false });
+                    results.push_back({ "moveAtoms_wrap", time_ns([&armd] { Benchmark::moveAtoms(armd, true); }, param.mintime), false });
+
+                    std::fprintf(fp, "%s\n    {\n", first ? "" : ",");
+                    std::fprintf(fp, "      \"nc\": %d,\n", nc);
+                    std::fprintf(fp, "      \"scale\": %g,\n", scale);
+                    std::fprintf(fp, "      \"temperature\": %g,\n", temperature);
+                    std::fprintf(fp, "      \"atoms\": %d,\n", static_cast<std::int32_t>(armd.NumAtom));
+                    std::fprintf(fp, "      \"pairs\": %.0f,\n", pairs);
+                    std::fprintf(fp, "      \"pairs_per_atom\": %.3f,\n", pairs / atoms);
+                    std::fprintf(fp, "      \"bytes_per_atom\": %.1f,\n", bytes);
+                    std::fprintf(fp, "      \"pairlist_bytes_per_pair\": { \"index32\": %.3f, \"delta16\": %.3f },\n",
+                        pairs > 0.0 ? index32bytes / pairs : 0.0, pairs > 0.0 ? delta16bytes / pairs : 0.0);
+                    std::fprintf(fp, "      \"potential_table\": { \"intervals\": %d", param.tablesize);
+                    for (auto k = 0U; k < tables.size(); k++) {
+                        auto const & t = tables[k];
+                        std::fprintf(fp, ", \"%s\": { \"kib\": %.1f, \"max_force_error\": %.3e, \"energy_error\": %.3e, \"virial_error\": %.3e }",
+                            k ? "cubic" : "linear", static_cast<double>(t.bytes) / 1024.0, t.force, t.energy, t.virial);
+                    }
+                    std::fprintf(fp, " },\n");
+                    std::fprintf(fp, "      \"kernels\": {");
+
+                    for (auto k = 0U; k < results.size(); k++) {
+                        auto const & r = results[k];
+
+                        std::fprintf(fp, "%s\n        \"%s\": ", k ? "," : "", r.name);
+                        if (r.ns < 0.0) {
+                            std::fprintf(fp, "null");
+                            continue;
+                        }
+
+                        std::fprintf(fp, "{ \"ns_per_call\": %.1f, \"ns_per_atom\": %.4f", r.ns, r.ns / atoms);
+                        if (r.perpair) {
+                            std::fprintf(fp, ", \"ns_per_pair\": ");
+                            std::fprintf(fp, pairs > 0.0 ? "%.4f" : "null", r.ns / pairs);
+                        }
+                        std::fprintf(fp, " }");
+                    }
+
+                    std::fprintf(fp, "\n      }\n    }");
+                    std::fflush(fp);
+
+                    first = false;
+                }
+            }
+        }
+
+        std::fprintf(fp, "\n  ]\n}\n");
+    }
+
+    template <typename Function>
+    double time_ns(Function && func, double mintime)
+    {
+        using clock = std::chrono::steady_clock;
+
+        auto const batch = [&func](std::int32_t reps) {
+            auto const begin = clock::now();
+            for (auto i = 0; i < reps; i++) {
+                func();
+            }
+
+            return std::chrono::duration<double>(clock::now() - begin).count();
+        };
+
+        // 1回のバッチがmintime以上になるように、呼び出す回数を倍々に増やす
+        auto reps = 1;
+        auto elapsed = batch(reps);
+        while (elapsed < mintime) {
+            reps *= 2;
+            elapsed = batch(reps);
+        }
+
+        auto best = elapsed / static_cast<double>(reps);
+        for (auto b = 1; b < BATCHES; b++) {
+            best = std::min(best, batch(reps) / static_cast<double>(reps));
+        }
+
+        return best * 1.0E+9;
+    }
+}
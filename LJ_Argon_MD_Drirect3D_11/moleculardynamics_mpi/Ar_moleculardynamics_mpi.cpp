@@ -0,0 +1,1027 @@
+﻿/*! \file Ar_moleculardynamics_mpi.cpp
+    \brief 箱を空間的に分割し、複数のプロセスでアルゴンの分子動力学シミュレーションを行うクラスの実装
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "Ar_moleculardynamics_mpi.h"
+#include "myrandom/philox.h"
+#include <algorithm>                // for std::max, std::min
+#include <chrono>                   // for std::chrono::steady_clock
+#include <cmath>                    // for std::floor, std::pow, std::sqrt
+#include <functional>               // for std::plus
+#include <limits>                   // for std::numeric_limits
+#include <numeric>                  // for std::accumulate, std::partial_sum
+#include <random>                   // for std::random_device
+#include <boost/assert.hpp>         // for BOOST_ASSERT
+#include <tbb/parallel_for.h>       // for tbb::parallel_for
+#include <tbb/parallel_reduce.h>    // for tbb::parallel_deterministic_reduce
+
+namespace moleculardynamics {
+    namespace {
+        //! A function.
+        /*!
+            隣のプロセスとデータの長さを交換してから、データを交換する
+            \param comm 通信子
+            \param send 送るデータ
+            \param dest 送る先のプロセスの順位
+            \param source 受け取る元のプロセスの順位
+            \param tag メッセージのタグ
+            \param recv 受け取ったデータの格納先
+        */
+        void sendrecv(MPI_Comm comm, std::vector<double> const & send, int dest, int source, int tag, std::vector<double> & recv);
+
+        //! A function.
+        /*!
+            計測を始めた時刻からの経過時間を返す
+            \param begin 計測を始めた時刻
+            \return 経過時間（秒）
+        */
+        double since(std::chrono::steady_clock::time_point begin);
+
+        //! A function.
+        /*!
+            座標を周期境界条件の箱[0, L)の中に戻す
+            \param x 座標の成分
+            \param L 周期の長さ
+            \return 箱の中に戻した座標の成分
+        */
+        real wrap(real x, real L);
+    }
+
+    // #region コンストラクタ・デストラクタ
+
+    Ar_moleculardynamics_mpi::Ar_moleculardynamics_mpi(MPI_Comm comm)
+        :
+        NumAtom([this] { return NumAtom_; }, nullptr),
+        Uk([this] { return Ar_moleculardynamics::DimensionlessToHartree(Uk_); }, nullptr),
+        Up([this] { return Ar_moleculardynamics::DimensionlessToHartree(Up_); }, nullptr),
+        Utot([this] { return Ar_moleculardynamics::DimensionlessToHartree(Utot_); }, nullptr),
+        potential_(potential::lennardjones(SystemParam::RCUTOFF)),
+        Tg_(Ar_moleculardynamics::FIRSTTEMP * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON)
+    {
+        // プロセスを、なるべく立方体に近い3次元の周期的な格子に並べる
+        int nranks;
+        MPI_Comm_size(comm, &nranks);
+
+        dims_ = { 0, 0, 0 };
+        MPI_Dims_create(nranks, 3, dims_.data());
+
+        std::array<int, 3> const periods = { 1, 1, 1 };
+        MPI_Cart_create(comm, 3, dims_.data(), periods.data(), 0, &comm_);
+        MPI_Comm_rank(comm_, &rank_);
+        MPI_Cart_coords(comm_, rank_, 3, coords_.data());
+
+        // x, y, zの順に、下側の隣に送って上側の隣から受け取り、次に上側の隣に送って下側の隣から受け取る
+        for (auto d = 0; d < 3; d++) {
+            int lower, upper;
+            MPI_Cart_shift(comm_, d, 1, &lower, &upper);
+
+            halos_[2 * d].dest = lower;
+            halos_[2 * d].source = upper;
+            halos_[2 * d + 1].dest = upper;
+            halos_[2 * d + 1].source = lower;
+            halos_[2 * d].dim = halos_[2 * d + 1].dim = d;
+        }
+
+        // シードが与えられなければ、実行ごとに異なる乱数列を用いる（全プロセスで同じ値にする）
+        std::random_device rnd;
+        seed_ = (static_cast<std::uint64_t>(rnd()) << 32) | static_cast<std::uint64_t>(rnd());
+        MPI_Bcast(&seed_, 1, MPI_UINT64_T, 0, comm_);
+
+        lat_ = std::pow(2.0, 2.0 / 3.0) * scale_;
+    }
+
+    Ar_moleculardynamics_mpi::~Ar_moleculardynamics_mpi()
+    {
+        MPI_Comm_free(&comm_);
+    }
+
+    // #endregion コンストラクタ・デストラクタ
+
+    // #region publicメンバ関数
+
+    double Ar_moleculardynamics_mpi::getCommTime() const
+    {
+        return commtime_;
+    }
+
+    DistributedCounters Ar_moleculardynamics_mpi::getCounters() const
+    {
+        DistributedCounters counters;
+
+        std::array<std::int64_t, 3> const sums = { nghost_, static_cast<std::int64_t>(pairs_.size() + ghostpairs_.size()), migrations_ };
+        std::array<std::int64_t, 3> totals;
+        MPI_Allreduce(sums.data(), totals.data(), 3, MPI_INT64_T, MPI_SUM, comm_);
+
+        counters.ghosts = totals[0];
+        counters.pairs = totals[1];
+        counters.migrations = totals[2];
+
+        MPI_Allreduce(&nlocal_, &counters.maxatoms, 1, MPI_INT32_T, MPI_MAX, comm_);
+        MPI_Allreduce(&nlocal_, &counters.minatoms, 1, MPI_INT32_T, MPI_MIN, comm_);
+
+        return counters;
+    }
+
+    double Ar_moleculardynamics_mpi::getDeltat() const
+    {
+        return Ar_moleculardynamics::TAU * t_ * 1.0E+12;
+    }
+
+    std::array<std::int32_t, 3> Ar_moleculardynamics_mpi::getDims() const
+    {
+        return { dims_[0], dims_[1], dims_[2] };
+    }
+
+    double Ar_moleculardynamics_mpi::getLatticeconst() const
+    {
+        return Ar_moleculardynamics::SIGMA * lat_ * 1.0E+9;
+    }
+
+    double Ar_moleculardynamics_mpi::getPressure() const
+    {
+        auto const N = static_cast<double>(NumAtom_);
+        auto const V = std::pow(periodiclen_, 3);
+
+        // ビリアルは、力の計算と同時に求めて全プロセスで集計したものを用いる
+        auto const phi = virial_ / (3.0 * V);
+
+        auto const density = N / V;
+
+        return (density * Tc_ + phi) / std::pow(Ar_moleculardynamics::SIGMA, 3) * Ar_moleculardynamics::YPSILON * Ar_moleculardynamics::ATM;
+    }
+
+    std::int32_t Ar_moleculardynamics_mpi::getRank() const
+    {
+        return rank_;
+    }
+
+    std::int32_t Ar_moleculardynamics_mpi::getRebuilds() const
+    {
+        return rebuilds_;
+    }
+
+    SimdType Ar_moleculardynamics_mpi::getSimd() const
+    {
+        return simd_;
+    }
+
+    double Ar_moleculardynamics_mpi::getSkin() const
+    {
+        return skin_;
+    }
+
+    double Ar_moleculardynamics_mpi::getTcalc() const
+    {
+        return Ar_moleculardynamics::YPSILON / Ar_moleculardynamics::KB * Tc_;
+    }
+
+    double Ar_moleculardynamics_mpi::getTgiven() const
+    {
+        return Ar_moleculardynamics::YPSILON / Ar_moleculardynamics::KB * Tg_;
+    }
+
+    bool Ar_moleculardynamics_mpi::recalc()
+    {
+        lat_ = std::pow(2.0, 2.0 / 3.0) * scale_;
+        periodiclen_ = lat_ * static_cast<double>(Nc_);
+
+        // 幽霊原子は隣のプロセスからだけ受け取るので、部分領域の一辺はカットオフ半径とマージンの和以上でなければならない
+        for (auto d = 0; d < 3; d++) {
+            if (periodiclen_ / static_cast<double>(dims_[d]) < potential_.rc + skin_) {
+                return false;
+            }
+
+            lo_[d] = boundary(d, coords_[d]);
+            hi_[d] = boundary(d, coords_[d] + 1);
+        }
+
+        t_ = 0.0;
+        MD_iter_ = 1;
+        Up_ = 0.0;
+        virial_ = 0.0;
+        zeta_ = 0.0;
+        rebuilds_ = 0;
+        migrations_ = 0;
+        commtime_ = 0.0;
+
+        MD_initPos();
+
+        MD_initVel();
+
+        rebuildPairlist();
+
+        return true;
+    }
+
+    void Ar_moleculardynamics_mpi::runCalc()
+    {
+        moveAtoms(false);
+
+        // 全プロセスの変位の大きい方から2つの和がマージンを超えたら、原子を移してペアリストを作り直す
+        if (dispmax_ > skin_) {
+            rebuildPairlist();
+            rebuilds_++;
+        }
+        else {
+            forwardPositions();
+        }
+
+        calcForcePair();
+
+        moveAtoms(true);
+
+        // 繰り返し回数と時間を増加
+        t_ = static_cast<double>(MD_iter_) * Ar_moleculardynamics::DT;
+        MD_iter_++;
+    }
+
+    void Ar_moleculardynamics_mpi::setEnsemble(EnsembleType ensemble)
+    {
+        ensemble_ = ensemble;
+    }
+
+    void Ar_moleculardynamics_mpi::setNc(std::int32_t Nc)
+    {
+        BOOST_ASSERT(Nc > 0);
+
+        Nc_ = Nc;
+    }
+
+    void Ar_moleculardynamics_mpi::setScale(double scale)
+    {
+        BOOST_ASSERT(scale > 0.0);
+
+        scale_ = scale;
+    }
+
+    void Ar_moleculardynamics_mpi::setSeed(std::uint64_t seed)
+    {
+        seed_ = seed;
+    }
+
+    void Ar_moleculardynamics_mpi::setSimd(SimdType simd)
+    {
+        // CPUが対応していない命令セットが指定されたときは、使用できるもっとも幅の広いものにする
+        simd_ = std::min(simd, forcekernel::best_simd());
+    }
+
+    void Ar_moleculardynamics_mpi::setSkin(double skin)
+    {
+        BOOST_ASSERT(skin > 0.0);
+
+        skin_ = skin;
+    }
+
+    void Ar_moleculardynamics_mpi::setTempContMethod(TempControlMethod tempcontmethod)
+    {
+        tempcontmethod_ = tempcontmethod;
+        zeta_ = 0.0;
+    }
+
+    void Ar_moleculardynamics_mpi::setTgiven(double Tgiven)
+    {
+        Tg_ = Tgiven * Ar_moleculardynamics::KB / Ar_moleculardynamics::YPSILON;
+    }
+
+    // #endregion publicメンバ関数
+
+    // #region privateメンバ関数
+
+    double Ar_moleculardynamics_mpi::boundary(std::int32_t dim, std::int32_t c) const
+    {
+        // 上端の部分領域の上端は、丸め誤差なしに周期の長さと一致させる
+        return c == dims_[dim] ? periodiclen_ : periodiclen_ * static_cast<double>(c) / static_cast<double>(dims_[dim]);
+    }
+
+    void Ar_moleculardynamics_mpi::calcForcePair()
+    {
+        auto const stamp = ++forcestamp_;
+        auto const N = static_cast<std::size_t>(nlocal_ + nghost_);
+
+        // 幽霊原子は周期境界条件の像の座標そのものを持つので、カーネルでは周期境界条件の補正をしない
+        // （無限大を渡すと、補正するかどうかの比較が常に偽になる）
+        auto const L = std::numeric_limits<double>::infinity();
+
+        ForceKernelParam const inner = {
+            rx_.data(), ry_.data(), rz_.data(),
+            pairs_.offsets.data(), pairs_.neighbors.data(), nullptr, nullptr, nullptr,
+            L, potential_ };
+
+        ForceKernelParam const outer = {
+            rx_.data(), ry_.data(), rz_.data(),
+            ghostpairs_.offsets.data(), ghostpairs_.neighbors.data(), nullptr, nullptr, nullptr,
+            L, potential_ };
+
+        auto const kernel = forcekernel::get(simd_);
+
+        // 各スレッドは自分のバッファにだけ書き込むので、作用・反作用の更新が競合しない
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, nlocal_, SystemParam::ROWGRAINSIZE),
+            [this, stamp, N, kernel, &inner, &outer](tbb::blocked_range<std::int32_t> const & range) {
+                auto & buf = forcebuffers_.local();
+
+                if (buf.stamp != stamp) {
+                    buf.fx.assign(N, 0.0);
+                    buf.fy.assign(N, 0.0);
+                    buf.fz.assign(N, 0.0);
+                    buf.inner = ForceKernelEnergy();
+                    buf.outer = ForceKernelEnergy();
+                    buf.stamp = stamp;
+                }
+
+                kernel(inner, range.begin(), range.end(), buf.fx.data(), buf.fy.data(), buf.fz.data(), &buf.inner);
+                kernel(outer, range.begin(), range.end(), buf.fx.data(), buf.fy.data(), buf.fz.data(), &buf.outer);
+        });
+
+        // 境界をまたぐペアは両側のプロセスで計算するので、ポテンシャルエネルギーとビリアルは半分ずつ数える
+        std::vector<ForceBuffer const *> used;
+        auto up = 0.0, virial = 0.0;
+        for (auto && buf : forcebuffers_) {
+            if (buf.stamp == stamp) {
+                used.push_back(&buf);
+
+                up += static_cast<double>(buf.inner.up) + 0.5 * static_cast<double>(buf.outer.up);
+                virial += static_cast<double>(buf.inner.virial) + 0.5 * static_cast<double>(buf.outer.virial);
+            }
+        }
+
+        // 力の集計と運動量の更新を同じループで行い、更新後の運動エネルギーも求める（幽霊原子に働く力は捨てる）
+        auto const p2 = tbb::parallel_deterministic_reduce(
+            tbb::blocked_range<std::int32_t>(0, nlocal_, SystemParam::ATOMGRAINSIZE),
+            static_cast<accum>(0),
+            [this, &used](tbb::blocked_range<std::int32_t> const & range, accum sum) {
+                auto const dt = static_cast<real>(Ar_moleculardynamics::DT);
+
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    auto sx = 0.0, sy = 0.0, sz = 0.0;
+
+                    for (auto buf : used) {
+                        sx += buf->fx[n];
+                        sy += buf->fy[n];
+                        sz += buf->fz[n];
+                    }
+
+                    px_[n] += static_cast<real>(sx) * dt;
+                    py_[n] += static_cast<real>(sy) * dt;
+                    pz_[n] += static_cast<real>(sz) * dt;
+
+                    sum += static_cast<accum>(px_[n] * px_[n] + py_[n] * py_[n] + pz_[n] * pz_[n]);
+                }
+
+                return sum;
+            },
+            std::plus<>());
+
+        // 運動エネルギー、ポテンシャルエネルギー、ビリアルを1回の集団通信で集計する
+        auto const begin = std::chrono::steady_clock::now();
+
+        std::array<double, 3> const local = { static_cast<double>(p2), up, virial };
+        std::array<double, 3> total;
+        MPI_Allreduce(local.data(), total.data(), 3, MPI_DOUBLE, MPI_SUM, comm_);
+
+        commtime_ += since(begin);
+
+        kinetic_ = 0.5 * total[0];
+        Up_ = total[1];
+        virial_ = total[2];
+    }
+
+    void Ar_moleculardynamics_mpi::exchangeGhosts()
+    {
+        auto const begin = std::chrono::steady_clock::now();
+
+        auto const rcs = static_cast<real>(potential_.rc + skin_);
+        auto const L = static_cast<real>(periodiclen_);
+
+        rx_.resize(nlocal_);
+        ry_.resize(nlocal_);
+        rz_.resize(nlocal_);
+
+        auto stage = nlocal_;
+        for (auto h = 0; h < 6; h++) {
+            auto & halo = halos_[h];
+            auto const d = halo.dim;
+            auto const r = d == 0 ? rx_.data() : (d == 1 ? ry_.data() : rz_.data());
+
+            // 同じ方向の2回の交換では、前の方向までに受け取った原子だけを送る（角や辺の原子は、こうして隣の隣まで届く）
+            if (h % 2 == 0) {
+                stage = static_cast<std::int32_t>(rx_.size());
+            }
+
+            halo.send.clear();
+            if (h % 2 == 0) {
+                auto const lo = static_cast<real>(lo_[d]);
+                for (auto n = 0; n < stage; n++) {
+                    if (r[n] < lo + rcs) {
+                        halo.send.push_back(n);
+                    }
+                }
+
+                halo.shift = coords_[d] == 0 ? L : real(0);
+            }
+            else {
+                auto const hi = static_cast<real>(hi_[d]);
+                for (auto n = 0; n < stage; n++) {
+                    if (r[n] >= hi - rcs) {
+                        halo.send.push_back(n);
+                    }
+                }
+
+                halo.shift = coords_[d] == dims_[d] - 1 ? -L : real(0);
+            }
+
+            auto const sendcount = static_cast<int>(halo.send.size());
+            int recvcount;
+            MPI_Sendrecv(&sendcount, 1, MPI_INT, halo.dest, h, &recvcount, 1, MPI_INT, halo.source, h, comm_, MPI_STATUS_IGNORE);
+
+            halo.recvfirst = static_cast<std::int32_t>(rx_.size());
+            halo.recvcount = recvcount;
+
+            rx_.resize(halo.recvfirst + recvcount);
+            ry_.resize(halo.recvfirst + recvcount);
+            rz_.resize(halo.recvfirst + recvcount);
+
+            transfer(h);
+        }
+
+        nghost_ = static_cast<std::int32_t>(rx_.size()) - nlocal_;
+
+        commtime_ += since(begin);
+    }
+
+    void Ar_moleculardynamics_mpi::forwardPositions()
+    {
+        auto const begin = std::chrono::steady_clock::now();
+
+        for (auto h = 0; h < 6; h++) {
+            transfer(h);
+        }
+
+        commtime_ += since(begin);
+    }
+
+    double Ar_moleculardynamics_mpi::Langevin()
+    {
+        // 揺動力の標準偏差（揺動力そのものは、sweep()の中で原子ごとに生成する）
+        sigma_ = std::sqrt(2.0 * Ar_moleculardynamics::GAMMA * Tg_ / Ar_moleculardynamics::DT);
+
+        return 1.0 - Ar_moleculardynamics::GAMMA * Ar_moleculardynamics::DT;
+    }
+
+    void Ar_moleculardynamics_mpi::makePair()
+    {
+        auto const rcs = potential_.rc + skin_;
+        auto const ml2 = static_cast<real>(rcs * rcs);
+        auto const N = nlocal_ + nghost_;
+
+        // 幽霊原子の層を含めた領域を、一辺がカットオフ半径とマージンの和以上の番地に分ける
+        std::array<std::int32_t, 3> m;
+        std::array<double, 3> origin, size;
+        for (auto d = 0; d < 3; d++) {
+            auto const extent = hi_[d] - lo_[d] + 2.0 * rcs;
+            m[d] = std::max(static_cast<std::int32_t>(std::floor(extent / rcs)), 1);
+            origin[d] = lo_[d] - rcs;
+            size[d] = extent / static_cast<double>(m[d]);
+        }
+
+        auto const cellof = [&m, &origin, &size](real x, std::int32_t d) {
+            auto const c = static_cast<std::int32_t>(std::floor((static_cast<double>(x) - origin[d]) / size[d]));
+            return std::min(std::max(c, 0), m[d] - 1);
+        };
+
+        // 番地ごとの原子の数を数えてから、番地番号の順に原子のインデックスを並べる
+        cellbegin_.assign(m[0] * m[1] * m[2] + 1, 0);
+        std::vector<std::int32_t> cell(N);
+        for (auto n = 0; n < N; n++) {
+            cell[n] = (cellof(rz_[n], 2) * m[1] + cellof(ry_[n], 1)) * m[0] + cellof(rx_[n], 0);
+            cellbegin_[cell[n] + 1]++;
+        }
+
+        std::partial_sum(cellbegin_.begin(), cellbegin_.end(), cellbegin_.begin());
+
+        cellatoms_.resize(N);
+        auto fill = cellbegin_;
+        for (auto n = 0; n < N; n++) {
+            cellatoms_[fill[cell[n]]++] = n;
+        }
+
+        // 原子iの周りの27個の番地にいる原子のうち、マージンの分まで含めて近いものを調べる
+        // （自分の原子どうしはj > iだけ、幽霊原子はすべて）
+        auto const visit = [this, &m, &cell, ml2](std::int32_t i, auto && inner, auto && outer) {
+            auto const ix = cell[i] % m[0], iy = cell[i] / m[0] % m[1], iz = cell[i] / (m[0] * m[1]);
+            auto const xi = rx_[i], yi = ry_[i], zi = rz_[i];
+
+            for (auto z = std::max(iz - 1, 0); z <= std::min(iz + 1, m[2] - 1); z++) {
+                for (auto y = std::max(iy - 1, 0); y <= std::min(iy + 1, m[1] - 1); y++) {
+                    for (auto x = std::max(ix - 1, 0); x <= std::min(ix + 1, m[0] - 1); x++) {
+                        auto const id = (z * m[1] + y) * m[0] + x;
+
+                        for (auto k = cellbegin_[id]; k < cellbegin_[id + 1]; k++) {
+                            auto const j = cellatoms_[k];
+                            if (j < nlocal_ && j <= i) {
+                                continue;
+                            }
+
+                            auto const dx = rx_[j] - xi;
+                            auto const dy = ry_[j] - yi;
+                            auto const dz = rz_[j] - zi;
+                            if (dx * dx + dy * dy + dz * dz <= ml2) {
+                                if (j < nlocal_) {
+                                    inner(j);
+                                }
+                                else {
+                                    outer(j);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        // 1回目で行ごとの相手の数を数え、2回目でCSR形式の配列に書き込む（結果はスレッド数によらない）
+        pairs_.clear(nlocal_);
+        ghostpairs_.clear(nlocal_);
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, nlocal_, SystemParam::ROWGRAINSIZE),
+            [this, &visit](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    std::int32_t ninner = 0, nouter = 0;
+                    visit(i, [&ninner](std::int32_t) { ninner++; }, [&nouter](std::int32_t) { nouter++; });
+
+                    pairs_.offsets[i + 1] = ninner;
+                    ghostpairs_.offsets[i + 1] = nouter;
+                }
+        });
+
+        std::partial_sum(pairs_.offsets.begin(), pairs_.offsets.end(), pairs_.offsets.begin());
+        std::partial_sum(ghostpairs_.offsets.begin(), ghostpairs_.offsets.end(), ghostpairs_.offsets.begin());
+        pairs_.neighbors.resize(pairs_.offsets[nlocal_]);
+        ghostpairs_.neighbors.resize(ghostpairs_.offsets[nlocal_]);
+
+        tbb::parallel_for(
+            tbb::blocked_range<std::int32_t>(0, nlocal_, SystemParam::ROWGRAINSIZE),
+            [this, &visit](tbb::blocked_range<std::int32_t> const & range) {
+                for (auto i = range.begin(); i != range.end(); ++i) {
+                    auto pin = pairs_.neighbors.data() + pairs_.offsets[i];
+                    auto pout = ghostpairs_.neighbors.data() + ghostpairs_.offsets[i];
+                    visit(i, [&pin](std::int32_t j) { *pin++ = j; }, [&pout](std::int32_t j) { *pout++ = j; });
+                }
+        });
+    }
+
+    void Ar_moleculardynamics_mpi::MD_initPos()
+    {
+        // Ar_moleculardynamics::MD_initPos()と同じ順序で全原子の初期位置を作り、重心を同じ順序の総和で求める
+        auto const N = 4 * Nc_ * Nc_ * Nc_;
+
+        auto const lattice = [this](auto && setpos) {
+            for (auto i = 0; i < Nc_; i++) {
+                for (auto j = 0; j < Nc_; j++) {
+                    for (auto k = 0; k < Nc_; k++) {
+                        // 基本セルをコピーする
+                        auto const sx = static_cast<double>(i) * lat_;
+                        auto const sy = static_cast<double>(j) * lat_;
+                        auto const sz = static_cast<double>(k) * lat_;
+
+                        // 基本セル内には4つの原子がある
+                        setpos(sx, sy, sz);
+                        setpos(0.5 * lat_ + sx, 0.5 * lat_ + sy, sz);
+                        setpos(sx, 0.5 * lat_ + sy, 0.5 * lat_ + sz);
+                        setpos(0.5 * lat_ + sx, sy, 0.5 * lat_ + sz);
+                    }
+                }
+            }
+        };
+
+        auto sumx = 0.0, sumy = 0.0, sumz = 0.0;
+        lattice([&sumx, &sumy, &sumz](double x, double y, double z) {
+            sumx += static_cast<real>(x);
+            sumy += static_cast<real>(y);
+            sumz += static_cast<real>(z);
+        });
+
+        sumx /= static_cast<double>(N);
+        sumy /= static_cast<double>(N);
+        sumz /= static_cast<double>(N);
+
+        // 系の重心を座標系の原点とし、箱の中に戻した座標が自分の部分領域にある原子だけを残す
+        rx_.clear();
+        ry_.clear();
+        rz_.clear();
+        id_.clear();
+
+        auto const L = static_cast<real>(periodiclen_);
+        auto const inside = [this](real r, std::int32_t d) { return r >= lo_[d] && r < hi_[d]; };
+
+        auto n = 0;
+        lattice([this, sumx, sumy, sumz, L, &inside, &n](double x, double y, double z) {
+            auto const rx = wrap(static_cast<real>(static_cast<real>(x) - sumx), L);
+            auto const ry = wrap(static_cast<real>(static_cast<real>(y) - sumy), L);
+            auto const rz = wrap(static_cast<real>(static_cast<real>(z) - sumz), L);
+
+            if (inside(rx, 0) && inside(ry, 1) && inside(rz, 2)) {
+                rx_.push_back(rx);
+                ry_.push_back(ry);
+                rz_.push_back(rz);
+                id_.push_back(n);
+            }
+
+            n++;
+        });
+
+        NumAtom_ = N;
+        nlocal_ = static_cast<std::int32_t>(id_.size());
+        nghost_ = 0;
+    }
+
+    void Ar_moleculardynamics_mpi::MD_initVel()
+    {
+        auto const v = std::sqrt(3.0 * Tg_);
+        auto const key = myrandom::Philox::make_key(seed_);
+
+        px_.resize(nlocal_);
+        py_.resize(nlocal_);
+        pz_.resize(nlocal_);
+
+        for (auto n = 0; n < nlocal_; n++) {
+            // 原子のIDをカウンタとするので、乱数列はプロセス数によらない
+            auto const bits = myrandom::Philox::generate(
+                { static_cast<std::uint32_t>(id_[n]), 0U, 0U, Ar_moleculardynamics::STREAM_INITVEL }, key);
+
+            auto const rndx = 2.0 * myrandom::Philox::to_uniform(bits[0]) - 1.0;
+            auto const rndy = 2.0 * myrandom::Philox::to_uniform(bits[1]) - 1.0;
+            auto const rndz = 2.0 * myrandom::Philox::to_uniform(bits[2]) - 1.0;
+            auto const norm = std::sqrt(rndx * rndx + rndy * rndy + rndz * rndz);
+
+            // 方向はランダムに与える
+            px_[n] = v * rndx / norm;
+            py_[n] = v * rndy / norm;
+            pz_[n] = v * rndz / norm;
+        }
+
+        std::array<double, 3> const local = {
+            std::accumulate(px_.begin(), px_.end(), 0.0),
+            std::accumulate(py_.begin(), py_.end(), 0.0),
+            std::accumulate(pz_.begin(), pz_.end(), 0.0) };
+        std::array<double, 3> sum;
+        MPI_Allreduce(local.data(), sum.data(), 3, MPI_DOUBLE, MPI_SUM, comm_);
+
+        auto const N = static_cast<double>(NumAtom_);
+
+        // 重心の並進運動を避けるために、全プロセスの速度の和がゼロになるように補正
+        accum p2 = 0;
+        for (auto n = 0; n < nlocal_; n++) {
+            px_[n] -= sum[0] / N;
+            py_[n] -= sum[1] / N;
+            pz_[n] -= sum[2] / N;
+
+            p2 += static_cast<accum>(px_[n] * px_[n] + py_[n] * py_[n] + pz_[n] * pz_[n]);
+        }
+
+        auto const local2 = static_cast<double>(p2);
+        auto p2sum = 0.0;
+        MPI_Allreduce(&local2, &p2sum, 1, MPI_DOUBLE, MPI_SUM, comm_);
+
+        kinetic_ = 0.5 * p2sum;
+    }
+
+    void Ar_moleculardynamics_mpi::migrateAtoms()
+    {
+        auto const begin = std::chrono::steady_clock::now();
+
+        auto const L = static_cast<real>(periodiclen_);
+
+        // 幽霊原子は作り直すので捨てる
+        rx_.resize(nlocal_);
+        ry_.resize(nlocal_);
+        rz_.resize(nlocal_);
+
+        // 1回の作り直しの間に原子が動く距離はマージン以下で、部分領域の一辺より短いので、隣のプロセスに移すだけでよい
+        std::array<std::vector<double>, 2> out;
+        for (auto d = 0; d < 3; d++) {
+            auto const r = d == 0 ? rx_.data() : (d == 1 ? ry_.data() : rz_.data());
+
+            out[0].clear();
+            out[1].clear();
+
+            auto k = 0;
+            for (auto n = 0; n < nlocal_; n++) {
+                auto const side = r[n] < lo_[d] ? 0 : (r[n] >= hi_[d] ? 1 : -1);
+
+                if (side < 0) {
+                    rx_[k] = rx_[n];
+                    ry_[k] = ry_[n];
+                    rz_[k] = rz_[n];
+                    px_[k] = px_[n];
+                    py_[k] = py_[n];
+                    pz_[k] = pz_[n];
+                    id_[k] = id_[n];
+                    k++;
+                }
+                else {
+                    out[side].insert(out[side].end(), {
+                        static_cast<double>(rx_[n]), static_cast<double>(ry_[n]), static_cast<double>(rz_[n]),
+                        static_cast<double>(px_[n]), static_cast<double>(py_[n]), static_cast<double>(pz_[n]),
+                        static_cast<double>(id_[n]) });
+
+                    if (halos_[2 * d + side].dest != rank_) {
+                        migrations_++;
+                    }
+                }
+            }
+
+            nlocal_ = k;
+
+            for (auto side = 0; side < 2; side++) {
+                auto const & halo = halos_[2 * d + side];
+                sendrecv(comm_, out[side], halo.dest, halo.source, 2 * d + side, recvbuf_);
+
+                // 箱の端をまたいで移ってきた原子は、座標を箱の中に戻す
+                auto const count = static_cast<std::int32_t>(recvbuf_.size() / 7);
+                for (auto v : { &rx_, &ry_, &rz_, &px_, &py_, &pz_ }) {
+                    v->resize(nlocal_ + count);
+                }
+                id_.resize(nlocal_ + count);
+
+                for (auto m = 0; m < count; m++) {
+                    auto const a = recvbuf_.data() + 7 * m;
+                    rx_[nlocal_] = wrap(static_cast<real>(a[0]), L);
+                    ry_[nlocal_] = wrap(static_cast<real>(a[1]), L);
+                    rz_[nlocal_] = wrap(static_cast<real>(a[2]), L);
+                    px_[nlocal_] = static_cast<real>(a[3]);
+                    py_[nlocal_] = static_cast<real>(a[4]);
+                    pz_[nlocal_] = static_cast<real>(a[5]);
+                    id_[nlocal_] = static_cast<std::int32_t>(a[6]);
+                    nlocal_++;
+                }
+            }
+        }
+
+        commtime_ += since(begin);
+    }
+
+    void Ar_moleculardynamics_mpi::moveAtoms(bool second)
+    {
+        // 運動エネルギーは、直前に運動量を更新したループで求めて全プロセスで集計してある
+        Uk_ = kinetic_;
+
+        // 全エネルギー（運動エネルギー+ポテンシャルエネルギー）の計算
+        Utot_ = Uk_ + Up_;
+
+        // 温度の計算
+        Tc_ = Uk_ / (1.5 * static_cast<double>(NumAtom_));
+
+        auto s = 1.0;
+        auto noise = false;
+
+        switch (ensemble_) {
+        case EnsembleType::NVE:
+            break;
+
+        case EnsembleType::NVT:
+            switch (tempcontmethod_) {
+            case TempControlMethod::LANGEVIN:
+                s = Langevin();
+                noise = true;
+                break;
+
+            case TempControlMethod::NOSE_HOOVER:
+                s = NoseHoover();
+                break;
+
+            case TempControlMethod::VELOCITY:
+                s = Woodcock_velocity_scaling();
+                break;
+
+            default:
+                BOOST_ASSERT(!"何かがおかしい！");
+                break;
+            }
+            break;
+
+        default:
+            BOOST_ASSERT(!"何かがおかしい！");
+            break;
+        }
+
+        // 揺動力の乱数のカウンタ（ステップの前半と後半で異なる値にする）
+        auto const counter = static_cast<std::uint64_t>(MD_iter_) * 2 + (second ? 1 : 0);
+
+        auto const res = noise ? sweep<true>(s, counter) : sweep<false>(s, counter);
+
+        auto const begin = std::chrono::steady_clock::now();
+
+        if (second) {
+            // 次のステップの前半の温度制御に用いる運動エネルギー
+            auto const local = static_cast<double>(res.p2);
+            auto p2 = 0.0;
+            MPI_Allreduce(&local, &p2, 1, MPI_DOUBLE, MPI_SUM, comm_);
+
+            kinetic_ = 0.5 * p2;
+        }
+        else {
+            // 全プロセスの変位の大きい方から2つを求める
+            int nranks;
+            MPI_Comm_size(comm_, &nranks);
+
+            std::array<double, 2> const local = { static_cast<double>(res.d2max1), static_cast<double>(res.d2max2) };
+            std::vector<double> all(2 * nranks);
+            MPI_Allgather(local.data(), 2, MPI_DOUBLE, all.data(), 2, MPI_DOUBLE, comm_);
+
+            auto d2max1 = 0.0, d2max2 = 0.0;
+            for (auto d2 : all) {
+                if (d2 > d2max2) {
+                    d2max2 = d2 > d2max1 ? d2max1 : d2;
+                    d2max1 = d2 > d2max1 ? d2 : d2max1;
+                }
+            }
+
+            dispmax_ = std::sqrt(d2max1) + std::sqrt(d2max2);
+        }
+
+        commtime_ += since(begin);
+    }
+
+    double Ar_moleculardynamics_mpi::NoseHoover()
+    {
+        zeta_ += (Tc_ - Tg_) / (Ar_moleculardynamics::TAU_NOSE_HOOVER * Ar_moleculardynamics::TAU_NOSE_HOOVER) * Ar_moleculardynamics::DT;
+
+        return 1.0 - zeta_ * Ar_moleculardynamics::DT;
+    }
+
+    void Ar_moleculardynamics_mpi::rebuildPairlist()
+    {
+        migrateAtoms();
+
+        exchangeGhosts();
+
+        makePair();
+
+        // 変位の基準となる座標を記録する
+        rx0_.assign(rx_.begin(), rx_.begin() + nlocal_);
+        ry0_.assign(ry_.begin(), ry_.begin() + nlocal_);
+        rz0_.assign(rz_.begin(), rz_.begin() + nlocal_);
+        dispmax_ = 0.0;
+    }
+
+    template <bool Noise>
+    Ar_moleculardynamics_mpi::SweepResult Ar_moleculardynamics_mpi::sweep(double s, std::uint64_t counter)
+    {
+        // 2つの部分的な結果をまとめる（変位は、両者の大きい方から2つを残す）
+        auto const merge = [](SweepResult lhs, SweepResult const & rhs) {
+            lhs.p2 += rhs.p2;
+
+            auto const lo = rhs.d2max1 > lhs.d2max1 ? lhs.d2max1 : rhs.d2max1;
+            auto const second = rhs.d2max2 > lhs.d2max2 ? rhs.d2max2 : lhs.d2max2;
+            lhs.d2max1 = rhs.d2max1 > lhs.d2max1 ? rhs.d2max1 : lhs.d2max1;
+            lhs.d2max2 = second > lo ? second : lo;
+
+            return lhs;
+        };
+
+        return tbb::parallel_deterministic_reduce(
+            tbb::blocked_range<std::int32_t>(0, nlocal_, SystemParam::ATOMGRAINSIZE),
+            SweepResult(),
+            [this, s, counter, &merge](tbb::blocked_range<std::int32_t> const & range, SweepResult res) {
+                auto const key = myrandom::Philox::make_key(seed_);
+                auto const c1 = static_cast<std::uint32_t>(counter);
+                auto const c2 = static_cast<std::uint32_t>(counter >> 32);
+                auto const sdt = sigma_ * Ar_moleculardynamics::DT;
+
+                // 揺動力の標準正規乱数は、Ar_moleculardynamicsと同じくブロックごとにまとめてSIMD命令で作る
+                auto constexpr B = Ar_moleculardynamics::NORMALBLOCKSIZE;
+                auto const normal = forcekernel::get_normal(simd_);
+                alignas(64) std::uint32_t bits[4 * B];
+                alignas(64) double g[4 * B];
+
+                auto const sr = static_cast<real>(s);
+                auto const hdt = static_cast<real>(Ar_moleculardynamics::DT * 0.5);
+
+                accum p2 = 0;
+                real d2max1 = 0, d2max2 = 0;
+
+                for (auto n = range.begin(); n != range.end(); ++n) {
+                    auto x = px_[n] * sr;
+                    auto y = py_[n] * sr;
+                    auto z = pz_[n] * sr;
+
+                    if (Noise) {
+                        auto const m = (n - range.begin()) % B;
+                        if (!m) {
+                            // 揺動力は（シード, ステップ, 原子のID）だけで決まるので、プロセス数やスレッド数によらない
+                            for (auto k = 0; k < B; k++) {
+                                bits[k] = n + k < range.end() ? static_cast<std::uint32_t>(id_[n + k]) : 0U;
+                                bits[B + k] = c1;
+                                bits[2 * B + k] = c2;
+                                bits[3 * B + k] = Ar_moleculardynamics::STREAM_LANGEVIN;
+                            }
+
+                            myrandom::Philox::generate<B>(bits, key);
+                            normal(bits, B, g);
+                        }
+
+                        x += static_cast<real>(g[m] * sdt);
+                        y += static_cast<real>(g[B + m] * sdt);
+                        z += static_cast<real>(g[2 * B + m] * sdt);
+                    }
+
+                    px_[n] = x;
+                    py_[n] = y;
+                    pz_[n] = z;
+
+                    p2 += static_cast<accum>(x * x + y * y + z * z);
+
+                    // 幽霊原子の座標と食い違わないように、作り直すまでは箱の中に戻さない
+                    rx_[n] += x * hdt;
+                    ry_[n] += y * hdt;
+                    rz_[n] += z * hdt;
+
+                    // ペアリストを作ったときからの変位
+                    auto const dx = rx_[n] - rx0_[n];
+                    auto const dy = ry_[n] - ry0_[n];
+                    auto const dz = rz_[n] - rz0_[n];
+
+                    auto const d2 = dx * dx + dy * dy + dz * dz;
+                    if (d2 > d2max2) {
+                        d2max2 = d2 > d2max1 ? d2max1 : d2;
+                        d2max1 = d2 > d2max1 ? d2 : d2max1;
+                    }
+                }
+
+                return merge(res, SweepResult{ p2, d2max1, d2max2 });
+            },
+            merge);
+    }
+
+    void Ar_moleculardynamics_mpi::transfer(std::int32_t h)
+    {
+        auto const & halo = halos_[h];
+        auto const count = static_cast<std::int32_t>(halo.send.size());
+
+        // 箱の端をまたいで送るときは、受け取る側で像の座標になるように周期の長さだけずらす
+        auto const sx = halo.dim == 0 ? halo.shift : real(0);
+        auto const sy = halo.dim == 1 ? halo.shift : real(0);
+        auto const sz = halo.dim == 2 ? halo.shift : real(0);
+
+        sendbuf_.resize(3 * count);
+        for (auto k = 0; k < count; k++) {
+            auto const n = halo.send[k];
+            sendbuf_[3 * k] = static_cast<double>(rx_[n] + sx);
+            sendbuf_[3 * k + 1] = static_cast<double>(ry_[n] + sy);
+            sendbuf_[3 * k + 2] = static_cast<double>(rz_[n] + sz);
+        }
+
+        recvbuf_.resize(3 * halo.recvcount);
+        MPI_Sendrecv(sendbuf_.data(), 3 * count, MPI_DOUBLE, halo.dest, h,
+                     recvbuf_.data(), 3 * halo.recvcount, MPI_DOUBLE, halo.source, h, comm_, MPI_STATUS_IGNORE);
+
+        for (auto k = 0; k < halo.recvcount; k++) {
+            rx_[halo.recvfirst + k] = static_cast<real>(recvbuf_[3 * k]);
+            ry_[halo.recvfirst + k] = static_cast<real>(recvbuf_[3 * k + 1]);
+            rz_[halo.recvfirst + k] = static_cast<real>(recvbuf_[3 * k + 2]);
+        }
+    }
+
+    double Ar_moleculardynamics_mpi::Woodcock_velocity_scaling()
+    {
+        return std::sqrt((Tg_ + Ar_moleculardynamics::ALPHA * (Tc_ - Tg_)) / Tc_);
+    }
+
+    // #endregion privateメンバ関数
+
+    namespace {
+        void sendrecv(MPI_Comm comm, std::vector<double> const & send, int dest, int source, int tag, std::vector<double> & recv)
+        {
+            auto const sendcount = static_cast<int>(send.size());
+            int recvcount;
+            MPI_Sendrecv(&sendcount, 1, MPI_INT, dest, tag, &recvcount, 1, MPI_INT, source, tag, comm, MPI_STATUS_IGNORE);
+
+            recv.resize(recvcount);
+            MPI_Sendrecv(send.data(), sendcount, MPI_DOUBLE, dest, tag, recv.data(), recvcount, MPI_DOUBLE, source, tag, comm, MPI_STATUS_IGNORE);
+        }
+
+        double since(std::chrono::steady_clock::time_point begin)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+
+        real wrap(real x, real L)
+        {
+            // 箱のすぐ外の負の値にLを足すと、丸めでちょうどLになることがあるので、2回に分けて戻す
+            if (x < real(0)) {
+                x += L;
+            }
+
+            if (x >= L) {
+                x -= L;
+            }
+
+            return x;
+        }
+    }
+}
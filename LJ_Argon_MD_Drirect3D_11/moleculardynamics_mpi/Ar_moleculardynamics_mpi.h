@@ -0,0 +1,850 @@
+﻿/*! \file Ar_moleculardynamics_mpi.h
+    \brief 箱を空間的に分割し、複数のプロセスでアルゴンの分子動力学シミュレーションを行うクラスの宣言
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#ifndef _AR_MOLECULARDYNAMICS_MPI_H_
+#define _AR_MOLECULARDYNAMICS_MPI_H_
+
+#pragma once
+
+#include "Ar_moleculardynamics.h"
+#include <array>                                // for std::array
+#include <cstdint>                              // for std::int32_t, std::int64_t, std::uint64_t
+#include <vector>                               // for std::vector
+#include <mpi.h>                                // for MPI_Comm
+#include <tbb/enumerable_thread_specific.h>     // for tbb::enumerable_thread_specific
+
+namespace moleculardynamics {
+    //! A struct.
+    /*!
+        領域分割に関する、全プロセスで集計したカウンタ
+    */
+    struct DistributedCounters {
+        //! A public member variable.
+        /*!
+            プロセスごとの幽霊原子の数の和
+        */
+        std::int64_t ghosts = 0;
+
+        //! A public member variable.
+        /*!
+            1つのプロセスが受け持つ原子の数の最大値
+        */
+        std::int32_t maxatoms = 0;
+
+        //! A public member variable.
+        /*!
+            1つのプロセスが受け持つ原子の数の最小値
+        */
+        std::int32_t minatoms = 0;
+
+        //! A public member variable.
+        /*!
+            作り直しのときに、隣のプロセスに移った原子の数の和
+        */
+        std::int64_t migrations = 0;
+
+        //! A public member variable.
+        /*!
+            ペアリストのペアの数の和（境界をまたぐペアは、両側のプロセスで1つずつ数える）
+        */
+        std::int64_t pairs = 0;
+    };
+
+    //! A class.
+    /*!
+        周期境界条件の箱をプロセスの3次元の格子で直方体の部分領域に分割し、
+        各プロセスが自分の部分領域にいる原子だけを持って、アルゴンの分子動力学シミュレーションを行うクラス
+        部分領域の外側のカットオフ半径とマージンの和の厚さの層にいる原子（幽霊原子）の座標を、
+        毎ステップ隣のプロセスとx, y, zの順に交換し（角や辺の原子は、前の段で受け取ったものを転送する）、
+        部分領域から出た原子は、ペアリストを作り直すときに隣のプロセスに移す
+        初期状態と揺動力は原子のIDだけで決まるので、プロセス数によらず、Ar_moleculardynamicsと
+        （総和の順序による丸め誤差を除いて）同じ軌跡になる
+        メンバ関数はすべて、通信子の全プロセスで同じ順序で呼ぶ
+    */
+    class Ar_moleculardynamics_mpi final {
+        // #region コンストラクタ・デストラクタ
+
+    public:
+        //! A constructor.
+        /*!
+            唯一のコンストラクタ（通信子のプロセスを3次元の格子に並べるが、原子はrecalc()まで作らない）
+            \param comm 計算に用いる通信子
+        */
+        explicit Ar_moleculardynamics_mpi(MPI_Comm comm);
+
+        //! A destructor.
+        /*!
+            デストラクタ（プロセスの格子の通信子を解放する）
+        */
+        ~Ar_moleculardynamics_mpi();
+
+        // #endregion コンストラクタ・デストラクタ
+
+        // #region publicメンバ関数
+
+        //! A public member function (constant).
+        /*!
+            ペアリストの作り直しと、幽霊原子の座標の交換と、総和の集計で通信に費やした時間を返す
+            \return 通信に費やした時間（秒、このプロセスの値）
+        */
+        double getCommTime() const;
+
+        //! A public member function (constant).
+        /*!
+            全プロセスで集計したカウンタを返す（集団通信なので、全プロセスで呼ぶ）
+            \return 全プロセスで集計したカウンタ
+        */
+        DistributedCounters getCounters() const;
+
+        //! A public member function (constant).
+        /*!
+            経過時間を返す
+            \return 経過時間（ps）
+        */
+        double getDeltat() const;
+
+        //! A public member function (constant).
+        /*!
+            プロセスの格子の形を返す
+            \return x, y, z方向のプロセスの数
+        */
+        std::array<std::int32_t, 3> getDims() const;
+
+        //! A public member function (constant).
+        /*!
+            格子定数を返す
+            \return 格子定数（nm）
+        */
+        double getLatticeconst() const;
+
+        //! A public member function (constant).
+        /*!
+            圧力を返す
+            \return 圧力（atm）
+        */
+        double getPressure() const;
+
+        //! A public member function (constant).
+        /*!
+            このプロセスの順位を返す
+            \return 通信子での順位
+        */
+        std::int32_t getRank() const;
+
+        //! A public member function (constant).
+        /*!
+            初期状態を作ってからペアリストを作り直した回数を返す
+            \return ペアリストを作り直した回数
+        */
+        std::int32_t getRebuilds() const;
+
+        //! A public member function (constant).
+        /*!
+            力の計算に用いるSIMD命令セットを返す
+            \return 力の計算に用いるSIMD命令セット
+        */
+        SimdType getSimd() const;
+
+        //! A public member function (constant).
+        /*!
+            ペアリストのマージンを返す
+            \return ペアリストのマージン
+        */
+        double getSkin() const;
+
+        //! A public member function (constant).
+        /*!
+            計算された温度を返す
+            \return 計算された温度（絶対温度）
+        */
+        double getTcalc() const;
+
+        //! A public member function (constant).
+        /*!
+            与えた温度を返す
+            \return 与えた温度（絶対温度）
+        */
+        double getTgiven() const;
+
+        //! A public member function.
+        /*!
+            初期状態を作り、原子を各プロセスに振り分けて、ペアリストを作る
+            \return 部分領域の一辺がカットオフ半径とマージンの和より短く、領域分割できなければfalse（原子は作らない）
+        */
+        bool recalc();
+
+        //! A public member function.
+        /*!
+            MDを1ステップ実行する
+        */
+        void runCalc();
+
+        //! A public member function.
+        /*!
+            アンサンブルを設定する（recalc()を呼ぶまで反映されない）
+            \param ensemble アンサンブル
+        */
+        void setEnsemble(EnsembleType ensemble);
+
+        //! A public member function.
+        /*!
+            スーパーセルの個数を設定する（recalc()を呼ぶまで反映されない）
+            \param Nc スーパーセルの個数
+        */
+        void setNc(std::int32_t Nc);
+
+        //! A public member function.
+        /*!
+            格子定数のスケールを設定する（recalc()を呼ぶまで反映されない）
+            \param scale 格子定数のスケール
+        */
+        void setScale(double scale);
+
+        //! A public member function.
+        /*!
+            乱数のシードを設定する（recalc()を呼ぶまで反映されない）
+            全プロセスで同じ値を与える
+            \param seed 乱数のシード
+        */
+        void setSeed(std::uint64_t seed);
+
+        //! A public member function.
+        /*!
+            力の計算に用いるSIMD命令セットを設定する
+            \param simd SIMD命令セット（CPUが対応していなければ、使用できるもっとも幅の広いものになる）
+        */
+        void setSimd(SimdType simd);
+
+        //! A public member function.
+        /*!
+            ペアリストのマージンを設定する（recalc()を呼ぶまで反映されない）
+            \param skin ペアリストのマージン
+        */
+        void setSkin(double skin);
+
+        //! A public member function.
+        /*!
+            温度制御の方法を設定する
+            \param tempcontmethod 温度制御の方法
+        */
+        void setTempContMethod(TempControlMethod tempcontmethod);
+
+        //! A public member function.
+        /*!
+            温度を設定する（初期速度には、recalc()を呼ぶまで反映されない）
+            \param Tgiven 温度（絶対温度）
+        */
+        void setTgiven(double Tgiven);
+
+        // #endregion publicメンバ関数
+
+        // #region 内部クラス
+
+    private:
+        //! A struct.
+        /*!
+            ある方向の隣のプロセスと交換する幽霊原子の一覧
+        */
+        struct Halo {
+            //! A public member variable.
+            /*!
+                送る先のプロセスの順位
+            */
+            int dest;
+
+            //! A public member variable.
+            /*!
+                交換する方向（0: x, 1: y, 2: z）
+            */
+            std::int32_t dim;
+
+            //! A public member variable.
+            /*!
+                受け取った幽霊原子の数
+            */
+            std::int32_t recvcount;
+
+            //! A public member variable.
+            /*!
+                受け取った幽霊原子を格納する位置
+            */
+            std::int32_t recvfirst;
+
+            //! A public member variable.
+            /*!
+                送る原子のインデックス（自分の原子と、前の段で受け取った幽霊原子）
+            */
+            std::vector<std::int32_t> send;
+
+            //! A public member variable.
+            /*!
+                送る座標に足す周期の長さ（箱の端をまたいで送るときだけ±L、それ以外は0）
+            */
+            real shift;
+
+            //! A public member variable.
+            /*!
+                受け取る元のプロセスの順位
+            */
+            int source;
+        };
+
+        //! A struct.
+        /*!
+            スレッドごとに原子に働く力を足し込むためのバッファ
+        */
+        struct ForceBuffer {
+            //! A public member variable.
+            /*!
+                原子に働く力のx成分
+            */
+            AtomArray::myvector fx;
+
+            //! A public member variable.
+            /*!
+                原子に働く力のy成分
+            */
+            AtomArray::myvector fy;
+
+            //! A public member variable.
+            /*!
+                原子に働く力のz成分
+            */
+            AtomArray::myvector fz;
+
+            //! A public member variable.
+            /*!
+                自分の原子どうしのペアの、ポテンシャルエネルギーとビリアルの和
+            */
+            ForceKernelEnergy inner;
+
+            //! A public member variable.
+            /*!
+                自分の原子と幽霊原子のペアの、ポテンシャルエネルギーとビリアルの和
+            */
+            ForceKernelEnergy outer;
+
+            //! A public member variable.
+            /*!
+                最後に使用されたステップの番号
+            */
+            std::int32_t stamp = -1;
+        };
+
+        //! A struct.
+        /*!
+            sweep()で求める、運動量の2乗の和と、変位の2乗の大きい方から2つ
+        */
+        struct SweepResult {
+            //! A public member variable.
+            /*!
+                運動量の2乗の和
+            */
+            accum p2 = 0;
+
+            //! A public member variable.
+            /*!
+                ペアリストを作ったときからの変位の2乗の最大値
+            */
+            real d2max1 = 0;
+
+            //! A public member variable.
+            /*!
+                ペアリストを作ったときからの変位の2乗の、2番目に大きい値
+            */
+            real d2max2 = 0;
+        };
+
+        // #endregion 内部クラス
+
+        // #region privateメンバ関数
+
+        //! A private member function (constant).
+        /*!
+            x, y, z方向のc番目の部分領域の下端を求める（上端は、c + 1番目の下端と同じ値になる）
+            \param dim 方向（0: x, 1: y, 2: z）
+            \param c 部分領域の位置
+            \return 下端の座標
+        */
+        double boundary(std::int32_t dim, std::int32_t c) const;
+
+        //! A private member function.
+        /*!
+            原子に働く力を計算し、運動量を更新して、全プロセスのポテンシャルエネルギー、ビリアル、運動エネルギーを集計する
+        */
+        void calcForcePair();
+
+        //! A private member function.
+        /*!
+            幽霊原子の一覧を作り、隣のプロセスから座標を受け取る
+        */
+        void exchangeGhosts();
+
+        //! A private member function.
+        /*!
+            前回と同じ幽霊原子について、隣のプロセスから新しい座標を受け取る
+        */
+        void forwardPositions();
+
+        //! A private member function.
+        /*!
+            Langevin法の係数を求め、揺動力の標準偏差を設定する
+            \return 運動量に掛ける係数
+        */
+        double Langevin();
+
+        //! A private member function.
+        /*!
+            自分の原子と幽霊原子からペアリストを作る（部分領域は周期的でないので、座標の差をそのまま用いる）
+        */
+        void makePair();
+
+        //! A private member function.
+        /*!
+            初期位置を作り、自分の部分領域にいる原子だけを残す
+        */
+        void MD_initPos();
+
+        //! A private member function.
+        /*!
+            初期速度を与え、全プロセスの速度の和がゼロになるように補正する
+        */
+        void MD_initVel();
+
+        //! A private member function.
+        /*!
+            部分領域から出た原子を隣のプロセスに移す（x, y, zの順に移すので、斜めに出た原子も届く）
+        */
+        void migrateAtoms();
+
+        //! A private member function.
+        /*!
+            ステップの前半または後半の、温度制御と座標の移動を行う
+            \param second ステップの後半ならtrue
+        */
+        void moveAtoms(bool second);
+
+        //! A private member function.
+        /*!
+            Nose-Hoover法の係数を求める
+            \return 運動量に掛ける係数
+        */
+        double NoseHoover();
+
+        //! A private member function.
+        /*!
+            原子を隣のプロセスに移し、幽霊原子の一覧とペアリストを作り直す
+        */
+        void rebuildPairlist();
+
+        //! A private member function.
+        /*!
+            ステップの前半と後半の一方の運動量と座標の更新を、1回のループで行う
+            \tparam Noise Langevin法の揺動力を加えるならtrue
+            \param s 運動量に掛ける温度制御の係数
+            \param counter 揺動力の乱数のカウンタ
+            \return 運動量の2乗の和と、変位の2乗の大きい方から2つ
+        */
+        template <bool Noise>
+        SweepResult sweep(double s, std::uint64_t counter);
+
+        //! A private member function.
+        /*!
+            隣のプロセスに幽霊原子の座標を送り、隣のプロセスから幽霊原子の座標を受け取る
+            \param h 交換の番号（halos_の添字）
+        */
+        void transfer(std::int32_t h);
+
+        //! A private member function.
+        /*!
+            Woodcockの速度スケーリング法の係数を求める
+            \return 運動量に掛ける係数
+        */
+        double Woodcock_velocity_scaling();
+
+        // #endregion privateメンバ関数
+
+        // #region プロパティ
+
+    public:
+        //! A property.
+        /*!
+            全プロセスの原子数へのプロパティ
+        */
+        Property<std::int32_t> const NumAtom;
+
+        //! A property.
+        /*!
+            運動エネルギーへのプロパティ（Hartree）
+        */
+        Property<double> const Uk;
+
+        //! A property.
+        /*!
+            ポテンシャルエネルギーへのプロパティ（Hartree）
+        */
+        Property<double> const Up;
+
+        //! A property.
+        /*!
+            全エネルギーへのプロパティ（Hartree）
+        */
+        Property<double> const Utot;
+
+        // #endregion プロパティ
+
+        // #region privateメンバ変数
+
+    private:
+        //! A private member variable.
+        /*!
+            スーパーセルの個数
+        */
+        std::int32_t Nc_ = Ar_moleculardynamics::FIRSTNC;
+
+        //! A private member variable.
+        /*!
+            ペアリストを作り直すときの原子の振り分けに用いる、番地ごとの原子の頭出しのインデックス
+        */
+        std::vector<std::int32_t> cellbegin_;
+
+        //! A private member variable.
+        /*!
+            番地番号の順に並べた、自分の原子と幽霊原子のインデックス
+        */
+        std::vector<std::int32_t> cellatoms_;
+
+        //! A private member variable.
+        /*!
+            プロセスの格子の通信子
+        */
+        MPI_Comm comm_;
+
+        //! A private member variable.
+        /*!
+            通信に費やした時間（秒）
+        */
+        double commtime_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            プロセスの格子でのこのプロセスの位置
+        */
+        std::array<int, 3> coords_;
+
+        //! A private member variable.
+        /*!
+            プロセスの格子の形（x, y, z方向のプロセスの数）
+        */
+        std::array<int, 3> dims_;
+
+        //! A private member variable.
+        /*!
+            全プロセスで、ペアリストを作ったときからの変位の大きい方から2つの和
+        */
+        double dispmax_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            アンサンブル
+        */
+        EnsembleType ensemble_ = EnsembleType::NVT;
+
+        //! A private member variable.
+        /*!
+            スレッドごとに原子に働く力を足し込むためのバッファ
+        */
+        tbb::enumerable_thread_specific<ForceBuffer> forcebuffers_;
+
+        //! A private member variable.
+        /*!
+            力の計算の通し番号（スレッドごとのバッファが今回のステップで使われたかの判定に用いる）
+        */
+        std::int32_t forcestamp_ = 0;
+
+        //! A private member variable.
+        /*!
+            自分の原子と幽霊原子のペアリスト（幽霊原子に働く力は捨て、ポテンシャルエネルギーとビリアルは半分ずつ数える）
+        */
+        PairList ghostpairs_;
+
+        //! A private member variable.
+        /*!
+            x, y, z方向の下側と上側の隣のプロセスとの、幽霊原子の交換の一覧（交換する順に並ぶ）
+        */
+        std::array<Halo, 6> halos_;
+
+        //! A private member variable.
+        /*!
+            部分領域の上端
+        */
+        std::array<double, 3> hi_;
+
+        //! A private member variable.
+        /*!
+            自分の原子のID
+        */
+        std::vector<std::int32_t> id_;
+
+        //! A private member variable.
+        /*!
+            直前に運動量を更新したループで求めた、全プロセスの運動エネルギー
+        */
+        double kinetic_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            格子定数
+        */
+        double lat_;
+
+        //! A private member variable.
+        /*!
+            部分領域の下端
+        */
+        std::array<double, 3> lo_;
+
+        //! A private member variable.
+        /*!
+            MDのステップ数
+        */
+        std::int32_t MD_iter_ = 1;
+
+        //! A private member variable.
+        /*!
+            作り直しのときに、隣のプロセスに移った原子の数の和
+        */
+        std::int64_t migrations_ = 0;
+
+        //! A private member variable.
+        /*!
+            幽霊原子の数
+        */
+        std::int32_t nghost_ = 0;
+
+        //! A private member variable.
+        /*!
+            自分の原子の数
+        */
+        std::int32_t nlocal_ = 0;
+
+        //! A private member variable.
+        /*!
+            全プロセスの原子数
+        */
+        std::int32_t NumAtom_ = 0;
+
+        //! A private member variable.
+        /*!
+            自分の原子どうしのペアリスト
+        */
+        PairList pairs_;
+
+        //! A private member variable (constant).
+        /*!
+            原子の組の間に働くポテンシャルの種類と係数（Lennard-Jonesポテンシャル）
+        */
+        PotentialParam const potential_;
+
+        //! A private member variable.
+        /*!
+            周期境界条件の長さ
+        */
+        double periodiclen_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            自分の原子の運動量のx成分
+        */
+        AtomArray::myvector px_;
+
+        //! A private member variable.
+        /*!
+            自分の原子の運動量のy成分
+        */
+        AtomArray::myvector py_;
+
+        //! A private member variable.
+        /*!
+            自分の原子の運動量のz成分
+        */
+        AtomArray::myvector pz_;
+
+        //! A private member variable.
+        /*!
+            このプロセスの順位
+        */
+        int rank_;
+
+        //! A private member variable.
+        /*!
+            初期状態を作ってからペアリストを作り直した回数
+        */
+        std::int32_t rebuilds_ = 0;
+
+        //! A private member variable.
+        /*!
+            隣のプロセスから受け取るデータのバッファ
+        */
+        std::vector<double> recvbuf_;
+
+        //! A private member variable.
+        /*!
+            自分の原子と幽霊原子の座標のx成分（幽霊原子は、自分の原子の後ろに並ぶ）
+        */
+        AtomArray::myvector rx_;
+
+        //! A private member variable.
+        /*!
+            自分の原子と幽霊原子の座標のy成分
+        */
+        AtomArray::myvector ry_;
+
+        //! A private member variable.
+        /*!
+            自分の原子と幽霊原子の座標のz成分
+        */
+        AtomArray::myvector rz_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの、自分の原子の座標のx成分
+        */
+        AtomArray::myvector rx0_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの、自分の原子の座標のy成分
+        */
+        AtomArray::myvector ry0_;
+
+        //! A private member variable.
+        /*!
+            最後にペアリストを作ったときの、自分の原子の座標のz成分
+        */
+        AtomArray::myvector rz0_;
+
+        //! A private member variable.
+        /*!
+            格子定数のスケーリングの定数
+        */
+        double scale_ = Ar_moleculardynamics::FIRSTSCALE;
+
+        //! A private member variable.
+        /*!
+            乱数のシード（全プロセスで同じ値）
+        */
+        std::uint64_t seed_;
+
+        //! A private member variable.
+        /*!
+            隣のプロセスに送るデータのバッファ
+        */
+        std::vector<double> sendbuf_;
+
+        //! A private member variable.
+        /*!
+            Langevin法の揺動力の標準偏差
+        */
+        double sigma_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            力の計算に用いるSIMD命令セット
+        */
+        SimdType simd_ = forcekernel::best_simd();
+
+        //! A private member variable.
+        /*!
+            ペアリストのマージン
+        */
+        double skin_ = SystemParam::MARGIN;
+
+        //! A private member variable.
+        /*!
+            経過時間
+        */
+        double t_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            計算された温度Tcalc
+        */
+        double Tc_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            与えられた温度Tgiven
+        */
+        double Tg_;
+
+        //! A private member variable.
+        /*!
+            温度制御の方法
+        */
+        TempControlMethod tempcontmethod_ = TempControlMethod::VELOCITY;
+
+        //! A private member variable.
+        /*!
+            運動エネルギー
+        */
+        double Uk_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            ポテンシャルエネルギー
+        */
+        double Up_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            全エネルギー
+        */
+        double Utot_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            ビリアル（ペアごとの r・F の和）
+        */
+        double virial_ = 0.0;
+
+        //! A private member variable.
+        /*!
+            Nose-Hoover法の変数
+        */
+        double zeta_ = 0.0;
+
+        // #endregion privateメンバ変数
+
+        // #region 禁止されたコンストラクタ・メンバ関数
+
+    public:
+        //! A private constructor (deleted).
+        /*!
+            デフォルトコンストラクタ（禁止）
+        */
+        Ar_moleculardynamics_mpi() = delete;
+
+        //! A private copy constructor (deleted).
+        /*!
+            コピーコンストラクタ（禁止）
+        */
+        Ar_moleculardynamics_mpi(Ar_moleculardynamics_mpi const &) = delete;
+
+        //! A private member function (deleted).
+        /*!
+            operator=()の宣言（禁止）
+            \param コピー元のオブジェクト（未使用）
+            \return コピー元のオブジェクト
+        */
+        Ar_moleculardynamics_mpi & operator=(Ar_moleculardynamics_mpi const &) = delete;
+
+        // #endregion 禁止されたコンストラクタ・メンバ関数
+    };
+}
+
+#endif  // _AR_MOLECULARDYNAMICS_MPI_H_
@@ -0,0 +1,350 @@
+﻿/*! \file moleculardynamics_mpi.cpp
+    \brief 箱を領域分割し、MPIの複数のプロセスでアルゴンの分子動力学シミュレーションを実行するドライバ
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "Ar_moleculardynamics_mpi.h"
+#include <chrono>                           // for std::chrono::steady_clock
+#include <cstdint>                          // for std::int32_t, std::uint64_t
+#include <cstdio>                           // for std::printf
+#include <exception>                        // for std::exception
+#include <iostream>                         // for std::cerr, std::cout
+#include <memory>                           // for std::unique_ptr
+#include <string>                           // for std::string
+#include <boost/program_options.hpp>        // for boost::program_options
+#include <mpi.h>                            // for MPI_Init_thread, MPI_Finalize
+#include <tbb/global_control.h>             // for tbb::global_control
+
+namespace {
+    //! A struct.
+    /*!
+        コマンドライン引数で与えられる計算条件
+    */
+    struct MpiParam {
+        //! A public member variable.
+        /*!
+            アンサンブル
+        */
+        moleculardynamics::EnsembleType ensemble;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数
+        */
+        std::int32_t nc;
+
+        //! A public member variable.
+        /*!
+            格子定数のスケール
+        */
+        double scale;
+
+        //! A public member variable.
+        /*!
+            乱数のシード
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            乱数のシードが与えられたかどうか
+        */
+        bool seeded;
+
+        //! A public member variable.
+        /*!
+            力の計算に用いるSIMD命令セット
+        */
+        moleculardynamics::SimdType simd;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン
+        */
+        double skin;
+
+        //! A public member variable.
+        /*!
+            計測するMDのステップ数
+        */
+        std::int32_t steps;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）
+        */
+        double temperature;
+
+        //! A public member variable.
+        /*!
+            温度制御の方法
+        */
+        moleculardynamics::TempControlMethod tempcontmethod;
+
+        //! A public member variable.
+        /*!
+            1プロセスあたりのスレッド数（0ならTBBに任せる）
+        */
+        std::int32_t threads;
+
+        //! A public member variable.
+        /*!
+            計測前に捨てるMDのステップ数
+        */
+        std::int32_t warmup;
+    };
+
+    //! A function.
+    /*!
+        コマンドライン引数を解析する
+        \param argc コマンドライン引数の数
+        \param argv コマンドライン引数
+        \param param 解析結果の格納先
+        \param rank このプロセスの順位（0番のプロセスだけがヘルプを表示する）
+        \return 計算を続行するならtrue
+    */
+    bool parse_options(int argc, char * argv[], MpiParam & param, int rank);
+
+    //! A function.
+    /*!
+        計測結果を表示する（集団通信を含むので、全プロセスで呼び、0番のプロセスだけが表示する）
+        \param armd 分子動力学シミュレーションのオブジェクト
+        \param param 計算条件
+        \param elapsed 計測されたMDの経過時間（秒）
+        \param simtime 計測された区間のシミュレーション時間（ps）
+        \param rebuilds 計測された区間でペアリストを作り直した回数
+    */
+    void print_result(moleculardynamics::Ar_moleculardynamics_mpi const & armd, MpiParam const & param, double elapsed, double simtime, std::int32_t rebuilds);
+
+    //! A function.
+    /*!
+        MDを実行して、計測結果を表示する
+        \param param 計算条件
+        \return 正常に終了したら0
+    */
+    int run(MpiParam const & param);
+}
+
+int main(int argc, char * argv[])
+{
+    // MPIの関数は主スレッドからだけ呼ぶ（力の計算などのTBBのスレッドは通信しない）
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    MpiParam param;
+    auto status = 0;
+
+    try {
+        if (parse_options(argc, argv, param, rank)) {
+            std::unique_ptr<tbb::global_control> pcontrol;
+            if (param.threads > 0) {
+                pcontrol = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, param.threads);
+            }
+
+            status = run(param);
+        }
+    }
+    catch (std::exception const & e) {
+        if (rank == 0) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        status = 1;
+    }
+
+    MPI_Finalize();
+
+    return status;
+}
+
+namespace {
+    bool parse_options(int argc, char * argv[], MpiParam & param, int rank)
+    {
+        namespace po = boost::program_options;
+        using moleculardynamics::Ar_moleculardynamics;
+
+        std::string ensemble, simd, tempcontmethod;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "show this help message")
+            ("nc,n", po::value<std::int32_t>(&param.nc)->default_value(Ar_moleculardynamics::FIRSTNC), "number of FCC unit cells per side")
+            ("scale,s", po::value<double>(&param.scale)->default_value(Ar_moleculardynamics::FIRSTSCALE), "scale of the lattice constant")
+            ("temperature,T", po::value<double>(&param.temperature)->default_value(Ar_moleculardynamics::FIRSTTEMP), "given temperature (K)")
+            ("ensemble,e", po::value<std::string>(&ensemble)->default_value("nvt"), "ensemble (nve | nvt)")
+            ("thermostat,t", po::value<std::string>(&tempcontmethod)->default_value("velocity"), "thermostat (langevin | nosehoover | velocity)")
+            ("simd", po::value<std::string>(&simd)->default_value("auto"), "SIMD instruction set of the force kernel (auto | scalar | avx2 | avx512)")
+            ("skin", po::value<double>(&param.skin)->default_value(moleculardynamics::SystemParam::MARGIN), "pair list margin in units of sigma")
+            ("seed", po::value<std::uint64_t>(&param.seed), "random seed for the initial velocities and the Langevin thermostat (default: random)")
+            ("threads,j", po::value<std::int32_t>(&param.threads)->default_value(0), "number of threads per process (0: let TBB decide)")
+            ("steps,N", po::value<std::int32_t>(&param.steps)->default_value(1000), "number of timed MD steps")
+            ("warmup,w", po::value<std::int32_t>(&param.warmup)->default_value(0), "number of untimed MD steps before timing");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            if (rank == 0) {
+                std::cout << "Usage: mpirun -np <processes> " << argv[0] << " [options]\n" << desc << std::endl;
+            }
+
+            return false;
+        }
+
+        if (param.nc < 1 || param.steps < 1 || param.warmup < 0 || param.threads < 0 || param.scale <= 0.0 || param.temperature <= 0.0 || param.skin <= 0.0) {
+            throw po::error("nc, steps, scale, temperature and skin must be positive");
+        }
+
+        param.seeded = vm.count("seed") != 0;
+
+        // 列挙型の解析はmoleculardynamics_batchと同じ文字列を受け付ける
+        using namespace moleculardynamics;
+
+        if (ensemble == "nve") {
+            param.ensemble = EnsembleType::NVE;
+        }
+        else if (ensemble == "nvt") {
+            param.ensemble = EnsembleType::NVT;
+        }
+        else {
+            throw po::invalid_option_value(ensemble);
+        }
+
+        if (tempcontmethod == "langevin") {
+            param.tempcontmethod = TempControlMethod::LANGEVIN;
+        }
+        else if (tempcontmethod == "nosehoover") {
+            param.tempcontmethod = TempControlMethod::NOSE_HOOVER;
+        }
+        else if (tempcontmethod == "velocity") {
+            param.tempcontmethod = TempControlMethod::VELOCITY;
+        }
+        else {
+            throw po::invalid_option_value(tempcontmethod);
+        }
+
+        if (simd == "auto") {
+            param.simd = forcekernel::best_simd();
+        }
+        else if (simd == "scalar") {
+            param.simd = SimdType::SCALAR;
+        }
+        else if (simd == "avx2") {
+            param.simd = SimdType::AVX2;
+        }
+        else if (simd == "avx512") {
+            param.simd = SimdType::AVX512;
+        }
+        else {
+            throw po::invalid_option_value(simd);
+        }
+
+        return true;
+    }
+
+    void print_result(moleculardynamics::Ar_moleculardynamics_mpi const & armd, MpiParam const & param, double elapsed, double simtime, std::int32_t rebuilds)
+    {
+        auto const counters = armd.getCounters();
+
+        // 通信時間はプロセスごとに異なるので、最大値を表示する
+        auto const commtime = armd.getCommTime();
+        auto maxcommtime = 0.0;
+        MPI_Reduce(&commtime, &maxcommtime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (armd.getRank() != 0) {
+            return;
+        }
+
+        auto const atomsteps = static_cast<double>(armd.NumAtom) * static_cast<double>(param.steps);
+
+        // 1日あたりに計算できるシミュレーション時間（ns）
+        auto const nsperday = simtime * 1.0E-3 / elapsed * 86400.0;
+
+        auto const dims = armd.getDims();
+
+        static char const * const simdname[] = { "scalar", "AVX2", "AVX-512" };
+
+        std::printf("Number of atoms            : %d\n", static_cast<std::int32_t>(armd.NumAtom));
+        std::printf("Number of supercell        : %d\n", param.nc);
+        std::printf("Lattice constant           : %.3f (nm)\n", armd.getLatticeconst());
+        std::printf("Preset temperture          : %.3f (K)\n", armd.getTgiven());
+        std::printf("Calculation temperture     : %.3f (K)\n", armd.getTcalc());
+        std::printf("Pressure                   : %.3f (atm)\n", armd.getPressure());
+        std::printf("Potential energy           : %.6f (Hartree)\n", static_cast<double>(armd.Up));
+        std::printf("Total energy               : %.6f (Hartree)\n", static_cast<double>(armd.Utot));
+        std::printf("Precision                  : %s\n", moleculardynamics::PRECISION_NAME);
+        std::printf("Force kernel               : %s\n", simdname[static_cast<std::int32_t>(armd.getSimd())]);
+        std::printf("Process grid               : %d x %d x %d\n", dims[0], dims[1], dims[2]);
+        std::printf("Atoms per process          : %d - %d\n", counters.minatoms, counters.maxatoms);
+        std::printf("Ghost atoms                : %lld\n", static_cast<long long>(counters.ghosts));
+        std::printf("Migrated atoms             : %lld\n", static_cast<long long>(counters.migrations));
+        std::printf("Pairs in pair list         : %lld\n", static_cast<long long>(counters.pairs));
+        std::printf("MD steps                   : %d\n", param.steps);
+        std::printf("Pair list rebuilds         : %d\n", rebuilds);
+        std::printf("Pair list skin             : %.3f\n", armd.getSkin());
+        std::printf("Wall time                  : %.6f (s)\n", elapsed);
+        std::printf("Communication time (max)   : %.6f (s)\n", maxcommtime);
+        std::printf("Steps per second           : %.3f\n", static_cast<double>(param.steps) / elapsed);
+        std::printf("Performance                : %.6f (ns/day)\n", nsperday);
+        std::printf("Cost per atom-step         : %.3f (ns)\n", elapsed / atomsteps * 1.0E+9);
+    }
+
+    int run(MpiParam const & param)
+    {
+        using namespace moleculardynamics;
+
+        Ar_moleculardynamics_mpi armd(MPI_COMM_WORLD);
+
+        armd.setTgiven(param.temperature);
+        armd.setTempContMethod(param.tempcontmethod);
+        armd.setEnsemble(param.ensemble);
+        armd.setSimd(param.simd);
+        armd.setScale(param.scale);
+        armd.setNc(param.nc);
+        armd.setSkin(param.skin);
+
+        // シードを与えたときは、プロセス数やスレッド数によらず同じ初期速度と揺動力になる
+        if (param.seeded) {
+            armd.setSeed(param.seed);
+        }
+
+        if (!armd.recalc()) {
+            if (armd.getRank() == 0) {
+                auto const dims = armd.getDims();
+                std::cerr << "The box is too small for a " << dims[0] << " x " << dims[1] << " x " << dims[2]
+                          << " process grid: each sub-domain must be at least the cutoff radius plus the skin wide" << std::endl;
+            }
+
+            return 1;
+        }
+
+        // 初期化と準備のステップを計測から除き、全プロセスの足並みをそろえてから計測を始める
+        for (auto i = 0; i < param.warmup; i++) {
+            armd.runCalc();
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        auto const t0 = armd.getDeltat();
+        auto const rebuilds0 = armd.getRebuilds();
+        auto const begin = std::chrono::steady_clock::now();
+
+        for (auto i = 0; i < param.steps; i++) {
+            armd.runCalc();
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        print_result(armd, param, elapsed, armd.getDeltat() - t0, armd.getRebuilds() - rebuilds0);
+
+        return 0;
+    }
+}
@@ -0,0 +1,451 @@
+﻿/*! \file moleculardynamics_remd.cpp
+    \brief 温度の異なるレプリカの間で配置を交換しながら、アルゴンのMDを行うドライバ（レプリカ交換法）
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "replicaexchange.h"
+#include <algorithm>                        // for std::fill, std::min
+#include <chrono>                           // for std::chrono::steady_clock
+#include <cmath>                            // for std::pow
+#include <cstdint>                          // for std::int32_t, std::int64_t, std::uint64_t
+#include <cstdio>                           // for std::printf
+#include <exception>                        // for std::exception
+#include <iostream>                         // for std::cerr
+#include <memory>                           // for std::unique_ptr
+#include <random>                           // for std::random_device
+#include <string>                           // for std::string
+#include <vector>                           // for std::vector
+#include <boost/program_options.hpp>        // for boost::program_options
+#include <tbb/global_control.h>             // for tbb::global_control
+#include <tbb/task_arena.h>                 // for tbb::task_arena
+
+namespace {
+    //! A struct.
+    /*!
+        コマンドライン引数で与えられる計算条件
+    */
+    struct RemdParam {
+        //! A public member variable.
+        /*!
+            交換を試みる間隔（ステップ数）
+        */
+        std::int32_t interval;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数（すべてのレプリカで共通）
+        */
+        std::int32_t nc;
+
+        //! A public member variable.
+        /*!
+            格子定数のスケール（すべてのレプリカで共通）
+        */
+        double scale;
+
+        //! A public member variable.
+        /*!
+            乱数のシード
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            力の計算に用いるSIMD命令セット
+        */
+        moleculardynamics::SimdType simd;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン（0なら自動調整する）
+        */
+        double skin;
+
+        //! A public member variable.
+        /*!
+            計測するMDのステップ数（レプリカごと）
+        */
+        std::int32_t steps;
+
+        //! A public member variable.
+        /*!
+            温度制御の方法
+        */
+        moleculardynamics::TempControlMethod tempcontmethod;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）の段の一覧（昇順）
+        */
+        std::vector<double> temperatures;
+
+        //! A public member variable.
+        /*!
+            スレッド数（0ならTBBに任せる）
+        */
+        std::int32_t threads;
+
+        //! A public member variable.
+        /*!
+            計測前に捨てるMDのステップ数（この間も交換を行う）
+        */
+        std::int32_t warmup;
+    };
+
+    //! A struct.
+    /*!
+        温度の段ごとに集計する物理量
+    */
+    struct SlotStat {
+        //! A public member variable.
+        /*!
+            標本の数
+        */
+        std::int64_t samples = 0;
+
+        //! A public member variable.
+        /*!
+            計算された温度の和（K）
+        */
+        double tcalc = 0.0;
+
+        //! A public member variable.
+        /*!
+            ポテンシャルエネルギーの和（Hartree）
+        */
+        double up = 0.0;
+    };
+
+    //! A function.
+    /*!
+        コマンドライン引数を解析する
+        \param argc コマンドライン引数の数
+        \param argv コマンドライン引数
+        \param param 解析結果の格納先
+        \return 計算を続行するならtrue
+    */
+    bool parse_options(int argc, char * argv[], RemdParam & param);
+
+    //! A function.
+    /*!
+        文字列からSIMD命令セットを求める
+        \param str SIMD命令セットを表す文字列
+        \return SIMD命令セット
+    */
+    moleculardynamics::SimdType parse_simd(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からペアリストのマージンを求める
+        \param str ペアリストのマージンを表す文字列（autoなら自動調整）
+        \return ペアリストのマージン（自動調整なら0）
+    */
+    double parse_skin(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から温度制御の方法を求める
+        \param str 温度制御の方法を表す文字列
+        \return 温度制御の方法
+    */
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str);
+
+    //! A function.
+    /*!
+        計測結果を表示する
+        \param remd レプリカ交換のオブジェクト
+        \param param 計算条件
+        \param elapsed 計測されたMDの経過時間（秒）
+        \param busy 計測された区間で、レプリカごとに計算にかかった時間（秒）
+        \param stats 温度の段ごとに集計した物理量
+    */
+    void print_result(moleculardynamics::ReplicaExchange & remd, RemdParam const & param, double elapsed, std::vector<double> const & busy, std::vector<SlotStat> const & stats);
+
+    //! A function.
+    /*!
+        レプリカ交換法でMDを実行して、計測結果を表示する
+        \param param 計算条件
+    */
+    void run(RemdParam const & param);
+
+    //! A function.
+    /*!
+        交換を挟みながら、すべてのレプリカをstepsステップ進める
+        \param remd レプリカ交換のオブジェクト
+        \param param 計算条件
+        \param steps 進めるMDのステップ数
+        \param busy レプリカごとに計算にかかった時間（秒）の足し込み先
+        \param stats 温度の段ごとに集計する物理量の足し込み先
+    */
+    void step(moleculardynamics::ReplicaExchange & remd, RemdParam const & param, std::int32_t steps, std::vector<double> & busy, std::vector<SlotStat> & stats);
+}
+
+int main(int argc, char * argv[])
+{
+    RemdParam param;
+
+    try {
+        if (!parse_options(argc, argv, param)) {
+            return 0;
+        }
+    }
+    catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<tbb::global_control> pcontrol;
+    if (param.threads > 0) {
+        pcontrol = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, param.threads);
+    }
+
+    // スレッド数を指定したときは、TBBの上限を引き上げたうえで専用のアリーナで実行する
+    tbb::task_arena arena(param.threads > 0 ? param.threads : static_cast<std::int32_t>(tbb::task_arena::automatic));
+    arena.execute([&param] { run(param); });
+
+    return 0;
+}
+
+namespace {
+    bool parse_options(int argc, char * argv[], RemdParam & param)
+    {
+        namespace po = boost::program_options;
+        using moleculardynamics::Ar_moleculardynamics;
+
+        std::int32_t replicas;
+        double tmax, tmin;
+        std::string simd, skin, tempcontmethod;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "show this help message")
+            ("nc,n", po::value<std::int32_t>(&param.nc)->default_value(4), "number of FCC unit cells per side of every replica")
+            ("scale,s", po::value<double>(&param.scale)->default_value(Ar_moleculardynamics::FIRSTSCALE), "scale of the lattice constant")
+            ("replicas,M", po::value<std::int32_t>(&replicas)->default_value(8), "number of replicas (temperatures spaced geometrically from tmin to tmax)")
+            ("tmin", po::value<double>(&tmin)->default_value(60.0), "lowest temperature of the ladder (K)")
+            ("tmax", po::value<double>(&tmax)->default_value(120.0), "highest temperature of the ladder (K)")
+            ("temperature,T", po::value<std::vector<double> >(&param.temperatures)->multitoken(), "explicit temperature ladder in K, ascending (overrides -M, --tmin and --tmax)")
+            ("exchange-interval,x", po::value<std::int32_t>(&param.interval)->default_value(100), "MD steps between exchange attempts")
+            ("thermostat,t", po::value<std::string>(&tempcontmethod)->default_value("langevin"), "thermostat (langevin | nosehoover | velocity)")
+            ("simd", po::value<std::string>(&simd)->default_value("auto"), "SIMD instruction set of the force kernel (auto | scalar | avx2 | avx512)")
+            ("skin", po::value<std::string>(&skin)->default_value("0.75"), "pair list margin in units of sigma (value | auto: tuned by elapsed time, not reproducible)")
+            ("seed", po::value<std::uint64_t>(&param.seed), "random seed; replica k uses seed + k (default: random)")
+            ("threads,j", po::value<std::int32_t>(&param.threads)->default_value(0), "number of threads (0: let TBB decide)")
+            ("steps,N", po::value<std::int32_t>(&param.steps)->default_value(10000), "number of timed MD steps of every replica")
+            ("warmup,w", po::value<std::int32_t>(&param.warmup)->default_value(0), "number of untimed MD steps (with exchanges) before timing");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n" << desc << std::endl;
+            return false;
+        }
+
+        if (param.nc < 1 || param.interval < 1 || param.steps < 1 || param.warmup < 0 || param.threads < 0 || param.scale <= 0.0) {
+            throw po::error("nc, exchange-interval, steps and scale must be positive");
+        }
+
+        if (param.temperatures.empty()) {
+            if (replicas < 1 || tmin <= 0.0 || tmax < tmin) {
+                throw po::error("replicas and tmin must be positive, and tmax must not be lower than tmin");
+            }
+
+            // 温度を等比数列にとると、隣り合う段の受理率がほぼ等しくなる
+            for (auto k = 0; k < replicas; k++) {
+                param.temperatures.push_back(replicas > 1 ? tmin * std::pow(tmax / tmin, static_cast<double>(k) / static_cast<double>(replicas - 1)) : tmin);
+            }
+        }
+
+        for (auto k = 0U; k < param.temperatures.size(); k++) {
+            if (param.temperatures[k] <= 0.0 || (k > 0 && param.temperatures[k] < param.temperatures[k - 1])) {
+                throw po::error("temperatures must be positive and ascending");
+            }
+        }
+
+        if (!vm.count("seed")) {
+            std::random_device rnd;
+            param.seed = (static_cast<std::uint64_t>(rnd()) << 32) | static_cast<std::uint64_t>(rnd());
+        }
+
+        param.simd = parse_simd(simd);
+        param.skin = parse_skin(skin);
+        param.tempcontmethod = parse_tempcontmethod(tempcontmethod);
+
+        return true;
+    }
+
+    moleculardynamics::SimdType parse_simd(std::string const & str)
+    {
+        using moleculardynamics::SimdType;
+
+        if (str == "auto") {
+            return moleculardynamics::forcekernel::best_simd();
+        }
+        else if (str == "scalar") {
+            return SimdType::SCALAR;
+        }
+        else if (str == "avx2") {
+            return SimdType::AVX2;
+        }
+        else if (str == "avx512") {
+            return SimdType::AVX512;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    double parse_skin(std::string const & str)
+    {
+        if (str == "auto") {
+            return 0.0;
+        }
+
+        try {
+            auto const skin = std::stod(str);
+            if (skin > 0.0) {
+                return skin;
+            }
+        }
+        catch (std::exception const &) {
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str)
+    {
+        using moleculardynamics::TempControlMethod;
+
+        if (str == "langevin") {
+            return TempControlMethod::LANGEVIN;
+        }
+        else if (str == "nosehoover") {
+            return TempControlMethod::NOSE_HOOVER;
+        }
+        else if (str == "velocity") {
+            return TempControlMethod::VELOCITY;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    void print_result(moleculardynamics::ReplicaExchange & remd, RemdParam const & param, double elapsed, std::vector<double> const & busy, std::vector<SlotStat> const & stats)
+    {
+        auto const replicas = static_cast<std::int32_t>(remd.size());
+        auto const numatom = static_cast<std::int32_t>(remd.batch().replica(0).NumAtom);
+        auto const atomsteps = static_cast<double>(numatom) * static_cast<double>(param.steps);
+
+        // 温度の段ごとの交換の受理率と物理量の平均（受理率は、その段と1つ上の段の間の値）
+        std::printf("  k  Tgiven (K)  Acceptance (k, k+1)  <Tcalc> (K)  <Potential> (Hartree)  Replica\n");
+
+        for (auto k = 0; k < replicas; k++) {
+            auto const attempts = remd.getAttempts(k);
+            auto const & stat = stats[k];
+            auto const n = static_cast<double>(stat.samples > 0 ? stat.samples : 1);
+
+            if (k + 1 < replicas && attempts > 0) {
+                std::printf("%3d  %10.3f  %9.2f%% (%5lld)  %11.3f  %21.6f  %7d\n",
+                    k,
+                    remd.getTemperature(k),
+                    static_cast<double>(remd.getAccepted(k)) / static_cast<double>(attempts) * 100.0,
+                    static_cast<long long>(attempts),
+                    stat.tcalc / n,
+                    stat.up / n,
+                    static_cast<std::int32_t>(remd.getReplica(k)));
+            }
+            else {
+                std::printf("%3d  %10.3f  %19s  %11.3f  %21.6f  %7d\n",
+                    k,
+                    remd.getTemperature(k),
+                    "-",
+                    stat.tcalc / n,
+                    stat.up / n,
+                    static_cast<std::int32_t>(remd.getReplica(k)));
+            }
+        }
+
+        // レプリカごとの計算の速さ（交換の判定にかかった時間は含まない）
+        std::printf("\n  #  Time (s)  Steps per second  Atom-steps per second\n");
+
+        for (auto i = 0; i < replicas; i++) {
+            std::printf("%3d  %8.3f  %16.3f  %21.3e\n",
+                i,
+                busy[i],
+                static_cast<double>(param.steps) / busy[i],
+                atomsteps / busy[i]);
+        }
+
+        std::printf("\n");
+        std::printf("Number of replicas         : %d\n", replicas);
+        std::printf("Atoms per replica          : %d\n", numatom);
+        std::printf("Lattice constant           : %.3f (nm)\n", remd.batch().replica(0).getLatticeconst());
+        std::printf("Precision                  : %s\n", moleculardynamics::PRECISION_NAME);
+        std::printf("Threads                    : %d\n", tbb::this_task_arena::max_concurrency());
+        std::printf("MD steps per replica       : %d\n", param.steps);
+        std::printf("Exchange interval          : %d (steps)\n", param.interval);
+        std::printf("Wall time                  : %.6f (s)\n", elapsed);
+        std::printf("Atom-steps per second      : %.3e\n", atomsteps * static_cast<double>(replicas) / elapsed);
+    }
+
+    void run(RemdParam const & param)
+    {
+        using namespace moleculardynamics;
+
+        ReplicaExchange remd(param.nc, param.scale, param.temperatures, param.seed);
+
+        remd.batch().apply([&param](Ar_moleculardynamics & armd) {
+            armd.setTempContMethod(param.tempcontmethod);
+            armd.setSimd(param.simd);
+
+            if (param.skin > 0.0) {
+                armd.setSkin(param.skin);
+            }
+            else {
+                armd.setSkinAutoTune(true);
+            }
+        });
+
+        std::vector<double> busy(remd.size());
+        std::vector<SlotStat> stats(remd.size());
+
+        step(remd, param, param.warmup, busy, stats);
+
+        // 平衡化の間の交換の統計と物理量は捨てる
+        remd.resetStatistics();
+        std::fill(busy.begin(), busy.end(), 0.0);
+        std::fill(stats.begin(), stats.end(), SlotStat());
+
+        auto const begin = std::chrono::steady_clock::now();
+
+        step(remd, param, param.steps, busy, stats);
+
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        print_result(remd, param, elapsed, busy, stats);
+    }
+
+    void step(moleculardynamics::ReplicaExchange & remd, RemdParam const & param, std::int32_t steps, std::vector<double> & busy, std::vector<SlotStat> & stats)
+    {
+        for (auto done = 0; done < steps; done += param.interval) {
+            remd.runCalc(std::min(param.interval, steps - done));
+
+            for (auto i = 0U; i < remd.size(); i++) {
+                busy[i] += remd.batch().getElapsed(i);
+            }
+
+            // 交換の直前の配置を、その温度の段の標本とする
+            for (auto k = 0U; k < remd.size(); k++) {
+                auto const & armd = remd.batch().replica(remd.getReplica(k));
+                stats[k].samples++;
+                stats[k].tcalc += armd.getTcalc();
+                stats[k].up += static_cast<double>(armd.Up);
+            }
+
+            remd.exchange();
+        }
+    }
+}
@@ -0,0 +1,465 @@
+﻿/*! \file moleculardynamics_replica.cpp
+    \brief 温度や密度の異なる多数の小さな系を、1つのプロセスでまとめて計算するドライバ
+
+    Copyright ©  2018 @dc1394 All Rights Reserved.
+    This software is released under the BSD 2-Clause License.
+*/
+
+#include "replicabatch.h"
+#include <algorithm>                        // for std::max
+#include <chrono>                           // for std::chrono::steady_clock
+#include <cstdint>                          // for std::int32_t, std::uint64_t
+#include <cstdio>                           // for std::printf
+#include <exception>                        // for std::exception
+#include <iostream>                         // for std::cerr
+#include <memory>                           // for std::unique_ptr
+#include <random>                           // for std::random_device
+#include <string>                           // for std::string
+#include <vector>                           // for std::vector
+#include <boost/program_options.hpp>        // for boost::program_options
+#include <tbb/global_control.h>             // for tbb::global_control
+#include <tbb/task_arena.h>                 // for tbb::task_arena
+
+namespace {
+    //! A struct.
+    /*!
+        コマンドライン引数で与えられる計算条件
+    */
+    struct ReplicaBatchParam {
+        //! A public member variable.
+        /*!
+            アンサンブル
+        */
+        moleculardynamics::EnsembleType ensemble;
+
+        //! A public member variable.
+        /*!
+            原子に働く力を計算するときの、相手の原子の探し方
+        */
+        moleculardynamics::ForceMethod forcemethod;
+
+        //! A public member variable.
+        /*!
+            スーパーセルの個数（すべてのレプリカで共通）
+        */
+        std::int32_t nc;
+
+        //! A public member variable.
+        /*!
+            同じ温度と格子定数のスケールで、シードだけを変えて計算するレプリカの数
+        */
+        std::int32_t repeat;
+
+        //! A public member variable.
+        /*!
+            格子定数のスケールの一覧
+        */
+        std::vector<double> scales;
+
+        //! A public member variable.
+        /*!
+            乱数のシード（レプリカごとに1ずつずらす）
+        */
+        std::uint64_t seed;
+
+        //! A public member variable.
+        /*!
+            乱数のシードが与えられたかどうか
+        */
+        bool seeded;
+
+        //! A public member variable.
+        /*!
+            力の計算に用いるSIMD命令セット
+        */
+        moleculardynamics::SimdType simd;
+
+        //! A public member variable.
+        /*!
+            ペアリストのマージン（0なら自動調整する）
+        */
+        double skin;
+
+        //! A public member variable.
+        /*!
+            計測するMDのステップ数
+        */
+        std::int32_t steps;
+
+        //! A public member variable.
+        /*!
+            温度制御の方法
+        */
+        moleculardynamics::TempControlMethod tempcontmethod;
+
+        //! A public member variable.
+        /*!
+            温度（絶対温度）の一覧
+        */
+        std::vector<double> temperatures;
+
+        //! A public member variable.
+        /*!
+            スレッド数（0ならTBBに任せる）
+        */
+        std::int32_t threads;
+
+        //! A public member variable.
+        /*!
+            計測前に捨てるMDのステップ数
+        */
+        std::int32_t warmup;
+    };
+
+    //! A function.
+    /*!
+        温度と格子定数のスケールの組ごとに、レプリカの計算条件を作る
+        \param param 計算条件
+        \return レプリカごとの計算条件
+    */
+    std::vector<moleculardynamics::ReplicaParam> make_replicas(ReplicaBatchParam const & param);
+
+    //! A function.
+    /*!
+        文字列からアンサンブルを求める
+        \param str アンサンブルを表す文字列
+        \return アンサンブル
+    */
+    moleculardynamics::EnsembleType parse_ensemble(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から原子に働く力を計算するときの相手の原子の探し方を求める
+        \param str 相手の原子の探し方を表す文字列
+        \return 相手の原子の探し方
+    */
+    moleculardynamics::ForceMethod parse_forcemethod(std::string const & str);
+
+    //! A function.
+    /*!
+        コマンドライン引数を解析する
+        \param argc コマンドライン引数の数
+        \param argv コマンドライン引数
+        \param param 解析結果の格納先
+        \return 計算を続行するならtrue
+    */
+    bool parse_options(int argc, char * argv[], ReplicaBatchParam & param);
+
+    //! A function.
+    /*!
+        文字列からSIMD命令セットを求める
+        \param str SIMD命令セットを表す文字列
+        \return SIMD命令セット
+    */
+    moleculardynamics::SimdType parse_simd(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列からペアリストのマージンを求める
+        \param str ペアリストのマージンを表す文字列（autoなら自動調整）
+        \return ペアリストのマージン（自動調整なら0）
+    */
+    double parse_skin(std::string const & str);
+
+    //! A function.
+    /*!
+        文字列から温度制御の方法を求める
+        \param str 温度制御の方法を表す文字列
+        \return 温度制御の方法
+    */
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str);
+
+    //! A function.
+    /*!
+        計測結果を表示する
+        \param batch レプリカの集まり
+        \param param 計算条件
+        \param elapsed 計測されたMDの経過時間（秒）
+        \param rebuilds 計測された区間で、レプリカごとにペアリストを作り直した回数
+    */
+    void print_result(moleculardynamics::ReplicaBatch const & batch, ReplicaBatchParam const & param, double elapsed, std::vector<std::int32_t> const & rebuilds);
+
+    //! A function.
+    /*!
+        すべてのレプリカのMDを実行して、計測結果を表示する
+        \param param 計算条件
+    */
+    void run(ReplicaBatchParam const & param);
+}
+
+int main(int argc, char * argv[])
+{
+    ReplicaBatchParam param;
+
+    try {
+        if (!parse_options(argc, argv, param)) {
+            return 0;
+        }
+    }
+    catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<tbb::global_control> pcontrol;
+    if (param.threads > 0) {
+        pcontrol = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, param.threads);
+    }
+
+    // スレッド数を指定したときは、TBBの上限を引き上げたうえで専用のアリーナで実行する
+    tbb::task_arena arena(param.threads > 0 ? param.threads : static_cast<std::int32_t>(tbb::task_arena::automatic));
+    arena.execute([&param] { run(param); });
+
+    return 0;
+}
+
+namespace {
+    std::vector<moleculardynamics::ReplicaParam> make_replicas(ReplicaBatchParam const & param)
+    {
+        std::vector<moleculardynamics::ReplicaParam> replicas;
+        std::random_device rnd;
+
+        for (auto temperature : param.temperatures) {
+            for (auto scale : param.scales) {
+                for (auto r = 0; r < param.repeat; r++) {
+                    // シードを与えたときは、レプリカの並び順でシードを決める（スレッド数によらず同じ結果になる）
+                    auto const seed = param.seeded ?
+                        param.seed + static_cast<std::uint64_t>(replicas.size()) :
+                        (static_cast<std::uint64_t>(rnd()) << 32) | static_cast<std::uint64_t>(rnd());
+
+                    replicas.push_back({ scale, seed, temperature });
+                }
+            }
+        }
+
+        return replicas;
+    }
+
+    moleculardynamics::EnsembleType parse_ensemble(std::string const & str)
+    {
+        using moleculardynamics::EnsembleType;
+
+        if (str == "nve") {
+            return EnsembleType::NVE;
+        }
+        else if (str == "nvt") {
+            return EnsembleType::NVT;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::ForceMethod parse_forcemethod(std::string const & str)
+    {
+        using moleculardynamics::ForceMethod;
+
+        if (str == "pairlist") {
+            return ForceMethod::PAIRLIST;
+        }
+        else if (str == "cellpair") {
+            return ForceMethod::CELLPAIR;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    bool parse_options(int argc, char * argv[], ReplicaBatchParam & param)
+    {
+        namespace po = boost::program_options;
+        using moleculardynamics::Ar_moleculardynamics;
+
+        std::string ensemble, forcemethod, simd, skin, tempcontmethod;
+
+        po::options_description desc("Options");
+        desc.add_options()
+            ("help,h", "show this help message")
+            ("nc,n", po::value<std::int32_t>(&param.nc)->default_value(4), "number of FCC unit cells per side of every replica")
+            ("scale,s", po::value<std::vector<double> >(&param.scales)->multitoken()->default_value({ Ar_moleculardynamics::FIRSTSCALE }, "5"), "scales of the lattice constant (one replica set per value)")
+            ("temperature,T", po::value<std::vector<double> >(&param.temperatures)->multitoken()->default_value({ Ar_moleculardynamics::FIRSTTEMP }, "300"), "given temperatures in K (one replica set per value)")
+            ("repeat,R", po::value<std::int32_t>(&param.repeat)->default_value(1), "number of replicas per (temperature, scale) pair, differing only in the seed")
+            ("ensemble,e", po::value<std::string>(&ensemble)->default_value("nvt"), "ensemble (nve | nvt)")
+            ("thermostat,t", po::value<std::string>(&tempcontmethod)->default_value("velocity"), "thermostat (langevin | nosehoover | velocity)")
+            ("force-method", po::value<std::string>(&forcemethod)->default_value("pairlist"), "neighbour search (pairlist | cellpair)")
+            ("simd", po::value<std::string>(&simd)->default_value("auto"), "SIMD instruction set of the force kernel (auto | scalar | avx2 | avx512)")
+            ("skin", po::value<std::string>(&skin)->default_value("0.75"), "pair list margin in units of sigma (value | auto: tuned by elapsed time, not reproducible)")
+            ("seed", po::value<std::uint64_t>(&param.seed), "random seed of the first replica; replica k uses seed + k (default: random)")
+            ("threads,j", po::value<std::int32_t>(&param.threads)->default_value(0), "number of threads (0: let TBB decide)")
+            ("steps,N", po::value<std::int32_t>(&param.steps)->default_value(1000), "number of timed MD steps of every replica")
+            ("warmup,w", po::value<std::int32_t>(&param.warmup)->default_value(0), "number of untimed MD steps before timing");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: " << argv[0] << " [options]\n" << desc << std::endl;
+            return false;
+        }
+
+        if (param.nc < 1 || param.repeat < 1 || param.steps < 1 || param.warmup < 0 || param.threads < 0) {
+            throw po::error("nc, repeat and steps must be positive");
+        }
+
+        for (auto scale : param.scales) {
+            if (scale <= 0.0) {
+                throw po::error("scales must be positive");
+            }
+        }
+
+        for (auto temperature : param.temperatures) {
+            if (temperature <= 0.0) {
+                throw po::error("temperatures must be positive");
+            }
+        }
+
+        param.seeded = vm.count("seed") != 0;
+        param.ensemble = parse_ensemble(ensemble);
+        param.forcemethod = parse_forcemethod(forcemethod);
+        param.simd = parse_simd(simd);
+        param.skin = parse_skin(skin);
+        param.tempcontmethod = parse_tempcontmethod(tempcontmethod);
+
+        return true;
+    }
+
+    moleculardynamics::SimdType parse_simd(std::string const & str)
+    {
+        using moleculardynamics::SimdType;
+
+        if (str == "auto") {
+            return moleculardynamics::forcekernel::best_simd();
+        }
+        else if (str == "scalar") {
+            return SimdType::SCALAR;
+        }
+        else if (str == "avx2") {
+            return SimdType::AVX2;
+        }
+        else if (str == "avx512") {
+            return SimdType::AVX512;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    double parse_skin(std::string const & str)
+    {
+        if (str == "auto") {
+            return 0.0;
+        }
+
+        try {
+            auto const skin = std::stod(str);
+            if (skin > 0.0) {
+                return skin;
+            }
+        }
+        catch (std::exception const &) {
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    moleculardynamics::TempControlMethod parse_tempcontmethod(std::string const & str)
+    {
+        using moleculardynamics::TempControlMethod;
+
+        if (str == "langevin") {
+            return TempControlMethod::LANGEVIN;
+        }
+        else if (str == "nosehoover") {
+            return TempControlMethod::NOSE_HOOVER;
+        }
+        else if (str == "velocity") {
+            return TempControlMethod::VELOCITY;
+        }
+
+        throw boost::program_options::invalid_option_value(str);
+    }
+
+    void print_result(moleculardynamics::ReplicaBatch const & batch, ReplicaBatchParam const & param, double elapsed, std::vector<std::int32_t> const & rebuilds)
+    {
+        auto const replicas = static_cast<std::int32_t>(batch.size());
+        auto const numatom = static_cast<std::int32_t>(batch.replica(0).NumAtom);
+        auto const atomsteps = static_cast<double>(numatom) * static_cast<double>(replicas) * static_cast<double>(param.steps);
+
+        std::printf("  #  Tgiven (K)  Lattice (nm)  Tcalc (K)  Pressure (atm)  Potential (Hartree)  Total (Hartree)  Rebuilds  Time (s)\n");
+
+        auto sum = 0.0, longest = 0.0;
+        for (auto i = 0; i < replicas; i++) {
+            auto const & armd = batch.replica(i);
+            std::printf("%3d  %10.3f  %12.5f  %9.3f  %14.3f  %19.6f  %15.6f  %8d  %8.3f\n",
+                i,
+                armd.getTgiven(),
+                armd.getLatticeconst(),
+                armd.getTcalc(),
+                armd.getPressure(),
+                static_cast<double>(armd.Up),
+                static_cast<double>(armd.Utot),
+                rebuilds[i],
+                batch.getElapsed(i));
+
+            sum += batch.getElapsed(i);
+            longest = std::max(longest, batch.getElapsed(i));
+        }
+
+        std::printf("\n");
+        std::printf("Number of replicas         : %d\n", replicas);
+        std::printf("Atoms per replica          : %d\n", numatom);
+        std::printf("Number of supercell        : %d\n", param.nc);
+        std::printf("Precision                  : %s\n", moleculardynamics::PRECISION_NAME);
+        std::printf("Threads                    : %d\n", tbb::this_task_arena::max_concurrency());
+        std::printf("MD steps per replica       : %d\n", param.steps);
+        std::printf("Wall time                  : %.6f (s)\n", elapsed);
+        std::printf("Replica-steps per second   : %.3f\n", static_cast<double>(replicas) * static_cast<double>(param.steps) / elapsed);
+        std::printf("Atom-steps per second      : %.3e\n", atomsteps / elapsed);
+        std::printf("Cost per atom-step         : %.3f (ns)\n", elapsed / atomsteps * 1.0E+9);
+
+        // レプリカの計算時間の和を経過時間で割ったものが、実質的に使えたスレッドの数になる
+        std::printf("Busy threads (average)     : %.2f\n", sum / elapsed);
+        std::printf("Longest replica            : %.6f (s)\n", longest);
+    }
+
+    void run(ReplicaBatchParam const & param)
+    {
+        using namespace moleculardynamics;
+
+        ReplicaBatch batch(param.nc, make_replicas(param));
+
+        // すべてのレプリカに共通の設定（recalc()を伴う設定は、レプリカごとに並列に行われる）
+        batch.apply([&param](Ar_moleculardynamics & armd) {
+            armd.setTempContMethod(param.tempcontmethod);
+            armd.setForceMethod(param.forcemethod);
+            armd.setSimd(param.simd);
+            armd.setEnsemble(param.ensemble);
+
+            if (param.skin > 0.0) {
+                armd.setSkin(param.skin);
+            }
+            else {
+                armd.setSkinAutoTune(true);
+            }
+        });
+
+        if (param.warmup > 0) {
+            batch.runCalc(param.warmup);
+        }
+
+        std::vector<std::int32_t> rebuilds(batch.size());
+        for (auto i = 0U; i < batch.size(); i++) {
+            rebuilds[i] = batch.replica(i).getRebuilds();
+        }
+
+        auto const begin = std::chrono::steady_clock::now();
+
+        batch.runCalc(param.steps);
+
+        auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        for (auto i = 0U; i < batch.size(); i++) {
+            rebuilds[i] = batch.replica(i).getRebuilds() - rebuilds[i];
+        }
+
+        print_result(batch, param, elapsed, rebuilds);
+    }
+}